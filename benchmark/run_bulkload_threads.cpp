@@ -0,0 +1,89 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <iterator>
+#include <random>
+#include <cmath>
+#include <fstream>
+
+#ifdef PARALLEL_SWIX
+#include "../src/PSwix.hpp"
+#include "../utils/load_concurrent.hpp"
+#else
+#include "../utils/output_files.hpp"
+#include "../src/Swix.hpp"
+#include "../utils/load.hpp"
+#endif
+#include "../timer/rdtsc.h"
+
+using namespace std;
+
+#ifndef MAX_THREADS
+#define MAX_THREADS 16
+#endif
+
+/*
+Bulk load time of the first TIME_WINDOW tuples with 1, 2, 4, ... MAX_THREADS threads.
+SWIX uses omp_get_max_threads() threads, PSWIX (compiled with -DPARALLEL_SWIX) one thread per partition.
+*/
+
+void load_data(vector<tuple<uint64_t, uint64_t, uint64_t>> & data)
+{
+    #ifdef PARALLEL_SWIX
+    sosd_range_query<uint64_t,uint64_t>(DATA_DIR FILE_NAME);
+    data.swap(benchmark_data);
+    #else
+    std::string input_file = DATA_DIR FILE_NAME;
+
+    add_timestamp(input_file, data, MATCH_RATE ,SEED);
+    #endif
+}
+
+void run_bulkload(vector<tuple<uint64_t, uint64_t, uint64_t>> & data, int numThreads)
+{
+    vector<pair<uint64_t, uint64_t>> data_initial;
+    data_initial.reserve(TIME_WINDOW);
+    for (auto it = data.begin(); it != data.begin()+TIME_WINDOW; it++)
+    {
+        data_initial.push_back(make_pair(get<0>(*it),get<1>(*it)));
+    }
+
+    uint64_t bulkLoadCycle = 0;
+
+    #ifdef PARALLEL_SWIX
+    startTimer(&bulkLoadCycle);
+    pswix::SWmeta<uint64_t,uint64_t> * index = new pswix::SWmeta<uint64_t,uint64_t>(numThreads, data_initial);
+    stopTimer(&bulkLoadCycle);
+    cout << "Algorithm=PSWIX";
+    #else
+    #ifdef _OPENMP
+    omp_set_num_threads(numThreads);
+    #endif
+    startTimer(&bulkLoadCycle);
+    swix::SWmeta<uint64_t,uint64_t> * index = new swix::SWmeta<uint64_t,uint64_t>(data_initial);
+    stopTimer(&bulkLoadCycle);
+    cout << "Algorithm=SWIX";
+    #endif
+
+    cout << ";Data=" << FILE_NAME << ";TimeWindow=" << TIME_WINDOW << ";Threads=" << numThreads;
+    cout << ";BulkloadTime=" << (double)bulkLoadCycle/CPU_CLOCK << ";";
+    cout << endl;
+
+    delete index;
+}
+
+int main(int argc, char** argv)
+{
+    vector<tuple<uint64_t, uint64_t, uint64_t>> data;
+    data.reserve(TEST_LEN);
+
+    load_data(data);
+
+    for (int numThreads = 1; numThreads <= MAX_THREADS; numThreads *= 2)
+    {
+        run_bulkload(data, numThreads);
+    }
+
+    return 0;
+}
@@ -135,6 +135,12 @@ void run_swix(vector<tuple<uint64_t, uint64_t, uint64_t>> & data)
     cout << ";LastSearchLatency=" << (double)searchCycleAll.back()/CPU_CLOCK;
     cout << ";AvgInsertLatency=" << (reduce(insertCycleAll.begin(), insertCycleAll.end(), 0.0) / insertCycleAll.size())/CPU_CLOCK;
     cout << ";LastInsertLatency=" << (double)insertCycleAll.back()/CPU_CLOCK;
+    cout << ";P999InsertLatency=" << (double)insertCycleAll[insertCycleAll.size()*0.999]/CPU_CLOCK;
+    #ifdef INCREMENTAL_META_RETRAIN
+    cout << ";MetaRetrain=Incremental";
+    #else
+    cout << ";MetaRetrain=Full";
+    #endif
     cout << ";AvgDeleteLatency=" << 0;
     cout << ";LastDeleteLatency=" << 0;
     cout << ";TotalTime=" << (double)totalCycle/CPU_CLOCK << ";TotalCount=" << lookupCount << ";";
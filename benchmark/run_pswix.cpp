@@ -4,21 +4,34 @@
 #include <atomic>
 #include <unistd.h>
 
-#include "../src/PSwix.hpp"
+#include "../src/PSWrouter.hpp"
 
 #include "../utils/load_concurrent.hpp"
 #include "../timer/timer.h"
 #include "../timer/rdtsc.h"
 
-#include "../lib/multithread_queues/concurrent_queue.h"
-#include "../lib/multithread_queues/reader_writer_queue.h"
-
 using namespace std;
 
+//0 = keys arrive in random order, 1 = in key order, 2 = half of them in key order (moving hotspot)
 #ifndef LOAD_DATA_METHOD
 #define LOAD_DATA_METHOD 0         
 #endif
 
+//0 = rounds (the dispatcher waits for every worker at the end of a round)
+//1 = continuous (no barrier, a watermark every WATERMARK_INTERVAL rounds bounds the expiry of meta retrain)
+#ifndef EXECUTION_MODE
+#define EXECUTION_MODE 0
+#endif
+
+#ifndef WATERMARK_INTERVAL
+#define WATERMARK_INTERVAL 64
+#endif
+
+//Rounds between two load checks of the dispatcher (SWrouter::rebalance), 0 = partition boundaries stay fixed
+#ifndef REBALANCE_INTERVAL
+#define REBALANCE_INTERVAL 256
+#endif
+
 /*Key and Timestamp Types*/
 typedef uint64_t key_type;
 typedef uint64_t time_type;
@@ -27,32 +40,38 @@ typedef uint64_t val_type;
 struct alignas(CACHELINE_SIZE) ThreadParam;
 typedef ThreadParam thread_param_t;
 typedef pswix::SWmeta<key_type, time_type> pswix_type;
-typedef tuple<task_status,uint64_t,uint64_t,uint64_t> task_type; // tuple<task_type,lowerbound,timestamp,upperbound>
+typedef pswix::SWrouter<key_type, time_type> router_type;
+typedef pswix::SWtask<key_type, time_type> task_type;
 
 // volatile bool running = false;
 atomic<bool> start_flag(false);
 atomic<size_t> ready_threads(0);
+atomic<size_t> finished_threads(0);
 
 struct alignas(CACHELINE_SIZE) ThreadParam {
     pswix_type *pswix;
+    router_type *router;
     uint64_t time;
+    double cpuTime; //Seconds the worker ran its tasks, without the time it was descheduled
+    double roundEndCpuTime; //cpuTime when the worker reached its last ROUND_END
     uint32_t thread_id;
 };
 
 struct Perf
 {
     uint64_t totalCycle;
+    double criticalPath; //CPU time of the busiest worker of each round (of the run in continuous mode), summed up
     uint64_t totalCycleWithSync;
     size_t memoryUsage;
+    uint64_t numTasks;
+    uint64_t numHandoffs;
+    uint64_t numRerouted;
 };
 typedef Perf perf_type;
 
-//Temporary task queue for each worker thread
-moodycamel::ReaderWriterQueue<task_type> task_queue_worker[NUM_THREADS];
-
 void prepare_index(pswix_type *&pswix);
 void start_benchmark(pswix_type *pswix, perf_type & perf);
-void query_dispatcher(pswix_type *pswix, perf_type & perf);
+void query_dispatcher(pswix_type *pswix, router_type *router, thread_param_t *thread_params, perf_type & perf);
 void *meta_thread(void *param);
 void *worker_threads(void *param);
 
@@ -63,6 +82,9 @@ int main(int argc, char **argv)
         case 1:
             sosd_range_query_sequential<key_type,time_type>(DATA_DIR FILE_NAME);
             break;
+        case 2:
+            sosd_range_query_hotspot<key_type,time_type>(DATA_DIR FILE_NAME);
+            break;
         default:
             sosd_range_query<key_type,time_type>(DATA_DIR FILE_NAME);
             break;
@@ -71,8 +93,12 @@ int main(int argc, char **argv)
 
     perf_type perf;
     perf.totalCycle = 0;
+    perf.criticalPath = 0;
     perf.totalCycleWithSync = 0;
     perf.memoryUsage = 0;
+    perf.numTasks = 0;
+    perf.numHandoffs = 0;
+    perf.numRerouted = 0;
 
     prepare_index(pswix);
 
@@ -89,10 +115,11 @@ int main(int argc, char **argv)
     #else
     cout << "Algorithm=PSWIX";
     #endif
-    cout << ";Threads=" << NUM_THREADS  << ";Data=" << FILE_NAME << ";MatchRate=" << MATCH_RATE << ";SearchPerRound=" << NUM_SEARCH_PER_ROUND;
+    cout << ";Threads=" << NUM_THREADS  << ";Mode=" << (EXECUTION_MODE ? "Continuous" : "Rounds") << ";Data=" << FILE_NAME << ";MatchRate=" << MATCH_RATE << ";SearchPerRound=" << NUM_SEARCH_PER_ROUND;
     cout << ";UpdatePerRound=" << NUM_UPDATE_PER_ROUND <<";TimeWindow=" << TIME_WINDOW << ";TestLength=" << TEST_LEN-TIME_WINDOW;
-    cout << ";TotalTime=" << (double)perf.totalCycle/CPU_CLOCK << ";TotalTimeSync=" << (double)perf.totalCycleWithSync/CPU_CLOCK;
-    cout << ";MemoryUsage=" << perf.memoryUsage << ";";
+    cout << ";TotalTime=" << (double)perf.totalCycle/CPU_CLOCK << ";CriticalPath=" << perf.criticalPath << ";TotalTimeSync=" << (double)perf.totalCycleWithSync/CPU_CLOCK;
+    cout << ";MemoryUsage=" << perf.memoryUsage << ";Throughput=" << perf.numTasks/((double)perf.totalCycleWithSync/CPU_CLOCK) << ";";
+    cout << "Handoffs=" << perf.numHandoffs << ";Reroutes=" << perf.numRerouted << ";";
     cout << endl;
 
     return 0;
@@ -136,12 +163,16 @@ void start_benchmark(pswix_type *pswix, perf_type & perf)
     }
 
     LOG_INFO("[Loading DALi into Threads]");
+    router_type router(pswix, NUM_THREADS);
     start_flag = false;
     for(size_t worker_i = 0; worker_i < NUM_THREADS; ++worker_i)
     {
         thread_params[worker_i].pswix = pswix;
+        thread_params[worker_i].router = &router;
         thread_params[worker_i].thread_id = worker_i;
         thread_params[worker_i].time = 0;
+        thread_params[worker_i].cpuTime = 0;
+        thread_params[worker_i].roundEndCpuTime = 0;
     }
 
     LOG_INFO("[Creating Threads]");
@@ -162,7 +193,7 @@ void start_benchmark(pswix_type *pswix, perf_type & perf)
     LOG_INFO("[Start Workload]");
     ready_threads = 0;
     start_flag = true;
-    query_dispatcher(pswix, perf);
+    query_dispatcher(pswix, &router, thread_params, perf);
 
     LOG_INFO("[Finish Workload, joining threads]");
     void *status;
@@ -176,22 +207,27 @@ void start_benchmark(pswix_type *pswix, perf_type & perf)
         }
     }
 
+    perf.numRerouted = router.get_no_rerouted();
     for(int i = 0; i < NUM_THREADS; ++i)
     {
         perf.totalCycle += thread_params[i].time;
+        #if EXECUTION_MODE == 1
+        perf.criticalPath = max(perf.criticalPath, thread_params[i].cpuTime);
+        #endif
     }
 }
 
 /*
 Query dispatcher
+Each task goes only to the partitions owning its keys (pswix::SWrouter), in batches
 */
-void query_dispatcher(pswix_type *pswix, perf_type & perf)
+void query_dispatcher(pswix_type *pswix, router_type *router, thread_param_t *thread_params, perf_type & perf)
 {
     LOG_INFO("[Preparing Dispatcher]");
     auto startIt = benchmark_data.begin();
     auto endIt = benchmark_data.begin() + TIME_WINDOW;
 
-    task_type search_task, insert_task, delete_task, round_end_task, finish_task;
+    task_type search_task, insert_task, delete_task;
     tuple<uint64_t,uint64_t,uint64_t> searchTuple;
 
     srand(1); //Change seed if necessary
@@ -199,6 +235,7 @@ void query_dispatcher(pswix_type *pswix, perf_type & perf)
 
     size_t total_mem = 0;
     int mem_count = 0;
+    vector<double> roundStartCpuTime(NUM_THREADS, 0);
 
     while (endIt != benchmark_data.begin() + TEST_LEN)
     {
@@ -206,27 +243,18 @@ void query_dispatcher(pswix_type *pswix, perf_type & perf)
         for (int i = 0; i < NUM_SEARCH_PER_ROUND; ++i)
         {
             searchTuple = benchmark_data.at((startIt - benchmark_data.begin()) + (rand() % ( (endIt - benchmark_data.begin()) - (startIt - benchmark_data.begin()) + 1 )));
-            search_task = make_tuple(task_status::SEARCH, get<0>(searchTuple), get<1>(searchTuple), get<2>(searchTuple));
-
-            // to all worker threads
-            for (int worker = 0; worker < NUM_THREADS; ++worker)
-            {
-                task_queue_worker[worker].enqueue(search_task);
-            }
-
+            search_task = {get<0>(searchTuple), get<2>(searchTuple), get<1>(searchTuple), task_status::SEARCH};
+            router->dispatch(search_task);
+            ++perf.numTasks;
         }
 
         for (int i = 0; i < NUM_UPDATE_PER_ROUND; ++i)
         {   
-            insert_task = make_tuple(task_status::INSERT, get<0>(*endIt), get<1>(*endIt), numeric_limits<key_type>::max());
-            delete_task = make_tuple(task_status::DELETE, get<0>(*startIt), get<1>(*startIt), numeric_limits<key_type>::max());
-
-            // to all worker threads
-            for (int worker = 0; worker < NUM_THREADS; ++worker)
-            {
-                task_queue_worker[worker].enqueue(insert_task);
-                task_queue_worker[worker].enqueue(delete_task);
-            }
+            insert_task = {get<0>(*endIt), get<0>(*endIt), get<1>(*endIt), task_status::INSERT};
+            delete_task = {get<0>(*startIt), get<0>(*startIt), get<1>(*startIt), task_status::DELETE};
+            router->dispatch(insert_task);
+            router->dispatch(delete_task);
+            perf.numTasks += 2;
 
             ++startIt;
             ++endIt;
@@ -234,12 +262,21 @@ void query_dispatcher(pswix_type *pswix, perf_type & perf)
             if (endIt == benchmark_data.begin() + TEST_LEN) { break;}
         }
 
+        #if REBALANCE_INTERVAL > 0
+        if (round % REBALANCE_INTERVAL == 0 && router->rebalance())
+        {
+            ++perf.numHandoffs;
+        }
+        #endif
 
-        round_end_task = make_tuple(task_status::ROUND_END, 0, 0, 0);
-        for (int worker = 0; worker < NUM_THREADS; ++worker)
+        #if EXECUTION_MODE == 0
+        router->dispatch_all(task_status::ROUND_END, get<1>(*(endIt-1)));
+        #else
+        if (round % WATERMARK_INTERVAL == 0)
         {
-            task_queue_worker[worker].enqueue(round_end_task);
+            router->dispatch_all(task_status::WATERMARK, get<1>(*(endIt-1)));
         }
+        #endif
 
         if (round % 1000 == 0)
         {
@@ -250,17 +287,24 @@ void query_dispatcher(pswix_type *pswix, perf_type & perf)
         LOG_INFO("[Dispatching round %i finished]",round);
         ++round;
 
+        #if EXECUTION_MODE == 0
         LOG_INFO("[Waiting for next round]");
         while (ready_threads < NUM_THREADS) sleep(0.5);
         ready_threads = 0;
-    }
 
-    finish_task = make_tuple(task_status::FINISH, 0, 0, 0);
-    for (int worker = 0; worker < NUM_THREADS; ++worker)
-    {
-        task_queue_worker[worker].enqueue(finish_task);
+        //With a core per worker the round takes as long as its busiest worker
+        double roundCpuTime = 0;
+        for (int i = 0; i < NUM_THREADS; ++i)
+        {
+            roundCpuTime = max(roundCpuTime, thread_params[i].roundEndCpuTime - roundStartCpuTime[i]);
+            roundStartCpuTime[i] = thread_params[i].roundEndCpuTime;
+        }
+        perf.criticalPath += roundCpuTime;
+        #endif
     }
 
+    router->dispatch_all(task_status::FINISH, get<1>(*(endIt-1)));
+
     perf.memoryUsage = total_mem / mem_count;
     LOG_INFO("[Dispatcher finished: total rounds = %i]", round-1);
 }
@@ -273,6 +317,7 @@ void *worker_threads(void *param)
     thread_param_t &thread_param = *(thread_param_t *)param;
     uint32_t thread_id = thread_param.thread_id;
     pswix_type *pswix = thread_param.pswix;
+    router_type *router = thread_param.router;
     LOG_INFO("[Created thread %u]", thread_id);
     ready_threads++;
 
@@ -280,81 +325,54 @@ void *worker_threads(void *param)
     volatile int count = 0;
 
     while (!start_flag);
-    task_type task;
-    bool found;
+    task_type tasks[ROUTER_BATCH_SIZE];
+    bool finished = false;
 
     while (true)
     {
-        found = task_queue_worker[thread_id].try_dequeue(task);
-        if (found)
+        //Workers reroute parts of their tasks before they reach FINISH: once all of them did, an empty queue stays empty
+        bool allFinished = finished && finished_threads == NUM_THREADS;
+
+        size_t numTasks = router->dequeue(thread_id, tasks, ROUTER_BATCH_SIZE);
+        if (!numTasks)
         {
-            uint64_t cycles = 0;
-            startTimer(&cycles);
+            if (allFinished) {return NULL;}
+            continue;
+        }
+
+        uint64_t cycles = 0;
+        timespec cpuStart, cpuEnd;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpuStart);
+        startTimer(&cycles);
 
-            if (get<0>(task) == task_status::ROUND_END || get<0>(task) == task_status::FINISH)
+        for (size_t i = 0; i < numTasks; ++i)
+        {
+            if (tasks[i].status == task_status::ROUND_END || tasks[i].status == task_status::FINISH)
             {
                 LOG_INFO("[Thread %u finished round %i: count %i]",thread_id, round, count);
+                router->execute(thread_id, tasks[i]);
+                clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpuEnd);
+                thread_param.cpuTime += (cpuEnd.tv_sec - cpuStart.tv_sec) + (cpuEnd.tv_nsec - cpuStart.tv_nsec) / 1e9;
+                thread_param.roundEndCpuTime = thread_param.cpuTime;
+                cpuStart = cpuEnd;
                 count = 0;
                 ++round;
                 ++ready_threads;
-
-                if (get<0>(task) == task_status::FINISH) 
+                if (tasks[i].status == task_status::FINISH)
                 {
-                    stopTimer(&cycles);
-                    thread_param.time += cycles;
-                    return NULL; 
+                    finished = true;
+                    ++finished_threads;
                 }
             }
             else
             {
-                pswix::search_bound_type predictBound;
-                #if (MATCH_RATE  == 1)
-                if (pswix->within_thread(thread_id, get<1>(task), predictBound))
-                {
-                    switch (get<0>(task))
-                    {
-                        case task_status::SEARCH:
-                            count += pswix->lookup(thread_id, get<1>(task), get<2>(task), predictBound);
-                            break;
-                        case task_status::INSERT:
-                            pswix->insert(thread_id, get<1>(task), get<2>(task), predictBound);
-                            break;
-                        default:
-                            break;
-                    }
-                }
-                #else
-                if (pswix->within_thread(thread_id, get<1>(task), get<3>(task), predictBound))
-                {
-                    switch (get<0>(task))
-                    {
-                        case task_status::SEARCH:
-                            LOG_INFO("[Thread %u round %i: search %lu start]",thread_id, round, get<1>(task));
-                            count += pswix->range_query(thread_id, get<1>(task), get<2>(task), get<3>(task), predictBound);
-                            LOG_INFO("[Thread %u round %i: search %lu finish]",thread_id, round, get<1>(task));
-                            break;
-
-                        case task_status::INSERT:
-                            LOG_INFO("[Thread %u round %i: insert %lu start]",thread_id, round, get<1>(task));
-                            pswix->insert(thread_id, get<1>(task), get<2>(task), predictBound);
-                            LOG_INFO("[Thread %u round %i: insert %lu finish]",thread_id, round, get<1>(task));
-                            break;
-
-                        default:
-                            break;
-                    }
-
-                    if (pswix::thread_retraining != -1 && pswix::thread_retraining.load()/10 == thread_id) 
-                    { 
-                        LOG_INFO("[Thread %u round %i: retrain]", thread_id, round);
-                        pswix->meta_retrain();
-                    }
-                }
-                #endif
+                count += router->execute(thread_id, tasks[i]);
             }
-            stopTimer(&cycles);
-            thread_param.time += cycles;
         }
+
+        stopTimer(&cycles);
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpuEnd);
+        thread_param.time += cycles;
+        thread_param.cpuTime += (cpuEnd.tv_sec - cpuStart.tv_sec) + (cpuEnd.tv_nsec - cpuStart.tv_nsec) / 1e9;
     }
 }
-
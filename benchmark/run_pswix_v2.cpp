@@ -327,7 +327,8 @@ void *worker_threads(void *param)
                             break;
                     }
 
-                    if (pswix::thread_retraining != -1 && pswix::thread_retraining.load()/10 == thread_id) 
+                    int threadRetraining = pswix->get_thread_retraining();
+                    if (threadRetraining != -1 && threadRetraining/10 == thread_id) 
                     { 
                         LOG_INFO("[Thread %u round %i: retrain]", thread_id, round);
                         pswix->meta_retrain();
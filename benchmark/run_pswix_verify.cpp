@@ -0,0 +1,308 @@
+#include <iostream>
+#include <vector>
+#include <map>
+#include <unordered_set>
+#include <random>
+#include <thread>
+#include <condition_variable>
+
+#include "../src/PSWrouter.hpp"
+#include "../parameters_p.hpp"
+
+using namespace std;
+
+#ifndef VERIFY_LEN
+#define VERIFY_LEN 600000 //Tuples in the stream (unique keys)
+#endif
+
+#ifdef VERIFY_WINDOW
+#define VERIFY_WINDOWS VERIFY_WINDOW
+#endif
+
+#ifndef VERIFY_WINDOWS
+#define VERIFY_WINDOWS 500000, 100000, 20000, 2000 //Windows of the verified index (runtime SWparams, independent of TIME_WINDOW)
+#endif
+
+#ifndef VERIFY_SEEDS
+#define VERIFY_SEEDS 3 //Streams generated from seeds SEED, SEED+1, ...
+#endif
+
+#ifndef VERIFY_KEY_SPACE
+#define VERIFY_KEY_SPACE (1ULL << 40) //Keys are drawn uniformly from [1, VERIFY_KEY_SPACE]
+#endif
+
+#ifndef VERIFY_CONCURRENT
+#define VERIFY_CONCURRENT 0 //1 = NUM_THREADS workers run the tasks of SWrouter continuously and rebalance
+#endif
+
+#ifndef VERIFY_REBALANCE_INTERVAL
+#define VERIFY_REBALANCE_INTERVAL 16 //Rounds (8 inserts) between two SWrouter::rebalance (VERIFY_CONCURRENT)
+#endif
+
+#ifndef VERIFY_TIMEOUT
+#define VERIFY_TIMEOUT 300 //Seconds before a run that did not finish (VERIFY_CONCURRENT) is reported as hung
+#endif
+
+/*
+Checks PSWIX against a brute force window (std::map) on synthetic streams, for every window of VERIFY_WINDOWS (or only
+VERIFY_WINDOW) and VERIFY_SEEDS seeds. Bulk loads the first half of the stream (at most one window of tuples) into
+NUM_THREADS partitions, then inserts the rest. Every insert is followed by a lookup
+of a key in the window, every fourth by a range search. Tasks go through SWmeta::route and SWmeta::execute on this
+thread, so the check is deterministic. At the end every key of the window is looked up.
+With VERIFY_CONCURRENT, half of the inserted keys fall in a hot region moving across the key space and the searches
+ask for recent keys. NUM_THREADS workers run the tasks of SWrouter without a round barrier while the dispatcher
+rebalances every VERIFY_REBALANCE_INTERVAL rounds and sends a watermark every 64 rounds. Each partition runs its tasks in
+dispatch order, so the sum of the results must match the brute force window; a run that does not finish within
+VERIFY_TIMEOUT seconds aborts.
+Prints the number of mismatches of each run and returns 1 if there is any.
+*/
+
+typedef pswix::SWmeta<uint64_t,uint64_t> pswix_type;
+typedef pswix::SWtask<uint64_t,uint64_t> task_type;
+typedef pswix::SWrouter<uint64_t,uint64_t> router_type;
+
+//skewed: after bulkLoadSize tuples, every second key falls in a region of 1/64 of the key space moving to the right
+void generate_stream(vector<pair<uint64_t,uint64_t>> & data, size_t bulkLoadSize, uint64_t seed, bool skewed)
+{
+    mt19937_64 gen(seed);
+    unordered_set<uint64_t> used;
+    data.reserve(VERIFY_LEN);
+    while (data.size() < VERIFY_LEN)
+    {
+        uint64_t key = gen() % VERIFY_KEY_SPACE + 1;
+        if (skewed && data.size() >= bulkLoadSize && gen() % 2)
+        {
+            uint64_t hotStart = (VERIFY_KEY_SPACE / 64 * 63) / (VERIFY_LEN - bulkLoadSize) * (data.size() - bulkLoadSize);
+            key = hotStart + gen() % (VERIFY_KEY_SPACE / 64) + 1;
+        }
+        if (used.insert(key).second)
+        {
+            data.push_back(make_pair(key, data.size()+1));
+        }
+    }
+}
+
+/*
+Sequential check
+*/
+void verify_sequential(pswix_type * pswix, const vector<pair<uint64_t,uint64_t>> & data, size_t bulkLoadSize,
+                       map<uint64_t,uint64_t> & window, uint64_t timeWindow, uint64_t seed,
+                       uint64_t & numQueries, uint64_t & numMismatches)
+{
+    mt19937_64 gen(seed);
+
+    auto run = [&](const task_type & task)
+    {
+        int result = 0;
+        pswix->route(task, [&](uint32_t partitionID, const task_type & partitionTask)
+        {
+            result += pswix->execute(partitionID, partitionTask, [](const task_type &)
+            {
+                LOG_ERROR("Task reached a partition that does not own it without a concurrent handoff");
+                abort();
+            });
+        });
+        return result;
+    };
+
+    auto check = [&](uint64_t lowerBound, uint64_t upperBound, uint64_t timestamp)
+    {
+        int result = run({lowerBound, upperBound, timestamp, task_status::SEARCH});
+
+        int expected = 0;
+        for (auto it = window.lower_bound(lowerBound); it != window.end() && it->first <= upperBound; ++it)
+        {
+            expected += (it->second + timeWindow >= timestamp);
+        }
+
+        ++numQueries;
+        if (result != expected && numMismatches++ < 10)
+        {
+            cout << "Mismatch: [" << lowerBound << ", " << upperBound << "] at " << timestamp << " returned " << result << ", expected " << expected << endl;
+        }
+    };
+
+    for (size_t i = bulkLoadSize; i < VERIFY_LEN; ++i)
+    {
+        run({data[i].first, data[i].first, data[i].second, task_status::INSERT});
+        window[data[i].first] = data[i].second;
+
+        uint64_t timestamp = data[i].second;
+        size_t windowStart = (i+1 > timeWindow) ? i+1-timeWindow : 0;
+        uint64_t key = data[windowStart + gen() % (i+1-windowStart)].first;
+
+        check(key, key, timestamp);
+        if (i % 4 == 0)
+        {
+            check(key, key + (VERIFY_KEY_SPACE >> (10 + gen() % 20)), timestamp);
+        }
+    }
+
+    uint64_t lastTimestamp = data.back().second;
+    for (auto & it : window)
+    {
+        if (it.second + timeWindow >= lastTimestamp)
+        {
+            check(it.first, it.first, lastTimestamp);
+        }
+    }
+}
+
+/*
+Concurrent check
+*/
+void verify_concurrent(pswix_type * pswix, const vector<pair<uint64_t,uint64_t>> & data, size_t bulkLoadSize,
+                       map<uint64_t,uint64_t> & window, uint64_t timeWindow, uint64_t seed,
+                       uint64_t & numQueries, uint64_t & numMismatches, uint64_t & numHandoffs, uint64_t & numRerouted)
+{
+    router_type router(pswix, NUM_THREADS);
+    atomic<uint32_t> finishedThreads(0);
+    vector<pswix::SWcounter> results(NUM_THREADS);
+
+    vector<thread> workers;
+    for (uint32_t threadID = 0; threadID < NUM_THREADS; ++threadID)
+    {
+        workers.emplace_back([&, threadID]()
+        {
+            task_type tasks[ROUTER_BATCH_SIZE];
+            bool finished = false;
+            uint64_t result = 0;
+            while (true)
+            {
+                bool allFinished = finished && finishedThreads == NUM_THREADS;
+                size_t numTasks = router.dequeue(threadID, tasks, ROUTER_BATCH_SIZE);
+                if (numTasks == 0)
+                {
+                    if (allFinished) break;
+                    this_thread::yield();
+                    continue;
+                }
+                for (size_t i = 0; i < numTasks; ++i)
+                {
+                    result += router.execute(threadID, tasks[i]);
+                    if (tasks[i].status == task_status::FINISH)
+                    {
+                        finished = true;
+                        ++finishedThreads;
+                    }
+                }
+            }
+            results[threadID].value.store(result);
+        });
+    }
+
+    //Watchdog: a handoff that never completes stops the workers, report it instead of hanging
+    mutex doneMutex;
+    condition_variable doneCond;
+    bool done = false;
+    thread watchdog([&]()
+    {
+        unique_lock<mutex> lock(doneMutex);
+        if (!doneCond.wait_for(lock, chrono::seconds(VERIFY_TIMEOUT), [&]() {return done;}))
+        {
+            LOG_ERROR("Concurrent run did not finish within %i seconds", VERIFY_TIMEOUT);
+            fflush(stdout);
+            abort();
+        }
+    });
+
+    mt19937_64 gen(seed);
+    uint64_t expected = 0;
+    auto search = [&](uint64_t lowerBound, uint64_t upperBound, uint64_t timestamp)
+    {
+        router.dispatch({lowerBound, upperBound, timestamp, task_status::SEARCH});
+        for (auto it = window.lower_bound(lowerBound); it != window.end() && it->first <= upperBound; ++it)
+        {
+            expected += (it->second + timeWindow >= timestamp);
+        }
+        ++numQueries;
+    };
+
+    for (size_t i = bulkLoadSize, round = 1; i < VERIFY_LEN; ++round)
+    {
+        for (size_t end = min<size_t>(i + 8, VERIFY_LEN); i < end; ++i)
+        {
+            router.dispatch({data[i].first, data[i].first, data[i].second, task_status::INSERT});
+            window[data[i].first] = data[i].second;
+
+            uint64_t key = data[i - gen() % min<size_t>(i+1, 4096)].first;
+            search(key, key, data[i].second);
+            if (i % 4 == 0)
+            {
+                search(key, key + (VERIFY_KEY_SPACE >> (10 + gen() % 20)), data[i].second);
+            }
+        }
+
+        if (round % VERIFY_REBALANCE_INTERVAL == 0 && router.rebalance())
+        {
+            ++numHandoffs;
+        }
+        if (round % 64 == 0)
+        {
+            router.dispatch_all(task_status::WATERMARK, data[i-1].second);
+        }
+    }
+    router.dispatch_all(task_status::FINISH, data.back().second);
+
+    for (auto & worker : workers)
+    {
+        worker.join();
+    }
+    {
+        lock_guard<mutex> lock(doneMutex);
+        done = true;
+    }
+    doneCond.notify_one();
+    watchdog.join();
+
+    uint64_t result = 0;
+    for (auto & threadResult : results)
+    {
+        result += threadResult.value.load();
+    }
+    if (result != expected)
+    {
+        ++numMismatches;
+        cout << "Mismatch: searches returned " << result << " tuples, expected " << expected << endl;
+    }
+    numRerouted = router.get_no_rerouted();
+}
+
+int main(int argc, char** argv)
+{
+    bool anyMismatch = false;
+    for (uint64_t timeWindow : {VERIFY_WINDOWS})
+    {
+        for (uint64_t seed = SEED; seed < SEED + VERIFY_SEEDS; ++seed)
+        {
+            size_t bulkLoadSize = min<size_t>(timeWindow, VERIFY_LEN/2);
+            vector<pair<uint64_t,uint64_t>> data;
+            generate_stream(data, bulkLoadSize, seed, VERIFY_CONCURRENT);
+
+            vector<pair<uint64_t,uint64_t>> data_initial(data.begin(), data.begin()+bulkLoadSize);
+            sort(data_initial.begin(), data_initial.end());
+
+            pswix_type * pswix = new pswix_type(NUM_THREADS, data_initial, pswix::SWparams(timeWindow));
+            map<uint64_t,uint64_t> window(data_initial.begin(), data_initial.end());
+
+            uint64_t numQueries = 0, numMismatches = 0;
+#if VERIFY_CONCURRENT
+            uint64_t numHandoffs = 0, numRerouted = 0;
+            verify_concurrent(pswix, data, bulkLoadSize, window, timeWindow, seed, numQueries, numMismatches, numHandoffs, numRerouted);
+#else
+            verify_sequential(pswix, data, bulkLoadSize, window, timeWindow, seed, numQueries, numMismatches);
+#endif
+
+            cout << "Algorithm=PSWIX;Mode=" << (VERIFY_CONCURRENT ? "VerifyConcurrent" : "Verify") << ";Threads=" << NUM_THREADS << ";Tuples=" << VERIFY_LEN;
+            cout << ";TimeWindow=" << timeWindow << ";Seed=" << seed << ";Queries=" << numQueries << ";Mismatches=" << numMismatches << ";";
+#if VERIFY_CONCURRENT
+            cout << "Handoffs=" << numHandoffs << ";Reroutes=" << numRerouted << ";";
+#endif
+            cout << endl;
+
+            anyMismatch |= (numMismatches != 0);
+            delete pswix;
+        }
+    }
+    return anyMismatch;
+}
@@ -0,0 +1,134 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <iterator>
+#include <random>
+#include <cmath>
+#include <fstream>
+
+#include "../utils/output_files.hpp"
+#include "../src/Swix.hpp"
+#include "../src/SwixTuner.hpp"
+#include "../utils/load.hpp"
+#include "../timer/rdtsc.h"
+
+using namespace std;
+
+#ifndef BATCH_SIZE
+#define BATCH_SIZE 1000
+#endif
+
+/*
+Same workload as run_swix, but arrivals are ingested with insert_batch every BATCH_SIZE tuples
+*/
+
+void load_data(vector<tuple<uint64_t, uint64_t, uint64_t>> & data)
+{
+    std::string input_file = DATA_DIR FILE_NAME;
+
+    add_timestamp(input_file, data, MATCH_RATE ,SEED);
+}
+
+
+void run_swix_batch(vector<tuple<uint64_t, uint64_t, uint64_t>> & data)
+{
+    vector<pair<uint64_t, uint64_t>> data_initial;
+    data_initial.reserve(TIME_WINDOW);
+    for (auto it = data.begin(); it != data.begin()+TIME_WINDOW; it++)
+    {
+        data_initial.push_back(make_pair(get<0>(*it),get<1>(*it)));
+    }
+
+    swix::SWmeta<uint64_t,uint64_t> swix(data_initial);
+
+    auto it = data.begin()+TIME_WINDOW;
+    auto itDelete = data.begin();
+
+    uint64_t startTime = get<1>(*(data.begin()+TIME_WINDOW));
+
+    if(startTime < 1)
+    {
+        cout << "ERROR : timestamp is less than 1 " << endl;
+    }
+
+    uint64_t lookupCount = 0;
+
+    uint64_t searchCycle = 0;
+    uint64_t insertCycle = 0;
+    uint64_t totalCycle = 0;
+
+    vector<pair<uint64_t,uint64_t>> insertBatch;
+    insertBatch.reserve(BATCH_SIZE);
+
+    uint64_t maxTimestamp =  get<1>(data.back());
+    srand(1); //When using searchTuple
+
+    for(uint64_t i = startTime; i < maxTimestamp; i++ )
+    {
+        while (get<1>(*itDelete) < i-TIME_WINDOW)
+        {
+            itDelete++;
+        }
+
+        while(get<1>(*it) == i)
+        {
+            tuple<uint64_t,uint64_t,uint64_t> searchTuple = data.at((itDelete - data.begin()) + (rand() % ( (it - data.begin()) - (itDelete - data.begin()) + 1 )));
+
+            uint64_t tempSearchCycles = 0;
+            vector<pair<uint64_t, uint64_t>> tempJoinResult;
+            startTimer(&tempSearchCycles);
+            swix.range_search(searchTuple,tempJoinResult);
+            stopTimer(&tempSearchCycles);
+            searchCycle += tempSearchCycles;
+            lookupCount += tempJoinResult.size();
+
+            insertBatch.push_back(make_pair(get<0>(*it),get<1>(*it)));
+
+            if (insertBatch.size() == BATCH_SIZE)
+            {
+                uint64_t tempInsertCycles = 0;
+                startTimer(&tempInsertCycles);
+                swix.insert_batch(insertBatch);
+                stopTimer(&tempInsertCycles);
+                insertCycle += tempInsertCycles;
+                insertBatch.clear();
+            }
+
+            it++;
+        }
+    }
+
+    if (insertBatch.size())
+    {
+        uint64_t tempInsertCycles = 0;
+        startTimer(&tempInsertCycles);
+        swix.insert_batch(insertBatch);
+        stopTimer(&tempInsertCycles);
+        insertCycle += tempInsertCycles;
+    }
+
+    totalCycle = searchCycle + insertCycle;
+
+    cout << "Algorithm=SWIXBatch";
+    cout << ";Data=" << FILE_NAME << ";MatchRate=" << MATCH_RATE;
+    cout << ";Fanout=" << 0 << ";SplitError=" << INITIAL_ERROR << ";TimeWindow=" << TIME_WINDOW << ";UpdateLength=" << (TEST_LEN/TIME_WINDOW)-1;
+    cout << ";BatchSize=" << BATCH_SIZE;
+    cout << ";SearchTime=" << (double)searchCycle/CPU_CLOCK;
+    cout << ";InsertTime=" << (double)insertCycle/CPU_CLOCK;
+    cout << ";DeleteTime=" << 0;
+    cout << ";TotalTime=" << (double)totalCycle/CPU_CLOCK << ";TotalCount=" << lookupCount << ";";
+    cout << endl;
+}
+
+int main(int argc, char** argv)
+{
+    vector<tuple<uint64_t, uint64_t, uint64_t>> data;
+    data.reserve(TEST_LEN);
+
+    load_data(data);
+
+    run_swix_batch(data);
+
+    return 0;
+}
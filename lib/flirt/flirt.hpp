@@ -25,6 +25,7 @@ class Segment
 private:
 	int n;    //current number of keys
 	int nDelete; //number of keys deleted from keys
+	int error; //error bound of segment (set by Flirt instance)
 	double slope;
 	double slopeLow;  //Low Slope of Segment
 	double slopeHigh; //High Slope of Segment
@@ -36,7 +37,7 @@ private:
 
 public:
     //Constructor
-	Segment(K keyStart, double slopeLow = 0, double slopeHigh = numeric_limits<double>::max());
+	Segment(K keyStart, int error = GLOBAL_ERROR, double slopeLow = 0, double slopeHigh = numeric_limits<double>::max());
 
 public:
     //Point Lookup and Range Search
@@ -67,7 +68,7 @@ public:
 Constructor
 */
 template<class K>
-Segment<K>::Segment(K keyStart, double slopeLow, double slopeHigh)
+Segment<K>::Segment(K keyStart, int error, double slopeLow, double slopeHigh)
 {
     this->slopeLow = slopeLow;
     this->slopeHigh = slopeHigh;
@@ -76,6 +77,7 @@ Segment<K>::Segment(K keyStart, double slopeLow, double slopeHigh)
     this->keys = { {keyStart,false} };
     this->n = 1;
     this->nDelete = 0;
+    this->error = error;
 }
 
 /*
@@ -92,7 +94,7 @@ bool Segment<K>::lookup(K key) {
 	}
 
 	int pos = (key - keyStart) * slope;
-    return binary_search_vector_key(keys, pos - GLOBAL_ERROR, pos + GLOBAL_ERROR, key);
+    return binary_search_vector_key(keys, pos - error, pos + error, key);
 }
 
 template<class K>
@@ -107,7 +109,7 @@ void Segment<K>::range_search(K key, K searchRange, vector<K> & searchResults)
 
     int predictPos = (lowerBound - keyStart) * slope;
     
-    int actualPos = binary_search_vector_key_return_index(keys, predictPos-GLOBAL_ERROR,predictPos+GLOBAL_ERROR, lowerBound);
+    int actualPos = binary_search_vector_key_return_index(keys, predictPos-error,predictPos+error, lowerBound);
     actualPos = (actualPos == -1)? n : actualPos;
     range_scan(actualPos, key, lowerBound, upperBound, searchResults);
 }
@@ -117,7 +119,7 @@ void Segment<K>::range_search(K key, int matchRate, vector<K> & searchResults)
 {
     int predictPos = (key - keyStart) * slope;
     
-    int actualPos = binary_search_vector_key_return_index(keys, predictPos-GLOBAL_ERROR,predictPos+GLOBAL_ERROR, key);
+    int actualPos = binary_search_vector_key_return_index(keys, predictPos-error,predictPos+error, key);
     actualPos = (actualPos == -1)? n : actualPos;
     range_scan(actualPos,matchRate, searchResults);
 }
@@ -127,7 +129,7 @@ void Segment<K>::range_search(K key, K lowerBound, K upperBound, vector<K> & sea
 {
     int predictPos = (lowerBound - keyStart) * slope;
     
-    int actualPos = binary_search_vector_key_return_index(keys, predictPos-GLOBAL_ERROR,predictPos+GLOBAL_ERROR, lowerBound);
+    int actualPos = binary_search_vector_key_return_index(keys, predictPos-error,predictPos+error, lowerBound);
     actualPos = (actualPos == -1)? n : actualPos;
     range_scan(actualPos, key, lowerBound, upperBound, searchResults);
 }
@@ -180,8 +182,8 @@ Segment<K>* Segment<K>::push_back(K key)
     //If slope less than error than just add to leaf
 	if (slopeLow <= (double)(n) / (double)(key - keyStart) &&
 		(double)(n) / (double)(key - keyStart) <= slopeHigh) {
-		double slopeHighTemp = (double)((n + GLOBAL_ERROR)) / (double)(key - keyStart);
-		double slopeLowTemp = (double)((n - GLOBAL_ERROR)) / (double)(key - keyStart);
+		double slopeHighTemp = (double)((n + error)) / (double)(key - keyStart);
+		double slopeLowTemp = (double)((n - error)) / (double)(key - keyStart);
 
 		slopeHigh = min(slopeHigh, slopeHighTemp);
 		slopeLow = max(slopeLow, slopeLowTemp);
@@ -193,7 +195,7 @@ Segment<K>* Segment<K>::push_back(K key)
 	}
 	//Else create new segment
 	else {
-		Segment<K>* segPtr = new Segment<K>(key);
+		Segment<K>* segPtr = new Segment<K>(key, error);
 		rightSibling = segPtr;
 		segPtr->leftSibling = this;
 		return segPtr;
@@ -215,13 +217,13 @@ Getters
 template<class K>
 uint64_t Segment<K>::get_model_size_in_bytes(){
     
-    return sizeof(int)*2 + sizeof(double)*3 + sizeof(K) + sizeof(Segment<K>*)*2 + sizeof(vector<Key<K>>);
+    return sizeof(int)*3 + sizeof(double)*3 + sizeof(K) + sizeof(Segment<K>*)*2 + sizeof(vector<Key<K>>);
 }
 
 template<class K>
 uint64_t Segment<K>::get_total_size_in_bytes(){
         
-    return sizeof(int)*2 + sizeof(double)*3 + sizeof(K) + sizeof(Segment<K>*)*2 + sizeof(vector<Key<K>>)
+    return sizeof(int)*3 + sizeof(double)*3 + sizeof(K) + sizeof(Segment<K>*)*2 + sizeof(vector<Key<K>>)
     + sizeof(K)*n + sizeof(bool)*n;
 }
 
@@ -238,6 +240,7 @@ private:
     int last_index;  //back index
     int capacity; //capacity
     int n; // current size of the queue
+    int error; // error bound given to new segments
     
     pair<K,Segment<K>*>* queue; //queue which is the SummaryList
 
@@ -246,7 +249,7 @@ private:
 
 public:
     //Constructor & Destructor
-    Flirt(int size);
+    Flirt(int size, int initialError = GLOBAL_ERROR);
     ~Flirt();
 
 public:
@@ -281,6 +284,7 @@ public:
     uint64_t get_model_size_in_bytes();
     uint64_t get_total_size_in_bytes();
 
+    int get_error(){return this->error;}
     int get_n(){return this->n;}
 };
 
@@ -288,13 +292,14 @@ public:
  Constructor & Destructor
 */
 template<class K>
-Flirt<K>::Flirt(int size)
+Flirt<K>::Flirt(int size, int initialError)
 {
     queue = new pair<K,Segment<K>*>[size];
     capacity = size;
     first_index = 0;
     last_index = -1;
     n = 0;
+    error = initialError;
 };
 
 template<class K>
@@ -753,7 +758,7 @@ void Flirt<K>::enqueue(K key)
     }
 
     if (n == 0){
-        Segment<K>* segPtr = new Segment<K>(key);
+        Segment<K>* segPtr = new Segment<K>(key, error);
         last_index++;
         last_index %= capacity;
         queue[last_index] = make_pair(key,segPtr);
@@ -830,7 +835,7 @@ Getters
 template<class K>
 uint64_t Flirt<K>::get_model_size_in_bytes()
 {
-    uint64_t model_size = sizeof(Segment<K>*)*2 + sizeof(int)*4 + sizeof(pair<K,Segment<K>*>*) + 
+    uint64_t model_size = sizeof(Segment<K>*)*2 + sizeof(int)*5 + sizeof(pair<K,Segment<K>*>*) + 
     sizeof(pair<K,Segment<K>*>)*n;
 
     for (int i=first_index; i<=last_index;i++)
@@ -843,7 +848,7 @@ uint64_t Flirt<K>::get_model_size_in_bytes()
 template<class K>
 uint64_t Flirt<K>::get_total_size_in_bytes()
 {
-    uint64_t total_size = sizeof(Segment<K>*)*2 + sizeof(int)*4 + sizeof(pair<K,Segment<K>*>*) + 
+    uint64_t total_size = sizeof(Segment<K>*)*2 + sizeof(int)*5 + sizeof(pair<K,Segment<K>*>*) + 
     sizeof(pair<K,Segment<K>*>)*n;
 
     for (int i=first_index; i<=last_index;i++)
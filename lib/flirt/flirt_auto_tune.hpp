@@ -255,6 +255,7 @@ private:
     bool direction; // 0 decrease error, 1 increase error
     int error; //auto adjusted
     int numberOfEnqueue; //number of enqueue
+    int autoTuneSize; //number of enqueue between auto tune
     int errorBegin; //error at the start of the auto tune cycle
     int nEnqueue; //Number of items added
     int nBegin; //size of queue at the start of the auto tune cycle
@@ -274,7 +275,7 @@ private:
 
 public:
     //Constructor & Destructor
-    Flirt(int size, int initialError = 256);
+    Flirt(int size, int initialError = 256, int autoTuneSize = static_cast<int>(AUTO_TUNE_SIZE));
     ~Flirt();
 
 public:
@@ -330,7 +331,7 @@ public:
  Constructor & Destructor
 */
 template<class K>
-Flirt<K>::Flirt(int size, int initialError)
+Flirt<K>::Flirt(int size, int initialError, int autoTuneSize)
 {
     queue = new pair<K,Segment<K>*>[size];
     capacity = size;
@@ -342,6 +343,7 @@ Flirt<K>::Flirt(int size, int initialError)
     errorBegin = initialError;
     adjustment = 2;
     numberOfEnqueue = 0;
+    this->autoTuneSize = autoTuneSize;
     nEnqueue = 0;
     nBegin = 0;
     direction = 1;
@@ -952,7 +954,7 @@ void Flirt<K>::enqueue_auto_tune(K key)
 
     numberOfEnqueue++;
 
-    if (numberOfEnqueue == static_cast<int>(AUTO_TUNE_SIZE))
+    if (numberOfEnqueue == autoTuneSize)
     {
         auto_tune_error();
     }
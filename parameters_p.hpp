@@ -11,7 +11,9 @@
 #define NO_STD 1
 // #define PRINT
 
+#ifndef NUM_THREADS
 #define NUM_THREADS 4
+#endif
 #define CACHELINE_SIZE (1 << 6)
 #define NUM_SEARCH_PER_ROUND 1
 #define NUM_UPDATE_PER_ROUND 5
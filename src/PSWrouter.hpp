@@ -0,0 +1,324 @@
+#ifndef __PSWIX_ROUTER_HPP__
+#define __PSWIX_ROUTER_HPP__
+
+#pragma once
+#include <memory>
+#include <thread>
+#include "PSwix.hpp"
+
+using namespace std;
+
+namespace pswix {
+
+/*
+Task Router
+*/
+//Hands SWtask records to the worker of each partition: a point task to the partition owning its key, a range task to
+//every partition it overlaps (SWmeta::route). The dispatcher (one thread) collects the tasks of each partition and
+//enqueues them batchSize at a time; worker threadID dequeues its partition's tasks in batches and runs them with
+//execute. Each partition runs its tasks in dispatch order, so workers need no round barrier: the dispatcher only waits
+//when a partition falls maxPending tasks behind, and markers carry the dispatcher's timestamp to every partition
+//(watermark). rebalance moves the boundary between the most loaded partition and its lighter neighbour (each partition
+//needs its own worker thread: the handoff waits for the workers of both partitions). Until the boundary has moved, the
+//parts and markers for those two partitions are held back and then routed with the new boundary in dispatch order, so
+//a rebalance never reorders tasks. A part that still reaches a partition not owning its keys is routed again at the
+//end of the owner's queue (counted by get_no_rerouted).
+template<class Type_Key, class Type_Ts>
+class SWrouter
+{
+private:
+    SWmeta<Type_Key,Type_Ts> * m_index;
+    size_t m_batchSize;
+    vector<unique_ptr<moodycamel::ConcurrentQueue<SWtask<Type_Key,Type_Ts>>>> m_queues; //One per partition
+    vector<vector<SWtask<Type_Key,Type_Ts>>> m_batches; //Tasks not enqueued yet (dispatcher)
+    vector<uint64_t> m_numDispatched; //Tasks given to each partition (dispatcher)
+    unique_ptr<SWcounter[]> m_numDequeued; //Tasks taken by each worker
+    uint64_t m_maxPending;
+    vector<uint64_t> m_recentLoad; //Searches and inserts routed to each partition, halved at every rebalance (dispatcher)
+    vector<vector<Type_Key>> m_recentKeys; //Keys of the last REBALANCE_SAMPLES of them (dispatcher, ring buffer)
+    vector<size_t> m_numRecentKeys;
+    SWcounter m_numRerouted; //Parts routed again by a worker
+
+    //Parts (partition -1, routed again) and markers (their partition) for the two partitions of the pending handoff,
+    //held back until the boundary has moved (dispatcher)
+    bool m_handoffDeferring;
+    uint32_t m_handoffIDs[2];
+    vector<pair<int,SWtask<Type_Key,Type_Ts>>> m_deferred;
+
+public:
+    SWrouter(SWmeta<Type_Key,Type_Ts> * index, int numThreads, int batchSize = ROUTER_BATCH_SIZE, 
+            uint64_t maxPending = ROUTER_MAX_PENDING);
+
+    //Dispatcher
+    void dispatch(const SWtask<Type_Key,Type_Ts> & task);
+    void dispatch_all(task_status status, Type_Ts timestamp = 0); //Marker to every partition, after its pending tasks
+    void flush();
+    bool rebalance(double threshold = REBALANCE_THRESHOLD);
+    uint64_t get_no_rerouted() const {return m_numRerouted.value.load(memory_order_relaxed);}
+
+    //Workers
+    size_t dequeue(uint32_t threadID, SWtask<Type_Key,Type_Ts> * tasks, size_t maxTasks);
+    int execute(uint32_t threadID, const SWtask<Type_Key,Type_Ts> & task);
+
+private:
+    //Dispatcher helpers
+    void enqueue(uint32_t threadID, const SWtask<Type_Key,Type_Ts> & task);
+    bool is_deferred(uint32_t threadID) const;
+    void release_deferred(bool wait);
+};
+
+template<class Type_Key, class Type_Ts>
+SWrouter<Type_Key,Type_Ts>::SWrouter(SWmeta<Type_Key,Type_Ts> * index, int numThreads, int batchSize, uint64_t maxPending)
+:m_index(index), m_batchSize(batchSize), m_batches(numThreads), m_numDispatched(numThreads, 0), 
+m_numDequeued(new SWcounter[numThreads]), m_maxPending(maxPending), m_recentLoad(numThreads, 0),
+m_recentKeys(numThreads, vector<Type_Key>(REBALANCE_SAMPLES)), m_numRecentKeys(numThreads, 0),
+m_handoffDeferring(false)
+{
+    if (numThreads < 1 || batchSize < 1 || maxPending < (uint64_t)batchSize)
+    {
+        throw invalid_argument("SWrouter: numThreads and batchSize must be > 0, maxPending >= batchSize");
+    }
+
+    m_queues.reserve(numThreads);
+    for (int i = 0; i < numThreads; ++i)
+    {
+        m_queues.emplace_back(new moodycamel::ConcurrentQueue<SWtask<Type_Key,Type_Ts>>(batchSize * 4));
+        m_batches[i].reserve(batchSize);
+    }
+}
+
+template<class Type_Key, class Type_Ts>
+void SWrouter<Type_Key,Type_Ts>::dispatch(const SWtask<Type_Key,Type_Ts> & task)
+{
+    release_deferred(false);
+
+    m_index->route(task, [&](uint32_t threadID, const SWtask<Type_Key,Type_Ts> & partitionTask)
+    {
+        if (is_deferred(threadID))
+        {
+            m_deferred.push_back(make_pair(-1, partitionTask));
+            if (m_deferred.size() >= m_maxPending) //Backpressure
+            {
+                release_deferred(true);
+            }
+            return;
+        }
+        enqueue(threadID, partitionTask);
+    });
+}
+
+//ROUND_END and FINISH wait for a pending handoff (the workers of both partitions must reach them), WATERMARK is held
+//back with the parts of the two partitions
+template<class Type_Key, class Type_Ts>
+void SWrouter<Type_Key,Type_Ts>::dispatch_all(task_status status, Type_Ts timestamp)
+{
+    release_deferred(status != task_status::WATERMARK);
+
+    SWtask<Type_Key,Type_Ts> marker = {0, 0, timestamp, status};
+    for (int i = 0; i < m_batches.size(); ++i)
+    {
+        if (is_deferred(i))
+        {
+            m_deferred.push_back(make_pair(i, marker));
+            continue;
+        }
+        m_batches[i].push_back(marker);
+        ++m_numDispatched[i];
+    }
+    flush();
+}
+
+template<class Type_Key, class Type_Ts>
+void SWrouter<Type_Key,Type_Ts>::flush()
+{
+    for (int i = 0; i < m_batches.size(); ++i)
+    {
+        if (!m_batches[i].empty())
+        {
+            m_queues[i]->enqueue_bulk(m_batches[i].begin(), m_batches[i].size());
+            m_batches[i].clear();
+        }
+    }
+}
+
+//Load of a partition = searches and inserts routed to it, halved at every call so the last few intervals count. Queued
+//tasks are not counted again (a handoff does not move them) and deletes are no-ops. Of the neighbours with the largest
+//load gap, the heavier one hands the lighter one the keys that would even out their loads if it exceeds threshold times
+//the mean: the boundary moves to the quantile of its recent keys that leaves the excess share on the neighbour's side
+//(SWmeta::request_handoff). A hot region spanning two partitions thus moves on towards the cold ones over several calls.
+//Returns true if a handoff was requested.
+template<class Type_Key, class Type_Ts>
+bool SWrouter<Type_Key,Type_Ts>::rebalance(double threshold)
+{
+    release_deferred(false);
+
+    int numPartitions = min(m_batches.size(), m_index->get_no_partitions());
+    if (numPartitions < 2 || m_handoffDeferring)
+    {
+        return false;
+    }
+
+    vector<uint64_t> load(numPartitions);
+    uint64_t totalLoad = 0;
+    for (int i = 0; i < numPartitions; ++i)
+    {
+        load[i] = m_recentLoad[i];
+        m_recentLoad[i] /= 2;
+        totalLoad += load[i];
+    }
+
+    int hotID = (load[0] >= load[1]) ? 0 : 1;
+    int coldID = 1 - hotID;
+    for (int i = 1; i < numPartitions-1; ++i)
+    {
+        int heavyID = (load[i] >= load[i+1]) ? i : i+1;
+        int lightID = (heavyID == i) ? i+1 : i;
+        if (load[heavyID] - load[lightID] > load[hotID] - load[coldID])
+        {
+            hotID = heavyID;
+            coldID = lightID;
+        }
+    }
+
+    if (load[hotID] == 0 || load[hotID] < threshold * totalLoad / numPartitions)
+    {
+        return false;
+    }
+
+    double fraction = (double)(load[hotID] - load[coldID]) / (2 * load[hotID]);
+
+    vector<Type_Key> keys(m_recentKeys[hotID].begin(), m_recentKeys[hotID].begin() + min<size_t>(m_numRecentKeys[hotID], REBALANCE_SAMPLES));
+    if (keys.size() < 2)
+    {
+        return false;
+    }
+    sort(keys.begin(), keys.end());
+    size_t numGiven = min(max<size_t>(round(fraction * keys.size()), 1), keys.size()-1);
+    Type_Key splitKey = (coldID > hotID) ? keys[keys.size()-numGiven] : keys[numGiven];
+
+    if (!m_index->request_handoff(hotID, coldID, splitKey))
+    {
+        return false;
+    }
+    m_recentLoad[hotID] = m_recentLoad[coldID] = (m_recentLoad[hotID] + m_recentLoad[coldID]) / 2; //Evened out
+    m_numRecentKeys[hotID] = m_numRecentKeys[coldID] = 0;
+
+    //Marker after the tasks already dispatched to both partitions, the next ones wait for the new boundary
+    SWtask<Type_Key,Type_Ts> marker = {0, 0, 0, task_status::REBALANCE};
+    for (int threadID: {hotID, coldID})
+    {
+        m_batches[threadID].push_back(marker);
+        ++m_numDispatched[threadID];
+        m_queues[threadID]->enqueue_bulk(m_batches[threadID].begin(), m_batches[threadID].size());
+        m_batches[threadID].clear();
+    }
+
+    m_handoffDeferring = true;
+    m_handoffIDs[0] = hotID;
+    m_handoffIDs[1] = coldID;
+    return true;
+}
+
+//Adds a part to the batch of partition threadID. Backpressure: only a partition maxPending tasks behind stops the
+//dispatcher (rerouted parts may make the difference negative)
+template<class Type_Key, class Type_Ts>
+void SWrouter<Type_Key,Type_Ts>::enqueue(uint32_t threadID, const SWtask<Type_Key,Type_Ts> & task)
+{
+    vector<SWtask<Type_Key,Type_Ts>> & batch = m_batches[threadID];
+
+    while ((int64_t)(m_numDispatched[threadID] - m_numDequeued[threadID].value.load(memory_order_acquire)) >= (int64_t)m_maxPending)
+    {
+        if (!batch.empty())
+        {
+            m_queues[threadID]->enqueue_bulk(batch.begin(), batch.size());
+            batch.clear();
+        }
+        this_thread::yield();
+    }
+
+    batch.push_back(task);
+    ++m_numDispatched[threadID];
+    if (task.status != task_status::DELETE)
+    {
+        ++m_recentLoad[threadID];
+        m_recentKeys[threadID][m_numRecentKeys[threadID]++ % REBALANCE_SAMPLES] = task.lowerBound;
+    }
+    if (batch.size() == m_batchSize)
+    {
+        m_queues[threadID]->enqueue_bulk(batch.begin(), batch.size());
+        batch.clear();
+    }
+}
+
+template<class Type_Key, class Type_Ts>
+inline bool SWrouter<Type_Key,Type_Ts>::is_deferred(uint32_t threadID) const
+{
+    return m_handoffDeferring && (threadID == m_handoffIDs[0] || threadID == m_handoffIDs[1]);
+}
+
+//Once the handoff is done (or after waiting for it), routes the held back parts with the new boundary and enqueues
+//them with the held back markers, in dispatch order
+template<class Type_Key, class Type_Ts>
+void SWrouter<Type_Key,Type_Ts>::release_deferred(bool wait)
+{
+    if (!m_handoffDeferring)
+    {
+        return;
+    }
+
+    while (m_index->handoff_pending())
+    {
+        if (!wait)
+        {
+            return;
+        }
+        this_thread::yield();
+    }
+    m_handoffDeferring = false;
+
+    for (auto & deferred: m_deferred)
+    {
+        if (deferred.first != -1)
+        {
+            enqueue(deferred.first, deferred.second);
+            continue;
+        }
+
+        m_index->route(deferred.second, [&](uint32_t threadID, const SWtask<Type_Key,Type_Ts> & partitionTask)
+        {
+            enqueue(threadID, partitionTask);
+        });
+    }
+    m_deferred.clear();
+}
+
+template<class Type_Key, class Type_Ts>
+inline size_t SWrouter<Type_Key,Type_Ts>::dequeue(uint32_t threadID, SWtask<Type_Key,Type_Ts> * tasks, size_t maxTasks)
+{
+    size_t numTasks = m_queues[threadID]->try_dequeue_bulk(tasks, maxTasks);
+    if (numTasks)
+    {
+        m_numDequeued[threadID].value.fetch_add(numTasks, memory_order_release);
+    }
+    return numTasks;
+}
+
+//Rerouted parts skip the dispatcher's batches (enqueued one by one) and run after the tasks already queued at their
+//owner. The dispatcher routes with the current boundaries and holds back parts while a boundary moves, so this only
+//happens with more workers than partitions.
+template<class Type_Key, class Type_Ts>
+inline int SWrouter<Type_Key,Type_Ts>::execute(uint32_t threadID, const SWtask<Type_Key,Type_Ts> & task)
+{
+    return m_index->execute(threadID, task, [&](const SWtask<Type_Key,Type_Ts> & outsideTask)
+    {
+        m_numRerouted.value.fetch_add(1, memory_order_relaxed);
+        m_index->route(outsideTask, [&](uint32_t ownerID, const SWtask<Type_Key,Type_Ts> & partitionTask)
+        {
+            m_queues[ownerID]->enqueue(partitionTask);
+        });
+    });
+}
+
+}
+
+#endif
@@ -23,6 +23,9 @@ private:
     int m_numPairBuffer;
     int m_maxSearchError;
     int m_tuneStage;
+    #ifndef STATIC_PARAMS
+    int m_maxBufferSize;
+    #endif
 
     Type_Ts m_maxTimeStamp;
     double m_slope;
@@ -39,8 +42,8 @@ private:
 // Functions
 public:
     SWseg();
-    SWseg(int startIndex, int endIndex, double slope, const vector<pair<Type_Key,Type_Ts>> & data);
-    SWseg(const pair<Type_Key,Type_Ts> & singleData);
+    SWseg(int startIndex, int endIndex, double slope, const vector<pair<Type_Key,Type_Ts>> & data, int maxBufferSize = MAX_BUFFER_SIZE);
+    SWseg(const pair<Type_Key,Type_Ts> & singleData, int maxBufferSize = MAX_BUFFER_SIZE);
 
     void local_train(int startIndex, int endIndex, double slope, 
                     const vector<pair<Type_Key,Type_Ts>> & data);
@@ -50,14 +53,18 @@ public:
     int lookup( int threadLeftBoundary, int threadRightBoundary, 
                 Type_Key key, Type_Ts expiryTime, tuple<pswix::seg_update_type,int,Type_Key> & updateSeg);
 
-    int range_search(   int threadLeftBoundary, int threadRightBoundary, 
+    //Type_Result: int (count) or SWaggregate<Type_Key>
+    template<class Type_Result>
+    void range_search(  int threadLeftBoundary, int threadRightBoundary, 
                         Type_Key lowerBound, Type_Ts expiryTime, Type_Key upperBound, 
-                        vector<tuple<pswix::seg_update_type,int,Type_Key>> & updateSeg);
+                        vector<tuple<pswix::seg_update_type,int,Type_Key>> & updateSeg,
+                        Type_Result & result);
 
-    int range_scan( int threadLeftBoundary, int threadRightBoundary, 
+    template<class Type_Result>
+    void range_scan(int threadLeftBoundary, int threadRightBoundary, 
                     Type_Key lowerBound, Type_Ts expiryTime, Type_Key upperBound, 
                     vector<tuple<pswix::seg_update_type,int,Type_Key>> & updateSeg,
-                    int startPos = 0, int startBufferPos = 0);
+                    Type_Result & result, int startPos = 0, int startBufferPos = 0);
 
     int insert( int threadLeftBoundary, int threadRightBoundary, Type_Key key, Type_Ts timestamp, Type_Ts expiryTime,
                 vector<tuple<pswix::seg_update_type,int,Type_Key>> & updateSeg);
@@ -92,12 +99,22 @@ private:
     tuple<int,int,int> find_predict_pos_bound(Type_Key targetKey);
     void exponential_search_dp_right(Type_Key targetKey, int & foundPos, int maxSearchBound);
     void exponential_search_dp_left(Type_Key targetKey, int & foundPos, int maxSearchBound);
+    void lower_bound_dp(Type_Key targetKey, int & foundPos);
     void binary_search_lower_bound_buffer(Type_Key targetKey, int & foundPos);
     bool index_exists_model(int index, Type_Ts expiryTime);
     bool index_exists_buffer(int index, Type_Ts expiryTime);
     void update_maximium_timestamp(Type_Ts timestamp);
     void update_maximium_search_bound();
     void update_neighour_siblings(int threadLeftBoundary, int threadRightBoundary);
+
+    inline int max_buffer_size() const
+    {
+        #ifdef STATIC_PARAMS
+        return MAX_BUFFER_SIZE;
+        #else
+        return m_maxBufferSize;
+        #endif
+    }
 };
 
 /*
@@ -107,17 +124,25 @@ template<class Type_Key, class Type_Ts>
 SWseg<Type_Key,Type_Ts>::SWseg()
 :m_rightSearchBound(0), m_leftSearchBound(0), m_numPair(0), m_numPairBuffer(0), m_parentIndex(0), m_maxSearchError(0),
  m_slope(-1), m_maxTimeStamp(numeric_limits<Type_Ts>::min()), 
- m_startKey(numeric_limits<Type_Key>::min()), m_currentNodeStartKey(numeric_limits<Type_Key>::min()) {}
+ m_startKey(numeric_limits<Type_Key>::min()), m_currentNodeStartKey(numeric_limits<Type_Key>::min())
+{
+    #ifndef STATIC_PARAMS
+    m_maxBufferSize = MAX_BUFFER_SIZE;
+    #endif
+}
 
 template<class Type_Key, class Type_Ts>
-SWseg<Type_Key,Type_Ts>::SWseg(int startIndex, int endIndex, double slope, const vector<pair<Type_Key,Type_Ts>> & data)
+SWseg<Type_Key,Type_Ts>::SWseg(int startIndex, int endIndex, double slope, const vector<pair<Type_Key,Type_Ts>> & data, int maxBufferSize)
 :m_rightSearchBound(0), m_leftSearchBound(0), m_numPair(0), m_numPairBuffer(0), m_maxTimeStamp(0), m_parentIndex(0), m_maxSearchError(0)
 {
     #ifdef DEBUG
     DEBUG_ENTER_FUNCTION("SWseg","Constructor(startIndex, endIndex, slope, data)");
     #endif
 
-    m_buffer.reserve(MAX_BUFFER_SIZE);
+    #ifndef STATIC_PARAMS
+    m_maxBufferSize = maxBufferSize;
+    #endif
+    m_buffer.reserve(max_buffer_size());
     local_train(startIndex, endIndex, slope, data);
 
     #ifdef TUNE
@@ -130,14 +155,17 @@ SWseg<Type_Key,Type_Ts>::SWseg(int startIndex, int endIndex, double slope, const
 }
 
 template<class Type_Key, class Type_Ts>
-SWseg<Type_Key,Type_Ts>::SWseg(const pair<Type_Key,Type_Ts> & singleData)
+SWseg<Type_Key,Type_Ts>::SWseg(const pair<Type_Key,Type_Ts> & singleData, int maxBufferSize)
 :m_rightSearchBound(0), m_leftSearchBound(0), m_numPair(0), m_numPairExist(0), m_slope(0), m_parentIndex(0), m_maxSearchError(0)
 {
     #ifdef DEBUG
     DEBUG_ENTER_FUNCTION("SWseg","Constructor(singleData)");
     #endif
 
-    m_buffer.reserve(MAX_BUFFER_SIZE);
+    #ifndef STATIC_PARAMS
+    m_maxBufferSize = maxBufferSize;
+    #endif
+    m_buffer.reserve(max_buffer_size());
 
     m_buffer.push_back(singleData);
     m_numPairBuffer = 1;
@@ -341,17 +369,29 @@ int SWseg<Type_Key,Type_Ts>::lookup(   int threadLeftBoundary, int threadRightBo
             {
                 actualPos = (!predictPosMin)? 0 : m_numPair-1;
             }
-
-            if (m_localData[actualPos].second && m_localData[actualPos].second >= expiryTime)
+            else //Bounds clamped to a single position, the prediction itself can be outside the array
             {
-                return (m_localData[actualPos].first == key);
+                actualPos = predictPosMin;
             }
-            else
+            lower_bound_dp(key, actualPos);
+
+            if (actualPos < m_numPair) //Key after the last key of the model otherwise, only the buffer can hold it
             {
-                if (m_localData[actualPos].second)
+                if (m_localData[actualPos].second && m_localData[actualPos].second >= expiryTime)
                 {
-                    m_localData[actualPos].second = 0;
-                    --m_numPairExist;
+                    if (m_localData[actualPos].first == key)
+                    {
+                        return 1;
+                    }
+                    //A live tuple with another key, the key can still be in the buffer
+                }
+                else
+                {
+                    if (m_localData[actualPos].second)
+                    {
+                        m_localData[actualPos].second = 0;
+                        --m_numPairExist;
+                    }
                 }
             }
 
@@ -404,9 +444,11 @@ int SWseg<Type_Key,Type_Ts>::lookup(   int threadLeftBoundary, int threadRightBo
 Range Query
 */
 template<class Type_Key, class Type_Ts>
-int SWseg<Type_Key,Type_Ts>::range_search( int threadLeftBoundary, int threadRightBoundary, 
+template<class Type_Result>
+void SWseg<Type_Key,Type_Ts>::range_search(int threadLeftBoundary, int threadRightBoundary, 
                                             Type_Key lowerBound, Type_Ts expiryTime, Type_Key upperBound, 
-                                            vector<tuple<pswix::seg_update_type,int,Type_Key>> & updateSeg)
+                                            vector<tuple<pswix::seg_update_type,int,Type_Key>> & updateSeg,
+                                            Type_Result & result)
 {    
     #ifdef DEBUG
     DEBUG_ENTER_FUNCTION("SWseg","range_search");
@@ -462,6 +504,11 @@ int SWseg<Type_Key,Type_Ts>::range_search( int threadLeftBoundary, int threadRig
             {
                 actualPos = (!predictPosMin)? 0 : m_numPair-1;
             }
+            else //Bounds clamped to a single position, the prediction itself can be outside the array
+            {
+                actualPos = predictPosMin;
+            }
+            lower_bound_dp(lowerBound, actualPos); //range_scan counts every key up to upperBound from actualPos
         }
 
         if (m_numPairBuffer)
@@ -479,10 +526,11 @@ int SWseg<Type_Key,Type_Ts>::range_search( int threadLeftBoundary, int threadRig
             }
             #endif
         }
-        return range_scan(threadLeftBoundary, threadRightBoundary, lowerBound, expiryTime, upperBound, updateSeg, actualPos, bufferPos);
+        range_scan(threadLeftBoundary, threadRightBoundary, lowerBound, expiryTime, upperBound, updateSeg, result, actualPos, bufferPos);
+        return;
     }
 
-    return range_scan(threadLeftBoundary, threadRightBoundary, lowerBound, expiryTime, upperBound, updateSeg); //Entire segment expired
+    range_scan(threadLeftBoundary, threadRightBoundary, lowerBound, expiryTime, upperBound, updateSeg, result); //Entire segment expired
     
     #ifdef DEBUG
     DEBUG_EXIT_FUNCTION("SWseg","range_search");
@@ -494,10 +542,11 @@ int SWseg<Type_Key,Type_Ts>::range_search( int threadLeftBoundary, int threadRig
 }
 
 template<class Type_Key, class Type_Ts>
-int SWseg<Type_Key,Type_Ts>::range_scan(   int threadLeftBoundary, int threadRightBoundary, 
+template<class Type_Result>
+void SWseg<Type_Key,Type_Ts>::range_scan(  int threadLeftBoundary, int threadRightBoundary, 
                                             Type_Key lowerBound, Type_Ts expiryTime, Type_Key upperBound, 
                                             vector<tuple<pswix::seg_update_type,int,Type_Key>> & updateSeg, 
-                                            int startPos, int startBufferPos)
+                                            Type_Result & result, int startPos, int startBufferPos)
 {
     #ifdef DEBUG
     DEBUG_ENTER_FUNCTION("SWseg","range_scan");
@@ -524,7 +573,6 @@ int SWseg<Type_Key,Type_Ts>::range_scan(   int threadLeftBoundary, int threadRig
     segScanNoSeg++;
     #endif
 
-    int count = 0;
     if (m_maxTimeStamp >= expiryTime) 
     {
         
@@ -533,7 +581,7 @@ int SWseg<Type_Key,Type_Ts>::range_scan(   int threadLeftBoundary, int threadRig
         {
             if (m_localData[startPos].second && m_localData[startPos].second >= expiryTime)
             {
-                ++count;
+                append_result(result, m_localData[startPos].first);
             }
             else
             {
@@ -552,7 +600,7 @@ int SWseg<Type_Key,Type_Ts>::range_scan(   int threadLeftBoundary, int threadRig
         {
             if (m_buffer[startBufferPos].second && m_buffer[startBufferPos].second >= expiryTime)
             {
-                ++count;
+                append_result(result, m_buffer[startBufferPos].first);
             }
             else
             {
@@ -593,7 +641,7 @@ int SWseg<Type_Key,Type_Ts>::range_scan(   int threadLeftBoundary, int threadRig
     {
         if(m_rightSibling && m_rightSibling->m_currentNodeStartKey <= upperBound)
         {
-            count += m_rightSibling->range_scan(threadLeftBoundary, threadRightBoundary, lowerBound, expiryTime, upperBound, updateSeg);
+            m_rightSibling->range_scan(threadLeftBoundary, threadRightBoundary, lowerBound, expiryTime, upperBound, updateSeg, result);
         }
     }
     
@@ -605,8 +653,6 @@ int SWseg<Type_Key,Type_Ts>::range_scan(   int threadLeftBoundary, int threadRig
     if(DEBUG_KEY == lowerBound){printf("[Debug Info:] Range Scan: Back from Sibling \n");}
     #endif
 
-    return count;
-
     #ifdef DEBUG
     DEBUG_EXIT_FUNCTION("SWseg","range_scan");
     printf("[Debug Info:] stop DP pos = %i \n", startPos);
@@ -678,6 +724,7 @@ int SWseg<Type_Key,Type_Ts>::insert(   int threadLeftBoundary, int threadRightBo
         updateSeg.reserve(2);
         bool leftInsertFlag = ((m_parentIndex > threadLeftBoundary) && m_leftSibling); //At left boundary do not insert into left sibling
         bool rightInsertFlag = ((m_parentIndex < threadRightBoundary) && m_rightSibling); //At right boundary do not insert into right sibling
+        SWseg<Type_Key,Type_Ts>* insertedSegPointer = nullptr;
 
         if (leftInsertFlag) //Left Sibling accessible 
         {
@@ -693,31 +740,21 @@ int SWseg<Type_Key,Type_Ts>::insert(   int threadLeftBoundary, int threadRightBo
                 #endif
 
                 SWseg<Type_Key,Type_Ts>* rightSibling = (rightInsertFlag && m_rightSibling)? m_rightSibling : nullptr;
-                SWseg<Type_Key,Type_Ts>* insertedSegPointer = m_leftSibling->insert_neighbour(threadLeftBoundary,threadRightBoundary,
+                insertedSegPointer = m_leftSibling->insert_neighbour(threadLeftBoundary,threadRightBoundary,
                                                                 key, timestamp, expiryTime, updateSeg,
                                                                 true,rightSibling);              
 
-                updateSeg.push_back(make_tuple(pswix::seg_update_type::DELETE,m_parentIndex,m_currentNodeStartKey));
-                if (rightInsertFlag)
+                if (insertedSegPointer != NULL)
                 {
-                    if (insertedSegPointer != NULL)
+                    updateSeg.push_back(make_tuple(pswix::seg_update_type::DELETE,m_parentIndex,m_currentNodeStartKey));
+                    if (rightInsertFlag)
                     {
                         m_rightSibling->m_leftSibling = insertedSegPointer;
                     }
-                    else
-                    {
-                        insertedSegPointer = rightSibling->insert_neighbour(threadLeftBoundary,threadRightBoundary,
-                                                                key, timestamp, expiryTime, updateSeg,
-                                                                false, nullptr);
-                        if (insertedSegPointer == NULL)
-                        {
-                            LOG_ERROR("ERROR: All segments in partition is empty, abort insertion \n");
-                            abort();
-                        }
-                    }
                 }
         }
-        else if (rightInsertFlag) //Right Sibling accessible
+
+        if (insertedSegPointer == NULL && rightInsertFlag) //Right Sibling accessible (left ones all expired)
         {
                 #ifdef DEBUG
                 printf("[Debug Info:] Insert into right neighbour \n");
@@ -730,20 +767,30 @@ int SWseg<Type_Key,Type_Ts>::insert(   int threadLeftBoundary, int threadRightBo
                 }
                 #endif
 
+                int deleteIndex = updateSeg.size();
                 updateSeg.push_back(make_tuple(pswix::seg_update_type::DELETE,m_parentIndex,m_currentNodeStartKey));
-                SWseg<Type_Key,Type_Ts>* insertedSegPointer = m_rightSibling->insert_neighbour(threadLeftBoundary,threadRightBoundary,
+                insertedSegPointer = m_rightSibling->insert_neighbour(threadLeftBoundary,threadRightBoundary,
                                                                 key, timestamp, expiryTime, updateSeg,
                                                                 false,nullptr);
                 if (insertedSegPointer == NULL)
                 {
-                    LOG_ERROR("ERROR: All segments in partition is empty, abort insertion \n");
-                    abort();
+                    updateSeg.erase(updateSeg.begin() + deleteIndex);
                 }
         }
-        else //Isolated Segment
+
+        //No live segment left in the partition (the expired siblings tried are deleted): it stays and takes the key
+        if (insertedSegPointer == NULL)
         {
-            LOG_ERROR("ERROR: No left or right sibling to insert into \n");
-            abort();
+            m_leftSibling = leftInsertFlag ? nullptr : m_leftSibling;
+            m_rightSibling = rightInsertFlag ? nullptr : m_rightSibling;
+            int updateSegSize = updateSeg.size();
+            insert_current(key, timestamp, expiryTime, updateSeg);
+            update_maximium_timestamp(timestamp);
+
+            if (updateSeg.size() == updateSegSize && (double)m_numPairExist/m_numPair < 0.5)
+            {
+                updateSeg.push_back(make_tuple(pswix::seg_update_type::RETRAIN,m_parentIndex,m_currentNodeStartKey));
+            }
         }
     }
 
@@ -790,7 +837,7 @@ SWseg<Type_Key,Type_Ts>* SWseg<Type_Key,Type_Ts>::insert_neighbour( int threadLe
             update_maximium_timestamp(timestamp);
 
             m_rightSibling = otherNeighbour;
-            if (m_numPairBuffer > MAX_BUFFER_SIZE)
+            if (m_numPairBuffer > max_buffer_size())
             {
                 updateSeg.push_back(make_tuple(pswix::seg_update_type::RETRAIN,m_parentIndex,m_currentNodeStartKey));
             }
@@ -954,7 +1001,7 @@ void SWseg<Type_Key,Type_Ts>::insert_model(int insertionPos, bool addErrorFlag,
         int rightGapPos, leftGapPos;
 
         //Find Left Gap
-        int minDiffGap = (insertionPos-MAX_BUFFER_SIZE < 0)? 0 : insertionPos-MAX_BUFFER_SIZE;
+        int minDiffGap = (insertionPos-max_buffer_size() < 0)? 0 : insertionPos-max_buffer_size();
         for (leftGapPos = insertionPos; leftGapPos >= minDiffGap; --leftGapPos)
         {
             if (!index_exists_model(leftGapPos, expiryTime))
@@ -966,7 +1013,7 @@ void SWseg<Type_Key,Type_Ts>::insert_model(int insertionPos, bool addErrorFlag,
         }
 
         //Find Right Gap
-        minDiffGap = (gapPos == -1) ? insertionPos + MAX_BUFFER_SIZE : insertionPos + (insertionPos - gapPos);
+        minDiffGap = (gapPos == -1) ? insertionPos + max_buffer_size() : insertionPos + (insertionPos - gapPos);
         minDiffGap = (minDiffGap > m_numPair) ? m_numPair : minDiffGap;
         for (rightGapPos = insertionPos; rightGapPos < minDiffGap; ++rightGapPos)
         {
@@ -978,7 +1025,7 @@ void SWseg<Type_Key,Type_Ts>::insert_model(int insertionPos, bool addErrorFlag,
             }
         }
 
-        //No Gap and reached the end (end is still within MAX_BUFFER_SIZE)
+        //No Gap and reached the end (end is still within max_buffer_size())
         if (rightGapPos == m_numPair)
         {
             gapPos = m_numPair;
@@ -1333,7 +1380,7 @@ void SWseg<Type_Key,Type_Ts>::insert_buffer(   int insertionPos, Type_Key key, T
         ++m_numPairBuffer;
     }
 
-    if (m_numPairBuffer >= MAX_BUFFER_SIZE-1)
+    if (m_numPairBuffer >= max_buffer_size()-1)
     {
         updateSeg.push_back(make_tuple(pswix::seg_update_type::RETRAIN,m_parentIndex,m_currentNodeStartKey));
     }
@@ -1432,6 +1479,21 @@ inline void SWseg<Type_Key,Type_Ts>::exponential_search_dp_left(Type_Key targetK
     #endif
 }
 
+//Moves foundPos to the first position whose key is not below targetKey (m_numPair if there is none). A clamped
+//prediction can stop on a smaller key, and gaps repeat the previous key, so an equal key can be a gap after the tuple.
+template<class Type_Key, class Type_Ts>
+inline void SWseg<Type_Key,Type_Ts>::lower_bound_dp(Type_Key targetKey, int & foundPos)
+{
+    while (foundPos < m_numPair && m_localData[foundPos].first < targetKey)
+    {
+        ++foundPos;
+    }
+    while (foundPos > 0 && m_localData[foundPos-1].first >= targetKey)
+    {
+        --foundPos;
+    }
+}
+
 template<class Type_Key, class Type_Ts>
 inline void SWseg<Type_Key,Type_Ts>::binary_search_lower_bound_buffer(Type_Key targetKey, int & foundPos)
 {
@@ -1557,7 +1619,13 @@ inline void SWseg<Type_Key,Type_Ts>::print()
 template <class Type_Key, class Type_Ts>
 inline uint64_t SWseg<Type_Key,Type_Ts>::memory_usage()
 {
-    return sizeof(int)*7 + sizeof(Type_Ts) + sizeof(double) + sizeof(Type_Key)*2 + sizeof(vector<pair<Type_Key,Type_Ts>>)*2 +
+    #ifdef STATIC_PARAMS
+    int numIntMembers = 7;
+    #else
+    int numIntMembers = 8;
+    #endif
+
+    return sizeof(int)*numIntMembers + sizeof(Type_Ts) + sizeof(double) + sizeof(Type_Key)*2 + sizeof(vector<pair<Type_Key,Type_Ts>>)*2 +
     sizeof(pair<Type_Key,Type_Ts>)*(m_numPairBuffer + m_numPair) + sizeof(SWseg<Type_Key,Type_Ts>*)*2;
 }
 
@@ -16,57 +16,74 @@ typedef uint64_t key_type;
 typedef uint64_t time_type;
 typedef tuple<bool,int,int,int> search_bound_type;
 
-mutex thread_lock[NUM_THREADS];
-condition_variable thread_cv[NUM_THREADS];
-bool thread_occupied[NUM_THREADS];
-
-atomic<int> thread_retraining(-1); //Indicates which thread is retraining
-
-moodycamel::ConcurrentQueue<tuple<key_type,SWseg<key_type,time_type>*,bool>> retrain_insertion_queue(NUM_SEARCH_PER_ROUND + NUM_UPDATE_PER_ROUND*2);
-
 // There is meta thread in this version of Parallel pswix, all threads are worker threads.
+// Each partition has its own meta model, bitmaps and slots (indices and SWseg::m_parentIndex are local to the
+// partition), so a partition extends or retrains under its own lock while the others keep running.
 
-template<class Type_Key, class Type_Ts> 
+template<class Type_Key, class Type_Ts>
 class SWmeta
 {
 //Variables
 private:
     int splitError;
 
-    atomic<int> m_rightSearchBound;
-    atomic<int> m_leftSearchBound;
-    atomic<int> m_maxSearchError;
-    atomic<int> m_numSeg;
-    atomic<int> m_numSegExist;
-    
-    Type_Key m_startKey;
-    double m_slope;
+    //Model of each partition: slot of key = m_slope * (key - m_startKey) (m_slope == -1: binary search)
+    vector<int> m_rightSearchBound;
+    vector<int> m_leftSearchBound;
+    vector<int> m_maxSearchError;
+    vector<Type_Key> m_startKey;
+    vector<double> m_slope;
 
-    vector<int> m_partitionIndex; //start index of each partition
-    vector<Type_Ts> m_parititonMaxTime; //Updated during insertion
-    vector<Type_Key> m_partitionStartKey; //starting key of each partition
+    vector<Type_Ts> m_parititonMaxTime; //Latest timestamp of each partition (inserts and watermarks)
+    vector<atomic<Type_Key>> m_partitionStartKey; //starting key of each partition (moved by handoffs while tasks are routed)
     vector<int> m_numSegPerPartition; //number of segments in each partition
     vector<int> m_numSegExistsPerPartition; //number of segments exists in each partition
-    
-    vector<uint64_t> m_bitmap;
-    vector<uint64_t> m_retrainBitmap;
+    vector<atomic<int>> m_partitionNumSeg; //m_numSegExistsPerPartition as of the last unlock, read by the dispatcher
+
+    //Retrain of each partition (0 = none, 1 = extend, 2 = retrain), run before the operation that requested it
+    //unlocks the partition. Segments reinserted meanwhile wait in m_deferredSeg.
+    vector<int> m_retrainStatus;
+    vector<vector<tuple<Type_Key,SWseg<Type_Key,Type_Ts>*,bool>>> m_deferredSeg;
+
+    vector<vector<uint64_t>> m_bitmap;
+    vector<vector<uint64_t>> m_retrainBitmap;
     vector<vector<Type_Key>> m_keys;
+
+    //Summary of m_bitmap of each partition, one bit per m_bitmap word (words past the end of the summary are empty)
+    vector<vector<uint64_t>> m_bitmapSummary; //word has a non-gap
+    vector<vector<uint64_t>> m_bitmapFullSummary; //word has no gap
     vector<vector<SWseg<Type_Key,Type_Ts>*>> m_ptr;
 
+    unique_ptr<SWlock[]> m_partitionLock; //Lock of each partition
+
+    //Handoff of boundary segments between two adjacent partitions, one at a time (requested by the SWrouter
+    //dispatcher, run by the workers of both partitions when they reach its REBALANCE marker)
+    atomic<bool> m_handoffPending;
+    atomic<int> m_handoffArrived;
+    uint32_t m_handoffFromID;
+    uint32_t m_handoffToID;
+    Type_Key m_handoffKey;
+
+    #ifndef STATIC_PARAMS
+    SWparams m_params;
+    #endif
+
 //Functions
 public:
     //Constructors & Deconstructors
     SWmeta();
-    SWmeta(int numThreads, const pair<Type_Key, Type_Ts> & arrivalTuple);
-    SWmeta(int numThreads, const vector<pair<Type_Key, Type_Ts>> & stream);
+    SWmeta(int numThreads, const pair<Type_Key, Type_Ts> & arrivalTuple, const SWparams & params = SWparams());
+    SWmeta(int numThreads, const vector<pair<Type_Key, Type_Ts>> & stream, const SWparams & params = SWparams());
     ~SWmeta();
 
     //Bulk Load
     void bulk_load(int numThreads, const vector<pair<Type_Key, Type_Ts>> & stream);
 private:
-    void split_data(const vector<pair<Type_Key,Type_Ts>> & data, vector<pair<Type_Key, SWseg<Type_Key,Type_Ts> * >> & splitedDataPtr);
-    void partition_data_into_threads(int numThreads, vector<Type_Key> & keys, vector<SWseg<Type_Key,Type_Ts>*> & ptr);
-    void partition_data_into_threads_no_empty(int numThreads, vector<Type_Key> & keys, vector<SWseg<Type_Key,Type_Ts>*> & ptr);
+    double split_data(int numThreads, const vector<pair<Type_Key,Type_Ts>> & data, vector<pair<Type_Key, SWseg<Type_Key,Type_Ts> * >> & splitedDataPtr);
+    void partition_data_into_threads(int numThreads, double slope, vector<pair<Type_Key, SWseg<Type_Key,Type_Ts> * >> & splitedDataPtr);
+    void partition_data_into_threads_no_empty(int numThreads, vector<pair<Type_Key, SWseg<Type_Key,Type_Ts> * >> & splitedDataPtr);
+    void build_partitions(const vector<int> & firstSegment, vector<pair<Type_Key, SWseg<Type_Key,Type_Ts> * >> & splitedDataPtr);
+    void init_partitions(int numPartitions);
 
 public:
     //Multithread Index Operations
@@ -76,21 +93,37 @@ public:
     int lookup(uint32_t threadID, Type_Key key, Type_Ts timestamp, tuple<bool,int,int,int> & predictBound);
 
     int range_query(uint32_t threadID, Type_Key lowerBound, Type_Ts timestamp, Type_Key upperBound, tuple<bool,int,int,int> & predictBound);
+    SWaggregate<Type_Key> range_aggregate(uint32_t threadID, Type_Key lowerBound, Type_Ts timestamp, Type_Key upperBound, tuple<bool,int,int,int> & predictBound);
 
     int insert(uint32_t threadID, Type_Key key, Type_Ts timestamp, tuple<bool,int,int,int> & predictBound);
 
+    //Task routing (SWtask, see PSWrouter.hpp)
+    template<class Visitor>
+    void route(const SWtask<Type_Key,Type_Ts> & task, Visitor && visitor);
+    template<class Visitor>
+    int execute(uint32_t threadID, const SWtask<Type_Key,Type_Ts> & task, Visitor && reroute);
+    void advance_watermark(uint32_t threadID, Type_Ts timestamp);
+
+    //Rebalancing (see SWrouter::rebalance)
+    bool request_handoff(uint32_t fromID, uint32_t toID, Type_Key splitKey);
+    bool handoff_pending() const {return m_handoffPending.load(memory_order_acquire);}
+
 private:
     //Thread Locators
     uint32_t predict_thread(Type_Key key);
     uint32_t predict_thread(Type_Key key, tuple<bool,int,int,int> & predictBound);
     vector<uint32_t> predict_thread(Type_Key lowerBound, Type_Key upperBound, vector<tuple<bool,int,int,int>> & predictBound);
-    
+    void predict_bound_in_thread(uint32_t threadID, Type_Key key, tuple<bool,int,int,int> & predictBound);
+
     //Search helpers
+    template<class Type_Result>
+    void range_query_result(uint32_t threadID, Type_Key lowerBound, Type_Ts timestamp, Type_Key upperBound,
+                            tuple<bool,int,int,int> & predictBound, Type_Result & result);
     int meta_model_search(uint32_t threadID, Type_Key targetKey, tuple<bool,int,int,int> & predictBound);
     int meta_non_model_search(uint32_t threadID, Type_Key targetKey, tuple<bool,int,int,int> & searchBound);
 
     //Update SWmeta helper functions
-    int thread_dispatch_update_seg(uint32_t threadID, Type_Ts expiryTime, 
+    void thread_dispatch_update_seg(uint32_t threadID, Type_Ts expiryTime,
                                     vector<tuple<pswix::seg_update_type,int,Type_Key>> & updateSeg);
     void seg_retrain(uint32_t threadID, int startIndex, int endIndex, Type_Ts expiryTime,
                     vector<pair<Type_Key,SWseg<Type_Key,Type_Ts>*>> & retrainSeg);
@@ -102,60 +135,52 @@ private:
     //Insertion helpers functions
     int insert_model(uint32_t threadID, int insertionPos, Type_Key key, SWseg<Type_Key,Type_Ts>* segPtr, bool addErrorFlag, bool currentRetrainStatus);
     int insert_model_no_gap(uint32_t threadID, int insertionPos, Type_Key key, SWseg<Type_Key,Type_Ts>* segPtr, bool addErrorFlag, bool currentRetrainStatus);
-    int insert_end(uint32_t threadID, Type_Key key, SWseg<Type_Key,Type_Ts>* segPtr, bool currentRetrainStatus); //Only last partition calls
-    int insert_append(uint32_t threadID, int insertionPos, Type_Key key, SWseg<Type_Key,Type_Ts>* segPtr, bool currentRetrainStatus); //Only last partition calls
+    int insert_end(uint32_t threadID, Type_Key key, SWseg<Type_Key,Type_Ts>* segPtr, bool currentRetrainStatus);
+    int meta_retrain_status(uint32_t threadID);
 
-public: 
-    // Meta retrain
-    void meta_retrain();
+    // Meta retrain (one partition, its lock held)
+    void meta_retrain(uint32_t threadID);
 
-private:
     //Retrain helpers
-    vector<tuple<key_type,SWseg<key_type,time_type>*,bool>> flatten_partition_retrain(Type_Ts expiryTime);
-    void retrain_model_combine_data(Type_Ts expiryTime, vector<Type_Key> & tempKey, vector<SWseg<Type_Key,Type_Ts>*> & tempPtr);
-    void retrain_combine_data(Type_Ts expiryTime, vector<Type_Key> & tempKey, vector<SWseg<Type_Key,Type_Ts>*> & tempPtr);
-    void retrain_model_insert_segments(Type_Key currentKey, SWseg<key_type,time_type>* currentPtr, bool currentIsRetrain,
-                                int &currentInsertionPos, int&lastNonGapIndex, int& dataIndex,
-                                vector<Type_Key> & tempKey, vector<SWseg<Type_Key,Type_Ts>*> & tempPtr,
-                                vector<uint64_t> & tempBitmap, vector<uint64_t> & tempRetrainBitmap);
-    void retrain_insert_segments(Type_Key currentKey, SWseg<key_type,time_type>* currentPtr, bool currentIsRetrain,
-                                int &currentInsertionPos, int& dataIndex,
-                                vector<Type_Key> & tempKey, vector<SWseg<Type_Key,Type_Ts>*> & tempPtr,
-                                vector<uint64_t> & tempBitmap, vector<uint64_t> & tempRetrainBitmap);
-
-private: 
+    void flatten_partition_retrain(uint32_t threadID, Type_Ts expiryTime, vector<tuple<Type_Key,SWseg<Type_Key,Type_Ts>*,bool>> & segments);
+    double fit_partition_slope(const vector<tuple<Type_Key,SWseg<Type_Key,Type_Ts>*,bool>> & segments);
+    void layout_partition(uint32_t threadID, double slope, vector<tuple<Type_Key,SWseg<Type_Key,Type_Ts>*,bool>> & segments);
+
+    //Rebalancing helpers
+    void handoff(uint32_t threadID);
+    void migrate_segments(uint32_t fromID, uint32_t toID, Type_Key splitKey);
+    void split_segment(int index, Type_Key splitKey, Type_Ts expiryTime, vector<tuple<Type_Key,SWseg<Type_Key,Type_Ts>*,bool>> & segments);
+
+private:
     //Util helper functions
-    tuple<int,int,int> find_predict_pos_bound(Type_Key targetKey);
+    tuple<int,int,int> find_predict_pos_bound(uint32_t threadID, Type_Key targetKey);
     int exponential_search_right(vector<Type_Key> & keys, Type_Key targetKey, int normalizedStartingPos, int maxSearchBound);
     int exponential_search_right_insert(uint32_t threadID, vector<Type_Key> & keys, Type_Key targetKey, int normalizedStartingPos, int maxSearchBound);
     int exponential_search_left(vector<Type_Key> & keys, Type_Key targetKey, int normalizedStartingPos, int maxSearchBound);
     int exponential_search_left_insert(uint32_t threadID, vector<Type_Key> & keys, Type_Key targetKey, int normalizedStartingPos, int maxSearchBound);
 
-    uint32_t find_index_partition(int index);
     int find_first_segment_in_partition(uint32_t threadID);
     int find_last_segment_in_partition(uint32_t threadID);
-
-    int find_closest_gap(int index);
-    int find_closest_gap(int index, int leftBoundary, int rightBoundary);
     int find_closest_gap_within_thread(uint32_t threadID, int index);
 
-    void update_segment_with_neighbours(uint32_t threadID, int index, int startIndex, int endIndex);
+    void update_segment_with_neighbours(uint32_t threadID, int index);
     void update_keys_with_previous(uint32_t threadID, int index);
-
-    void flatten_partition_keys(vector<Type_Key> & data);
-
-    bool borrow_gap_position_from_end(uint32_t threadID, int & gapPos);
-    bool borrow_gap_position_from_begin(uint32_t threadID, int & gapPos);
     void update_seg_parent_index(uint32_t threadID, int startPos, int endPos, bool incrementFlag);
-    void update_seg_parent_index_normalized(uint32_t threadID, int startPos, int endPos, bool incrementFlag);
 
     void lock_thread(uint32_t threadID, unique_lock<mutex> & lock);
     void unlock_thread(uint32_t threadID, unique_lock<mutex> & lock);
 
+    //Per-instance parameters (compile-time constants with STATIC_PARAMS)
+    inline uint64_t time_window() const;
+    inline int max_buffer_size() const;
+    inline int initial_error() const;
+    inline Type_Ts calculate_expiry_time(Type_Ts timestamp) const;
+
 public:
     //Getters & Setters
     size_t get_meta_size();
     size_t get_no_seg();
+    size_t get_no_partitions() {return m_keys.size();}
     int get_split_error();
     void set_split_error(int error);
     void print();
@@ -163,91 +188,86 @@ public:
     void print_occupancy();
     uint64_t memory_usage();
     uint64_t get_no_keys(Type_Ts Timestamp);
+    uint64_t get_time_window() {return time_window();}
+    uint64_t get_auto_tune_size();
 
 private:
-    //Bitmap functions
-    bool bitmap_exists(int index) const;
+    //Bitmap functions (bitmaps of partition threadID)
+    bool bitmap_exists(uint32_t threadID, int index) const;
     bool bitmap_exists(vector<uint64_t> & bitmap, int index) const;
-    void bitmap_set_bit(int index);
+    void bitmap_set_bit(uint32_t threadID, int index);
     void bitmap_set_bit(vector<uint64_t> & bitmap, int index);
-    void bitmap_erase_bit(int index);
+    void bitmap_erase_bit(uint32_t threadID, int index);
     void bitmap_erase_bit(vector<uint64_t> & bitmap, int index);
 
-    int bitmap_closest_left_nongap(int index, int leftBoundary);
-    int bitmap_closest_right_nongap(int index, int rightBoundary);
-    int bitmap_closest_left_gap(int index, int leftBoundary);
-    int bitmap_closest_right_gap(int index, int rightBoundary);
-    int bitmap_closest_gap(int index);
-    int bitmap_closest_gap(int index, int leftBoundary, int rightBoundary);
-    pair<int,int> bitmap_retrain_range(int index);
-    void bitmap_move_bit_back(int startingIndex, int endingIndex);
+    int bitmap_closest_left_nongap(uint32_t threadID, int index, int leftBoundary);
+    int bitmap_closest_right_nongap(uint32_t threadID, int index, int rightBoundary);
+    int bitmap_closest_gap(uint32_t threadID, int index, int leftBoundary, int rightBoundary);
+    pair<int,int> bitmap_retrain_range(uint32_t threadID, int index);
+    void bitmap_move_bit_back(uint32_t threadID, int startingIndex, int endingIndex);
     void bitmap_move_bit_back(vector<uint64_t> & bitmap, int startingIndex, int endingIndex);
-    void bitmap_move_bit_front(int startingIndex, int endingIndex);
+    void bitmap_move_bit_front(uint32_t threadID, int startingIndex, int endingIndex);
     void bitmap_move_bit_front(vector<uint64_t> & bitmap, int startingIndex, int endingIndex);
+    void bitmap_summary_update(uint32_t threadID, int bitmapPos);
+    void bitmap_summary_update(uint32_t threadID, int startBitmapPos, int endBitmapPos);
+    void bitmap_summary_rebuild(uint32_t threadID);
+    int bitmap_summary_next(uint32_t threadID, const vector<uint64_t> & summary, uint64_t flip, int bitmapPos) const;
+    int bitmap_summary_prev(const vector<uint64_t> & summary, uint64_t flip, int bitmapPos) const;
 };
 
 /*
 Constructors & Deconstructors
 */
-template<class Type_Key, class Type_Ts> 
+template<class Type_Key, class Type_Ts>
 SWmeta<Type_Key,Type_Ts>::SWmeta()
-:m_rightSearchBound(0), m_leftSearchBound(0), m_numSeg(0), m_numSegExist(0), splitError(0), m_slope(-1), m_maxSearchError(0), 
- m_startKey(numeric_limits<Type_Key>::min()){}
+:splitError(0), m_handoffPending(false), m_handoffArrived(0){}
 
-template<class Type_Key, class Type_Ts> 
-SWmeta<Type_Key,Type_Ts>::SWmeta(int numThreads, const pair<Type_Key, Type_Ts> & arrivalTuple)
-:m_rightSearchBound(0), m_leftSearchBound(0), m_numSeg(0), m_numSegExist(0), m_slope(-1), m_maxSearchError(0), m_startKey(0)
+template<class Type_Key, class Type_Ts>
+SWmeta<Type_Key,Type_Ts>::SWmeta(int numThreads, const pair<Type_Key, Type_Ts> & arrivalTuple, const SWparams & params)
+:splitError(0), m_handoffPending(false), m_handoffArrived(0)
+#ifndef STATIC_PARAMS
+, m_params(params)
+#endif
 {
     #ifdef DEBUG
     DEBUG_ENTER_FUNCTION("SWmeta","Constructor(singleData)");
     #endif
 
-    SWseg<Type_Key,Type_Ts> * SWsegPtr = new SWseg<Type_Key,Type_Ts>(arrivalTuple);
-    SWsegPtr->m_leftSibling = nullptr;
-    SWsegPtr->m_rightSibling = nullptr;
-    SWsegPtr->m_parentIndex = 0;
+    SWseg<Type_Key,Type_Ts> * SWsegPtr = new SWseg<Type_Key,Type_Ts>(arrivalTuple, max_buffer_size());
+    vector<tuple<Type_Key,SWseg<Type_Key,Type_Ts>*,bool>> segments = {make_tuple(arrivalTuple.first, SWsegPtr, false)};
 
-    m_keys.push_back({arrivalTuple.first});
-    m_ptr.push_back({SWsegPtr});
+    //Single partition
+    init_partitions(1);
+    m_partitionStartKey[0] = arrivalTuple.first;
+    layout_partition(0, -1, segments);
 
-    m_startKey = arrivalTuple.first;
-    m_numSeg = 1;
-    m_numSegExist = 1;
-    m_bitmap.push_back(0);
-    m_retrainBitmap.push_back(0);
-    bitmap_set_bit(0);
-
-    m_partitionIndex.push_back(0);
-    m_parititonMaxTime.push_back(0);
-    m_partitionStartKey.push_back(m_startKey);
-
-    m_numSegPerPartition.push_back(1);
-    m_numSegExistsPerPartition.push_back(1);
-
-    splitError = INITIAL_ERROR;
+    splitError = initial_error();
 
     #ifdef DEBUG
     DEBUG_EXIT_FUNCTION("SWmeta","Constructor(singleData)");
     #endif
 }
 
-template<class Type_Key, class Type_Ts> 
-SWmeta<Type_Key,Type_Ts>::SWmeta(int numThreads, const vector<pair<Type_Key, Type_Ts>> & stream)
-:m_rightSearchBound(0), m_leftSearchBound(0), m_numSeg(0), m_numSegExist(0), m_slope(0), m_maxSearchError(0)
+template<class Type_Key, class Type_Ts>
+SWmeta<Type_Key,Type_Ts>::SWmeta(int numThreads, const vector<pair<Type_Key, Type_Ts>> & stream, const SWparams & params)
+:splitError(0), m_handoffPending(false), m_handoffArrived(0)
+#ifndef STATIC_PARAMS
+, m_params(params)
+#endif
 {
     #ifdef DEBUG
     DEBUG_ENTER_FUNCTION("SWmeta","Constructor(data)");
     #endif
 
     bulk_load(numThreads, stream);
-    splitError = INITIAL_ERROR;
+    splitError = initial_error();
 
     #ifdef DEBUG
     DEBUG_EXIT_FUNCTION("SWmeta","Constructor(data)");
     #endif
 }
 
-template<class Type_Key, class Type_Ts> 
+template<class Type_Key, class Type_Ts>
 SWmeta<Type_Key,Type_Ts>::~SWmeta()
 {
     #ifdef DEBUG
@@ -258,7 +278,7 @@ SWmeta<Type_Key,Type_Ts>::~SWmeta()
     {
         return;
     }
-    
+
     for (auto & partition: m_ptr)
     {
         for (auto & seg: partition)
@@ -271,6 +291,14 @@ SWmeta<Type_Key,Type_Ts>::~SWmeta()
         }
     }
 
+    for (auto & partition: m_deferredSeg)
+    {
+        for (auto & seg: partition)
+        {
+            delete get<1>(seg);
+        }
+    }
+
     #ifdef DEBUG
     DEBUG_EXIT_FUNCTION("SWmeta","Deconstructor");
     #endif
@@ -288,102 +316,16 @@ void SWmeta<Type_Key,Type_Ts>::bulk_load(int numThreads, const vector<pair<Type_
 
     vector<pair<Type_Key, Type_Ts>> data(stream);
 
-    sort(data.begin(), data.end());
+    parallel_sort(data.begin(), data.end(), less<pair<Type_Key, Type_Ts>>(), bulk_load_threads(data.size(), numThreads));
 
     vector<pair<Type_Key, SWseg<Type_Key,Type_Ts> * >> splitedDataPtr;
 
-    split_data(data, splitedDataPtr);
-
-    vector<Type_Key> tempKeys;
-    vector<SWseg<Type_Key,Type_Ts> *> tempPtr;
-
-    tempKeys.reserve(splitedDataPtr.size()*1.05);
-    tempPtr.reserve(splitedDataPtr.size()*1.05);
-
-    if (m_slope != -1)
-    {
-        int currentIndex = 1;
-        int currentInsertionPos = 0;
-        int predictedPos;
-
-        splitedDataPtr[0].second->m_parentIndex = currentInsertionPos;
-        ++currentInsertionPos;
-
-        tempKeys.push_back(splitedDataPtr[0].first);
-        tempPtr.push_back(splitedDataPtr[0].second);
-        m_startKey = splitedDataPtr[0].first;
-        m_numSegExist = splitedDataPtr.size();
-        m_bitmap.push_back(0);
-        m_retrainBitmap.push_back(0);
-        bitmap_set_bit(0);
-
-        while (currentIndex < splitedDataPtr.size())
-        {
-            predictedPos = static_cast<int>(floor(m_slope * ((double)splitedDataPtr[currentIndex].first - (double)m_startKey)));
-
-            if (static_cast<int>(currentInsertionPos >> 6) == m_bitmap.size())
-            {
-                m_bitmap.push_back(0);
-                m_retrainBitmap.push_back(0);
-            }
-
-            if(predictedPos == currentInsertionPos)
-            {
-                splitedDataPtr[currentIndex].second->m_parentIndex = currentInsertionPos;
-                
-                tempKeys.push_back(splitedDataPtr[currentIndex].first);
-                tempPtr.push_back(splitedDataPtr[currentIndex].second);
-                bitmap_set_bit(currentInsertionPos);
-
-                ++currentIndex;
-            }
-            else if (predictedPos < currentInsertionPos)
-            {
-                splitedDataPtr[currentIndex].second->m_parentIndex = currentInsertionPos;
-                
-                tempKeys.push_back(splitedDataPtr[currentIndex].first);
-                tempPtr.push_back(splitedDataPtr[currentIndex].second);
-                bitmap_set_bit(currentInsertionPos);
-
-                m_rightSearchBound = (currentInsertionPos - predictedPos) > m_rightSearchBound.load() 
-                                    ? (currentInsertionPos - predictedPos) : m_rightSearchBound.load();
-                
-                ++currentIndex;
-            }
-            else
-            {
-                tempKeys.push_back(tempKeys.back());
-                tempPtr.push_back(nullptr);
-            }
-            ++currentInsertionPos;
-        }   
-        m_rightSearchBound += 1;
-        m_numSeg = tempKeys.size();
-        m_maxSearchError = min(8192,(int)ceil(0.6*m_numSeg));
-    }
-    else //Single Segment in SWmeta
-    {        
-        int bitmapSize = ceil(MAX_BUFFER_SIZE/64.);
-        vector<uint64_t> temp(bitmapSize,0);
-        
-        m_startKey = splitedDataPtr[0].first;
-        m_numSeg = 1;
-        m_numSegExist = 1;
-        m_bitmap = temp;
-        m_retrainBitmap = temp;
-        bitmap_set_bit(0);
-        
-        splitedDataPtr[0].second->m_parentIndex = 0;
-        tempKeys.push_back(splitedDataPtr[0].first);
-        tempPtr.push_back(splitedDataPtr[0].second);
-    }
-    tempKeys.shrink_to_fit();
-    tempPtr.shrink_to_fit();
+    double slope = split_data(numThreads, data, splitedDataPtr);
 
     #if PARTITION_METHOD == 0
-    partition_data_into_threads(numThreads, tempKeys, tempPtr);
+    partition_data_into_threads(numThreads, slope, splitedDataPtr);
     #elif PARTITION_METHOD == 1
-    partition_data_into_threads_no_empty(numThreads, tempKeys, tempPtr);
+    partition_data_into_threads_no_empty(numThreads, splitedDataPtr);
     #else
     ASSERT_MESSAGE( 1 == 0, "PARTITION_METHOD is not defined, either 0 or 1")
     #endif
@@ -393,190 +335,123 @@ void SWmeta<Type_Key,Type_Ts>::bulk_load(int numThreads, const vector<pair<Type_
     #endif
 }
 
+//Returns the slope of a single meta model over all segments (-1 for a single segment)
 template<class Type_Key, class Type_Ts>
-void SWmeta<Type_Key,Type_Ts>::split_data(const vector<pair<Type_Key,Type_Ts>> & data, 
+double SWmeta<Type_Key,Type_Ts>::split_data(int numThreads, const vector<pair<Type_Key,Type_Ts>> & data,
                                 vector<pair<Type_Key, SWseg<Type_Key,Type_Ts> * >> & splitedDataPtr)
-{  
+{
     #ifdef DEBUG
     DEBUG_ENTER_FUNCTION("SWmeta","split_data");
     #endif
 
+    //A segment per thread at least, so that small windows still give every thread a partition (and rebalance a boundary)
+    int minSegments = numThreads;
+    numThreads = bulk_load_threads(data.size(), numThreads);
+
     vector<tuple<int,int,double>> splitIndexSlopeVector;
-    calculate_split_derivative((int)(TIME_WINDOW * 0.00001), data, splitIndexSlopeVector);
+    calculate_split_derivative(max(minSegments,(int)(time_window() * 0.00001)), data, splitIndexSlopeVector, numThreads);
 
-    if (splitIndexSlopeVector.size() != 1)
+    //The derivative split keeps split points apart and can give fewer segments, halve the largest (the slope still fits)
+    while (splitIndexSlopeVector.size() < minSegments)
     {
-        Type_Key firstKey = data[get<0>(splitIndexSlopeVector.front())].first;
-        double normalizedKey = 0, sumKey = 0, sumIndex = 0, sumKeyIndex = 0, sumKeySquared = 0;
-        int cnt = 0;
-        
-        for (auto it = splitIndexSlopeVector.begin(); it != splitIndexSlopeVector.end()-1; it++)
+        auto largest = max_element(splitIndexSlopeVector.begin(), splitIndexSlopeVector.end(), 
+                        [](const tuple<int,int,double> & a, const tuple<int,int,double> & b){return get<1>(a)-get<0>(a) < get<1>(b)-get<0>(b);});
+        if (get<1>(*largest) == get<0>(*largest))
         {
-            SWseg<Type_Key,Type_Ts> * SWsegPtr = new SWseg<Type_Key,Type_Ts>(get<0>(*it), get<1>(*it) ,get<2>(*it), data);
-            if(splitedDataPtr.size() > 0)
-            {
-                SWsegPtr->m_leftSibling = splitedDataPtr[splitedDataPtr.size() - 1].second;
-                splitedDataPtr[splitedDataPtr.size() - 1].second->m_rightSibling = SWsegPtr;
-            }
-            splitedDataPtr.push_back(make_pair( data[get<0>(*it)].first, SWsegPtr));
-
-            normalizedKey = (double)data[get<0>(*it)].first - (double)firstKey;
-            sumKey += normalizedKey;
-            sumIndex += cnt;
-            sumKeyIndex += normalizedKey * cnt;
-            sumKeySquared += pow(normalizedKey,2);
-            ++cnt;
+            break;
         }
+        int middle = get<0>(*largest) + (get<1>(*largest) - get<0>(*largest)) / 2;
+        tuple<int,int,double> upperHalf = make_tuple(middle+1, get<1>(*largest), get<2>(*largest));
+        get<1>(*largest) = middle;
+        splitIndexSlopeVector.insert(largest+1, upperHalf);
+    }
 
-        //Dealing with last segment with only one point
-        if (get<0>(splitIndexSlopeVector.back())  != get<1>(splitIndexSlopeVector.back()))
-        {
-            SWseg<Type_Key,Type_Ts> * SWsegPtr = new SWseg<Type_Key,Type_Ts>(get<0>(splitIndexSlopeVector.back()), get<1>(splitIndexSlopeVector.back()) ,get<2>(splitIndexSlopeVector.back()), data);
-            if(splitedDataPtr.size() > 0)
-            {
-                SWsegPtr->m_leftSibling = splitedDataPtr[splitedDataPtr.size() - 1].second;
-                splitedDataPtr[splitedDataPtr.size() - 1].second->m_rightSibling = SWsegPtr;
-            }
-            splitedDataPtr.push_back(make_pair( data[get<0>(splitIndexSlopeVector.back())].first, SWsegPtr));
-
-            normalizedKey = (double)data[get<0>(splitIndexSlopeVector.back())].first - (double)firstKey;
-            sumKey += normalizedKey;
-            sumIndex += cnt;
-            sumKeyIndex += normalizedKey * cnt;
-            sumKeySquared += pow(normalizedKey,2);
-            ++cnt;
-        }
-        else //Single Point 
-        {        
-            SWseg<Type_Key,Type_Ts> * SWsegPtr = new SWseg<Type_Key,Type_Ts>(data.back());
-            if(splitedDataPtr.size() > 0)
-            {
-                SWsegPtr->m_leftSibling = splitedDataPtr[splitedDataPtr.size() - 1].second;
-                splitedDataPtr[splitedDataPtr.size() - 1].second->m_rightSibling = SWsegPtr;
-            }
-            splitedDataPtr.push_back(make_pair( data.back().first, SWsegPtr));
-
-            normalizedKey = (double)data.back().first - (double)firstKey;
-            sumKey += normalizedKey;
-            sumIndex += cnt;
-            sumKeyIndex += normalizedKey * cnt;
-            sumKeySquared += pow(normalizedKey,2);
-            ++cnt;
-        }
+    //Static schedule: each thread builds the SWseg of a contiguous key range, roughly the partition it later serves
+    vector<SWseg<Type_Key,Type_Ts> *> segPtr(splitIndexSlopeVector.size());
 
-        m_slope =  (sumKeyIndex - sumKey *(sumIndex/cnt))/(sumKeySquared - sumKey*(sumKey/cnt)) * 1.05;
-    }
-    else //Single Segment in SWmeta
+    #pragma omp parallel for num_threads(numThreads) schedule(static)
+    for (int i = 0; i < segPtr.size(); i++)
     {
-        if (get<0>(splitIndexSlopeVector[0]) != get<1>(splitIndexSlopeVector[0]))
+        auto & split = splitIndexSlopeVector[i];
+
+        //Dealing with last segment with only one point
+        if (i == segPtr.size()-1 && get<0>(split) == get<1>(split))
         {
-            SWseg<Type_Key,Type_Ts> * SWsegPtr = new SWseg<Type_Key,Type_Ts>(get<0>(splitIndexSlopeVector[0]), get<1>(splitIndexSlopeVector[0]), get<2>(splitIndexSlopeVector[0]), data);
-            splitedDataPtr.push_back(make_pair( data[get<0>(splitIndexSlopeVector[0])].first, SWsegPtr));
+            segPtr[i] = new SWseg<Type_Key,Type_Ts>(data.back(), max_buffer_size());
         }
         else
         {
-            printf("WARNING: entire data is one point \n");
-            SWseg<Type_Key,Type_Ts> * SWsegPtr = new SWseg<Type_Key,Type_Ts>(data.back());
-            splitedDataPtr.push_back(make_pair( data.back().first, SWsegPtr));
+            segPtr[i] = new SWseg<Type_Key,Type_Ts>(get<0>(split), get<1>(split), get<2>(split), data, max_buffer_size());
         }
-        m_slope = -1;
     }
 
-    if (splitedDataPtr.front().second->m_leftSibling != nullptr)
+    if (segPtr.size() == 1 && get<0>(splitIndexSlopeVector[0]) == get<1>(splitIndexSlopeVector[0]))
     {
-        printf("WARNING: left sibling of first segment not null \n");
+        printf("WARNING: entire data is one point \n");
     }
 
-    if (splitedDataPtr.back().second->m_rightSibling != nullptr)
+    Type_Key firstKey = data[get<0>(splitIndexSlopeVector.front())].first;
+    double normalizedKey = 0, sumKey = 0, sumIndex = 0, sumKeyIndex = 0, sumKeySquared = 0;
+    int cnt = 0;
+
+    for (int i = 0; i < segPtr.size(); i++)
     {
-        printf("WARNING: right sibling of last segmentnot null \n");
+        Type_Key startKey = data[get<0>(splitIndexSlopeVector[i])].first;
+        splitedDataPtr.push_back(make_pair(startKey, segPtr[i]));
+
+        normalizedKey = (double)startKey - (double)firstKey;
+        sumKey += normalizedKey;
+        sumIndex += cnt;
+        sumKeyIndex += normalizedKey * cnt;
+        sumKeySquared += pow(normalizedKey,2);
+        ++cnt;
     }
 
+    //Single Segment in SWmeta
+    double slope = (segPtr.size() != 1) ? (sumKeyIndex - sumKey *(sumIndex/cnt))/(sumKeySquared - sumKey*(sumKey/cnt)) * 1.05 : -1;
+
     #ifdef DEBUG
     DEBUG_EXIT_FUNCTION("SWmeta","split_data");
     #endif
+
+    return slope;
 }
 
 /*
 Parition data for threads
 */
+//Equal split of the slots a single meta model would give the segments, each partition then fits its own model
 template<class Type_Key, class Type_Ts>
-void SWmeta<Type_Key,Type_Ts>::partition_data_into_threads(int numThreads, vector<Type_Key> & keys, vector<SWseg<Type_Key,Type_Ts>*> & ptr)
+void SWmeta<Type_Key,Type_Ts>::partition_data_into_threads(int numThreads, double slope, vector<pair<Type_Key, SWseg<Type_Key,Type_Ts> * >> & splitedDataPtr)
 {
     #ifdef DEBUG
     DEBUG_ENTER_FUNCTION("SWmeta","partition_data_into_threads");
     #endif
 
-    if (m_numSeg == 1 || m_slope == -1)
-    {
-        m_partitionIndex = {0};
-
-        m_parititonMaxTime = {0};
-        m_partitionStartKey = {m_startKey};
-
-        m_numSegPerPartition = {1};
-        m_numSegExistsPerPartition = {1};
-        return;
-    }
-
-    //Equal Split Segments into Threads (Simple Partitioning)
-    int numSegmentsPerThread = m_numSeg / numThreads;
-    int maxPartitionSize = numSegmentsPerThread;
+    int numSegments = splitedDataPtr.size();
+    int numPartitions = min(numThreads, numSegments); //A segment at least in each partition
+    vector<int> firstSegment(numPartitions, 0);
 
-    m_partitionStartKey = vector<Type_Key>(numThreads);
-    m_partitionIndex = vector<int>(numThreads);
-
-    for (int i = 0; i < numThreads; ++i)
+    if (numPartitions > 1)
     {
-        int index = numSegmentsPerThread*i; //Starting index must be non-negative (or else the key may be same as max key in previous partition)
-
-        if (ptr[index] == nullptr)
-        {
-            index = bitmap_closest_right_nongap(index,(i == numThreads-1)? m_numSeg-1 : numSegmentsPerThread*(i+1)-1); //TODO: this prevents the position from being a gap.
-            ASSERT_MESSAGE(index != -1, "foundPos is -1, entire partition contains empty segments");
-        }
-
-        if (i != 0)
+        //Slot of each segment in the single model (right after the previous segment when predicted before it)
+        vector<int> slotIndex(numSegments, 0);
+        Type_Key startKey = splitedDataPtr[0].first;
+        for (int i = 1; i < numSegments; ++i)
         {
-            maxPartitionSize = max(maxPartitionSize, ((i == numThreads-1)? m_numSeg.load(): index)- m_partitionIndex[i-1]);
+            int predictedPos = static_cast<int>(floor(slope * ((double)splitedDataPtr[i].first - (double)startKey)));
+            slotIndex[i] = max(predictedPos, slotIndex[i-1]+1);
         }
-        m_partitionIndex[i] = index;
-        m_partitionStartKey[i] = ptr[index]->m_currentNodeStartKey; 
-    }
-
-    //Insert into partitioned m_keys and m_ptr
-    m_keys = vector<vector<Type_Key>>(numThreads,vector<Type_Key>());
-    m_ptr = vector<vector<SWseg<Type_Key,Type_Ts>*>>(numThreads,vector<SWseg<Type_Key,Type_Ts>*>());
-    m_parititonMaxTime = vector<Type_Ts>(numThreads,1); //No need to update, since used for retrain
-    m_numSegPerPartition = vector<int>(numThreads);
-    m_numSegExistsPerPartition = vector<int>(numThreads);
-
-    for (int i = 0; i < numThreads; ++i)
-    {
-        int startIndex = m_partitionIndex[i];
-        int endIndex = (i == numThreads-1)? m_numSeg-1 : m_partitionIndex[i+1]-1;
-
-        int partNumSeg = 0;
-        int partNumSegExists = 0;
 
-        m_keys[i].reserve(maxPartitionSize);
-        m_ptr[i].reserve(maxPartitionSize);
-
-        for (int currentIndex = startIndex; currentIndex <= endIndex; ++ currentIndex)
+        int numSlotsPerThread = (slotIndex.back()+1) / numPartitions;
+        for (int i = 1; i < numPartitions; ++i)
         {
-            m_keys[i].push_back(keys[currentIndex]);
-            m_ptr[i].push_back(ptr[currentIndex]);
-
-            if (ptr[currentIndex] != nullptr) { ++partNumSegExists;}
-            ++partNumSeg;
+            int index = lower_bound(slotIndex.begin(), slotIndex.end(), numSlotsPerThread*i) - slotIndex.begin();
+            firstSegment[i] = min(max(index, firstSegment[i-1]+1), numSegments-(numPartitions-i));
         }
-
-        m_numSegPerPartition[i] = partNumSeg;
-        m_numSegExistsPerPartition[i] = partNumSegExists;
     }
 
-    keys.clear();
-    ptr.clear();
+    build_partitions(firstSegment, splitedDataPtr);
 
     #ifdef DEBUG
     DEBUG_EXIT_FUNCTION("SWmeta","partition_data_into_threads");
@@ -585,83 +460,81 @@ void SWmeta<Type_Key,Type_Ts>::partition_data_into_threads(int numThreads, vecto
 
 //Partition based on actual number of segments
 template<class Type_Key, class Type_Ts>
-void SWmeta<Type_Key,Type_Ts>::partition_data_into_threads_no_empty(int numThreads, vector<Type_Key> & keys, vector<SWseg<Type_Key,Type_Ts>*> & ptr)
+void SWmeta<Type_Key,Type_Ts>::partition_data_into_threads_no_empty(int numThreads, vector<pair<Type_Key, SWseg<Type_Key,Type_Ts> * >> & splitedDataPtr)
 {
     #ifdef DEBUG
     DEBUG_ENTER_FUNCTION("SWmeta","partition_data_into_threads_no_empty");
     #endif
 
-    if (m_numSeg == 1 || m_slope == -1)
-    {
-        m_partitionIndex = {0};
-
-        m_parititonMaxTime = {0};
-        m_partitionStartKey = {m_startKey};
+    int numSegments = splitedDataPtr.size();
+    int numPartitions = min(numThreads, numSegments);
+    int numSegmentsPerThread = numSegments / numPartitions;
 
-        m_numSegPerPartition = {1};
-        m_numSegExistsPerPartition = {1};
-        return;
+    vector<int> firstSegment(numPartitions);
+    for (int i = 0; i < numPartitions; ++i)
+    {
+        firstSegment[i] = numSegmentsPerThread*i;
     }
 
-    //Insert into partitioned m_keys and m_ptr
-    m_keys = vector<vector<Type_Key>>(numThreads,vector<Type_Key>());
-    m_ptr = vector<vector<SWseg<Type_Key,Type_Ts>*>>(numThreads,vector<SWseg<Type_Key,Type_Ts>*>());
-    m_parititonMaxTime = vector<Type_Ts>(numThreads,1); //No need to update, since used for retrain
-    m_numSegPerPartition = vector<int>(numThreads);
-    m_numSegExistsPerPartition = vector<int>(numThreads);
-    m_partitionIndex = vector<int>(numThreads);
-    m_partitionStartKey = vector<Type_Key>(numThreads);
+    build_partitions(firstSegment, splitedDataPtr);
 
-    int numEstimateSegmentsPerThread = m_numSeg / numThreads;
-    for (int i = 0; i < numThreads; ++i )
-    {
-        m_keys[i].reserve(numEstimateSegmentsPerThread);
-        m_ptr[i].reserve(numEstimateSegmentsPerThread);
-        m_numSegPerPartition[i] = 0;
-        m_numSegExistsPerPartition[i] = 0;
-    }
-    
-    int numActualSegmentPerThread = m_numSegExist / numThreads;
-    int currentThread = 0;
+    #ifdef DEBUG
+    DEBUG_EXIT_FUNCTION("SWmeta","partition_data_into_threads_no_empty");
+    #endif
+}
 
-    ASSERT_MESSAGE(ptr[0] != nullptr, "first segment is a gap (ptr[0] is null)");
-    m_partitionIndex[0] = 0;
-    m_partitionStartKey[0] = ptr[0]->m_currentNodeStartKey;
+//Partition i gets the segments [firstSegment[i], firstSegment[i+1]) and fits its own model to them
+template<class Type_Key, class Type_Ts>
+void SWmeta<Type_Key,Type_Ts>::build_partitions(const vector<int> & firstSegment, vector<pair<Type_Key, SWseg<Type_Key,Type_Ts> * >> & splitedDataPtr)
+{
+    int numPartitions = firstSegment.size();
+    init_partitions(numPartitions);
 
-    for (int i = 0; i < m_numSeg-1; ++i)
-    {        
-        m_keys[currentThread].push_back(keys[i]);
-        m_ptr[currentThread].push_back(ptr[i]);
-        ++m_numSegPerPartition[currentThread];
+    #pragma omp parallel for num_threads(bulk_load_threads(splitedDataPtr.size(), numPartitions)) schedule(static)
+    for (int i = 0; i < numPartitions; ++i)
+    {
+        int endSegment = (i == numPartitions-1) ? splitedDataPtr.size() : firstSegment[i+1];
 
-        if (ptr[i] != nullptr)
+        vector<tuple<Type_Key,SWseg<Type_Key,Type_Ts>*,bool>> segments;
+        segments.reserve(endSegment - firstSegment[i]);
+        for (int j = firstSegment[i]; j < endSegment; ++j)
         {
-            ++m_numSegExistsPerPartition[currentThread];
+            segments.push_back(make_tuple(splitedDataPtr[j].first, splitedDataPtr[j].second, false));
         }
 
-        if (currentThread != numThreads-1 && ptr[i+1] != nullptr &&
-            m_numSegExistsPerPartition[currentThread] >= numActualSegmentPerThread)
-        {
-            ++currentThread;
-            m_partitionIndex[currentThread] = i+1;
-            m_partitionStartKey[currentThread] = ptr[i+1]->m_currentNodeStartKey;
-        }
+        m_partitionStartKey[i] = splitedDataPtr[firstSegment[i]].first;
+        layout_partition(i, fit_partition_slope(segments), segments);
     }
 
-    m_keys[currentThread].push_back(keys.back());
-    m_ptr[currentThread].push_back(ptr.back());
-    ++m_numSegPerPartition[currentThread];
-    if (ptr.back() != nullptr)
-    {
-        ++m_numSegExistsPerPartition[currentThread];
-    }
+    splitedDataPtr.clear();
+}
 
-    keys.clear();
-    ptr.clear();
+template<class Type_Key, class Type_Ts>
+void SWmeta<Type_Key,Type_Ts>::init_partitions(int numPartitions)
+{
+    m_rightSearchBound = vector<int>(numPartitions,0);
+    m_leftSearchBound = vector<int>(numPartitions,0);
+    m_maxSearchError = vector<int>(numPartitions,0);
+    m_startKey = vector<Type_Key>(numPartitions,0);
+    m_slope = vector<double>(numPartitions,-1);
 
-    #ifdef DEBUG
-    DEBUG_EXIT_FUNCTION("SWmeta","partition_data_into_threads_no_empty");
-    #endif
+    m_parititonMaxTime = vector<Type_Ts>(numPartitions,0);
+    vector<atomic<Type_Key>>(numPartitions).swap(m_partitionStartKey);
+    vector<atomic<int>>(numPartitions).swap(m_partitionNumSeg);
+    m_numSegPerPartition = vector<int>(numPartitions,0);
+    m_numSegExistsPerPartition = vector<int>(numPartitions,0);
+
+    m_retrainStatus = vector<int>(numPartitions,0);
+    m_deferredSeg = vector<vector<tuple<Type_Key,SWseg<Type_Key,Type_Ts>*,bool>>>(numPartitions);
+
+    m_bitmap = vector<vector<uint64_t>>(numPartitions);
+    m_retrainBitmap = vector<vector<uint64_t>>(numPartitions);
+    m_keys = vector<vector<Type_Key>>(numPartitions);
+    m_bitmapSummary = vector<vector<uint64_t>>(numPartitions);
+    m_bitmapFullSummary = vector<vector<uint64_t>>(numPartitions);
+    m_ptr = vector<vector<SWseg<Type_Key,Type_Ts>*>>(numPartitions);
+
+    m_partitionLock.reset(new SWlock[numPartitions]);
 }
 
 /*
@@ -674,22 +547,8 @@ uint32_t  SWmeta<Type_Key,Type_Ts>::predict_thread(Type_Key key)
     DEBUG_ENTER_FUNCTION("SWmeta","predict_thread(key)");
     #endif
 
-    if (m_numSeg == 1 || m_slope == -1)
-    {
-        return 0; 
-    }
-
-    int threadID = 0;
-    for (int i = 1; i < m_partitionIndex.size(); ++i)
-    {
-        if (key < m_partitionStartKey[i])
-        {
-            break;
-        }
-        ++threadID;
-    }
-
-    return threadID;
+    //Last partition starting at or before key (start keys are sorted)
+    return upper_bound(m_partitionStartKey.begin()+1, m_partitionStartKey.end(), key) - (m_partitionStartKey.begin()+1);
 
     #ifdef DEBUG
     DEBUG_EXIT_FUNCTION("SWmeta","predict_thread(key)");
@@ -703,35 +562,37 @@ uint32_t SWmeta<Type_Key,Type_Ts>::predict_thread(Type_Key key, tuple<bool,int,i
     DEBUG_ENTER_FUNCTION("SWmeta","predict_thread(key, predictBound for meta)");
     #endif
 
-    if (m_numSeg == 1 || m_slope == -1)
-    {
-        predictBound = make_tuple(false,0,0,m_numSeg-1);
-        return 0;
-    }
+    uint32_t threadID = predict_thread(key);
+    predict_bound_in_thread(threadID, key, predictBound);
+    return threadID;
+
+    #ifdef DEBUG
+    DEBUG_EXIT_FUNCTION("SWmeta","predict_thread(key, predictBound for meta)");
+    #endif
+}
 
-    tuple<int,int,int> predictPosBound = find_predict_pos_bound(key);
+//Search bound of key in the slots of partition threadID (key belongs to the partition)
+template<class Type_Key, class Type_Ts>
+void SWmeta<Type_Key,Type_Ts>::predict_bound_in_thread(uint32_t threadID, Type_Key key, tuple<bool,int,int,int> & predictBound)
+{
+    int endIndex = m_numSegPerPartition[threadID]-1;
 
-    int threadID = 0;
-    for (int i = 1; i < m_partitionIndex.size(); ++i)
+    if (m_slope[threadID] == -1 || endIndex <= 0)
     {
-        if (key < m_partitionStartKey[i])
-        {
-            break;
-        }
-        ++threadID;
+        predictBound = make_tuple(false, 0, 0, max(endIndex,0));
+        return;
     }
 
-    int startIndex = m_partitionIndex[threadID];
-    int endIndex = (threadID == m_partitionIndex.size()-1)? m_numSeg-1 : m_partitionIndex[threadID+1]-1;
+    tuple<int,int,int> predictPosBound = find_predict_pos_bound(threadID, key);
 
-    int startPredictBound = max(startIndex,get<1>(predictPosBound));
-    int endPredictBound = min(endIndex,get<2>(predictPosBound)); 
+    int startPredictBound = get<1>(predictPosBound);
+    int endPredictBound = get<2>(predictPosBound);
 
-     if (endPredictBound <= startPredictBound)
+    if (endPredictBound <= startPredictBound)
     {
-        if (startPredictBound == startIndex)
+        if (startPredictBound == 0)
         {
-            predictBound = make_tuple(false, get<0>(predictPosBound), startIndex, startIndex);
+            predictBound = make_tuple(false, get<0>(predictPosBound), 0, 0);
         }
         else if (endPredictBound == endIndex)
         {
@@ -746,15 +607,9 @@ uint32_t SWmeta<Type_Key,Type_Ts>::predict_thread(Type_Key key, tuple<bool,int,i
     }
     else
     {
-        bool expSearchFlag = (startIndex <= get<0>(predictPosBound) && get<0>(predictPosBound) <= endIndex);
+        bool expSearchFlag = (get<0>(predictPosBound) <= endIndex);
         predictBound = make_tuple(expSearchFlag, get<0>(predictPosBound), startPredictBound, endPredictBound);
     }
-
-    return threadID;
-
-    #ifdef DEBUG
-    DEBUG_EXIT_FUNCTION("SWmeta","predict_thread(key, predictBound for meta)");
-    #endif
 }
 
 template<class Type_Key, class Type_Ts>
@@ -765,16 +620,10 @@ vector<uint32_t>  SWmeta<Type_Key,Type_Ts>::predict_thread(Type_Key lowerBound,
     DEBUG_ENTER_FUNCTION("SWmeta","predict_thread(lowerBound,upperBound,predictBound)");
     #endif
 
-    if (m_numSeg == 1 || m_slope == -1)
-    {
-        predictBound.push_back(make_tuple(false,0,0,m_numSeg-1));
-        return {0};
-    }
-
     tuple<bool,int,int,int> singlePredictBound;
     uint32_t lowerBoundThread = predict_thread(lowerBound,singlePredictBound);
     uint32_t upperBoundThread = predict_thread(upperBound);
-    
+
     vector<uint32_t> threadList = {lowerBoundThread};
     threadList.reserve(upperBoundThread - lowerBoundThread + 1);
     predictBound.reserve(upperBoundThread - lowerBoundThread + 1);
@@ -782,10 +631,7 @@ vector<uint32_t>  SWmeta<Type_Key,Type_Ts>::predict_thread(Type_Key lowerBound,
 
     for (int i = lowerBoundThread+1; i <= upperBoundThread; ++i)
     {
-        predictBound.push_back(make_tuple(false,-1,
-                        (i == 0)? 0 : m_partitionIndex[i],
-                        (i == m_partitionIndex.size()-1)? m_numSeg-1 : m_partitionIndex[i+1]-1));
-
+        predictBound.push_back(make_tuple(false,-1,0,m_numSegPerPartition[i]-1));
         threadList.push_back(i);
     }
 
@@ -808,57 +654,12 @@ bool SWmeta<Type_Key,Type_Ts>::within_thread(uint32_t threadID, Type_Key key, tu
     DEBUG_ENTER_FUNCTION("SWmeta","within_thread(key)");
     #endif
 
-    if (m_numSeg == 1 || m_slope == -1)
-    {
-        predictBound = make_tuple(false,0, 0, m_numSeg-1);
-        return (threadID == 0);
-    }
-
-    int threadIDFound = 0;
-    for (int i = 1; i < m_partitionIndex.size(); ++i)
-    {
-        if (key < m_partitionStartKey[i])
-        {
-            break;
-        }
-        ++threadIDFound;
-    }
-
-    if (threadID != threadIDFound) {return false;}
-
-    tuple<int,int,int> predictPosBound = find_predict_pos_bound(key);
+    if (threadID >= m_keys.size() || threadID != predict_thread(key)) {return false;}
 
-    int startIndex = m_partitionIndex[threadID];
-    int endIndex = (threadID == m_partitionIndex.size()-1)? m_numSeg-1 : m_partitionIndex[threadID+1]-1;
-
-    int startPredictBound = max(startIndex,get<1>(predictPosBound));
-    int endPredictBound = min(endIndex,get<2>(predictPosBound)); 
-
-    if (endPredictBound <= startPredictBound)
-    {
-        if (startPredictBound == startIndex)
-        {
-            predictBound = make_tuple(false, get<0>(predictPosBound), startIndex, startIndex);
-        }
-        else if (endPredictBound == endIndex)
-        {
-            predictBound = make_tuple(false, get<0>(predictPosBound), endIndex, endIndex);
-        }
-        else
-        {
-            LOG_ERROR("SWmeta [within_thread] : endPredictBound (%i) <= startPredictBound (%i) but not at start or end of thread \n",
-                            endPredictBound, startPredictBound);
-            abort();
-        }
-    }
-    else
-    {
-        bool expSearchFlag = (startIndex <= get<0>(predictPosBound) && get<0>(predictPosBound) <= endIndex);
-        predictBound = make_tuple(expSearchFlag, get<0>(predictPosBound), startPredictBound, endPredictBound);
-    }
+    predict_bound_in_thread(threadID, key, predictBound);
     return true;
 
-    
+
     #ifdef DEBUG
     DEBUG_EXIT_FUNCTION("SWmeta","within_thread");
     #endif
@@ -877,14 +678,9 @@ bool SWmeta<Type_Key,Type_Ts>::within_thread(uint32_t threadID, Type_Key lowerBo
         return within_thread(threadID,lowerBound,predictBound);
     }
 
-    if (m_numSeg == 1 || m_slope == -1)
-    {
-        predictBound = make_tuple(false,0, 0, m_numSeg-1);
-        return (threadID == 0);
-    }
+    if (threadID >= m_keys.size()) {return false;}
 
-    tuple<bool,int,int,int> predictBoundLower;
-    uint32_t lowerBoundThread = predict_thread(lowerBound,predictBoundLower);
+    uint32_t lowerBoundThread = predict_thread(lowerBound);
     uint32_t upperBoundThread = predict_thread(upperBound);
     ASSERT_MESSAGE(lowerBoundThread <= upperBoundThread, "SWmeta [within_thread] : lowerBoundThread > upperBoundThread \n");
 
@@ -892,13 +688,11 @@ bool SWmeta<Type_Key,Type_Ts>::within_thread(uint32_t threadID, Type_Key lowerBo
     {
         if (threadID == lowerBoundThread)
         {
-            predictBound = predictBoundLower;
+            predict_bound_in_thread(threadID, lowerBound, predictBound);
         }
         else
         {
-            predictBound = make_tuple(false,-1,
-                        m_partitionIndex[threadID],
-                        (threadID == m_partitionIndex.size()-1)? m_numSeg-1 : m_partitionIndex[threadID+1]-1);
+            predictBound = make_tuple(false,-1,0,m_numSegPerPartition[threadID]-1);
         }
         return true;
     }
@@ -912,123 +706,286 @@ bool SWmeta<Type_Key,Type_Ts>::within_thread(uint32_t threadID, Type_Key lowerBo
     #endif
 }
 
-
 /*
-Lookup
+Task Routing
+Used with SWrouter: each task goes to the partitions owning its keys instead of every worker
 */
+//Calls visitor(threadID, task) for the partition owning a point task, or for every partition a range task overlaps
+//with the range clipped to the partition
 template<class Type_Key, class Type_Ts>
-int SWmeta<Type_Key,Type_Ts>::lookup(uint32_t threadID, Type_Key key, Type_Ts timestamp, tuple<bool,int,int,int> & predictBound)
+template<class Visitor>
+void SWmeta<Type_Key,Type_Ts>::route(const SWtask<Type_Key,Type_Ts> & task, Visitor && visitor)
 {
-    #ifdef DEBUG
-    DEBUG_ENTER_FUNCTION("SWmeta","lookup");
-    #endif
-
-    #if defined(DEBUG_KEY) || defined(DEBUG_TS) 
-    if(DEBUG_KEY == key) 
+    if (task.status != task_status::SEARCH || task.lowerBound == task.upperBound)
     {
-        DEBUG_ENTER_FUNCTION("SWmeta","lookup");
+        visitor(predict_thread(task.lowerBound), task);
+        return;
     }
-    #endif
 
-    int count = 0;
-    int startIndex = m_partitionIndex[threadID];
-    tuple<pswix::seg_update_type,int,Type_Key> updateSeg = make_tuple(pswix::seg_update_type::NONE,0,0);
-    Type_Ts expiryTime =  ((double)timestamp - TIME_WINDOW < numeric_limits<Type_Ts>::min()) ? numeric_limits<Type_Ts>::min(): timestamp - TIME_WINDOW;
-    
-    unique_lock<mutex> lock(thread_lock[threadID]);
-    lock_thread(threadID, lock);
+    uint32_t lowerBoundThread = predict_thread(task.lowerBound);
+    uint32_t upperBoundThread = max(predict_thread(task.upperBound), lowerBoundThread);
 
-    if (m_numSeg == 1)
-    {
-        count = m_ptr[0][0]->lookup(0,m_numSeg-1,key,expiryTime,updateSeg);
-    }
-    else
+    //Each start key is read once, so the parts cover the range even if a handoff moves a boundary meanwhile
+    //(a part given to its old owner is rerouted by execute)
+    SWtask<Type_Key,Type_Ts> partitionTask = task;
+    for (uint32_t threadID = lowerBoundThread; threadID <= upperBoundThread; ++threadID)
     {
-        int foundPos;
-        if (threadID == 0 && key < m_startKey)
-        {
-            foundPos = 0; 
-        }
-        else
+        if (threadID < upperBoundThread)
         {
-            if (m_slope != -1)
+            Type_Key nextStartKey = m_partitionStartKey[threadID+1];
+            if (nextStartKey <= partitionTask.lowerBound) //Empty partition
             {
-                foundPos = meta_model_search(threadID, key, predictBound);
+                continue;
             }
-            else
-            {
-                foundPos = meta_non_model_search(threadID, key, predictBound);
-            }
-        }
+            partitionTask.upperBound = min(task.upperBound, (Type_Key)(nextStartKey-1));
+            visitor(threadID, partitionTask);
 
-        if (!bitmap_exists(foundPos))
-        {
-            foundPos = bitmap_closest_left_nongap(foundPos , startIndex);
-            if (foundPos == -1)
+            if (nextStartKey > task.upperBound)
             {
-                unlock_thread(threadID, lock);
-                return 0;
+                return;
             }
+            partitionTask.lowerBound = nextStartKey;
         }
-
-        count = m_ptr[threadID][foundPos-startIndex]->lookup(find_first_segment_in_partition(threadID), find_last_segment_in_partition(threadID),
-                                        key,expiryTime,updateSeg);
-    }
-
-    if (get<0>(updateSeg) != pswix::seg_update_type::NONE)
-    {
-        vector<tuple<pswix::seg_update_type,int,Type_Key>> updateSegVector = {updateSeg};
-        int metaRetrainStatus = thread_dispatch_update_seg(threadID, expiryTime, updateSegVector);
-    
-        if (metaRetrainStatus > 0 && thread_retraining == -1)
+        else
         {
-            thread_retraining = threadID*10 + metaRetrainStatus;
+            partitionTask.upperBound = task.upperBound;
+            visitor(threadID, partitionTask);
         }
     }
-    unlock_thread(threadID, lock);
-
-    return count;
+}
 
+//Runs a routed task on partition threadID and returns the SEARCH count. Parts of the task outside the partition (its
+//boundaries moved since the task was routed) are passed to reroute(task) instead. DELETE is a no-op (tuples expire),
+//markers advance the watermark of the partition.
+template<class Type_Key, class Type_Ts>
+template<class Visitor>
+int SWmeta<Type_Key,Type_Ts>::execute(uint32_t threadID, const SWtask<Type_Key,Type_Ts> & task, Visitor && reroute)
+{
     #ifdef DEBUG
-    DEBUG_EXIT_FUNCTION("SWmeta","lookup");
+    DEBUG_ENTER_FUNCTION("SWmeta","execute");
     #endif
 
-    #if defined(DEBUG_KEY) || defined(DEBUG_TS) 
-    if(DEBUG_KEY == key) 
+    if (task.status == task_status::REBALANCE)
     {
-        DEBUG_EXIT_FUNCTION("SWmeta","lookup");
+        handoff(threadID);
+        return 0;
     }
-    #endif
-}
 
-/*
-Range Query
-*/
+    if (task.status == task_status::WATERMARK || task.status == task_status::ROUND_END || task.status == task_status::FINISH)
+    {
+        advance_watermark(threadID, task.timestamp);
+        return 0;
+    }
+
+    if (threadID >= m_keys.size()) //Fewer partitions than workers
+    {
+        reroute(task);
+        return 0;
+    }
+
+    //Keys of the partition: [partitionStartKey, nextStartKey)
+    bool hasStart = threadID > 0;
+    bool hasNext = threadID < m_partitionStartKey.size()-1;
+    Type_Key partitionStartKey = hasStart ? m_partitionStartKey[threadID].load() : 0;
+    Type_Key nextStartKey = hasNext ? m_partitionStartKey[threadID+1].load() : 0;
+
+    Type_Key lowerBound = task.lowerBound;
+    Type_Key upperBound = (task.status == task_status::SEARCH) ? task.upperBound : task.lowerBound;
+
+    SWtask<Type_Key,Type_Ts> outsideTask = task;
+    if (hasStart && lowerBound < partitionStartKey)
+    {
+        outsideTask.lowerBound = lowerBound;
+        outsideTask.upperBound = min(upperBound, (Type_Key)(partitionStartKey-1));
+        reroute(outsideTask);
+    }
+    if (hasNext && upperBound >= nextStartKey)
+    {
+        outsideTask.lowerBound = max(lowerBound, nextStartKey);
+        outsideTask.upperBound = upperBound;
+        reroute(outsideTask);
+    }
+
+    //Part within the partition
+    Type_Key startKey = hasStart ? max(lowerBound, partitionStartKey) : lowerBound;
+    if (startKey > upperBound || (hasNext && startKey >= nextStartKey))
+    {
+        return 0;
+    }
+    Type_Key endKey = hasNext ? min(upperBound, (Type_Key)(nextStartKey-1)) : upperBound;
+
+    tuple<bool,int,int,int> predictBound;
+    if (startKey != endKey && hasStart && lowerBound <= partitionStartKey) //Range scan from the first segment of the partition
+    {
+        predictBound = make_tuple(false,-1,0,m_numSegPerPartition[threadID]-1);
+    }
+    else
+    {
+        predict_bound_in_thread(threadID, startKey, predictBound);
+    }
+
+    switch (task.status)
+    {
+        case task_status::SEARCH:
+            if (task.lowerBound == task.upperBound)
+            {
+                return lookup(threadID, startKey, task.timestamp, predictBound);
+            }
+            return range_query(threadID, startKey, task.timestamp, endKey, predictBound);
+
+        case task_status::INSERT:
+            insert(threadID, startKey, task.timestamp, predictBound);
+            return 0;
+
+        default:
+            return 0;
+    }
+
+    #ifdef DEBUG
+    DEBUG_EXIT_FUNCTION("SWmeta","execute");
+    #endif
+}
+
+//Partition threadID has run every task up to timestamp (its meta retrain expires up to it)
+template<class Type_Key, class Type_Ts>
+inline void SWmeta<Type_Key,Type_Ts>::advance_watermark(uint32_t threadID, Type_Ts timestamp)
+{
+    if (threadID < m_parititonMaxTime.size() && m_parititonMaxTime[threadID] < timestamp)
+    {
+        m_parititonMaxTime[threadID] = timestamp;
+    }
+}
+
+/*
+Lookup
+*/
+template<class Type_Key, class Type_Ts>
+int SWmeta<Type_Key,Type_Ts>::lookup(uint32_t threadID, Type_Key key, Type_Ts timestamp, tuple<bool,int,int,int> & predictBound)
+{
+    #ifdef DEBUG
+    DEBUG_ENTER_FUNCTION("SWmeta","lookup");
+    #endif
+
+    #if defined(DEBUG_KEY) || defined(DEBUG_TS)
+    if(DEBUG_KEY == key)
+    {
+        DEBUG_ENTER_FUNCTION("SWmeta","lookup");
+    }
+    #endif
+
+    int count = 0;
+    tuple<pswix::seg_update_type,int,Type_Key> updateSeg = make_tuple(pswix::seg_update_type::NONE,0,0);
+    Type_Ts expiryTime = calculate_expiry_time(timestamp);
+
+    unique_lock<mutex> lock(m_partitionLock[threadID].lock);
+    lock_thread(threadID, lock);
+
+    if (m_numSegExistsPerPartition[threadID] == 0) //Empty partition
+    {
+        unlock_thread(threadID, lock);
+        return 0;
+    }
+
+    if (m_numSegPerPartition[threadID] == 1)
+    {
+        count = m_ptr[threadID][0]->lookup(0,0,key,expiryTime,updateSeg);
+    }
+    else
+    {
+        int foundPos = (m_slope[threadID] != -1) ? meta_model_search(threadID, key, predictBound)
+                                                 : meta_non_model_search(threadID, key, predictBound);
+
+        if (!bitmap_exists(threadID, foundPos))
+        {
+            int predictPos = foundPos;
+            foundPos = bitmap_closest_left_nongap(threadID, predictPos, 0);
+            if (foundPos == -1) //Key before the first segment of the partition
+            {
+                foundPos = bitmap_closest_right_nongap(threadID, predictPos, m_numSegPerPartition[threadID]-1);
+            }
+        }
+
+        count = m_ptr[threadID][foundPos]->lookup(find_first_segment_in_partition(threadID), find_last_segment_in_partition(threadID),
+                                        key,expiryTime,updateSeg);
+    }
+
+    if (get<0>(updateSeg) != pswix::seg_update_type::NONE)
+    {
+        vector<tuple<pswix::seg_update_type,int,Type_Key>> updateSegVector = {updateSeg};
+        thread_dispatch_update_seg(threadID, expiryTime, updateSegVector);
+    }
+
+    if (m_retrainStatus[threadID])
+    {
+        meta_retrain(threadID);
+    }
+    unlock_thread(threadID, lock);
+
+    return count;
+
+    #ifdef DEBUG
+    DEBUG_EXIT_FUNCTION("SWmeta","lookup");
+    #endif
+
+    #if defined(DEBUG_KEY) || defined(DEBUG_TS)
+    if(DEBUG_KEY == key)
+    {
+        DEBUG_EXIT_FUNCTION("SWmeta","lookup");
+    }
+    #endif
+}
+
+/*
+Range Query
+*/
 template<class Type_Key, class Type_Ts>
 int SWmeta<Type_Key,Type_Ts>::range_query(uint32_t threadID, Type_Key lowerBound, Type_Ts timestamp, Type_Key upperBound, tuple<bool,int,int,int> & predictBound)
+{
+    int count = 0;
+    range_query_result(threadID, lowerBound, timestamp, upperBound, predictBound, count);
+    return count;
+}
+
+//COUNT/SUM/MIN/MAX of the keys in range, same maintenance as range_query but nothing is materialized
+template<class Type_Key, class Type_Ts>
+SWaggregate<Type_Key> SWmeta<Type_Key,Type_Ts>::range_aggregate(uint32_t threadID, Type_Key lowerBound, Type_Ts timestamp, Type_Key upperBound, tuple<bool,int,int,int> & predictBound)
+{
+    SWaggregate<Type_Key> aggregate;
+    range_query_result(threadID, lowerBound, timestamp, upperBound, predictBound, aggregate);
+    return aggregate;
+}
+
+template<class Type_Key, class Type_Ts>
+template<class Type_Result>
+void SWmeta<Type_Key,Type_Ts>::range_query_result(uint32_t threadID, Type_Key lowerBound, Type_Ts timestamp, Type_Key upperBound,
+                                                    tuple<bool,int,int,int> & predictBound, Type_Result & result)
 {
     #ifdef DEBUG
     DEBUG_ENTER_FUNCTION("SWmeta","range_query");
     #endif
 
-    #if defined(DEBUG_KEY) || defined(DEBUG_TS) 
-    if(DEBUG_KEY == lowerBound) 
+    #if defined(DEBUG_KEY) || defined(DEBUG_TS)
+    if(DEBUG_KEY == lowerBound)
     {
         DEBUG_ENTER_FUNCTION("SWmeta","range_query");
     }
     #endif
 
-    int count = 0;
-    int startIndex = m_partitionIndex[threadID];
     vector<tuple<pswix::seg_update_type,int,Type_Key>> updateSeg;
-    Type_Ts expiryTime =  ((double)timestamp - TIME_WINDOW < numeric_limits<Type_Ts>::min()) ? numeric_limits<Type_Ts>::min(): timestamp - TIME_WINDOW;
-    
-    unique_lock<mutex> lock(thread_lock[threadID]);
+    Type_Ts expiryTime = calculate_expiry_time(timestamp);
+
+    unique_lock<mutex> lock(m_partitionLock[threadID].lock);
     lock_thread(threadID, lock);
 
-    if (m_numSeg == 1)
+    if (m_numSegExistsPerPartition[threadID] == 0) //Empty partition
+    {
+        unlock_thread(threadID, lock);
+        return;
+    }
+
+    if (m_numSegPerPartition[threadID] == 1)
     {
-        count = m_ptr[0][0]->range_search(0,m_numSeg-1,lowerBound,expiryTime,upperBound,updateSeg);
+        m_ptr[threadID][0]->range_search(0,0,lowerBound,expiryTime,upperBound,updateSeg,result);
     }
     else
     {
@@ -1037,77 +994,62 @@ int SWmeta<Type_Key,Type_Ts>::range_query(uint32_t threadID, Type_Key lowerBound
         //Search
         if (get<1>(predictBound) != -1)
         {
-            if (threadID == 0 && lowerBound < m_startKey)
-            {
-                foundPos = 0; 
-            }
-            else
-            {
-                if (m_slope != -1)
-                {
-                    foundPos = meta_model_search(threadID, lowerBound, predictBound);
-                }
-                else
-                {
-                    foundPos = meta_non_model_search(threadID, lowerBound, predictBound);
-                }
-            }
+            foundPos = (m_slope[threadID] != -1) ? meta_model_search(threadID, lowerBound, predictBound)
+                                                 : meta_non_model_search(threadID, lowerBound, predictBound);
 
-            if (!bitmap_exists(foundPos))
+            if (!bitmap_exists(threadID, foundPos))
             {
-                foundPos = bitmap_closest_left_nongap(foundPos, startIndex);
-                if (foundPos == -1)
+                int predictPos = foundPos;
+                foundPos = bitmap_closest_left_nongap(threadID, predictPos, 0);
+                if (foundPos == -1) //Range before the first segment of the partition, its buffer holds the keys below its start key
                 {
-                    foundPos = bitmap_closest_right_nongap(foundPos, 
-                        (threadID == m_partitionIndex.size()-1)? m_numSeg-1:m_partitionIndex[threadID+1]-1);
-                    if (foundPos == -1 || m_keys[threadID][foundPos-startIndex] > upperBound) 
+                    foundPos = bitmap_closest_right_nongap(threadID, predictPos, m_numSegPerPartition[threadID]-1);
+                    if (foundPos == -1)
                     {
                         unlock_thread(threadID, lock);
-                        return 0; 
+                        return;
                     }
                 }
             }
-            count = m_ptr[threadID][foundPos-startIndex]->range_search(find_first_segment_in_partition(threadID), find_last_segment_in_partition(threadID),
-                                        lowerBound,expiryTime,upperBound,updateSeg);
+            m_ptr[threadID][foundPos]->range_search(find_first_segment_in_partition(threadID), find_last_segment_in_partition(threadID),
+                                        lowerBound,expiryTime,upperBound,updateSeg,result);
         }
         //Scan (get<1>predictBound == -1 indicates scans)
         else
         {
             foundPos = get<2>(predictBound);
-            if (!bitmap_exists(foundPos))
+            if (!bitmap_exists(threadID, foundPos))
             {
-                foundPos = bitmap_closest_right_nongap(foundPos, get<3>(predictBound));
-                if (foundPos == -1 || m_keys[threadID][foundPos-startIndex] > upperBound) 
+                foundPos = bitmap_closest_right_nongap(threadID, foundPos, get<3>(predictBound));
+                if (foundPos == -1) //A first segment starting after upperBound can still hold keys in range in its buffer
                 {
                     unlock_thread(threadID, lock);
-                    return 0; 
+                    return;
                 }
             }
 
-            count = m_ptr[threadID][foundPos-startIndex]->range_scan(find_first_segment_in_partition(threadID), find_last_segment_in_partition(threadID),
-                                        lowerBound,expiryTime,upperBound,updateSeg);
+            m_ptr[threadID][foundPos]->range_scan(find_first_segment_in_partition(threadID), find_last_segment_in_partition(threadID),
+                                        lowerBound,expiryTime,upperBound,updateSeg,result);
         }
     }
 
     if (updateSeg.size() > 0)
     {
-        int metaRetrainStatus = thread_dispatch_update_seg(threadID, expiryTime, updateSeg);
+        thread_dispatch_update_seg(threadID, expiryTime, updateSeg);
+    }
 
-        if (metaRetrainStatus > 0 && thread_retraining == -1)
-        {
-            thread_retraining = threadID*10 + metaRetrainStatus;
-        }
+    if (m_retrainStatus[threadID])
+    {
+        meta_retrain(threadID);
     }
     unlock_thread(threadID,lock);
-    
-    return count;
 
     #ifdef DEBUG
     DEBUG_EXIT_FUNCTION("SWmeta","range_query");
     #endif
 
-    #if defined(DEBUG_KEY) || defined(DEBUG_TS) 
-    if(DEBUG_KEY == lowerBound) 
+    #if defined(DEBUG_KEY) || defined(DEBUG_TS)
+    if(DEBUG_KEY == lowerBound)
     {
         DEBUG_EXIT_FUNCTION("SWmeta","range_query");
     }
@@ -1115,7 +1057,7 @@ int SWmeta<Type_Key,Type_Ts>::range_query(uint32_t threadID, Type_Key lowerBound
 }
 
 /*
-Insertion 
+Insertion
 */
 template<class Type_Key, class Type_Ts>
 int SWmeta<Type_Key,Type_Ts>::insert(uint32_t threadID, Type_Key key, Type_Ts timestamp, tuple<bool,int,int,int> & predictBound)
@@ -1124,69 +1066,57 @@ int SWmeta<Type_Key,Type_Ts>::insert(uint32_t threadID, Type_Key key, Type_Ts ti
     DEBUG_ENTER_FUNCTION("SWmeta","insert");
     #endif
 
-    #if defined(DEBUG_KEY) || defined(DEBUG_TS) 
-    if(DEBUG_KEY == key) 
+    #if defined(DEBUG_KEY) || defined(DEBUG_TS)
+    if(DEBUG_KEY == key)
     {
         DEBUG_ENTER_FUNCTION("SWmeta","insert");
     }
     #endif
 
-    int startIndex = m_partitionIndex[threadID];
     vector<tuple<pswix::seg_update_type,int,Type_Key>> updateSeg;
-    Type_Ts expiryTime =  ((double)timestamp - TIME_WINDOW < numeric_limits<Type_Ts>::min()) ? numeric_limits<Type_Ts>::min(): timestamp - TIME_WINDOW;
-    
+    Type_Ts expiryTime = calculate_expiry_time(timestamp);
+
     m_parititonMaxTime[threadID] = timestamp;
 
-    unique_lock<mutex> lock(thread_lock[threadID]);
+    unique_lock<mutex> lock(m_partitionLock[threadID].lock);
     lock_thread(threadID, lock);
 
-    if (m_numSeg == 1)
+    if (m_numSegExistsPerPartition[threadID] == 0) //Empty partition (starts a new segment)
     {
-        m_ptr[0][0]->insert(0,m_numSeg-1,key,timestamp,expiryTime,updateSeg);
+        SWseg<Type_Key,Type_Ts> * SWsegPtr = new SWseg<Type_Key,Type_Ts>(make_pair(key,timestamp), max_buffer_size());
+        thread_insert(threadID, key, SWsegPtr, false);
+    }
+    else if (m_numSegPerPartition[threadID] == 1)
+    {
+        m_ptr[threadID][0]->insert(0,0,key,timestamp,expiryTime,updateSeg);
     }
     else
     {
-        int foundPos;
-        if (threadID == 0 && key < m_startKey)
-        {
-            foundPos = 0; 
-        }
-        else
-        {
-            if (m_slope != -1)
-            {
-                foundPos = meta_model_search(threadID, key, predictBound);
-            }
-            else
-            {
-                foundPos = meta_non_model_search(threadID, key, predictBound);
-            }
-        }
+        int foundPos = (m_slope[threadID] != -1) ? meta_model_search(threadID, key, predictBound)
+                                                 : meta_non_model_search(threadID, key, predictBound);
 
-        if (!bitmap_exists(foundPos))
+        if (!bitmap_exists(threadID, foundPos))
         {
-            foundPos = bitmap_closest_left_nongap(foundPos, startIndex);
-            if (foundPos == -1)
+            int predictPos = foundPos;
+            foundPos = bitmap_closest_left_nongap(threadID, predictPos, 0);
+            if (foundPos == -1) //Key before the first segment of the partition
             {
-                foundPos = bitmap_closest_right_nongap(foundPos, 
-                    (threadID == m_partitionIndex.size()-1)? m_numSeg-1:m_partitionIndex[threadID+1]-1);
-
-                ASSERT_MESSAGE(foundPos != -1, "SWmeta::insert: entire partition is empty, cannot insert");
+                foundPos = bitmap_closest_right_nongap(threadID, predictPos, m_numSegPerPartition[threadID]-1);
             }
         }
 
-        m_ptr[threadID][foundPos-startIndex]->insert(find_first_segment_in_partition(threadID), find_last_segment_in_partition(threadID),
+        m_ptr[threadID][foundPos]->insert(find_first_segment_in_partition(threadID), find_last_segment_in_partition(threadID),
                                 key,timestamp,expiryTime,updateSeg);
     }
 
     if (updateSeg.size() > 0)
     {
-        int metaRetrainStatus = thread_dispatch_update_seg(threadID, expiryTime, updateSeg);
+        thread_dispatch_update_seg(threadID, expiryTime, updateSeg);
+    }
 
-        if (metaRetrainStatus > 0 && thread_retraining == -1)
-        {
-            thread_retraining = threadID*10 + metaRetrainStatus;
-        }
+    if (m_retrainStatus[threadID])
+    {
+        meta_retrain(threadID);
     }
     unlock_thread(threadID,lock);
 
@@ -1194,8 +1124,8 @@ int SWmeta<Type_Key,Type_Ts>::insert(uint32_t threadID, Type_Key key, Type_Ts ti
     DEBUG_EXIT_FUNCTION("SWmeta","insert");
     #endif
 
-    #if defined(DEBUG_KEY) || defined(DEBUG_TS) 
-    if(DEBUG_KEY == key) 
+    #if defined(DEBUG_KEY) || defined(DEBUG_TS)
+    if(DEBUG_KEY == key)
     {
         DEBUG_EXIT_FUNCTION("SWmeta","insert");
     }
@@ -1211,80 +1141,54 @@ Search Helpers
 template<class Type_Key, class Type_Ts>
 inline int SWmeta<Type_Key,Type_Ts>::meta_model_search(uint32_t threadID, Type_Key targetKey, tuple<bool,int,int,int> & predictBound)
 {
-    //Checking starting segment range
-    if (threadID == 0 && targetKey < m_partitionStartKey[0])
-    {
-        return 0;
-    }
-
-    int startIndex = m_partitionIndex[threadID];
     vector<Type_Key> & keys = m_keys[threadID];
+    int foundPos;
 
     //Single point
     if (get<2>(predictBound) == get<3>(predictBound))
     {
-        return get<2>(predictBound);
+        foundPos = get<2>(predictBound);
     }
-
     //Search range
-    if (get<0>(predictBound)) //exponential search
+    else if (get<0>(predictBound)) //exponential search
     {
-        if (get<2>(predictBound) < get<3>(predictBound))
-        {
-            int foundPos = get<1>(predictBound);
-            foundPos = (foundPos < get<2>(predictBound))? get<2>(predictBound) : foundPos;
-            foundPos = (foundPos > get<3>(predictBound))? get<3>(predictBound) : foundPos;
+        foundPos = get<1>(predictBound);
+        foundPos = (foundPos < get<2>(predictBound))? get<2>(predictBound) : foundPos;
+        foundPos = (foundPos > get<3>(predictBound))? get<3>(predictBound) : foundPos;
 
-            if (targetKey < keys[foundPos-startIndex])
-            {
-                return exponential_search_left(keys,targetKey,foundPos-startIndex,foundPos-get<2>(predictBound)) + startIndex;
-            }
-            else if (targetKey > keys[foundPos-startIndex])
-            {
-                return exponential_search_right(keys,targetKey,foundPos-startIndex,get<3>(predictBound)-foundPos) + startIndex;
-            }
-            return foundPos;
-        }
-        else if (get<2>(predictBound) == get<3>(predictBound))
+        if (targetKey < keys[foundPos])
         {
-            if (targetKey < keys[get<1>(predictBound)-startIndex])
-            {
-                return get<1>(predictBound)-1;
-            }
-            else
-            {
-                return get<1>(predictBound);
-            }
+            foundPos = exponential_search_left(keys,targetKey,foundPos,foundPos-get<2>(predictBound));
         }
-        else
+        else if (targetKey > keys[foundPos])
         {
-            return get<3>(predictBound);
+            foundPos = exponential_search_right(keys,targetKey,foundPos,get<3>(predictBound)-foundPos);
         }
     }
     else //binary search
     {
-        auto lowerBoundIt = lower_bound(keys.begin()+(get<2>(predictBound)-startIndex),keys.begin()+(get<3>(predictBound)+1-startIndex),targetKey);
- 
-        if (lowerBoundIt == keys.begin()+(get<3>(predictBound)+1-startIndex) || 
-                ((lowerBoundIt != keys.begin()+(get<2>(predictBound)-startIndex)) && (*lowerBoundIt > targetKey)))
+        auto lowerBoundIt = lower_bound(keys.begin()+get<2>(predictBound),keys.begin()+(get<3>(predictBound)+1),targetKey);
+
+        if (lowerBoundIt == keys.begin()+(get<3>(predictBound)+1) ||
+                ((lowerBoundIt != keys.begin()+get<2>(predictBound)) && (*lowerBoundIt > targetKey)))
         {
             lowerBoundIt--;
         }
 
-        return (lowerBoundIt - keys.begin()) + startIndex;
+        foundPos = lowerBoundIt - keys.begin();
+    }
+
+    //The floored prediction of a key just below a segment can be that segment's slot (left of the search bound)
+    if (foundPos > 0 && keys[foundPos] > targetKey)
+    {
+        foundPos = exponential_search_left(keys,targetKey,foundPos,foundPos);
     }
+    return foundPos;
 }
 
 template<class Type_Key, class Type_Ts>
 inline int SWmeta<Type_Key,Type_Ts>::meta_non_model_search(uint32_t threadID, Type_Key targetKey, tuple<bool,int,int,int> & searchBound)
 {
-    //Checking starting segment range
-    if (threadID == 0 && targetKey < m_partitionStartKey[0])
-    {
-        return 0;
-    }
-
-    int startIndex = m_partitionIndex[threadID];
     vector<Type_Key> & keys = m_keys[threadID];
 
     //Single point
@@ -1294,26 +1198,23 @@ inline int SWmeta<Type_Key,Type_Ts>::meta_non_model_search(uint32_t threadID, Ty
     }
 
     //Within range
-    auto lowerBoundIt = lower_bound(keys.begin()+(get<2>(searchBound)-startIndex),keys.begin()+(get<3>(searchBound)+1-startIndex),targetKey);
+    auto lowerBoundIt = lower_bound(keys.begin()+get<2>(searchBound),keys.begin()+(get<3>(searchBound)+1),targetKey);
 
-    if (lowerBoundIt == keys.begin()+(get<3>(searchBound)+1-startIndex) || ((lowerBoundIt != keys.begin()+(get<2>(searchBound)-startIndex)) && (*lowerBoundIt > targetKey)))
+    if (lowerBoundIt == keys.begin()+(get<3>(searchBound)+1) || ((lowerBoundIt != keys.begin()+get<2>(searchBound)) && (*lowerBoundIt > targetKey)))
     {
         lowerBoundIt--;
     }
 
-    return (lowerBoundIt - keys.begin()) + startIndex;
+    return lowerBoundIt - keys.begin();
 }
 
 /*
 Update Segments from Meta and Rendezvous Retrain within thread range
 */
 template<class Type_Key, class Type_Ts>
-int SWmeta<Type_Key,Type_Ts>::thread_dispatch_update_seg(uint32_t threadID, Type_Ts expiryTime, 
+void SWmeta<Type_Key,Type_Ts>::thread_dispatch_update_seg(uint32_t threadID, Type_Ts expiryTime,
                                                             vector<tuple<pswix::seg_update_type,int,Type_Key>> & updateSeg)
 {
-    int metaRetrainStatus = 0;
-    int startIndex = m_partitionIndex[threadID];
-    
     int index;
     vector<int> retrainSegmentIndex;
     retrainSegmentIndex.reserve(updateSeg.size());
@@ -1324,39 +1225,37 @@ int SWmeta<Type_Key,Type_Ts>::thread_dispatch_update_seg(uint32_t threadID, Type
         {
             case pswix::seg_update_type::RETRAIN: //Rendezvous Retrain (flag first time)
             {
-                if (bitmap_exists(m_retrainBitmap,index))
+                if (bitmap_exists(m_retrainBitmap[threadID],index))
                 {
                     retrainSegmentIndex.push_back(index);
                 }
                 else
                 {
-                    bitmap_set_bit(m_retrainBitmap,index);
+                    bitmap_set_bit(m_retrainBitmap[threadID],index);
                 }
                 break;
             }
             case pswix::seg_update_type::REPLACE: //Replace Segment with reinsertion
             {
-                bool currentRetrainStatus = (bitmap_exists(m_retrainBitmap,index));
-                SWseg<Type_Key,Type_Ts>* segPtr = m_ptr[threadID][index-startIndex];
+                bool currentRetrainStatus = (bitmap_exists(m_retrainBitmap[threadID],index));
+                SWseg<Type_Key,Type_Ts>* segPtr = m_ptr[threadID][index];
 
-                m_ptr[threadID][index-startIndex] = nullptr;
-                bitmap_erase_bit(index);
-                bitmap_erase_bit(m_retrainBitmap,index);
+                m_ptr[threadID][index] = nullptr;
+                bitmap_erase_bit(threadID,index);
+                bitmap_erase_bit(m_retrainBitmap[threadID],index);
                 update_keys_with_previous(threadID, index);
-                --m_numSegExist;
                 --m_numSegExistsPerPartition[threadID];
 
-                metaRetrainStatus = thread_insert(threadID, get<2>(segment), segPtr, currentRetrainStatus);
+                thread_insert(threadID, get<2>(segment), segPtr, currentRetrainStatus);
                 break;
             }
             case pswix::seg_update_type::DELETE: //Delete Segments
             {
-                delete m_ptr[threadID][index-startIndex];
-                m_ptr[threadID][index-startIndex] = nullptr;
-                bitmap_erase_bit(index);
-                bitmap_erase_bit(m_retrainBitmap,index);
+                delete m_ptr[threadID][index];
+                m_ptr[threadID][index] = nullptr;
+                bitmap_erase_bit(threadID,index);
+                bitmap_erase_bit(m_retrainBitmap[threadID],index);
                 update_keys_with_previous(threadID, index);
-                --m_numSegExist;
                 --m_numSegExistsPerPartition[threadID];
 
                 break;
@@ -1373,40 +1272,38 @@ int SWmeta<Type_Key,Type_Ts>::thread_dispatch_update_seg(uint32_t threadID, Type
     vector<pair<Type_Key,SWseg<Type_Key,Type_Ts>*>>  retrainSeg;
     for (auto & index: retrainSegmentIndex)
     {
-        if (bitmap_exists(m_retrainBitmap,index))
+        if (bitmap_exists(m_retrainBitmap[threadID],index))
         {
             #ifdef TUNE
             segNoRetrain++;
             #endif
-                        
+
             int startRetrainIndex, endRetrainIndex;
-            tie(startRetrainIndex,endRetrainIndex) = bitmap_retrain_range(index);
-            startRetrainIndex = max(startRetrainIndex,(threadID == 0)? 0 : m_partitionIndex[threadID]);
-            endRetrainIndex = min(endRetrainIndex,(threadID == m_partitionIndex.size()-1)? m_numSeg-1 : m_partitionIndex[threadID+1]-1);
-            
+            tie(startRetrainIndex,endRetrainIndex) = bitmap_retrain_range(threadID, index);
+            startRetrainIndex = max(startRetrainIndex,0);
+            endRetrainIndex = min(endRetrainIndex,m_numSegPerPartition[threadID]-1);
+
             seg_retrain(threadID, startRetrainIndex, endRetrainIndex, expiryTime, retrainSeg);
-            
+
             //Delete old segments
             if (startRetrainIndex == endRetrainIndex)
             {
-                delete m_ptr[threadID][index-startIndex];
-                m_ptr[threadID][index-startIndex] = nullptr;
-                bitmap_erase_bit(index);
-                bitmap_erase_bit(m_retrainBitmap,index);
-                --m_numSegExist;
+                delete m_ptr[threadID][index];
+                m_ptr[threadID][index] = nullptr;
+                bitmap_erase_bit(threadID,index);
+                bitmap_erase_bit(m_retrainBitmap[threadID],index);
                 --m_numSegExistsPerPartition[threadID];
             }
             else
             {
                 for (int i = startRetrainIndex; i <= endRetrainIndex; ++i)
                 {
-                    if (bitmap_exists(i))
+                    if (bitmap_exists(threadID,i))
                     {
-                        delete m_ptr[threadID][i-startIndex];
-                        m_ptr[threadID][i-startIndex] = nullptr;
-                        bitmap_erase_bit(i);
-                        bitmap_erase_bit(m_retrainBitmap,i);
-                        --m_numSegExist;
+                        delete m_ptr[threadID][i];
+                        m_ptr[threadID][i] = nullptr;
+                        bitmap_erase_bit(threadID,i);
+                        bitmap_erase_bit(m_retrainBitmap[threadID],i);
                         --m_numSegExistsPerPartition[threadID];
                     }
                 }
@@ -1414,22 +1311,18 @@ int SWmeta<Type_Key,Type_Ts>::thread_dispatch_update_seg(uint32_t threadID, Type
             update_keys_with_previous(threadID, index);
         }
     }
-    
+
     for (auto & segment: retrainSeg)
     {
-        metaRetrainStatus = max(metaRetrainStatus, thread_insert(threadID, segment.first, segment.second, false));
+        thread_insert(threadID, segment.first, segment.second, false);
     }
-
-    return metaRetrainStatus;
 }
 
 
 //Retrain Segments
 template<class Type_Key, class Type_Ts>
 void SWmeta<Type_Key,Type_Ts>::seg_retrain(uint32_t threadID, int startIndex, int endIndex, Type_Ts expiryTime, vector<pair<Type_Key,SWseg<Type_Key,Type_Ts>*>> & retrainSeg)
-{  
-    int firstSegmentIndex = m_partitionIndex[threadID];
-    
+{
     vector<pair<Type_Key,Type_Ts>> data;
     int firstSegment = find_first_segment_in_partition(threadID);
     int lastSegment = find_last_segment_in_partition(threadID);
@@ -1437,15 +1330,15 @@ void SWmeta<Type_Key,Type_Ts>::seg_retrain(uint32_t threadID, int startIndex, in
     //Retrain Alone
     if (startIndex == endIndex)
     {
-        m_ptr[threadID][startIndex-firstSegmentIndex]->merge_data(expiryTime,data,firstSegment,lastSegment);
+        m_ptr[threadID][startIndex]->merge_data(expiryTime,data,firstSegment,lastSegment);
     }
     else //Retrain with neighbours
     {
         while(startIndex <= endIndex)
         {
-            if (bitmap_exists(startIndex))
-            { 
-                m_ptr[threadID][startIndex-firstSegmentIndex]->merge_data(expiryTime,data,firstSegment,lastSegment);
+            if (bitmap_exists(threadID,startIndex))
+            {
+                m_ptr[threadID][startIndex]->merge_data(expiryTime,data,firstSegment,lastSegment);
             }
             ++startIndex;
         }
@@ -1458,20 +1351,20 @@ void SWmeta<Type_Key,Type_Ts>::seg_retrain(uint32_t threadID, int startIndex, in
     retrainSeg.reserve(retrainSeg.size() + splitIndexSlopeVector.size());
     for (auto it = splitIndexSlopeVector.begin(); it != splitIndexSlopeVector.end()-1; it++)
     {
-        SWseg<Type_Key,Type_Ts>* SWsegPtr = new SWseg<Type_Key,Type_Ts>(get<0>(*it), get<1>(*it) ,get<2>(*it), data);
+        SWseg<Type_Key,Type_Ts>* SWsegPtr = new SWseg<Type_Key,Type_Ts>(get<0>(*it), get<1>(*it) ,get<2>(*it), data, max_buffer_size());
         retrainSeg.push_back(make_pair(data[get<0>(*it)].first, SWsegPtr));
     }
 
     //Check last segment if it contains single point
     if (get<0>(splitIndexSlopeVector.back())  != get<1>(splitIndexSlopeVector.back()))
     {
-        SWseg<Type_Key,Type_Ts> * SWsegPtr = new SWseg<Type_Key,Type_Ts>(get<0>(splitIndexSlopeVector.back()), get<1>(splitIndexSlopeVector.back()) ,get<2>(splitIndexSlopeVector.back()), data);
+        SWseg<Type_Key,Type_Ts> * SWsegPtr = new SWseg<Type_Key,Type_Ts>(get<0>(splitIndexSlopeVector.back()), get<1>(splitIndexSlopeVector.back()) ,get<2>(splitIndexSlopeVector.back()), data, max_buffer_size());
         retrainSeg.push_back(make_pair(data[get<0>(splitIndexSlopeVector.back())].first, SWsegPtr));
 
     }
-    else //Single Point 
+    else //Single Point
     {
-        SWseg<Type_Key,Type_Ts> * SWsegPtr = new SWseg<Type_Key,Type_Ts>(data.back());
+        SWseg<Type_Key,Type_Ts> * SWsegPtr = new SWseg<Type_Key,Type_Ts>(data.back(), max_buffer_size());
         retrainSeg.push_back(make_pair(data.back().first, SWsegPtr));
     }
 
@@ -1491,179 +1384,108 @@ int SWmeta<Type_Key,Type_Ts>::thread_insert(uint32_t threadID, Type_Key key, SWs
     DEBUG_ENTER_FUNCTION("SWmeta","thread_insert");
     #endif
 
-    #if defined(DEBUG_KEY) || defined(DEBUG_TS) 
-    if(DEBUG_KEY == key) 
+    #if defined(DEBUG_KEY) || defined(DEBUG_TS)
+    if(DEBUG_KEY == key)
     {
         DEBUG_ENTER_FUNCTION("SWmeta","thread_insert");
     }
     #endif
 
-    if (thread_retraining != -1) //Retrain is in progress (Do not insert)
+    if (m_retrainStatus[threadID]) //Retrain of the partition is pending (inserted by the retrain)
     {
-        retrain_insertion_queue.enqueue(make_tuple(key,segPtr,currentRetrainStatus));
+        m_deferredSeg[threadID].push_back(make_tuple(key,segPtr,currentRetrainStatus));
         return 2;
     }
-    
+
     int metaRetrainFlag = 0;
-    int startIndex = m_partitionIndex[threadID];
+    int numSeg = m_numSegPerPartition[threadID];
 
-    if (m_slope != -1) //Model Insertion
+    if (numSeg == 0) //Empty partition
     {
-        if (key < m_startKey) //Insert into front of meta (threadID == 0)
-        {
-            ASSERT_MESSAGE(threadID == 0, "thread_insert: threadID should be 0 for key < m_startKey");
-            metaRetrainFlag = insert_model(threadID, 0, key, segPtr, false, currentRetrainStatus);
-        }
-        else
-        {
-            tuple<bool,int,int,int> predictBound;
-            uint32_t predictThread = predict_thread(key, predictBound);
-            ASSERT_MESSAGE(predictThread == threadID, "thread_insert: threadID should be equal to predictThread");
-
-            int insertPos = get<1>(predictBound);
-            if (get<2>(predictBound) < get<3>(predictBound))
-            {
-                int predictPosMaxUnbounded = (m_rightSearchBound == 0) ? insertPos + 1 : insertPos + m_rightSearchBound;
-                
-                insertPos = insertPos < get<2>(predictBound) ? get<2>(predictBound) : insertPos;
-                insertPos = insertPos > get<3>(predictBound) ? get<3>(predictBound) : insertPos;
-
-                if (key < m_keys[threadID][insertPos-startIndex])
-                {
-                    insertPos = exponential_search_left_insert(threadID, m_keys[threadID], key, insertPos-startIndex, insertPos-get<2>(predictBound)) + startIndex;
-                }
-                else if (key > m_keys[threadID][insertPos-startIndex])
-                {
-                    insertPos = exponential_search_right_insert(threadID, m_keys[threadID], key, insertPos-startIndex, get<3>(predictBound)-insertPos) + startIndex;
-                }
-                
-                if (insertPos < m_numSeg) //Model Insertion
-                {
-                    metaRetrainFlag = insert_model(threadID, insertPos, key, segPtr, (insertPos > predictPosMaxUnbounded), currentRetrainStatus);
-                }
-                else //Append to the end (Last thread)
-                {
-                    ASSERT_MESSAGE(threadID == m_partitionIndex.size()-1, "thread_insert: only last thread should append");
-                    
-                    if (static_cast<int>(m_numSeg >> 6) == m_bitmap.size())
-                    {
-                        m_bitmap.push_back(0);
-                        m_retrainBitmap.push_back(0);
-                    }
-
-                    bitmap_set_bit(m_numSeg);
-                    if (currentRetrainStatus)
-                    {
-                        bitmap_set_bit(m_retrainBitmap,m_numSeg);
-                    }
-
-                    m_keys[threadID].push_back(key);
-                    m_ptr[threadID].push_back(segPtr);
-                    ++m_numSeg;
-                    ++m_numSegPerPartition[threadID];
+        metaRetrainFlag = insert_end(threadID, key, segPtr, currentRetrainStatus);
+    }
+    else if (m_slope[threadID] != -1) //Model Insertion
+    {
+        tuple<bool,int,int,int> predictBound;
+        predict_bound_in_thread(threadID, key, predictBound);
 
-                    segPtr->m_parentIndex = m_numSeg-1;
-                    update_segment_with_neighbours(threadID, m_numSeg-1, m_partitionIndex.back(), m_numSeg-1);
-                    ++m_numSegExist;
-                    ++m_numSegExistsPerPartition[threadID];
+        int insertPos = get<1>(predictBound);
+        if (get<2>(predictBound) < get<3>(predictBound))
+        {
+            int predictPosMaxUnbounded = (m_rightSearchBound[threadID] == 0) ? insertPos + 1 : insertPos + m_rightSearchBound[threadID];
 
-                    if (predictPosMaxUnbounded < insertPos) { ++m_rightSearchBound;}
+            insertPos = insertPos < get<2>(predictBound) ? get<2>(predictBound) : insertPos;
+            insertPos = insertPos > get<3>(predictBound) ? get<3>(predictBound) : insertPos;
 
-                    if (m_leftSearchBound + m_rightSearchBound > m_maxSearchError || (double)m_numSegExist / m_numSeg > 0.8)
-                    {
-                        metaRetrainFlag = ((double)m_numSegExist / m_numSeg < 0.5) ? 2 : 1;
-                    }
-                }
+            if (key < m_keys[threadID][insertPos])
+            {
+                insertPos = exponential_search_left_insert(threadID, m_keys[threadID], key, insertPos, insertPos-get<2>(predictBound));
             }
-            else if (get<2>(predictBound) == get<3>(predictBound))
+            else if (key > m_keys[threadID][insertPos])
             {
-                //Insert to End
-                metaRetrainFlag = insert_end(threadID, key, segPtr, currentRetrainStatus);
+                insertPos = exponential_search_right_insert(threadID, m_keys[threadID], key, insertPos, get<3>(predictBound)-insertPos);
             }
-            else
+
+            if (insertPos < numSeg) //Model Insertion
+            {
+                metaRetrainFlag = insert_model(threadID, insertPos, key, segPtr, (insertPos > predictPosMaxUnbounded), currentRetrainStatus);
+            }
+            else //Append to the end of the partition
             {
-                //Append (only last segment need lock)
-                metaRetrainFlag = insert_append(threadID, insertPos, key, segPtr, currentRetrainStatus);
+                if (predictPosMaxUnbounded < insertPos) { ++m_rightSearchBound[threadID];}
+                metaRetrainFlag = insert_end(threadID, key, segPtr, currentRetrainStatus);
             }
         }
-        m_maxSearchError = min(8192,(int)ceil(0.6*m_numSeg));
-
-        return metaRetrainFlag;
+        else
+        {
+            //Insert to End
+            metaRetrainFlag = insert_end(threadID, key, segPtr, currentRetrainStatus);
+        }
+        m_maxSearchError[threadID] = min(8192,(int)ceil(0.6*m_numSegPerPartition[threadID]));
     }
-    else //m_slope == -1 (Only thread 1 is running operations except meta retrain)
+    else //m_slope == -1 (binary search within the partition)
     {
-        ASSERT_MESSAGE(threadID == 0, "m_slope == -1, only thread 0 should be inserting and running");
-        ASSERT_MESSAGE(m_keys.size() == 1, "m_slope == -1, m_keys.size() should be 1");
-        ASSERT_MESSAGE(m_partitionIndex[0] == 0, "m_slope == -1, m_partitionIndex[0] == 0");
-
-        int insertPos = 0;
-        if (m_numSeg > 1)
+        if (numSeg > 1)
         {
-            if (key < m_startKey)
+            //Binary Search
+            auto lowerBoundIt = lower_bound(m_keys[threadID].begin(),m_keys[threadID].end()-1,key);
+            int insertPos = lowerBoundIt - m_keys[threadID].begin();
+
+            if (*lowerBoundIt < key && bitmap_exists(threadID,insertPos))
             {
-                insert_model(threadID, 0, key, segPtr, false, currentRetrainStatus);
+                ++insertPos;
+            }
+
+            if (insertPos < numSeg)
+            {
+                insert_model(threadID, insertPos, key, segPtr, false, currentRetrainStatus);
             }
             else
             {
-                //Binary Search
-                auto lowerBoundIt = lower_bound(m_keys[0].begin(),m_keys[0].end()-1,key);
-                insertPos = lowerBoundIt - m_keys[0].begin();
+                insert_end(threadID, key, segPtr, currentRetrainStatus);
+            }
+        }
+        else
+        {
+            insert_end(threadID, key, segPtr, currentRetrainStatus);
+        }
 
-                if (*lowerBoundIt < key && bitmap_exists(insertPos))
-                {
-                    ++insertPos;
-                }
+        m_startKey[threadID] = m_keys[threadID][0];
+        metaRetrainFlag = (m_numSegPerPartition[threadID] >= max_buffer_size())? 2 : 0;
+    }
 
-                if (insertPos < m_numSeg)
-                {
-                    insert_model(threadID, insertPos, key, segPtr, false, currentRetrainStatus);
-                }
-                else
-                {
-                    if (static_cast<int>(m_numSeg >> 6) == m_bitmap.size())
-                    {
-                        m_bitmap.push_back(0);
-                        m_retrainBitmap.push_back(0);
-                    }
-
-                    bitmap_set_bit(m_numSeg);
-                    if (currentRetrainStatus)
-                    {
-                        bitmap_set_bit(m_retrainBitmap,m_numSeg);
-                    }
-
-                    m_keys[0].push_back(key);
-                    m_ptr[0].push_back(segPtr);
-                    ++m_numSeg;
-                    ++m_numSegPerPartition[0];
-
-                    segPtr->m_parentIndex = m_numSeg-1;
-                    update_segment_with_neighbours(0, m_numSeg-1, m_partitionIndex.back(), m_numSeg-1);
-                    ++m_numSegExist;
-                    ++m_numSegExistsPerPartition[0];
-                }
-            }
-        }
-        else
-        {
-            insert_end(threadID, key, segPtr, currentRetrainStatus);         
-        }
-
-        m_startKey = m_keys[0][0];
-        m_numSeg = m_keys[0].size();
-        m_partitionStartKey[0] = m_startKey;
-
-        return (m_numSeg == MAX_BUFFER_SIZE)? 2 : 0;
+    if (metaRetrainFlag > m_retrainStatus[threadID])
+    {
+        m_retrainStatus[threadID] = metaRetrainFlag;
     }
-
     return metaRetrainFlag;
 
     #ifdef DEBUG
     DEBUG_EXIT_FUNCTION("SWmeta","thread_insert");
     #endif
 
-    #if defined(DEBUG_KEY) || defined(DEBUG_TS) 
-    if(DEBUG_KEY == key) 
+    #if defined(DEBUG_KEY) || defined(DEBUG_TS)
+    if(DEBUG_KEY == key)
     {
         DEBUG_EXIT_FUNCTION("SWmeta","thread_insert");
     }
@@ -1676,287 +1498,179 @@ Insertion Helpers
 template<class Type_Key, class Type_Ts>
 int SWmeta<Type_Key,Type_Ts>::insert_model(uint32_t threadID, int insertionPos, Type_Key key, SWseg<Type_Key,Type_Ts>* segPtr, bool addErrorFlag, bool currentRetrainStatus)
 {
-    if (bitmap_exists(insertionPos)) //insertionPos not a gap
+    vector<Type_Key> & keys = m_keys[threadID];
+    vector<SWseg<Type_Key,Type_Ts>*> & ptr = m_ptr[threadID];
+    int numSeg = m_numSegPerPartition[threadID];
+
+    if (bitmap_exists(threadID,insertionPos)) //insertionPos not a gap
     {
-        if (m_numSegPerPartition[threadID] == m_numSegExistsPerPartition[threadID]) //No gaps within thread, need to search for gap in neighbours
+        if (numSeg == m_numSegExistsPerPartition[threadID]) //No gaps within thread
         {
             return insert_model_no_gap(threadID, insertionPos, key, segPtr, addErrorFlag, currentRetrainStatus);
         }
         else
         {
-            int startIndex = m_partitionIndex[threadID];
-            int endIndex = (threadID == m_partitionIndex.size()-1) ? m_numSeg.load()-1 : m_partitionIndex[threadID+1]-1;
-            
             int gapPos = find_closest_gap_within_thread(threadID, insertionPos);
             ASSERT_MESSAGE(gapPos != -1, "SWmeta::insert_model: gapPos == -1 when there are gaps within thread");
 
-            if (gapPos != m_numSeg) //Shift using move operation
+            if (gapPos != numSeg) //Shift using move operation
             {
                 if (insertionPos < gapPos) //Right Shift (Move)
                 {
-                    vector<Type_Key> tempKey(m_keys[threadID].begin()+(insertionPos-startIndex),m_keys[threadID].begin()+(gapPos-startIndex));
-                    move(tempKey.begin(),tempKey.end(),m_keys[threadID].begin()+(insertionPos+1-startIndex));
-                    m_keys[threadID][insertionPos-startIndex] = key;
+                    move_backward(keys.begin()+insertionPos,keys.begin()+gapPos,keys.begin()+(gapPos+1));
+                    keys[insertionPos] = key;
 
                     update_seg_parent_index(threadID, insertionPos, gapPos, true);
-                    vector<SWseg<Type_Key,Type_Ts>*> tempPtr(m_ptr[threadID].begin()+(insertionPos-startIndex),m_ptr[threadID].begin()+(gapPos-startIndex));
-                    move(tempPtr.begin(),tempPtr.end(),m_ptr[threadID].begin()+(insertionPos+1-startIndex));
-                    m_ptr[threadID][insertionPos-startIndex] = segPtr;
+                    move_backward(ptr.begin()+insertionPos,ptr.begin()+gapPos,ptr.begin()+(gapPos+1));
+                    ptr[insertionPos] = segPtr;
 
-                    bitmap_move_bit_back(insertionPos,gapPos);
-                    bitmap_set_bit(insertionPos);
-                    bitmap_move_bit_back(m_retrainBitmap,insertionPos,gapPos);
+                    bitmap_move_bit_back(threadID,insertionPos,gapPos);
+                    bitmap_set_bit(threadID,insertionPos);
+                    bitmap_move_bit_back(m_retrainBitmap[threadID],insertionPos,gapPos);
 
                     segPtr->m_parentIndex = insertionPos;
-                    update_segment_with_neighbours(threadID, insertionPos, startIndex, endIndex);
-                    ++m_rightSearchBound;
+                    update_segment_with_neighbours(threadID, insertionPos);
+                    ++m_rightSearchBound[threadID];
                 }
                 else //Left Shift (Move)
                 {
                     --insertionPos;
-                    vector<Type_Key> tempKey(m_keys[threadID].begin()+(gapPos+1-startIndex),m_keys[threadID].begin()+(insertionPos+1-startIndex));
-                    move(tempKey.begin(),tempKey.end(),m_keys[threadID].begin()+(gapPos-startIndex));
-                    m_keys[threadID][insertionPos-startIndex] = key;
+                    move(keys.begin()+(gapPos+1),keys.begin()+(insertionPos+1),keys.begin()+gapPos);
+                    keys[insertionPos] = key;
 
                     update_seg_parent_index(threadID, gapPos, insertionPos, false);
-                    vector<SWseg<Type_Key,Type_Ts>*> tempPtr(m_ptr[threadID].begin()+(gapPos+1-startIndex),m_ptr[threadID].begin()+(insertionPos+1-startIndex));
-                    move(tempPtr.begin(),tempPtr.end(),m_ptr[threadID].begin()+(gapPos-startIndex));
-                    m_ptr[threadID][insertionPos-startIndex] = segPtr;
+                    move(ptr.begin()+(gapPos+1),ptr.begin()+(insertionPos+1),ptr.begin()+gapPos);
+                    ptr[insertionPos] = segPtr;
 
-                    bitmap_move_bit_front(insertionPos,gapPos);
-                    bitmap_set_bit(insertionPos);
-                    bitmap_move_bit_front(m_retrainBitmap,insertionPos,gapPos);
+                    bitmap_move_bit_front(threadID,insertionPos,gapPos);
+                    bitmap_set_bit(threadID,insertionPos);
+                    bitmap_move_bit_front(m_retrainBitmap[threadID],insertionPos,gapPos);
 
                     segPtr->m_parentIndex = insertionPos;
-                    update_segment_with_neighbours(threadID, insertionPos, startIndex, endIndex);
-                    ++m_leftSearchBound;
+                    update_segment_with_neighbours(threadID, insertionPos);
+                    ++m_leftSearchBound[threadID];
                 }
             }
-            else //Last partition shift to end.
+            else //Shift to the end of the partition (closer than the closest gap)
             {
-                ASSERT_MESSAGE (threadID == m_partitionIndex.size()-1, "SWmeta::insert_model: shift to end, must be last partition");
-                m_keys[threadID].insert(m_keys[threadID].begin()+(insertionPos-startIndex),key);
+                keys.insert(keys.begin()+insertionPos,key);
 
-                update_seg_parent_index(threadID, insertionPos, endIndex, true);
-                m_ptr[threadID].insert(m_ptr[threadID].begin()+(insertionPos-startIndex),segPtr);
+                update_seg_parent_index(threadID, insertionPos, numSeg-1, true);
+                ptr.insert(ptr.begin()+insertionPos,segPtr);
 
-                bitmap_move_bit_back(insertionPos,m_numSeg);
-                bitmap_set_bit(insertionPos);
-                bitmap_move_bit_back(m_retrainBitmap,insertionPos,m_numSeg);
-
-                if (currentRetrainStatus)
-                {
-                    bitmap_set_bit(m_retrainBitmap,insertionPos);
-                }
-                else
-                {
-                    bitmap_erase_bit(m_retrainBitmap,insertionPos);
-                }
+                bitmap_move_bit_back(threadID,insertionPos,numSeg);
+                bitmap_set_bit(threadID,insertionPos);
+                bitmap_move_bit_back(m_retrainBitmap[threadID],insertionPos,numSeg);
 
                 segPtr->m_parentIndex = insertionPos;
-                update_segment_with_neighbours(threadID, insertionPos, startIndex, endIndex);
-                ++m_numSeg;
-                ++m_rightSearchBound;
+                ++m_numSegPerPartition[threadID];
+                update_segment_with_neighbours(threadID, insertionPos);
+                ++m_rightSearchBound[threadID];
             }
 
             if (currentRetrainStatus)
             {
-                bitmap_set_bit(m_retrainBitmap,insertionPos);
+                bitmap_set_bit(m_retrainBitmap[threadID],insertionPos);
             }
             else
             {
-                bitmap_erase_bit(m_retrainBitmap,insertionPos);
+                bitmap_erase_bit(m_retrainBitmap[threadID],insertionPos);
             }
-            ++m_numSegExist;
             ++m_numSegExistsPerPartition[threadID];
         }
     }
     else //insertionPos is a gap
     {
-        int startIndex = m_partitionIndex[threadID];
-        int endIndex = (threadID == m_partitionIndex.size()-1) ? m_numSeg.load()-1 : m_partitionIndex[threadID+1]-1;
-        
-        m_keys[threadID][insertionPos-startIndex] = key;
-        m_ptr[threadID][insertionPos-startIndex] = segPtr;
+        keys[insertionPos] = key;
+        ptr[insertionPos] = segPtr;
         segPtr->m_parentIndex = insertionPos;
-        bitmap_set_bit(insertionPos);
-        if (currentRetrainStatus) {bitmap_set_bit(m_retrainBitmap, insertionPos);}
-        ++m_numSegExist;
+        bitmap_set_bit(threadID,insertionPos);
+        if (currentRetrainStatus) {bitmap_set_bit(m_retrainBitmap[threadID], insertionPos);}
         ++m_numSegExistsPerPartition[threadID];
-        
-        for (int i = insertionPos+1; i <= endIndex; ++i)
+        update_segment_with_neighbours(threadID, insertionPos);
+
+        for (int i = insertionPos+1; i < numSeg; ++i)
         {
-            if (m_keys[threadID][i-startIndex] >= key)
+            if (keys[i] >= key)
             {
                 break;
             }
-            
-            if (bitmap_exists(i))
+
+            if (bitmap_exists(threadID,i))
             {
                 LOG_ERROR("Keys are not sorted");
             }
             else
             {
-                m_keys[threadID][i-startIndex] = key;
+                keys[i] = key;
             }
         }
     }
 
-    if (addErrorFlag) { ++m_rightSearchBound;}
-    if (m_leftSearchBound + m_rightSearchBound > m_maxSearchError || (double)m_numSegExist / m_numSeg > 0.8)
-    {
-        return ((double)m_numSegExist / m_numSeg < 0.5) ? 2 : 1;
-    }
-    return 0;
+    if (addErrorFlag) { ++m_rightSearchBound[threadID];}
+    return meta_retrain_status(threadID);
 }
 
+//No gap in the partition: it grows by a slot (each partition owns its slots, no gap is borrowed from a neighbour)
 template<class Type_Key, class Type_Ts>
 int SWmeta<Type_Key,Type_Ts>::insert_model_no_gap(uint32_t threadID, int insertionPos, Type_Key key, SWseg<Type_Key,Type_Ts>* segPtr, bool addErrorFlag, bool currentRetrainStatus)
 {
-    if (threadID != m_partitionIndex.size()-1) //Need borrowing gaps
-    {
-        int gapPos;
-        uint32_t gapThreadID;
-        bool retrianFlag = false;
-        int startIndex = m_partitionIndex[threadID];
-        int endIndex = m_partitionIndex[threadID+1]-1;
-        
-        //Check neighbours for gaps
-        int leftNeighbourGaps = (threadID == 0)? 0 : m_numSegPerPartition[threadID-1] - m_numSegExistsPerPartition[threadID-1];
-        int rightNeighbourGaps = (threadID == m_partitionIndex.size()-1)? 0 : m_numSegPerPartition[threadID+1]-m_numSegExistsPerPartition[threadID+1];
-        if (leftNeighbourGaps == 0 && rightNeighbourGaps == 0)
-        {
-            retrianFlag = true;
-        }
-        else
-        {
-            //Borrow from neighbour with more gaps (need to lock neighbour to secure gap)
-            if (leftNeighbourGaps >= rightNeighbourGaps) //Borrow from left neighbour
-            {
-                if (!borrow_gap_position_from_end(threadID-1, gapPos))
-                {
-                    if (rightNeighbourGaps == 0 || borrow_gap_position_from_begin(threadID+1, gapPos) == false)
-                    {
-                        retrianFlag = true;
-                    }
-                }
-            }
-            else //Borrow from right neighbour
-            {
-                if (!borrow_gap_position_from_begin(threadID+1, gapPos))
-                {
-                    if (leftNeighbourGaps == 0 || borrow_gap_position_from_end(threadID-1, gapPos) == false)
-                    {
-                        retrianFlag = true;
-                    }
-                }
-            }
-        }
-
-        if (retrianFlag)
-        {
-            //Add key to queue and insert after retraining.
-            retrain_insertion_queue.enqueue(make_tuple(key,segPtr,currentRetrainStatus));
-            if (thread_retraining == -1) {thread_retraining = threadID*10+2;}
-            return 2;
-        }
-        //NOTE: after this point startIndex != m_partitionIndex[threadID] (left shift) and endIndex != m_partitionIndex[threadID+1]-1 (right shift
-        //       incremented in borrow gap function
-        
-        // ++m_numSegPerPartition[threadID]; //No need (done in borrow_gap_position)
-        // ++m_numSegExistsPerPartition[threadID]; //No need (done in borrow_gap_position)
-
-        if (insertionPos < gapPos) //Mimics Right Shift
-        {
-            m_keys[threadID].insert(m_keys[threadID].begin()+(insertionPos-startIndex),key);
-            update_seg_parent_index_normalized(threadID, insertionPos-startIndex, m_ptr[threadID].size()-1, true);
-            m_ptr[threadID].insert(m_ptr[threadID].begin()+(insertionPos-startIndex),segPtr);
-
-            bitmap_move_bit_back(insertionPos,endIndex+1);
-            bitmap_set_bit(insertionPos);
-            bitmap_move_bit_back(m_retrainBitmap,insertionPos,endIndex+1);
-
-            update_segment_with_neighbours(threadID, insertionPos, startIndex, endIndex+1);
-            ++m_rightSearchBound;
-        }
-        else //Mimics Left Shift TODO: check corrected 27/09/2023
-        {
-            m_keys[threadID].insert(m_keys[threadID].begin()+(insertionPos-startIndex),key);
-            update_seg_parent_index_normalized(threadID, 0, insertionPos-startIndex-1, false);
-            m_ptr[threadID].insert(m_ptr[threadID].begin()+(insertionPos-startIndex),segPtr);
-
-            bitmap_move_bit_front(insertionPos-1,startIndex-1);
-            bitmap_set_bit(insertionPos);
-            bitmap_move_bit_front(m_retrainBitmap,insertionPos-1,startIndex-1);
-
-            update_segment_with_neighbours(threadID, insertionPos, startIndex-1, endIndex);
-            ++m_leftSearchBound;
-        }
-    }
-    else //Last partition (directly insert) right shift
-    {
-        int startIndex = m_partitionIndex[threadID];
-
-        m_keys[threadID].insert(m_keys[threadID].begin()+(insertionPos-startIndex),key);
-        update_seg_parent_index(threadID, insertionPos, m_numSeg-1, true);
-        m_ptr[threadID].insert(m_ptr[threadID].begin()+(insertionPos-startIndex),segPtr);
+    int numSeg = m_numSegPerPartition[threadID];
 
-        bitmap_move_bit_back(insertionPos,m_numSeg);
-        bitmap_set_bit(insertionPos);
-        bitmap_move_bit_back(m_retrainBitmap,insertionPos,m_numSeg);
+    m_keys[threadID].insert(m_keys[threadID].begin()+insertionPos,key);
+    update_seg_parent_index(threadID, insertionPos, numSeg-1, true);
+    m_ptr[threadID].insert(m_ptr[threadID].begin()+insertionPos,segPtr);
 
-        update_segment_with_neighbours(threadID, insertionPos, startIndex, m_numSeg);
-        ++m_numSeg;
-        ++m_numSegPerPartition[threadID];
-        ++m_numSegExistsPerPartition[threadID];
-        ++m_rightSearchBound;
-    }
+    bitmap_move_bit_back(threadID,insertionPos,numSeg);
+    bitmap_set_bit(threadID,insertionPos);
+    bitmap_move_bit_back(m_retrainBitmap[threadID],insertionPos,numSeg);
 
     if (currentRetrainStatus)
     {
-        bitmap_set_bit(m_retrainBitmap,insertionPos);
+        bitmap_set_bit(m_retrainBitmap[threadID],insertionPos);
     }
     else
     {
-        bitmap_erase_bit(m_retrainBitmap,insertionPos);
+        bitmap_erase_bit(m_retrainBitmap[threadID],insertionPos);
     }
 
     segPtr->m_parentIndex = insertionPos;
-    ++m_numSegExist;
+    ++m_numSegPerPartition[threadID];
+    ++m_numSegExistsPerPartition[threadID];
+    update_segment_with_neighbours(threadID, insertionPos);
+    ++m_rightSearchBound[threadID];
 
-    if (addErrorFlag) { ++m_rightSearchBound;}
-    if (m_leftSearchBound + m_rightSearchBound > m_maxSearchError || (double)m_numSegExist / m_numSeg > 0.8)
-    {
-        return ((double)m_numSegExist / m_numSeg < 0.5) ? 2 : 1;
-    }
+    if (addErrorFlag) { ++m_rightSearchBound[threadID];}
+    return meta_retrain_status(threadID);
 }
 
 template<class Type_Key, class Type_Ts>
 int SWmeta<Type_Key,Type_Ts>::insert_end(uint32_t threadID, Type_Key key, SWseg<Type_Key,Type_Ts>* segPtr, bool currentRetrainStatus)
 {
-    ASSERT_MESSAGE(threadID == m_partitionIndex.size()-1, "SWmeta::insert_end must be called by last partition");
+    int numSeg = m_numSegPerPartition[threadID];
 
-    if (bitmap_exists(m_numSeg-1))
+    if (numSeg == 0) //Empty partition (first slot)
     {
-        if (static_cast<int>(m_numSeg >> 6) == m_bitmap.size())
-        {
-            m_bitmap.push_back(0);
-            m_retrainBitmap.push_back(0);
-        }
+        vector<tuple<Type_Key,SWseg<Type_Key,Type_Ts>*,bool>> segments = {make_tuple(key, segPtr, currentRetrainStatus)};
+        layout_partition(threadID, -1, segments);
+        return 0;
+    }
 
+    if (bitmap_exists(threadID,numSeg-1))
+    {
         if (key < m_keys[threadID].back()) //Insert into numSeg-1
         {
             //Insert and increment m_rightSearchBound
-            bitmap_move_bit_back(m_numSeg-1,m_numSeg);
-            bitmap_set_bit(m_numSeg-1);
-            bitmap_move_bit_back(m_retrainBitmap,m_numSeg-1,m_numSeg);
+            bitmap_move_bit_back(threadID,numSeg-1,numSeg);
+            bitmap_set_bit(threadID,numSeg-1);
+            bitmap_move_bit_back(m_retrainBitmap[threadID],numSeg-1,numSeg);
             if (currentRetrainStatus)
             {
-                bitmap_set_bit(m_retrainBitmap,m_numSeg-1);
+                bitmap_set_bit(m_retrainBitmap[threadID],numSeg-1);
             }
             else
             {
-                bitmap_erase_bit(m_retrainBitmap,m_numSeg-1);
+                bitmap_erase_bit(m_retrainBitmap[threadID],numSeg-1);
             }
 
             m_keys[threadID].insert(m_keys[threadID].end()-1,key);
@@ -1964,650 +1678,426 @@ int SWmeta<Type_Key,Type_Ts>::insert_end(uint32_t threadID, Type_Key key, SWseg<
             ++(m_ptr[threadID].back()->m_parentIndex);
             m_ptr[threadID].insert(m_ptr[threadID].end()-1,segPtr);
 
-            segPtr->m_parentIndex = m_numSeg-1;
-            update_segment_with_neighbours(threadID, m_numSeg-1, m_partitionIndex.back(), m_numSeg);
-            
-            ++m_numSeg;
+            segPtr->m_parentIndex = numSeg-1;
             ++m_numSegPerPartition[threadID];
-            ++m_numSegExist;
             ++m_numSegExistsPerPartition[threadID];
-            ++m_rightSearchBound;
+            update_segment_with_neighbours(threadID, numSeg-1);
+            ++m_rightSearchBound[threadID];
 
-            if (m_leftSearchBound + m_rightSearchBound > m_maxSearchError || (double)m_numSegExist / m_numSeg > 0.8)
-            {
-                return ((double)m_numSegExist / m_numSeg < 0.5) ? 2 : 1;
-            }
-            return 0;
+            return meta_retrain_status(threadID);
         }
+
         //Insert into numSeg
-        bitmap_set_bit(m_numSeg);
+        if (static_cast<int>(numSeg >> 6) == m_bitmap[threadID].size())
+        {
+            m_bitmap[threadID].push_back(0);
+            m_retrainBitmap[threadID].push_back(0);
+        }
+
+        bitmap_set_bit(threadID,numSeg);
         if (currentRetrainStatus)
         {
-            bitmap_set_bit(m_retrainBitmap,m_numSeg);
+            bitmap_set_bit(m_retrainBitmap[threadID],numSeg);
         }
 
         m_keys[threadID].push_back(key);
         m_ptr[threadID].push_back(segPtr);
-        ++m_numSeg;
-        ++m_numSegPerPartition[threadID];
 
-        segPtr->m_parentIndex = m_numSeg-1;
-        update_segment_with_neighbours(threadID, m_numSeg-1, m_partitionIndex.back(), m_numSeg-1);
-        ++m_numSegExist;
+        segPtr->m_parentIndex = numSeg;
+        ++m_numSegPerPartition[threadID];
         ++m_numSegExistsPerPartition[threadID];
-        
+        update_segment_with_neighbours(threadID, numSeg);
     }
     else //Replace numSeg
     {
         m_keys[threadID].back() = key;
         m_ptr[threadID].back() = segPtr;
-        bitmap_set_bit(m_numSeg-1);
+        bitmap_set_bit(threadID,numSeg-1);
         if (currentRetrainStatus)
         {
-            bitmap_set_bit(m_retrainBitmap,m_numSeg-1);
+            bitmap_set_bit(m_retrainBitmap[threadID],numSeg-1);
         }
-        segPtr->m_parentIndex = m_numSeg-1;
-        update_segment_with_neighbours(threadID, m_numSeg-1, m_partitionIndex.back(), m_numSeg-1);
-        ++m_numSegExist;
+        segPtr->m_parentIndex = numSeg-1;
         ++m_numSegExistsPerPartition[threadID];
+        update_segment_with_neighbours(threadID, numSeg-1);
     }
 
     return 0;
 }
 
+//Retrain partition threadID needs after an insertion: 0 = none, 1 = extend, 2 = retrain
 template<class Type_Key, class Type_Ts>
-int SWmeta<Type_Key,Type_Ts>::insert_append(uint32_t threadID, int insertionPos, Type_Key key, SWseg<Type_Key,Type_Ts>* segPtr, bool currentRetrainStatus)
+inline int SWmeta<Type_Key,Type_Ts>::meta_retrain_status(uint32_t threadID)
 {
-    ASSERT_MESSAGE(threadID == m_partitionIndex.size()-1, "SWmeta::insert_end must be called by last partition");
+    double occupancy = (double)m_numSegExistsPerPartition[threadID] / m_numSegPerPartition[threadID];
 
-    Type_Key lastKey = m_keys[threadID].back();
-    for (int index = m_numSeg; index <= insertionPos; ++index)
+    if (m_leftSearchBound[threadID] + m_rightSearchBound[threadID] > m_maxSearchError[threadID] || occupancy > 0.8)
     {
-        m_keys[threadID].push_back(lastKey);
-        m_ptr[threadID].push_back(nullptr);
-        ++m_numSeg;
-    }
-    m_keys[threadID].back() = key;
-    m_ptr[threadID].back() = segPtr;
-   
-    int bitmapExpandTimes = static_cast<int>(insertionPos >> 6) - (m_bitmap.size()-1);
-    for (int i = 0; i < bitmapExpandTimes; i++)
-    {
-        m_bitmap.push_back(0);
-        m_retrainBitmap.push_back(0);
-    }
-    bitmap_set_bit(insertionPos);
-    if (currentRetrainStatus)
-    {
-        bitmap_set_bit(m_retrainBitmap,insertionPos);
-    }
-
-    segPtr->m_parentIndex = insertionPos;
-    update_segment_with_neighbours(threadID, insertionPos, m_partitionIndex.back(), insertionPos);
-    ++m_numSegExist;
-    ++m_numSegExistsPerPartition[threadID];
-
-    if (((double)m_numSegExist) / (insertionPos+1) < 0.5)
-    {
-        return 2;
-    }
-    else if ((double)m_numSegExist / (insertionPos+1) > 0.8)
-    {
-        return 1;
-    }
-    else
-    {
-        return 0;
+        return (occupancy < 0.5) ? 2 : 1;
     }
+    return 0;
 }
 
 /*
 Meta Retrain
 */
+//Extends or retrains the model of partition threadID and lays out its segments (with the deferred ones) again.
+//Runs under the partition's lock only, other partitions keep running.
 template<class Type_Key, class Type_Ts>
-void SWmeta<Type_Key,Type_Ts>::meta_retrain()
-{    
+void SWmeta<Type_Key,Type_Ts>::meta_retrain(uint32_t threadID)
+{
     //Load retrain method
-    int retrainMethod = thread_retraining % 10; //1 = extend, 2 = retrain
-    retrainMethod = ((double)m_numSegExist/(m_numSeg*1.05) < 0.5) ? 2 : retrainMethod;
-
-    //Retrain Meta (calculate slope) without lock
-    vector<Type_Key> keys;
-    flatten_partition_keys(keys);
-    vector<uint64_t> bitmap = m_bitmap;
-    int numSeg = m_numSeg;
-    
-    double slopeTemp = m_slope;
-    if (retrainMethod == 1) //Extend
-    {
-        slopeTemp *= 1.05;
-    }
-    else //Retrain
-    {
-        int firstIndex;
-        Type_Key firstKey;
-        double nomalizedKey;
-        double sumKey = 0, sumIndex = 0, sumKeyIndex = 0, sumKeySquared = 0;
-        int cnt = 0;
-        for (int i = 0; i < numSeg; ++i)
-        {
-            if (bitmap_exists(bitmap,i))
-            {               
-                if (!cnt)
-                {
-                    firstIndex = keys[i];
-                    firstIndex = i;
-                }
-                nomalizedKey = (double)keys[i] - firstKey;
-                sumKey += nomalizedKey;
-                sumIndex += cnt;
-                sumKeyIndex += nomalizedKey * cnt;
-                sumKeySquared += (double)pow(nomalizedKey,2);
-                ++cnt;
-            }
-        }
-        if (cnt == 1)
-        {
-            slopeTemp = -1;
-        }
-        else
-        {
-            slopeTemp =  (sumKeyIndex - sumKey *(sumIndex/cnt))/(sumKeySquared - sumKey*(sumKey/cnt)) * 1.05;
-        }
-    }
-    keys.clear();
-    bitmap.clear();
+    int retrainMethod = m_retrainStatus[threadID]; //1 = extend, 2 = retrain
+    retrainMethod = ((double)m_numSegExistsPerPartition[threadID]/(m_numSegPerPartition[threadID]*1.05) < 0.5) ? 2 : retrainMethod;
 
-    vector<Type_Key> tempKey;
-    vector<SWseg<Type_Key,Type_Ts>*> tempPtr;
+    //Expire up to the partition's watermark (only its own tasks read its segments)
+    Type_Ts expiryTime = calculate_expiry_time(m_parititonMaxTime[threadID]);
 
-    // LOG_DEBUG("[Thread %u finish retraining model]", thread_retraining.load()/10);
-    
-    //Lock all threads
-    vector<unique_lock<mutex>> locks(m_partitionIndex.size());
-    for (uint32_t threadID = 0; threadID < m_partitionIndex.size(); ++threadID)
-    {
-        locks[threadID] = unique_lock<mutex>(thread_lock[threadID]);
-        lock_thread(threadID+1,locks[threadID]);
-    }
-
-    //Find max timestamp 
-    Type_Ts maxTimeStamp = *max_element(m_parititonMaxTime.begin(), m_parititonMaxTime.end());
-    Type_Ts expiryTime =  ((double)maxTimeStamp - TIME_WINDOW < numeric_limits<Type_Ts>::min()) ? numeric_limits<Type_Ts>::min(): maxTimeStamp - TIME_WINDOW;
+    vector<tuple<Type_Key,SWseg<Type_Key,Type_Ts>*,bool>> segments;
+    flatten_partition_retrain(threadID, expiryTime, segments);
 
-    if (slopeTemp != -1)
-    {
-        m_slope = slopeTemp;
-        retrain_model_combine_data(expiryTime, tempKey, tempPtr);
-    }
-    else
+    double slope;
+    if (retrainMethod == 1 && m_slope[threadID] != -1 && segments.size() > 1) //Extend
     {
-        retrain_combine_data(expiryTime, tempKey, tempPtr);
+        slope = m_slope[threadID] * 1.05;
     }
-    
-    #if PARTITION_METHOD == 0
-    partition_data_into_threads(m_partitionIndex.size(), tempKey, tempPtr);
-    #elif PARTITION_METHOD == 1
-    partition_data_into_threads_no_empty(m_partitionIndex.size(), tempKey, tempPtr);
-    #else
-    ASSERT_MESSAGE( 1 == 0, "PARTITION_METHOD is not defined, either 0 or 1")
-    #endif
-    
-    m_parititonMaxTime = vector<Type_Ts>(m_partitionIndex.size(),maxTimeStamp);
-    
-    thread_retraining = -1;
-
-    //Unlock all threads
-    for (uint32_t threadID = 0; threadID < m_partitionIndex.size(); ++threadID)
+    else //Retrain
     {
-        unlock_thread(threadID+1,locks[threadID]);
+        slope = fit_partition_slope(segments);
     }
 
-    // LOG_DEBUG("Retrain Partition finished");
+    layout_partition(threadID, slope, segments);
+    m_retrainStatus[threadID] = 0;
 }
 
 /*
 Retrain helpers
 */
+//Segments of partition threadID and its deferred segments that have not expired, sorted by key (expired ones are deleted)
 template<class Type_Key, class Type_Ts>
-vector<tuple<key_type,SWseg<key_type,time_type>*,bool>> SWmeta<Type_Key,Type_Ts>::flatten_partition_retrain(Type_Ts expiryTime)
+void SWmeta<Type_Key,Type_Ts>::flatten_partition_retrain(uint32_t threadID, Type_Ts expiryTime, vector<tuple<Type_Key,SWseg<Type_Key,Type_Ts>*,bool>> & segments)
 {
-    //Unload all segments from retrain insertion queue
-    vector<tuple<key_type,SWseg<key_type,time_type>*,bool>> insertionQueue;
-    insertionQueue.reserve(retrain_insertion_queue.size_approx());
+    vector<tuple<Type_Key,SWseg<Type_Key,Type_Ts>*,bool>> & deferredSeg = m_deferredSeg[threadID];
+    segments.reserve(m_numSegExistsPerPartition[threadID] + deferredSeg.size());
 
-    tuple<key_type,SWseg<key_type,time_type>*,bool> insertionSeg;
-    bool found = retrain_insertion_queue.try_dequeue(insertionSeg);
-    while (found)
+    for (int i = 0; i < m_numSegPerPartition[threadID]; ++i)
     {
-        if (get<1>(insertionSeg)->m_maxTimeStamp >= expiryTime)
-        {
-            insertionQueue.push_back(insertionSeg);
-        }
-        else
+        if (bitmap_exists(threadID,i))
         {
-            delete get<1>(insertionSeg);
-        }
-        found = retrain_insertion_queue.try_dequeue(insertionSeg);
-    }
-    insertionQueue.shrink_to_fit();
-
-    sort(insertionQueue.begin(),insertionQueue.end(),
-            [](const tuple<Type_Key,SWseg<Type_Key,Type_Ts>*,bool>&a, const tuple<Type_Key,SWseg<Type_Key,Type_Ts>*,bool>&b)
+            SWseg<Type_Key,Type_Ts>* segPtr = m_ptr[threadID][i];
+            if (segPtr->m_maxTimeStamp >= expiryTime)
             {
-                return get<0>(a) < get<0>(b);
-            });
-
-    return insertionQueue;
-}
-
-template<class Type_Key, class Type_Ts>
-void SWmeta<Type_Key,Type_Ts>::retrain_model_combine_data(Type_Ts expiryTime, vector<Type_Key> & tempKey, vector<SWseg<Type_Key,Type_Ts>*> & tempPtr)
-{
-    //Get all segments from retrain insertion queue
-    vector<tuple<key_type,SWseg<key_type,time_type>*,bool>> insertionQueue = flatten_partition_retrain(expiryTime);
-    
-    //Initiatlization 
-    vector<uint64_t> tempBitmap;
-    vector<uint64_t> tempRetrainBitmap;
-    tempKey.reserve(m_numSegExist + insertionQueue.size());
-    tempPtr.reserve(m_numSegExist + insertionQueue.size());
-    m_numSegExist = 0;
-    m_rightSearchBound = 0;
-    m_leftSearchBound = 0;
-
-    //Set up temporary variables
-    int startIndex = (bitmap_exists(0))? 0 : bitmap_closest_right_nongap(0, m_numSeg-1);
-    int partitionID = 0;
-    ASSERT_MESSAGE(startIndex < m_partitionIndex[1], "SWmeta::meta_retrain: startIndex should be in first partition");
-    
-    m_startKey = m_keys[partitionID][startIndex-m_partitionIndex[partitionID]];
-    int currentIndex = startIndex;
-    int partitionStartIndex = m_partitionIndex[partitionID];
-
-    int currentQueueIndex = 0;
-    int currentInsertionPos = 0;
-    int lastNonGapIndex = 0;
-    while (currentIndex < m_numSeg && currentQueueIndex < insertionQueue.size())
-    {    
-        if (partitionID < m_partitionIndex.size()-1 && currentIndex >= m_partitionIndex[partitionID+1])
-        {
-            ++partitionID;
-            partitionStartIndex = m_partitionIndex[partitionID];
-        }
-        if (bitmap_exists(currentIndex))
-        {
-            if (m_ptr[partitionID][currentIndex-partitionStartIndex]->m_maxTimeStamp >= expiryTime)
-            {
-                if (m_keys[partitionID][currentIndex-partitionStartIndex] < get<0>(insertionQueue[currentQueueIndex]))
-                {
-                    retrain_model_insert_segments(m_keys[partitionID][currentIndex-partitionStartIndex], 
-                                                m_ptr[partitionID][currentIndex-partitionStartIndex],
-                                                bitmap_exists(m_retrainBitmap,currentIndex), 
-                                                currentInsertionPos, lastNonGapIndex, currentIndex, 
-                                                tempKey, tempPtr, tempBitmap, tempRetrainBitmap);
-                }
-                else if (m_keys[partitionID][currentIndex-partitionStartIndex] > get<0>(insertionQueue[currentQueueIndex]))
-                {
-                    retrain_model_insert_segments(get<0>(insertionQueue[currentQueueIndex]), 
-                                                get<1>(insertionQueue[currentQueueIndex]),
-                                                get<2>(insertionQueue[currentQueueIndex]), 
-                                                currentInsertionPos, lastNonGapIndex, currentQueueIndex, 
-                                                tempKey, tempPtr, tempBitmap, tempRetrainBitmap);
-                }
-                else
-                {
-                    LOG_DEBUG_SHOW("SWmeta::meta_retrain: two segments have the same key");
-                }
+                segments.push_back(make_tuple(m_keys[threadID][i], segPtr, bitmap_exists(m_retrainBitmap[threadID],i)));
             }
             else
             {
-                delete m_ptr[partitionID][currentIndex-partitionStartIndex];
-                m_ptr[partitionID][currentIndex-partitionStartIndex] = nullptr;
-                ++currentIndex;
+                delete segPtr;
             }
-        }
-        else
-        {
-            ++currentIndex;
+            m_ptr[threadID][i] = nullptr;
         }
     }
+    int numSegments = segments.size();
 
-    while (currentIndex < m_numSeg)
+    for (auto & segment: deferredSeg)
     {
-        if (partitionID < m_partitionIndex.size()-1 && currentIndex >= m_partitionIndex[partitionID+1])
-        {
-            ++partitionID;
-            partitionStartIndex = m_partitionIndex[partitionID];
-        }
-
-        if (bitmap_exists(currentIndex))
+        if (get<1>(segment)->m_maxTimeStamp >= expiryTime)
         {
-            if (m_ptr[partitionID][currentIndex-partitionStartIndex]->m_maxTimeStamp >= expiryTime) //Segment has not expired
-            {
-                retrain_model_insert_segments(m_keys[partitionID][currentIndex-partitionStartIndex], 
-                                            m_ptr[partitionID][currentIndex-partitionStartIndex],
-                                            bitmap_exists(m_retrainBitmap,currentIndex), 
-                                            currentInsertionPos, lastNonGapIndex, currentIndex, 
-                                            tempKey, tempPtr, tempBitmap, tempRetrainBitmap);
-            }
-            else
-            {
-                delete m_ptr[partitionID][currentIndex-partitionStartIndex];
-                m_ptr[partitionID][currentIndex-partitionStartIndex] = nullptr;
-                ++currentIndex;
-            }
+            segments.push_back(segment);
         }
         else
         {
-            ++currentIndex;
+            delete get<1>(segment);
         }
     }
+    deferredSeg.clear();
+
+    auto compareKey = [](const tuple<Type_Key,SWseg<Type_Key,Type_Ts>*,bool>&a, const tuple<Type_Key,SWseg<Type_Key,Type_Ts>*,bool>&b)
+                        {
+                            return get<0>(a) < get<0>(b);
+                        };
+    sort(segments.begin()+numSegments, segments.end(), compareKey);
+    inplace_merge(segments.begin(), segments.begin()+numSegments, segments.end(), compareKey);
+}
+
+//Least squares slope of the rank of each segment over its normalized key (5% spare slots), -1 for a single segment
+template<class Type_Key, class Type_Ts>
+double SWmeta<Type_Key,Type_Ts>::fit_partition_slope(const vector<tuple<Type_Key,SWseg<Type_Key,Type_Ts>*,bool>> & segments)
+{
+    if (segments.size() <= 1)
+    {
+        return -1;
+    }
+
+    Type_Key firstKey = get<0>(segments.front());
+    double normalizedKey = 0, sumKey = 0, sumIndex = 0, sumKeyIndex = 0, sumKeySquared = 0;
+    int cnt = 0;
 
-    while (currentQueueIndex < insertionQueue.size())
+    for (auto & segment: segments)
     {
-        retrain_model_insert_segments(get<0>(insertionQueue[currentQueueIndex]), 
-                                    get<1>(insertionQueue[currentQueueIndex]),
-                                    get<2>(insertionQueue[currentQueueIndex]), 
-                                    currentInsertionPos, lastNonGapIndex, currentQueueIndex, 
-                                    tempKey, tempPtr, tempBitmap, tempRetrainBitmap);
+        normalizedKey = (double)get<0>(segment) - (double)firstKey;
+        sumKey += normalizedKey;
+        sumIndex += cnt;
+        sumKeyIndex += normalizedKey * cnt;
+        sumKeySquared += pow(normalizedKey,2);
+        ++cnt;
     }
-    tempPtr.front()->m_leftSibling = nullptr;
-    tempPtr[lastNonGapIndex]->m_rightSibling = nullptr;
 
-    m_rightSearchBound += 1;
-    m_maxSearchError = min(8192,(int)ceil(0.6*tempKey.size()));
-    m_bitmap = tempBitmap;
-    m_retrainBitmap = tempRetrainBitmap;
-    m_numSeg = tempKey.size();
-    tempKey.shrink_to_fit();
-    tempPtr.shrink_to_fit();
+    double denominator = sumKeySquared - sumKey*(sumKey/cnt);
+    return (denominator > 0) ? (sumKeyIndex - sumKey *(sumIndex/cnt))/denominator * 1.05 : -1;
 }
 
+//Places the segments (sorted) in the slots of partition threadID: at the slot slope predicts, or right after the
+//previous segment, with gaps in between (no gaps when slope == -1). Links siblings within the partition only.
 template<class Type_Key, class Type_Ts>
-void SWmeta<Type_Key,Type_Ts>::retrain_combine_data(Type_Ts expiryTime, vector<Type_Key> & tempKey, vector<SWseg<Type_Key,Type_Ts>*> & tempPtr)
+void SWmeta<Type_Key,Type_Ts>::layout_partition(uint32_t threadID, double slope, vector<tuple<Type_Key,SWseg<Type_Key,Type_Ts>*,bool>> & segments)
 {
-    //Get all segments from retrain insertion queue
-    vector<tuple<key_type,SWseg<key_type,time_type>*,bool>> insertionQueue = flatten_partition_retrain(expiryTime);
+    int numSegments = segments.size();
 
-    int totalSize = m_numSegExist+insertionQueue.size();
-    ASSERT_MESSAGE(totalSize < MAX_BUFFER_SIZE, "retrain m_slope = -1, but actual the number of keys is > MAX_BUFFER_SIZE");
-    ASSERT_MESSAGE(totalSize != 0, "retrain m_slope = -1, full index is empty");
+    vector<Type_Key> tempKey;
+    vector<SWseg<Type_Key,Type_Ts>*> tempPtr;
+    tempKey.reserve(numSegments*1.05 + 1);
+    tempPtr.reserve(numSegments*1.05 + 1);
 
-    int startIndex = (bitmap_exists(0))? 0 : bitmap_closest_right_nongap(0, m_numSeg-1);
-    int partitionID = 0;
-    
-    m_startKey = m_keys[partitionID][startIndex-m_partitionIndex[partitionID]];
+    Type_Key startKey = (numSegments) ? get<0>(segments.front()) : m_partitionStartKey[threadID].load();
+    int rightSearchBound = 0;
+    int currentInsertionPos = 0;
 
-    if (totalSize > 1)
+    for (int i = 0; i < numSegments; ++i)
     {
-        vector<uint64_t> tempBitmap;
-        vector<uint64_t> tempRetrainBitmap;
-        tempKey.reserve(totalSize);
-        tempPtr.reserve(totalSize);
-        m_numSegExist = 0;
-
-        int currentIndex = startIndex;
-        int partitionStartIndex = m_partitionIndex[partitionID];
-        int currentQueueIndex = 0;
-        int currentInsertionPos = 0;
-        
-        while (currentIndex < m_numSeg && currentQueueIndex < insertionQueue.size())
-        {    
-            if (partitionID < m_partitionIndex.size()-1 && currentIndex >= m_partitionIndex[partitionID+1])
-            {
-                ++partitionID;
-                partitionStartIndex = m_partitionIndex[partitionID];
-            }
-
-            if (bitmap_exists(currentIndex))
-            {
-                if (m_ptr[partitionID][currentIndex-partitionStartIndex]->m_maxTimeStamp >= expiryTime)
-                {
-                    
-                    if (m_keys[partitionID][currentIndex-partitionStartIndex] < get<0>(insertionQueue[currentQueueIndex]))
-                    {
-                        retrain_insert_segments(m_keys[partitionID][currentIndex-partitionStartIndex], 
-                                                m_ptr[partitionID][currentIndex-partitionStartIndex],
-                                                bitmap_exists(m_retrainBitmap,currentIndex), 
-                                                currentInsertionPos, currentIndex, 
-                                                tempKey, tempPtr, tempBitmap, tempRetrainBitmap);
-                    }
-                    else if (m_keys[partitionID][currentIndex-partitionStartIndex] > get<0>(insertionQueue[currentQueueIndex]))
-                    {
-                        retrain_insert_segments(get<0>(insertionQueue[currentQueueIndex]), 
-                                                get<1>(insertionQueue[currentQueueIndex]),
-                                                get<2>(insertionQueue[currentQueueIndex]), 
-                                                currentInsertionPos, currentQueueIndex, 
-                                                tempKey, tempPtr, tempBitmap, tempRetrainBitmap);
-                    }
-                    else
-                    {
-                        LOG_DEBUG_SHOW("SWmeta::meta_retrain: two segments have the same key");
-                    }
-                }
-                else
-                {
-                    delete m_ptr[partitionID][currentIndex-partitionStartIndex];
-                    m_ptr[partitionID][currentIndex-partitionStartIndex] = nullptr;
-                    ++currentIndex;
-                }
-            }
-            else
-            {
-                ++currentIndex;
-            }
-        }
+        Type_Key currentKey = get<0>(segments[i]);
+        SWseg<Type_Key,Type_Ts>* currentPtr = get<1>(segments[i]);
 
-        while (currentIndex < m_numSeg)
+        if (slope != -1)
         {
-            if (partitionID < m_partitionIndex.size()-1 && currentIndex >= m_partitionIndex[partitionID+1])
-            {
-                ++partitionID;
-                partitionStartIndex = m_partitionIndex[partitionID];
-            }
+            int predictedPos = static_cast<int>(floor(slope * ((double)currentKey - (double)startKey)));
 
-            if (bitmap_exists(currentIndex))
+            while (currentInsertionPos < predictedPos) //Gap
             {
-                if (m_ptr[partitionID][currentIndex-partitionStartIndex]->m_maxTimeStamp >= expiryTime) //Segment has not expired
-                {
-                    retrain_insert_segments(m_keys[partitionID][currentIndex-partitionStartIndex], 
-                                            m_ptr[partitionID][currentIndex-partitionStartIndex],
-                                            bitmap_exists(m_retrainBitmap,currentIndex), 
-                                            currentInsertionPos, currentIndex, 
-                                            tempKey, tempPtr, tempBitmap, tempRetrainBitmap);
-                }
-                else
-                {
-                    delete m_ptr[partitionID][currentIndex-partitionStartIndex];
-                    m_ptr[partitionID][currentIndex-partitionStartIndex] = nullptr;
-                    ++currentIndex;
-                }
-            }
-            else
-            {
-                ++currentIndex;
+                tempKey.push_back(tempKey.back());
+                tempPtr.push_back(nullptr);
+                ++currentInsertionPos;
             }
+            rightSearchBound = max(rightSearchBound, currentInsertionPos - predictedPos);
         }
 
-        while (currentQueueIndex < insertionQueue.size())
-        {
-            retrain_insert_segments(get<0>(insertionQueue[currentQueueIndex]), 
-                                    get<1>(insertionQueue[currentQueueIndex]),
-                                    get<2>(insertionQueue[currentQueueIndex]), 
-                                    currentInsertionPos, currentQueueIndex, 
-                                    tempKey, tempPtr, tempBitmap, tempRetrainBitmap);
-        }
-        tempPtr.front()->m_leftSibling = nullptr;
-        tempPtr.back()->m_rightSibling = nullptr;
+        currentPtr->m_parentIndex = currentInsertionPos;
+        currentPtr->m_leftSibling = (i > 0) ? get<1>(segments[i-1]) : nullptr;
+        currentPtr->m_rightSibling = (i < numSegments-1) ? get<1>(segments[i+1]) : nullptr;
 
-        m_bitmap = tempBitmap;
-        m_retrainBitmap = tempRetrainBitmap;
-        m_numSeg = tempKey.size();
-        tempKey.shrink_to_fit();
-        tempPtr.shrink_to_fit();
+        tempKey.push_back(currentKey);
+        tempPtr.push_back(currentPtr);
+        ++currentInsertionPos;
     }
-    else
-    {
-        Type_Key currentKey;
-        SWseg<Type_Key,Type_Ts>* currentPtr;
-        bool retrainFlag;
-        
-        if (m_numSegExist == 0)
-        {
-            currentKey = m_keys[partitionID][startIndex-m_partitionIndex[partitionID]];
-            currentPtr = m_ptr[partitionID][startIndex-m_partitionIndex[partitionID]];
-            retrainFlag = bitmap_exists(m_retrainBitmap,startIndex);
-        }
-        else
-        {
-            currentKey = get<0>(insertionQueue[0]);
-            currentPtr = get<1>(insertionQueue[0]);
-            retrainFlag = get<2>(insertionQueue[0]);
-        }
 
-        int bitmapSize = ceil(MAX_BUFFER_SIZE/64.);
-        vector<uint64_t> temp(bitmapSize,0);
-        
-        m_numSeg = 1;
-        m_numSegExist = 1;
-        m_bitmap = temp;
-        m_retrainBitmap = temp;
-        bitmap_set_bit(0);
-
-        if (retrainFlag)
+    //Bitmaps
+    int numSeg = tempKey.size();
+    vector<uint64_t> tempBitmap(max(1,(numSeg+63) >> 6),0);
+    vector<uint64_t> tempRetrainBitmap(tempBitmap.size(),0);
+    for (auto & segment: segments)
+    {
+        bitmap_set_bit(tempBitmap, get<1>(segment)->m_parentIndex);
+        if (get<2>(segment))
         {
-            bitmap_set_bit(m_retrainBitmap,0);
+            bitmap_set_bit(tempRetrainBitmap, get<1>(segment)->m_parentIndex);
         }
-        
-        currentPtr->m_parentIndex = 0;
-        currentPtr->m_leftSibling = nullptr;
-        currentPtr->m_rightSibling = nullptr;
-
-        tempKey.push_back(currentKey);
-        tempPtr.push_back(currentPtr);
     }
 
-    m_slope = -1;
-    m_rightSearchBound = 0;
-    m_leftSearchBound = 0;
+    m_keys[threadID].swap(tempKey);
+    m_ptr[threadID].swap(tempPtr);
+    m_bitmap[threadID].swap(tempBitmap);
+    m_retrainBitmap[threadID].swap(tempRetrainBitmap);
+    bitmap_summary_rebuild(threadID);
+
+    m_startKey[threadID] = startKey;
+    m_slope[threadID] = slope;
+    m_numSegPerPartition[threadID] = numSeg;
+    m_numSegExistsPerPartition[threadID] = numSegments;
+    m_partitionNumSeg[threadID].store(numSegments, memory_order_relaxed);
+    m_rightSearchBound[threadID] = (slope != -1) ? rightSearchBound + 1 : 0;
+    m_leftSearchBound[threadID] = 0;
+    m_maxSearchError[threadID] = min(8192,(int)ceil(0.6*numSeg));
 }
 
+/*
+Rebalancing
+*/
+//Dispatcher: partition fromID hands its keys beyond splitKey to its neighbour toID (migrate_segments). The caller
+//then sends a REBALANCE marker to both partitions. Returns false while the previous handoff is still pending, or if
+//fromID has no segment to give.
 template<class Type_Key, class Type_Ts>
-inline void SWmeta<Type_Key,Type_Ts>::retrain_model_insert_segments(Type_Key currentKey, SWseg<key_type,time_type>*currentPtr, bool currentIsRetrain,
-                                    int & currentInsertionPos, int & lastNonGapIndex, int & insertIndex,
-                                    vector<Type_Key> & tempKey, vector<SWseg<Type_Key,Type_Ts>*> & tempPtr,
-                                    vector<uint64_t> & tempBitmap, vector<uint64_t> & tempRetrainBitmap)
+bool SWmeta<Type_Key,Type_Ts>::request_handoff(uint32_t fromID, uint32_t toID, Type_Key splitKey)
 {
-    int  predictedPos = static_cast<int>(floor(m_slope * ((double)currentKey - (double)m_startKey)));
-                
-    if (static_cast<int>(currentInsertionPos >> 6) == tempBitmap.size())
+    if (m_handoffPending.load(memory_order_acquire))
     {
-        tempBitmap.push_back(0);
-        tempRetrainBitmap.push_back(0);
+        return false;
     }
 
-    if (predictedPos == currentInsertionPos)
+    if (fromID >= m_keys.size() || toID >= m_keys.size() || (fromID != toID+1 && toID != fromID+1))
     {
-        currentPtr->m_parentIndex = currentInsertionPos;
+        throw invalid_argument("SWmeta::request_handoff: partitions must exist and be adjacent");
+    }
 
-        tempKey.push_back(currentKey);
-        tempPtr.push_back(currentPtr);
-        if (lastNonGapIndex > 0)
-        {
-            tempPtr[lastNonGapIndex]->m_rightSibling = tempPtr.back();
-            tempPtr.back()->m_leftSibling = tempPtr[lastNonGapIndex];
-        }
-        bitmap_set_bit(tempBitmap, currentInsertionPos);
+    if (m_partitionNumSeg[fromID].load(memory_order_relaxed) == 0)
+    {
+        return false;
+    }
+
+    m_handoffFromID = fromID;
+    m_handoffToID = toID;
+    m_handoffKey = splitKey;
+    m_handoffArrived.store(0, memory_order_relaxed);
+    m_handoffPending.store(true, memory_order_release);
+    return true;
+}
 
-        if (currentIsRetrain)
+//Worker of either partition, at the REBALANCE marker: the first one to arrive waits (its partition is parked) and the
+//second one moves the segments, so neither partition runs a task while its boundary moves. m_handoffArrived goes
+//1 (first arrived), 2 (second arrived), 3 (moved). The first worker leaves last and only then clears m_handoffPending,
+//so the next request cannot reset the handoff while a worker still waits on it.
+template<class Type_Key, class Type_Ts>
+void SWmeta<Type_Key,Type_Ts>::handoff(uint32_t threadID)
+{
+    if (m_handoffArrived.fetch_add(1, memory_order_acq_rel) == 0)
+    {
+        while (m_handoffArrived.load(memory_order_acquire) != 3)
         {
-            bitmap_set_bit(tempRetrainBitmap,currentInsertionPos);
+            this_thread::yield();
         }
+        m_handoffPending.store(false, memory_order_release);
+        return;
+    }
 
-        ++insertIndex;
+    uint32_t leftID = min(m_handoffFromID, m_handoffToID);
+    uint32_t rightID = leftID + 1;
 
-        ++m_numSegExist;
-        lastNonGapIndex = currentInsertionPos;
-    }
-    else if (predictedPos < currentInsertionPos)
+    unique_lock<mutex> leftLock(m_partitionLock[leftID].lock);
+    lock_thread(leftID, leftLock);
+    unique_lock<mutex> rightLock(m_partitionLock[rightID].lock);
+    lock_thread(rightID, rightLock);
+
+    migrate_segments(m_handoffFromID, m_handoffToID, m_handoffKey);
+
+    unlock_thread(rightID, rightLock);
+    unlock_thread(leftID, leftLock);
+
+    m_handoffArrived.store(3, memory_order_release);
+}
+
+//Moves the keys of fromID beyond splitKey (from splitKey on if toID is the right neighbour, below it otherwise) to toID:
+//whole segments, and the segment holding splitKey is split. Then moves the start key of the right partition and lays
+//out both partitions again. fromID keeps at least one segment.
+template<class Type_Key, class Type_Ts>
+void SWmeta<Type_Key,Type_Ts>::migrate_segments(uint32_t fromID, uint32_t toID, Type_Key splitKey)
+{
+    uint32_t leftID = min(fromID, toID);
+    uint32_t rightID = leftID + 1;
+
+    vector<tuple<Type_Key,SWseg<Type_Key,Type_Ts>*,bool>> leftSegments, rightSegments;
+    flatten_partition_retrain(leftID, calculate_expiry_time(m_parititonMaxTime[leftID]), leftSegments);
+    flatten_partition_retrain(rightID, calculate_expiry_time(m_parititonMaxTime[rightID]), rightSegments);
+
+    vector<tuple<Type_Key,SWseg<Type_Key,Type_Ts>*,bool>> & fromSegments = (fromID == leftID) ? leftSegments : rightSegments;
+    auto belowSplitKey = [&]()
     {
-        currentPtr->m_parentIndex = currentInsertionPos;
+        return (int)(lower_bound(fromSegments.begin(), fromSegments.end(), splitKey, 
+                    [](const tuple<Type_Key,SWseg<Type_Key,Type_Ts>*,bool> & a, Type_Key key){return get<0>(a) < key;}) - fromSegments.begin());
+    };
 
-        tempKey.push_back(currentKey);
-        tempPtr.push_back(currentPtr);
-        if (lastNonGapIndex > 0)
+    int numBelow = belowSplitKey();
+    if (numBelow > 0) //The last segment below splitKey can hold keys from splitKey on
+    {
+        split_segment(numBelow-1, splitKey, calculate_expiry_time(m_parititonMaxTime[fromID]), fromSegments);
+        numBelow = belowSplitKey();
+    }
+
+    int numMove = (fromID == leftID) ? (int)fromSegments.size() - max(numBelow, 1) : min(numBelow, (int)fromSegments.size()-1);
+
+    if (numMove > 0)
+    {
+        //The first segment of the right partition may hold keys below its own key (down to the partition's start key).
+        //It is no longer first once segments move, so it is indexed from the old start key.
+        if (!rightSegments.empty())
         {
-            tempPtr[lastNonGapIndex]->m_rightSibling = tempPtr.back();
-            tempPtr.back()->m_leftSibling = tempPtr[lastNonGapIndex];
+            Type_Key rightStartKey = m_partitionStartKey[rightID];
+            get<0>(rightSegments.front()) = rightStartKey;
+            get<1>(rightSegments.front())->m_currentNodeStartKey = min(get<1>(rightSegments.front())->m_currentNodeStartKey, rightStartKey);
         }
-        bitmap_set_bit(tempBitmap, currentInsertionPos);
 
-        if (currentIsRetrain)
+        if (fromID == leftID) //Last segments of the left partition go to the front of the right one
         {
-            bitmap_set_bit(tempRetrainBitmap,currentInsertionPos);
+            rightSegments.insert(rightSegments.begin(), leftSegments.end()-numMove, leftSegments.end());
+            leftSegments.erase(leftSegments.end()-numMove, leftSegments.end());
         }
+        else //First segments of the right partition go to the end of the left one
+        {
+            leftSegments.insert(leftSegments.end(), rightSegments.begin(), rightSegments.begin()+numMove);
+            rightSegments.erase(rightSegments.begin(), rightSegments.begin()+numMove);
+        }
+        m_partitionStartKey[rightID] = get<0>(rightSegments.front());
 
-        m_rightSearchBound = (currentInsertionPos - predictedPos) > m_rightSearchBound.load() 
-                            ? (currentInsertionPos - predictedPos) : m_rightSearchBound.load();
-        
-        ++insertIndex;
-
-        ++m_numSegExist;
-        lastNonGapIndex = currentInsertionPos;
+        //Moved tuples expire no further than the watermark of the partition they came from
+        m_parititonMaxTime[toID] = min(m_parititonMaxTime[toID], m_parititonMaxTime[fromID]);
     }
-    else
-    {
-        tempKey.push_back((tempKey.size() == 0) ? numeric_limits<Type_Key>::min() : tempKey.back());
-        tempPtr.push_back(nullptr);
-    }
-    ++currentInsertionPos;
+
+    layout_partition(leftID, fit_partition_slope(leftSegments), leftSegments);
+    layout_partition(rightID, fit_partition_slope(rightSegments), rightSegments);
+    m_retrainStatus[leftID] = 0;
+    m_retrainStatus[rightID] = 0;
 }
 
+//Rebuilds segments[index] from its live tuples as a segment of its keys below splitKey and one of the others (none for
+//an empty side). The lower one keeps the key of the segment, as the buffer of a first segment can hold keys below its
+//start key.
 template<class Type_Key, class Type_Ts>
-inline void SWmeta<Type_Key,Type_Ts>::retrain_insert_segments(Type_Key currentKey, SWseg<key_type,time_type>*currentPtr, bool currentIsRetrain,
-                                    int & currentInsertionPos, int & insertIndex,
-                                    vector<Type_Key> & tempKey, vector<SWseg<Type_Key,Type_Ts>*> & tempPtr,
-                                    vector<uint64_t> & tempBitmap, vector<uint64_t> & tempRetrainBitmap)
-{                
-    if (static_cast<int>(currentInsertionPos >> 6) == tempBitmap.size())
-    {
-        tempBitmap.push_back(0);
-        tempRetrainBitmap.push_back(0);
-    }
+void SWmeta<Type_Key,Type_Ts>::split_segment(int index, Type_Key splitKey, Type_Ts expiryTime, vector<tuple<Type_Key,SWseg<Type_Key,Type_Ts>*,bool>> & segments)
+{
+    Type_Key segKey = get<0>(segments[index]);
+    SWseg<Type_Key,Type_Ts>* segPtr = get<1>(segments[index]);
+    segments.erase(segments.begin()+index);
 
-    currentPtr->m_parentIndex = currentInsertionPos;
+    //Its siblings may be deleted by the flatten already, layout_partition links the new segments
+    segPtr->m_leftSibling = nullptr;
+    segPtr->m_rightSibling = nullptr;
+    vector<pair<Type_Key,Type_Ts>> data;
+    segPtr->merge_data(expiryTime, data, 0, 0);
+    delete segPtr;
 
-    tempKey.push_back(currentKey);
-    tempPtr.push_back(currentPtr);
-    if (currentInsertionPos > 0)
+    auto build = [&](int startIndex, int endIndex)
     {
-        tempPtr[currentInsertionPos-1]->m_rightSibling = tempPtr.back();
-        tempPtr.back()->m_leftSibling = tempPtr[currentInsertionPos-1];
-    }
-    bitmap_set_bit(tempBitmap, currentInsertionPos);
+        if (startIndex == endIndex)
+        {
+            return new SWseg<Type_Key,Type_Ts>(data[startIndex], max_buffer_size());
+        }
+        double slope = (double)(endIndex - startIndex) / ((double)data[endIndex].first - (double)data[startIndex].first);
+        return new SWseg<Type_Key,Type_Ts>(startIndex, endIndex, slope, data, max_buffer_size());
+    };
 
-    if (currentIsRetrain)
+    int splitIndex = lower_bound(data.begin(), data.end(), make_pair(splitKey, (Type_Ts)0)) - data.begin();
+    if (splitIndex < data.size())
     {
-        bitmap_set_bit(tempRetrainBitmap,currentInsertionPos);
+        segments.insert(segments.begin()+index, make_tuple(data[splitIndex].first, build(splitIndex, data.size()-1), false));
+    }
+    if (splitIndex > 0)
+    {
+        SWseg<Type_Key,Type_Ts>* lowerPtr = build(0, splitIndex-1);
+        lowerPtr->m_currentNodeStartKey = min(lowerPtr->m_currentNodeStartKey, segKey);
+        segments.insert(segments.begin()+index, make_tuple(min(segKey, data.front().first), lowerPtr, false));
     }
-
-    ++insertIndex;
-    ++m_numSegExist;
-    ++currentInsertionPos;
 }
 
 /*
 Util functions
 */
 template<class Type_Key, class Type_Ts>
-inline tuple<int,int,int> SWmeta<Type_Key,Type_Ts>::find_predict_pos_bound(Type_Key targetKey)
+inline tuple<int,int,int> SWmeta<Type_Key,Type_Ts>::find_predict_pos_bound(uint32_t threadID, Type_Key targetKey)
 {
-    int predictPos = static_cast<int>(floor(m_slope * ((double)targetKey - (double)m_startKey)));
-    int predictPosMin = predictPos - m_leftSearchBound;
-    int predictPosMax = (m_rightSearchBound == 0) ? predictPos + 1 : predictPos + m_rightSearchBound;
+    int numSeg = m_numSegPerPartition[threadID];
+    double predictPosDouble = floor(m_slope[threadID] * ((double)targetKey - (double)m_startKey[threadID]));
+    int predictPos = (predictPosDouble < 0) ? 0 : ((predictPosDouble > numSeg) ? numSeg : static_cast<int>(predictPosDouble));
+    int predictPosMin = predictPos - m_leftSearchBound[threadID];
+    int predictPosMax = (m_rightSearchBound[threadID] == 0) ? predictPos + 1 : predictPos + m_rightSearchBound[threadID];
 
-    return (make_tuple(predictPos, predictPosMin < 0 ? 0 : predictPosMin, predictPosMax > m_numSeg-1 ? m_numSeg-1: predictPosMax));
+    return (make_tuple(predictPos, predictPosMin < 0 ? 0 : predictPosMin, predictPosMax > numSeg-1 ? numSeg-1: predictPosMax));
 }
 
 
@@ -2663,7 +2153,7 @@ inline int SWmeta<Type_Key,Type_Ts>::exponential_search_right_insert(uint32_t th
 
     int foundPos = lowerBoundIt - keys.begin();
 
-    if (*lowerBoundIt < targetKey && bitmap_exists(foundPos+m_partitionIndex[threadID]))
+    if (*lowerBoundIt < targetKey && bitmap_exists(threadID,foundPos))
     {
         ++foundPos;
     }
@@ -2730,7 +2220,7 @@ inline int SWmeta<Type_Key,Type_Ts>::exponential_search_left_insert(uint32_t thr
     
     int foundPos = lowerBoundIt - keys.begin();
 
-    if (*lowerBoundIt < targetKey && bitmap_exists(foundPos+m_partitionIndex[threadID]))
+    if (*lowerBoundIt < targetKey && bitmap_exists(threadID,foundPos))
     {
         ++foundPos;
     }
@@ -2743,31 +2233,16 @@ inline int SWmeta<Type_Key,Type_Ts>::exponential_search_left_insert(uint32_t thr
     return foundPos;
 
 }
-template<class Type_Key, class Type_Ts>
-inline uint32_t SWmeta<Type_Key,Type_Ts>::find_index_partition(int index)
-{
-    uint32_t threadID = 0;
-    for (int i = 1; i < m_partitionIndex.size(); ++i)
-    {
-        if (index >= m_partitionIndex[i])
-        {
-            ++threadID; 
-        }
-    }
-    return threadID;
-}
 
 template<class Type_Key, class Type_Ts>
 inline int SWmeta<Type_Key,Type_Ts>::find_first_segment_in_partition(uint32_t threadID)
 {
-    int firstSegmentIndex = m_partitionIndex[threadID];
+    if (m_numSegPerPartition[threadID] == 0) return -1;
 
-    if (!bitmap_exists(firstSegmentIndex))
+    int firstSegmentIndex = 0;
+    if (!bitmap_exists(threadID,firstSegmentIndex))
     {
-        firstSegmentIndex = bitmap_closest_right_nongap(firstSegmentIndex,
-            (threadID == m_partitionIndex.size()-1)? m_numSeg-1:m_partitionIndex[threadID+1]-1);
-        
-        if (firstSegmentIndex == -1) return -1;
+        firstSegmentIndex = bitmap_closest_right_nongap(threadID, firstSegmentIndex, m_numSegPerPartition[threadID]-1);
     }
     return firstSegmentIndex;
 }   
@@ -2775,89 +2250,64 @@ inline int SWmeta<Type_Key,Type_Ts>::find_first_segment_in_partition(uint32_t th
 template<class Type_Key, class Type_Ts>
 inline int SWmeta<Type_Key,Type_Ts>::find_last_segment_in_partition(uint32_t threadID)
 {
-    int lastSegmentIndex= (threadID == m_partitionIndex.size()-1)? m_numSeg-1 : m_partitionIndex[threadID+1]-1;
+    int lastSegmentIndex = m_numSegPerPartition[threadID]-1;
+    if (lastSegmentIndex < 0) return -1;
 
-    if (!bitmap_exists(lastSegmentIndex))
+    if (!bitmap_exists(threadID,lastSegmentIndex))
     {
-        lastSegmentIndex = bitmap_closest_left_nongap(lastSegmentIndex,m_partitionIndex[threadID]);
-        
-        if (lastSegmentIndex == -1) return -1;
+        lastSegmentIndex = bitmap_closest_left_nongap(threadID, lastSegmentIndex, 0);
     }
     return lastSegmentIndex;
 }
 
-
 template<class Type_Key, class Type_Ts>
-inline int SWmeta<Type_Key,Type_Ts>::find_closest_gap(int index)
+inline int SWmeta<Type_Key,Type_Ts>::find_closest_gap_within_thread(uint32_t threadID, int index)
+//Returns m_numSegPerPartition[threadID] when growing the partition at its end moves fewer slots than the closest gap
 {
-    if (bitmap_exists(index))
+    if (bitmap_exists(threadID,index))
     {
-        int gapPos = bitmap_closest_gap(index);
+        int numSeg = m_numSegPerPartition[threadID];
+        int gapPos = bitmap_closest_gap(threadID, index, 0, numSeg-1);
 
-        if (gapPos == -1)
+        if (gapPos == -1 || (gapPos < index && numSeg - index < index - gapPos))
         {
-            LOG_ERROR("No gap found in bitmap");
-            abort();
+            gapPos = numSeg;
         }
         return gapPos;
     }
     return index;
 }
 
-template<class Type_Key, class Type_Ts>
-inline int SWmeta<Type_Key,Type_Ts>::find_closest_gap(int index, int leftBoundary, int rightBoundary)
-{
-    if (bitmap_exists(index))
-    {
-        int gapPos = bitmap_closest_gap(index, leftBoundary, rightBoundary);
-
-        return (gapPos == -1)? -1 : gapPos;
-    }
-    return index;
-}
 
 template<class Type_Key, class Type_Ts>
-inline int SWmeta<Type_Key,Type_Ts>::find_closest_gap_within_thread(uint32_t threadID, int index)
+inline void SWmeta<Type_Key,Type_Ts>::update_segment_with_neighbours(uint32_t threadID, int index)
 {
-    if (bitmap_exists(index))
-    {
-        int gapPos = bitmap_closest_gap(index, m_partitionIndex[threadID],
-            (threadID == m_partitionIndex.size()-1)? m_numSeg.load():m_partitionIndex[threadID+1]-1);
-        //Last partition allow gapPos == m_numSeg;
+    ASSERT_MESSAGE(bitmap_exists(threadID,index), "Segment does not exist in bitmap");
 
-        return (gapPos == -1)? -1 : gapPos;
-    }
-    return index;
-}
-
-
-template<class Type_Key, class Type_Ts>
-inline void SWmeta<Type_Key,Type_Ts>::update_segment_with_neighbours(uint32_t threadID, int index, int startIndex, int endIndex)
-{
-    ASSERT_MESSAGE(bitmap_exists(index), "Segment does not exist in bitmap");
+    int endIndex = m_numSegPerPartition[threadID]-1;
 
     int leftNeighbour = -1;
-    if (startIndex < index)
+    if (0 < index)
     {
-        leftNeighbour = (bitmap_exists(index-1)) ? index-1: bitmap_closest_left_nongap(index-1,startIndex);
+        leftNeighbour = (bitmap_exists(threadID,index-1)) ? index-1: bitmap_closest_left_nongap(threadID,index-1,0);
     }
 
     if (leftNeighbour != -1)
     {
-        m_ptr[threadID][index-startIndex]->m_leftSibling = m_ptr[threadID][leftNeighbour-startIndex];
-        m_ptr[threadID][leftNeighbour-startIndex]->m_rightSibling = m_ptr[threadID][index-startIndex];
+        m_ptr[threadID][index]->m_leftSibling = m_ptr[threadID][leftNeighbour];
+        m_ptr[threadID][leftNeighbour]->m_rightSibling = m_ptr[threadID][index];
     }
 
     int rightNeighbour = -1;
     if (index < endIndex)
     {
-        rightNeighbour = (bitmap_exists(index+1)) ? index+1: bitmap_closest_right_nongap(index+1,endIndex);
+        rightNeighbour = (bitmap_exists(threadID,index+1)) ? index+1: bitmap_closest_right_nongap(threadID,index+1,endIndex);
     }
 
     if (rightNeighbour != -1)
     {
-        m_ptr[threadID][index-startIndex]->m_rightSibling = m_ptr[threadID][rightNeighbour-startIndex];
-        m_ptr[threadID][rightNeighbour-startIndex]->m_leftSibling = m_ptr[threadID][index-startIndex];
+        m_ptr[threadID][index]->m_rightSibling = m_ptr[threadID][rightNeighbour];
+        m_ptr[threadID][rightNeighbour]->m_leftSibling = m_ptr[threadID][index];
     }
 
 }
@@ -2867,213 +2317,158 @@ inline void SWmeta<Type_Key,Type_Ts>::update_keys_with_previous(uint32_t threadI
 {
     if (index) // Do not need to replace current key with previous key if it is the first segment
     {
-        int startIndex = m_partitionIndex[threadID];
-        int endIndex = (threadID == m_partitionIndex.size()-1)? m_numSeg-1 : m_partitionIndex[threadID+1]-1;
+        int endIndex = m_numSegPerPartition[threadID]-1;
+        Type_Key previousKey = m_keys[threadID][index-1];
         
-        Type_Key previousKey = (index == startIndex)? m_partitionStartKey[threadID]: m_keys[threadID][index-startIndex-1];
-        
-        m_keys[threadID][index-startIndex] = previousKey;
+        m_keys[threadID][index] = previousKey;
         ++index;
-        while (!bitmap_exists(index) && index <= endIndex)
+        while (index <= endIndex && !bitmap_exists(threadID,index))
         {
-            m_keys[threadID][index-startIndex] = previousKey;
+            m_keys[threadID][index] = previousKey;
             ++index;
         }
     }
 }
 
 template<class Type_Key, class Type_Ts>
-inline void SWmeta<Type_Key,Type_Ts>::flatten_partition_keys(vector<Type_Key> & data)
+void SWmeta<Type_Key,Type_Ts>::update_seg_parent_index(uint32_t threadID, int startPos, int endPos, bool incrementFlag)
+//Inclusive: [startPos, endPos]
 {
-    data.reserve(m_numSeg);
-    vector<vector<Type_Key>> tempKeys = m_keys;
-    for (auto & partition: tempKeys)
+    auto endIt = m_ptr[threadID].begin() + min<int>(endPos+1, m_ptr[threadID].size());
+
+    int increment = (incrementFlag)? 1 : -1;
+    for (auto it = m_ptr[threadID].begin() + startPos; it != endIt; ++it)
     {
-        for (auto & key: partition)
+        if ((*it) != nullptr)
         {
-            data.push_back(key);
+            (*it)->m_parentIndex += increment;
         }
     }
 }
 
+
 template<class Type_Key, class Type_Ts>
-bool SWmeta<Type_Key,Type_Ts>::borrow_gap_position_from_end(uint32_t threadID, int & gapPos) //Both threadID and threadID+1 locked
+inline void SWmeta<Type_Key,Type_Ts>::lock_thread(uint32_t threadID, unique_lock<mutex> & lock)
 {
-    ASSERT_MESSAGE(threadID != m_partitionIndex.size()-1, "borrow_gap_position_from_end cannot be called by last partition");
-    int startIndex = m_partitionIndex[threadID];
-    int endIndex = m_partitionIndex[threadID+1]-1;
-
-    unique_lock<mutex> lock(thread_lock[threadID]);
-    lock_thread(threadID, lock);
-    if (m_numSegExistsPerPartition[threadID] == m_numSegPerPartition[threadID]) {return false;}
-    
-    gapPos = bitmap_closest_left_gap(endIndex, startIndex);
-    ASSERT_MESSAGE(gapPos != -1, "borrow_gap_position_from_end: gapPos should not be -1 when there is gaps in partition");
-
-    if (gapPos != startIndex)
-    {
-        m_keys[threadID].erase(m_keys[threadID].begin()+(gapPos-startIndex));
-        update_seg_parent_index(threadID, gapPos, endIndex, false);
-        m_ptr[threadID].erase(m_ptr[threadID].begin()+(gapPos-startIndex));
-        bitmap_move_bit_front(endIndex, gapPos);
-        bitmap_move_bit_front(m_retrainBitmap, endIndex, gapPos);
-    }
-    else
+    while (m_partitionLock[threadID].occupied)
     {
-        m_keys[threadID].pop_back();
-        m_ptr[threadID].pop_back();
+        m_partitionLock[threadID].cv.wait(lock);
     }
-    --m_numSegPerPartition[threadID];
-    // DO NOT do this --m_numSeg, because this function is called by borrowing gaps.
-
-    --m_partitionIndex[threadID+1]; //threadID + 1 calls this function. (no need extra lock)
-    ++m_numSegPerPartition[threadID+1];
-    ++m_numSegExistsPerPartition[threadID+1];
-
-    unlock_thread(threadID, lock);
-    return true;
 }
 
 template<class Type_Key, class Type_Ts>
-bool SWmeta<Type_Key,Type_Ts>::borrow_gap_position_from_begin(uint32_t threadID, int & gapPos) //Both threadID and threadID-1 locked
+inline void SWmeta<Type_Key,Type_Ts>::unlock_thread(uint32_t threadID, unique_lock<mutex> & lock)
 {
-    ASSERT_MESSAGE(threadID != 0, "borrow_gap_position_from_begin cannot be called by first partition");
-    int startIndex = m_partitionIndex[threadID];
-    int endIndex = (threadID == m_partitionIndex.size()-1)? m_numSeg.load() :m_partitionIndex[threadID+1]-1;
-
-    unique_lock<mutex> lock(thread_lock[threadID]);
-    lock_thread(threadID, lock);
-    if (m_numSegExistsPerPartition[threadID] == m_numSegPerPartition[threadID]) {return false;}
-
-    gapPos = bitmap_closest_right_gap(startIndex, endIndex);
-    ASSERT_MESSAGE(gapPos != -1, "borrow_gap_position_from_begin: gapPos should not be -1 when there is gaps in partition");
-
-    if (gapPos != endIndex)
-    {
-        m_keys[threadID].erase(m_keys[threadID].begin()+(gapPos-startIndex));
-        update_seg_parent_index(threadID, startIndex, gapPos, true);
-        m_ptr[threadID].erase(m_ptr[threadID].begin()+(gapPos-startIndex));
-        bitmap_move_bit_back(startIndex,gapPos);
-        bitmap_move_bit_back(m_retrainBitmap,startIndex,gapPos);
-    }
-    else
-    {
-        m_keys[threadID].erase(m_keys[threadID].begin());
-        m_ptr[threadID].erase(m_ptr[threadID].begin());
-    }
-    --m_numSegPerPartition[threadID];
-    // --m_numSeg; //DO NOT do this, because this function is called by borrowing gaps.
-
-    ++m_partitionIndex[threadID];
-    ++m_numSegPerPartition[threadID-1];
-    ++m_numSegExistsPerPartition[threadID-1];
-
-    unlock_thread(threadID, lock);
-    return true;
+    m_partitionNumSeg[threadID].store(m_numSegExistsPerPartition[threadID], memory_order_relaxed);
+    m_partitionLock[threadID].occupied = false;
+    lock.unlock();
+    m_partitionLock[threadID].cv.notify_one();
 }
 
-
+/*
+Getters & Setters
+*/
 template<class Type_Key, class Type_Ts>
-void SWmeta<Type_Key,Type_Ts>::update_seg_parent_index(uint32_t threadID, int startPos, int endPos, bool incrementFlag)
-//Inclusive: [startPos, endPos]
+inline size_t SWmeta<Type_Key,Type_Ts>::get_meta_size()
 {
-    if (startPos == endPos) {return;}
-
-    int startIndex = m_partitionIndex[threadID];
-    int endIndex = (threadID == m_partitionIndex.size()-1)? m_numSeg.load() :m_partitionIndex[threadID+1]-1;
-
-    auto endIt = (endPos == endIndex)? m_ptr[threadID].end() : m_ptr[threadID].begin() + (endPos+1-startIndex);
-
-    int increment = (incrementFlag)? 1 : -1;
-    for (auto it = m_ptr[threadID].begin() + (startPos-startIndex); it != endIt; ++it)
+    size_t numSeg = 0;
+    for (auto & partitionSize: m_numSegPerPartition)
     {
-        if ((*it) != nullptr)
-        {
-            (*it)->m_parentIndex += increment;
-        }
+        numSeg += partitionSize;
     }
+    return numSeg;
 }
 
 template<class Type_Key, class Type_Ts>
-void SWmeta<Type_Key,Type_Ts>::update_seg_parent_index_normalized(uint32_t threadID, int startPos, int endPos, bool incrementFlag)
-//Inclusive: [startPos, endPos]: Normalized positions (actual index in m_ptr[threadID])
+inline size_t SWmeta<Type_Key,Type_Ts>::get_no_seg()
 {
-    if (startPos == endPos) {return;}
-
-    auto endIt = (endPos == m_ptr[threadID].size()-1)? m_ptr[threadID].end() : m_ptr[threadID].begin() + endPos+1;
-
-    int increment = (incrementFlag)? 1 : -1;
-    for (auto it = m_ptr[threadID].begin() + startPos; it != endIt; ++it)
+    size_t numSegExist = 0;
+    for (auto & partitionSize: m_numSegExistsPerPartition)
     {
-        if ((*it) != nullptr)
-        {
-            (*it)->m_parentIndex += increment;
-        }
+        numSegExist += partitionSize;
     }
+    return numSegExist;
 }
 
+template<class Type_Key, class Type_Ts>
+inline int SWmeta<Type_Key,Type_Ts>::get_split_error()
+{
+    return splitError;
+}
 
 template<class Type_Key, class Type_Ts>
-inline void SWmeta<Type_Key,Type_Ts>::lock_thread(uint32_t threadID, unique_lock<mutex> & lock)
+inline  void SWmeta<Type_Key,Type_Ts>::set_split_error(int error)
 {
-    while (thread_occupied[threadID])
-    {
-        thread_cv[threadID].wait(lock);
-    }
+    splitError = error;
 }
 
 template<class Type_Key, class Type_Ts>
-inline void SWmeta<Type_Key,Type_Ts>::unlock_thread(uint32_t threadID, unique_lock<mutex> & lock)
+inline uint64_t SWmeta<Type_Key,Type_Ts>::get_auto_tune_size()
 {
-    thread_occupied[threadID] = false;
-    lock.unlock();
-    thread_cv[threadID].notify_one();
+    #ifdef STATIC_PARAMS
+    return AUTO_TUNE_SIZE;
+    #else
+    return m_params.autoTuneSize;
+    #endif
 }
 
 /*
-Getters & Setters
+Per-Instance Parameters
 */
 template<class Type_Key, class Type_Ts>
-inline size_t SWmeta<Type_Key,Type_Ts>::get_meta_size()
+inline uint64_t SWmeta<Type_Key,Type_Ts>::time_window() const
 {
-    return m_numSeg;
+    #ifdef STATIC_PARAMS
+    return TIME_WINDOW;
+    #else
+    return m_params.timeWindow;
+    #endif
 }
 
 template<class Type_Key, class Type_Ts>
-inline size_t SWmeta<Type_Key,Type_Ts>::get_no_seg()
+inline int SWmeta<Type_Key,Type_Ts>::max_buffer_size() const
 {
-    return m_numSegExist;
+    #ifdef STATIC_PARAMS
+    return MAX_BUFFER_SIZE;
+    #else
+    return m_params.maxBufferSize;
+    #endif
 }
 
 template<class Type_Key, class Type_Ts>
-inline int SWmeta<Type_Key,Type_Ts>::get_split_error()
+inline int SWmeta<Type_Key,Type_Ts>::initial_error() const
 {
-    return splitError;
+    #ifdef STATIC_PARAMS
+    return INITIAL_ERROR;
+    #else
+    return m_params.initialError;
+    #endif
 }
 
 template<class Type_Key, class Type_Ts>
-inline  void SWmeta<Type_Key,Type_Ts>::set_split_error(int error)
+inline Type_Ts SWmeta<Type_Key,Type_Ts>::calculate_expiry_time(Type_Ts timestamp) const
 {
-    splitError = error;
+    return ((double)timestamp - time_window() < numeric_limits<Type_Ts>::min()) ? numeric_limits<Type_Ts>::min(): timestamp - time_window();
 }
 
+
 template<class Type_Key, class Type_Ts>
 void SWmeta<Type_Key,Type_Ts>::print()
 {
-    cout << "pswix: start key: " << m_startKey << ", slope: " << m_slope << endl;;
+    cout << "pswix: " << m_keys.size() << " partitions" << endl;
     for (int thread_id = 0; thread_id < m_keys.size(); ++thread_id)
     {
-        cout << "thread " << thread_id << 
-        "(num_exist=" << m_numSegExistsPerPartition[thread_id]
+        cout << "thread " << thread_id << "(start key: " << m_startKey[thread_id] << ", slope: " << m_slope[thread_id] <<
+        ", num_exist=" << m_numSegExistsPerPartition[thread_id]
             << ",num_seg=" << m_keys[thread_id].size() << "," << m_numSegPerPartition[thread_id] << ")" << endl;
         for (int i = 0; i < m_keys[thread_id].size(); ++i)
         {
-            if (bitmap_exists(m_partitionIndex[thread_id]+i))
+            if (bitmap_exists(thread_id,i))
             {
                 SWseg<Type_Key,Type_Ts>* seg = m_ptr[thread_id][i];
                 double occupancy = (double)seg->m_numPairExist/seg->m_numPair;
-                cout << m_partitionIndex[thread_id]+i << "(" <<  i  << "): ";
-                cout << m_keys[thread_id][i] << "(1)[" << (int)bitmap_exists(m_retrainBitmap,m_partitionIndex[thread_id]+i) << "] ";
+                cout << i << ": ";
+                cout << m_keys[thread_id][i] << "(1)[" << (int)bitmap_exists(m_retrainBitmap[thread_id],i) << "] ";
                 cout << occupancy;
                 if (seg->m_leftSibling != nullptr)
                 {
@@ -3087,7 +2482,7 @@ void SWmeta<Type_Key,Type_Ts>::print()
             }
             else
             {
-                cout << m_partitionIndex[thread_id]+i << "(" <<  i  << "): ";
+                cout << i << ": ";
                 cout << m_keys[thread_id][i] << "(0)" << endl;
             }
         }
@@ -3106,13 +2501,13 @@ void SWmeta<Type_Key,Type_Ts>::print()
 template<class Type_Key, class Type_Ts>
 void  SWmeta<Type_Key,Type_Ts>::print_all()
 {
-    printf("pswix: start key: %llu, slope: %g \n", m_startKey, m_slope);
+    printf("pswix: %d partitions \n", (int)m_keys.size());
     for (int thread_id = 0; thread_id < m_keys.size(); ++thread_id)
     {
-        printf("thread %d (num_seg=%d) \n", thread_id, m_keys[thread_id].size());
+        printf("thread %d (start key: %llu, slope: %g, num_seg=%d) \n", thread_id, m_startKey[thread_id], m_slope[thread_id], m_keys[thread_id].size());
         for (int i = 0; i < m_keys[thread_id].size(); ++i)
         {
-            if (bitmap_exists(m_partitionIndex[thread_id]+i))
+            if (bitmap_exists(thread_id,i))
             {
                 printf("***************************** \n");
                 printf("%llu(1) \n", m_keys[thread_id][i]);
@@ -3137,14 +2532,14 @@ void  SWmeta<Type_Key,Type_Ts>::print_occupancy()
     int numSeg = 0;
     double avgOccupancy = 0.0;
 
-    printf("pswix: start key: %llu, root occupancy: %f \n", m_startKey, (double)m_numSegExist/m_numSeg);
+    printf("pswix: root occupancy: %f \n", (double)get_no_seg()/get_meta_size());
     for (int thread_id = 0; thread_id < m_keys.size(); ++thread_id)
     {
-        printf("thread %d (num_seg=%d, thread occupancy=%f) \n", 
-            thread_id, m_keys[thread_id].size(), (double)m_numSegExistsPerPartition[thread_id]/m_numSegPerPartition[thread_id]);
+        printf("thread %d (start key: %llu, num_seg=%d, thread occupancy=%f) \n", 
+            thread_id, m_startKey[thread_id], m_keys[thread_id].size(), (double)m_numSegExistsPerPartition[thread_id]/m_numSegPerPartition[thread_id]);
         for (int i = 0; i < m_keys[thread_id].size(); ++i)
         {
-            if (bitmap_exists(m_partitionIndex[thread_id]+i))
+            if (bitmap_exists(thread_id,i))
             {
                 double occupancy = (double)m_ptr[thread_id][i]->m_numPairExist/m_ptr[thread_id][i]->m_numPair;
                 printf("%llu (%f) \n", m_keys[thread_id][i],occupancy);
@@ -3162,39 +2557,59 @@ template <class Type_Key, class Type_Ts>
 inline uint64_t SWmeta<Type_Key,Type_Ts>::memory_usage()
 {
     uint64_t segSize = 0;
-    for (auto & partition: m_ptr)
+    uint64_t partitionSize = 0;
+    for (int thread_id = 0; thread_id < m_ptr.size(); ++thread_id)
     {
-        for (auto & seg: partition)
+        for (auto & seg: m_ptr[thread_id])
         {
             if (seg != nullptr)
             {
                 segSize += seg->memory_usage();
             }
         }
+        for (auto & segment: m_deferredSeg[thread_id])
+        {
+            segSize += get<1>(segment)->memory_usage();
+        }
+
+        partitionSize += sizeof(Type_Key)*m_keys[thread_id].size() + sizeof(SWseg<Type_Key,Type_Ts>*)*m_ptr[thread_id].size() +
+                        sizeof(uint64_t)*(m_bitmap[thread_id].size() + m_retrainBitmap[thread_id].size() + 
+                                        m_bitmapSummary[thread_id].size() + m_bitmapFullSummary[thread_id].size()) +
+                        sizeof(tuple<Type_Key,SWseg<Type_Key,Type_Ts>*,bool>)*m_deferredSeg[thread_id].size();
     }
 
-    return sizeof(int) + sizeof(atomic<int>)*5 + 
-            sizeof(Type_Key) + sizeof(double) +
-            sizeof(vector<int>)*3 + sizeof(int)*m_partitionIndex.size() + 
-            sizeof(vector<Type_Ts>) + sizeof(Type_Ts)*m_partitionIndex.size() +
-            sizeof(vector<Type_Key>) + sizeof(Type_Key)*m_partitionIndex.size() +
-            sizeof(vector<uint64_t>)*2 + sizeof(uint64_t)*(m_bitmap.size()*2) +
-            sizeof(vector<vector<Type_Key>>) + sizeof(vector<Type_Key>)*m_keys.size() + sizeof(Type_Key)*m_numSeg +
-            sizeof(vector<vector<SWseg<Type_Key,Type_Ts>*>>) + sizeof(vector<SWseg<Type_Key,Type_Ts>*>)*m_ptr.size() 
-                                                                + sizeof(SWseg<Type_Key,Type_Ts>*)*m_numSeg + segSize;
+    uint64_t paramSize = 0;
+    #ifndef STATIC_PARAMS
+    paramSize = sizeof(SWparams);
+    #endif
+
+    return sizeof(int) + 
+            sizeof(vector<int>)*6 + sizeof(int)*6*m_keys.size() + 
+            sizeof(vector<Type_Key>)*2 + sizeof(Type_Key)*2*m_keys.size() +
+            sizeof(vector<double>) + sizeof(double)*m_keys.size() +
+            sizeof(vector<Type_Ts>) + sizeof(Type_Ts)*m_keys.size() +
+            sizeof(vector<vector<uint64_t>>)*4 + sizeof(vector<uint64_t>)*4*m_keys.size() +
+            sizeof(vector<vector<Type_Key>>) + sizeof(vector<Type_Key>)*m_keys.size() +
+            sizeof(vector<vector<SWseg<Type_Key,Type_Ts>*>>) + sizeof(vector<SWseg<Type_Key,Type_Ts>*>)*m_ptr.size() +
+            sizeof(vector<vector<tuple<Type_Key,SWseg<Type_Key,Type_Ts>*,bool>>>) + 
+            sizeof(vector<tuple<Type_Key,SWseg<Type_Key,Type_Ts>*,bool>>)*m_deferredSeg.size() + 
+            partitionSize + segSize + paramSize;
 }
 
 template <class Type_Key, class Type_Ts>
 inline uint64_t SWmeta<Type_Key,Type_Ts>::get_no_keys(Type_Ts Timestamp)
 {
-    Type_Ts expiryTime =  ((double)Timestamp - TIME_WINDOW < numeric_limits<Type_Ts>::min()) ? numeric_limits<Type_Ts>::min(): Timestamp - TIME_WINDOW;
+    Type_Ts expiryTime = calculate_expiry_time(Timestamp);
 
     uint64_t cnt = 0;
-    for (int i = 0; i < m_numSeg; i++)
+    for (int thread_id = 0; thread_id < m_keys.size(); ++thread_id)
     {
-        if (bitmap_exists(i))
+        for (int i = 0; i < m_numSegPerPartition[thread_id]; i++)
         {
-            cnt += m_ptr[i]->get_no_keys(expiryTime);
+            if (bitmap_exists(thread_id,i))
+            {
+                cnt += m_ptr[thread_id][i]->get_no_keys(expiryTime);
+            }
         }
     }
     
@@ -3205,11 +2620,11 @@ inline uint64_t SWmeta<Type_Key,Type_Ts>::get_no_keys(Type_Ts Timestamp)
 Bitmap Operations
 */
 template<class Type_Key, class Type_Ts>
-inline bool SWmeta<Type_Key,Type_Ts>::bitmap_exists(int index) const
+inline bool SWmeta<Type_Key,Type_Ts>::bitmap_exists(uint32_t threadID, int index) const
 {
     int bitmapPos = index >> 6;
     int bitPos = index - (bitmapPos << 6);
-    return static_cast<bool>(m_bitmap[bitmapPos] & (1ULL << bitPos));
+    return static_cast<bool>(m_bitmap[threadID][bitmapPos] & (1ULL << bitPos));
 }
 
 template<class Type_Key, class Type_Ts>
@@ -3221,12 +2636,13 @@ inline bool SWmeta<Type_Key,Type_Ts>::bitmap_exists(vector<uint64_t> & bitmap, i
 }
 
 template<class Type_Key, class Type_Ts>
-inline void SWmeta<Type_Key,Type_Ts>::bitmap_set_bit(int index)
+inline void SWmeta<Type_Key,Type_Ts>::bitmap_set_bit(uint32_t threadID, int index)
 {
     int bitmapPos = index >> 6;
     int bitPos = index - (bitmapPos << 6);
 
-    m_bitmap[bitmapPos] |= (1ULL << bitPos); 
+    m_bitmap[threadID][bitmapPos] |= (1ULL << bitPos); 
+    bitmap_summary_update(threadID, bitmapPos);
 }
 
 template<class Type_Key, class Type_Ts>
@@ -3239,11 +2655,12 @@ inline void SWmeta<Type_Key,Type_Ts>::bitmap_set_bit(vector<uint64_t> & bitmap,
 }
 
 template<class Type_Key, class Type_Ts>
-inline void SWmeta<Type_Key,Type_Ts>::bitmap_erase_bit(int index)
+inline void SWmeta<Type_Key,Type_Ts>::bitmap_erase_bit(uint32_t threadID, int index)
 {
     int bitmapPos = index >> 6;
     int bitPos = index - (bitmapPos << 6);
-    m_bitmap[bitmapPos] &= ~(1ULL << bitPos);
+    m_bitmap[threadID][bitmapPos] &= ~(1ULL << bitPos);
+    bitmap_summary_update(threadID, bitmapPos);
 }
 
 template<class Type_Key, class Type_Ts>
@@ -3256,25 +2673,25 @@ inline void SWmeta<Type_Key,Type_Ts>::bitmap_erase_bit(vector<uint64_t> & bitmap
 
 
 template<class Type_Key, class Type_Ts>
-inline int SWmeta<Type_Key,Type_Ts>::bitmap_closest_left_nongap(int index, int leftBoundary)
+inline int SWmeta<Type_Key,Type_Ts>::bitmap_closest_left_nongap(uint32_t threadID, int index, int leftBoundary)
 {
     int bitmapPos = index >> 6;
     int bitPos = index - (bitmapPos << 6);
 
     int boundaryBitmapPos = leftBoundary >> 6;
 
-    uint64_t currentBitmap = m_bitmap[bitmapPos];
+    uint64_t currentBitmap = m_bitmap[threadID][bitmapPos];
     currentBitmap &= ((1ULL << (bitPos)) - 1); //Erase all bits after the index (set them to 0)
 
     while(currentBitmap == 0) 
     //If current set of bitmap is empty (find previous bitmap that is not empty)
     {
-        --bitmapPos;
+        bitmapPos = bitmap_summary_prev(m_bitmapSummary[threadID], 0, bitmapPos - 1);
         if (bitmapPos < boundaryBitmapPos )
         {
             return -1; //Out of bounds
         }
-        currentBitmap = m_bitmap[bitmapPos];
+        currentBitmap = m_bitmap[threadID][bitmapPos];
     }
 
     // __builtin_clzll(currentBitmap) //Non x86instric.h equivalent for gcc.
@@ -3283,74 +2700,25 @@ inline int SWmeta<Type_Key,Type_Ts>::bitmap_closest_left_nongap(int index, int l
 }
 
 template<class Type_Key, class Type_Ts>
-inline int SWmeta<Type_Key,Type_Ts>::bitmap_closest_right_nongap(int index, int rightBoundary)
+inline int SWmeta<Type_Key,Type_Ts>::bitmap_closest_right_nongap(uint32_t threadID, int index, int rightBoundary)
 {
     int bitmapPos = index >> 6;
     int bitPos = index - (bitmapPos << 6);
 
     int boundaryBitmapPos = rightBoundary >> 6;
 
-    uint64_t currentBitmap = m_bitmap[bitmapPos];
+    uint64_t currentBitmap = m_bitmap[threadID][bitmapPos];
     currentBitmap &= ~((1ULL << (bitPos)) - 1); //Erase all bits before the index (set them to 0)
 
     while(currentBitmap == 0) 
     //If current set of bitmap is empty (find next bitmap that is not empty)
     {
-        ++bitmapPos;
+        bitmapPos = bitmap_summary_next(threadID, m_bitmapSummary[threadID], 0, bitmapPos + 1);
         if (bitmapPos > boundaryBitmapPos)
         {
             return -1;
         }
-        currentBitmap = m_bitmap[bitmapPos];
-    }
-
-    int return_index = bit_get_index(bitmapPos,bit_extract_rightmost_bit(currentBitmap));
-    return (return_index > rightBoundary) ? -1 : return_index;
-}
-
-template<class Type_Key, class Type_Ts>
-inline int SWmeta<Type_Key,Type_Ts>::bitmap_closest_left_gap(int index, int leftBoundary)
-{
-    int bitmapPos = index >> 6;
-    int bitPos = index - (bitmapPos << 6);
-
-    uint64_t currentBitmap = m_bitmap[bitmapPos];
-    currentBitmap &= ((1ULL << (bitPos)) - 1);
-    currentBitmap ^= ((1ULL << (bitPos)) - 1);
-
-    int leftBoundaryBitmapPos = leftBoundary >> 6;
-    while(currentBitmap == 0) 
-    {
-        --bitmapPos;
-        if (bitmapPos < leftBoundaryBitmapPos )
-        {
-            return -1;
-        }
-        currentBitmap = m_bitmap[bitmapPos] ^ numeric_limits<uint64_t>::max();
-    }
-    int return_index = (bitmapPos << 6) + (63-static_cast<int>(_lzcnt_u64(currentBitmap)));
-    return (return_index < leftBoundary) ? -1 : return_index;
-}
-
-template<class Type_Key, class Type_Ts>
-inline int SWmeta<Type_Key,Type_Ts>::bitmap_closest_right_gap(int index, int rightBoundary)
-{
-    int bitmapPos = index >> 6;
-    int bitPos = index - (bitmapPos << 6);
-
-    uint64_t currentBitmap = m_bitmap[bitmapPos];
-    currentBitmap &= ~((1ULL << (bitPos)) - 1);
-    currentBitmap ^= ~((1ULL << (bitPos)) - 1);
-
-    int rightBoundaryBitmapPos = rightBoundary >> 6;
-    while(currentBitmap == 0) 
-    {
-        bitmapPos++;
-        if (bitmapPos > rightBoundaryBitmapPos)
-        {
-           return -1;
-        }
-        currentBitmap = m_bitmap[bitmapPos] ^ numeric_limits<uint64_t>::max();
+        currentBitmap = m_bitmap[threadID][bitmapPos];
     }
 
     int return_index = bit_get_index(bitmapPos,bit_extract_rightmost_bit(currentBitmap));
@@ -3358,188 +2726,31 @@ inline int SWmeta<Type_Key,Type_Ts>::bitmap_closest_right_gap(int index, int rig
 }
 
 template<class Type_Key, class Type_Ts>
-inline int SWmeta<Type_Key,Type_Ts>::bitmap_closest_gap(int index)
-{
-    int bitmapPos = index >> 6;
-    int bitPos = index - (bitmapPos << 6);
-
-    //If bitmap block is full (check other blocks)
-    if (m_bitmap[bitmapPos] == numeric_limits<uint64_t>::max() || //block full
-       (bitmapPos == m_bitmap.size()-1 && _mm_popcnt_u64(m_bitmap[bitmapPos]) == (m_numSeg-((m_bitmap.size()-1)<<6))) //last block full
-       )
-    {
-        int maxLeftBlockDist = bitmapPos;
-        int maxRightBlockDist =  ((m_numSeg-1) >> 6) - bitmapPos;
-
-        if (m_bitmap.size() == 1)
-        {
-            return static_cast<int>(_tzcnt_u64(~m_bitmap[bitmapPos]));
-        }
-
-        if (m_numSeg == m_numSegExist)
-        {
-            return m_numSegExist;
-        }
-
-        int blockDist = 1;
-        int maxBothBlockDist = min<int>(maxLeftBlockDist,maxRightBlockDist);
-        
-        while (blockDist <= maxBothBlockDist)
-        {
-            uint64_t rightBitmap = m_bitmap[bitmapPos + blockDist];
-            uint64_t leftBitmap = m_bitmap[bitmapPos - blockDist];
-
-            //Both blocks have gaps (find closest)
-            if (leftBitmap != numeric_limits<uint64_t>::max() && rightBitmap != numeric_limits<uint64_t>::max())
-            {
-                int rightGap = ((bitmapPos + blockDist) << 6) + static_cast<int>(_tzcnt_u64(~rightBitmap));
-                int leftGap = ((bitmapPos - blockDist + 1) << 6) - static_cast<int>(_lzcnt_u64(~leftBitmap)) - 1;
-
-                if (rightGap - index < index - leftGap)
-                {
-                    return rightGap; //Can also be last position (need to check outside to append)
-                }
-                else
-                {
-                    return leftGap;
-                }
-            }
-            //Gap in right block only (Also need to check leftblock-1 if bitPos < 32)
-            else if (rightBitmap != numeric_limits<uint64_t>::max())
-            {
-                int rightGap = ((bitmapPos + blockDist) << 6) + static_cast<int>(_tzcnt_u64(~rightBitmap));
-
-                if (bitPos < 32 && bitmapPos - blockDist > 0 &&
-                    m_bitmap[bitmapPos - blockDist - 1] != numeric_limits<uint64_t>::max())
-                {
-                    int leftGap = ((bitmapPos - blockDist) << 6) - static_cast<int>(_lzcnt_u64(~m_bitmap[bitmapPos - blockDist - 1])) - 1;
-
-                    if (rightGap - index < index - leftGap)
-                    {
-                        return rightGap; //Can also be last position (need to check outside to append)
-                    }
-                    else
-                    {
-                        return leftGap;
-                    }
-                }
-                else
-                {
-                    return rightGap;
-                }
-            }
-            //Gap in left block only (Also need to check rightblock+1 if bitPos > 32)
-            else if (leftBitmap != numeric_limits<uint64_t>::max())
-            {
-                int leftGap = ((bitmapPos - blockDist + 1) << 6) - static_cast<int>(_lzcnt_u64(~leftBitmap)) - 1;
-
-                if (bitPos > 32 && bitmapPos + blockDist + 1 < m_bitmap.size() && 
-                    m_bitmap[bitmapPos + blockDist + 1] != numeric_limits<uint64_t>::max())
-                {
-                    int rightGap = ((bitmapPos + blockDist+1) << 6) + static_cast<int>(_tzcnt_u64(~m_bitmap[bitmapPos + blockDist + 1]));
-
-                    if (rightGap - index < index - leftGap)
-                    {
-                        return rightGap; //Can also be last position (need to check outside to append)
-                    }
-                    else
-                    {
-                        return leftGap;
-                    } 
-                }
-                else
-                {
-                    return leftGap;
-                }
-            }
-            blockDist++;
-        }
-
-        if (maxLeftBlockDist > maxRightBlockDist)
-        {
-            for (int i = bitmapPos - blockDist; i >= 0; i--)
-            {
-                if (m_bitmap[i] != numeric_limits<uint64_t>::max())
-                {
-                    return ((i + 1) << 6) - static_cast<int>(_lzcnt_u64(~m_bitmap[i])) - 1;
-                }
-            }
-        }
-        else
-        {
-            int rightBound = ((m_numSeg-1) >> 6);
-            for (int i = bitmapPos + blockDist; i <= rightBound; i++)
-            {
-                if (m_bitmap[i] != numeric_limits<uint64_t>::max())
-                {
-                    return (i << 6) + static_cast<int>(_tzcnt_u64(~m_bitmap[i]));
-                }
-            }
-        }
-        return -1; //Something went wrong (No Gap)
-
-    }
-    //There is a gap (somewhere) in current block
-    else
-    {
-        uint64_t currentBitmap = m_bitmap[bitmapPos];
-
-        int minRightGapDist = 64; //Find right closest gap
-        uint64_t rightGaps = ~(currentBitmap | ((1ULL << (bitPos)) - 1));
-        if (rightGaps)
-        {
-            minRightGapDist = static_cast<int>(_tzcnt_u64(rightGaps)) - bitPos;
-        }
-        else if (bitmapPos + 1 != m_bitmap.size())
-        {
-            minRightGapDist = static_cast<int>(_tzcnt_u64(~m_bitmap[bitmapPos+1])) + 64 - bitPos;
-        }
-
-        int minLeftGapDist = 64; //Find left closest gap
-        uint64_t leftGaps = (~currentBitmap) & ((1ULL << bitPos) - 1);
-        if (leftGaps)
-        {
-            minLeftGapDist = bitPos - (63 - static_cast<int>(_lzcnt_u64(leftGaps)));
-        }
-        else if (bitmapPos)
-        {
-            minLeftGapDist = bitPos + static_cast<int>(_lzcnt_u64(~m_bitmap[bitmapPos-1])) + 1;
-        }
-
-        if (minRightGapDist < minLeftGapDist)
-        {
-            return index + minRightGapDist;  //Can also be last position (need to check outside to append)
-        }
-        else
-        {
-            return index - minLeftGapDist;
-        }
-    }
-}
-
-template<class Type_Key, class Type_Ts>
-inline int SWmeta<Type_Key,Type_Ts>::bitmap_closest_gap(int index, int leftBoundary, int rightBoundary)
+inline int SWmeta<Type_Key,Type_Ts>::bitmap_closest_gap(uint32_t threadID, int index, int leftBoundary, int rightBoundary)
 {
     int bitmapPos = index >> 6;
     int bitPos = index - (bitmapPos << 6);
 
     int leftIndex;
-    uint64_t currentBitmap = m_bitmap[bitmapPos];
+    uint64_t currentBitmap = m_bitmap[threadID][bitmapPos];
     currentBitmap &= ((1ULL << (bitPos)) - 1);
     currentBitmap ^= ((1ULL << (bitPos)) - 1);
 
     int leftBoundaryBitmapPos = leftBoundary >> 6;
     while(currentBitmap == 0) 
     {
-        --bitmapPos;
+        bitmapPos = bitmap_summary_prev(m_bitmapFullSummary[threadID], numeric_limits<uint64_t>::max(), bitmapPos - 1);
         if (bitmapPos < leftBoundaryBitmapPos )
         {
             leftIndex = -1; //Out of bounds
             break;
         }
-        currentBitmap = m_bitmap[bitmapPos] ^ numeric_limits<uint64_t>::max();
+        currentBitmap = m_bitmap[threadID][bitmapPos] ^ numeric_limits<uint64_t>::max();
+    }
+    if (currentBitmap)
+    {
+        leftIndex = (bitmapPos << 6) + (63-static_cast<int>(_lzcnt_u64(currentBitmap)));
     }
-    leftIndex = (bitmapPos << 6) + (63-static_cast<int>(_lzcnt_u64(currentBitmap)));
 
     if (leftIndex < leftBoundary)
     {
@@ -3548,23 +2759,26 @@ inline int SWmeta<Type_Key,Type_Ts>::bitmap_closest_gap(int index, int leftBound
 
     int rightIndex;
     bitmapPos = index >> 6;
-    currentBitmap = m_bitmap[bitmapPos];
+    currentBitmap = m_bitmap[threadID][bitmapPos];
     currentBitmap &= ~((1ULL << (bitPos)) - 1);
     currentBitmap ^= ~((1ULL << (bitPos)) - 1);
 
     int rightBoundaryBitmapPos = rightBoundary >> 6;
     while(currentBitmap == 0) 
     {
-        bitmapPos++;
+        bitmapPos = bitmap_summary_next(threadID, m_bitmapFullSummary[threadID], numeric_limits<uint64_t>::max(), bitmapPos + 1);
         if (bitmapPos > rightBoundaryBitmapPos)
         {
             rightIndex = -1; //Out of bounds
             break;
         }
-        currentBitmap = m_bitmap[bitmapPos] ^ numeric_limits<uint64_t>::max();
+        currentBitmap = m_bitmap[threadID][bitmapPos] ^ numeric_limits<uint64_t>::max();
     }
 
-    rightIndex = bit_get_index(bitmapPos,bit_extract_rightmost_bit(currentBitmap));
+    if (currentBitmap)
+    {
+        rightIndex = bit_get_index(bitmapPos,bit_extract_rightmost_bit(currentBitmap));
+    }
 
     if (rightIndex > rightBoundary)
     {
@@ -3595,7 +2809,7 @@ inline int SWmeta<Type_Key,Type_Ts>::bitmap_closest_gap(int index, int leftBound
 }
 
 template<class Type_Key, class Type_Ts>
-inline pair<int,int> SWmeta<Type_Key,Type_Ts>::bitmap_retrain_range(int index)
+inline pair<int,int> SWmeta<Type_Key,Type_Ts>::bitmap_retrain_range(uint32_t threadID, int index)
 //Returns [leftExistIndex,rightExistIndex]. 
 //If leftExistIndex == rightExistIndex: retrain alone
 //Else: retrain with neighbours 
@@ -3604,34 +2818,34 @@ inline pair<int,int> SWmeta<Type_Key,Type_Ts>::bitmap_retrain_range(int index)
     int bitPos = index - (bitmapPos << 6);
 
     int tempBitmapPos = bitmapPos;
-    uint64_t tempBitmap = (m_retrainBitmap[bitmapPos] & m_bitmap[bitmapPos]);
+    uint64_t tempBitmap = (m_retrainBitmap[threadID][bitmapPos] & m_bitmap[threadID][bitmapPos]);
 
     int rightIndex = static_cast<int>(_tzcnt_u64(tempBitmap));
     int leftIndex = 63 - static_cast<int>(_lzcnt_u64(tempBitmap));
     
-    tempBitmap = (m_retrainBitmap[bitmapPos] ^ m_bitmap[bitmapPos]);
+    tempBitmap = (m_retrainBitmap[threadID][bitmapPos] ^ m_bitmap[threadID][bitmapPos]);
     tempBitmap &= ~((1ULL << (bitPos)) - 1);
 
     // leftIndex = min(leftIndex, static_cast<int>(_tzcnt_u64(tempBitmap))) + (bitmapPos << 6);
 
     leftIndex = min(leftIndex,static_cast<int>(_tzcnt_u64(tempBitmap))-1);
-    if (!static_cast<bool>(m_bitmap[bitmapPos] & (1ULL << leftIndex)))
+    if (!static_cast<bool>(m_bitmap[threadID][bitmapPos] & (1ULL << leftIndex)))
     {
-        uint64_t tempBitmap2 = (m_retrainBitmap[bitmapPos] & m_bitmap[bitmapPos]);
+        uint64_t tempBitmap2 = (m_retrainBitmap[threadID][bitmapPos] & m_bitmap[threadID][bitmapPos]);
         tempBitmap2 &= ((1ULL << (leftIndex+1)) - 1);
         leftIndex = min(leftIndex, 63 - static_cast<int>(_lzcnt_u64(tempBitmap2)));
     }
     leftIndex += (bitmapPos << 6);
 
-    if (tempBitmap == 0 && bitmapPos != m_bitmap.size()-1)
+    if (tempBitmap == 0 && bitmapPos != m_bitmap[threadID].size()-1)
     {
         tempBitmapPos++;
-        tempBitmap = (m_retrainBitmap[tempBitmapPos] ^ m_bitmap[tempBitmapPos]);
+        tempBitmap = (m_retrainBitmap[threadID][tempBitmapPos] ^ m_bitmap[threadID][tempBitmapPos]);
 
         int leftIndexTemp;
-        while (tempBitmap == 0 && tempBitmapPos != m_bitmap.size()-1)
+        while (tempBitmap == 0 && tempBitmapPos != m_bitmap[threadID].size()-1)
         {
-            leftIndexTemp = 63 - static_cast<int>(_lzcnt_u64((m_retrainBitmap[tempBitmapPos] & m_bitmap[tempBitmapPos])));
+            leftIndexTemp = 63 - static_cast<int>(_lzcnt_u64((m_retrainBitmap[threadID][tempBitmapPos] & m_bitmap[threadID][tempBitmapPos])));
 
             if (leftIndexTemp != -1)
             {
@@ -3639,10 +2853,10 @@ inline pair<int,int> SWmeta<Type_Key,Type_Ts>::bitmap_retrain_range(int index)
             }
             
             tempBitmapPos++;
-            tempBitmap = (m_retrainBitmap[tempBitmapPos] ^ m_bitmap[tempBitmapPos]);
+            tempBitmap = (m_retrainBitmap[threadID][tempBitmapPos] ^ m_bitmap[threadID][tempBitmapPos]);
         }
 
-        leftIndexTemp = 63 - static_cast<int>(_lzcnt_u64((m_retrainBitmap[tempBitmapPos] & m_bitmap[tempBitmapPos])));
+        leftIndexTemp = 63 - static_cast<int>(_lzcnt_u64((m_retrainBitmap[threadID][tempBitmapPos] & m_bitmap[threadID][tempBitmapPos])));
 
         if (leftIndexTemp != -1 && leftIndexTemp < static_cast<int>(_tzcnt_u64(tempBitmap)))
         {
@@ -3650,15 +2864,15 @@ inline pair<int,int> SWmeta<Type_Key,Type_Ts>::bitmap_retrain_range(int index)
         }
     }
 
-    tempBitmap = (m_retrainBitmap[bitmapPos] ^ m_bitmap[bitmapPos]);
+    tempBitmap = (m_retrainBitmap[threadID][bitmapPos] ^ m_bitmap[threadID][bitmapPos]);
     tempBitmap &= ((1ULL << (bitPos)) - 1);
 
     // rightIndex = max(rightIndex, 63 - (static_cast<int>(_lzcnt_u64(tempBitmap)))) + (bitmapPos << 6);
     
     rightIndex = max(rightIndex,64 - static_cast<int>(_lzcnt_u64(tempBitmap)));
-    if (!static_cast<bool>(m_bitmap[bitmapPos] & (1ULL << rightIndex)))
+    if (!static_cast<bool>(m_bitmap[threadID][bitmapPos] & (1ULL << rightIndex)))
     {
-        uint64_t tempBitmap2 = (m_retrainBitmap[bitmapPos] & m_bitmap[bitmapPos]);
+        uint64_t tempBitmap2 = (m_retrainBitmap[threadID][bitmapPos] & m_bitmap[threadID][bitmapPos]);
         tempBitmap2 &= ~((1ULL << (rightIndex)) - 1);
         rightIndex = max(rightIndex,static_cast<int>(_tzcnt_u64(tempBitmap2)));
     }
@@ -3667,12 +2881,12 @@ inline pair<int,int> SWmeta<Type_Key,Type_Ts>::bitmap_retrain_range(int index)
     if (tempBitmap == 0 && bitmapPos != 0)
     {
         tempBitmapPos = bitmapPos-1;
-        tempBitmap = (m_retrainBitmap[tempBitmapPos] ^ m_bitmap[tempBitmapPos]);
+        tempBitmap = (m_retrainBitmap[threadID][tempBitmapPos] ^ m_bitmap[threadID][tempBitmapPos]);
 
         int rightIndexTemp;
         while (tempBitmap == 0 && tempBitmapPos != 0)
         {
-            rightIndexTemp = static_cast<int>(_tzcnt_u64((m_retrainBitmap[tempBitmapPos] & m_bitmap[tempBitmapPos])));
+            rightIndexTemp = static_cast<int>(_tzcnt_u64((m_retrainBitmap[threadID][tempBitmapPos] & m_bitmap[threadID][tempBitmapPos])));
 
             if (rightIndexTemp != 64)
             {
@@ -3680,10 +2894,10 @@ inline pair<int,int> SWmeta<Type_Key,Type_Ts>::bitmap_retrain_range(int index)
             }
 
             tempBitmapPos--;
-            tempBitmap = (m_retrainBitmap[tempBitmapPos] ^ m_bitmap[tempBitmapPos]);
+            tempBitmap = (m_retrainBitmap[threadID][tempBitmapPos] ^ m_bitmap[threadID][tempBitmapPos]);
         }
 
-        rightIndexTemp = static_cast<int>(_tzcnt_u64((m_retrainBitmap[tempBitmapPos] & m_bitmap[tempBitmapPos])));
+        rightIndexTemp = static_cast<int>(_tzcnt_u64((m_retrainBitmap[threadID][tempBitmapPos] & m_bitmap[threadID][tempBitmapPos])));
 
         if (rightIndexTemp != 64 && rightIndexTemp > 63 - static_cast<int>(_lzcnt_u64(tempBitmap)))
         {
@@ -3695,12 +2909,21 @@ inline pair<int,int> SWmeta<Type_Key,Type_Ts>::bitmap_retrain_range(int index)
 }
 
 template<class Type_Key, class Type_Ts>
-inline void SWmeta<Type_Key,Type_Ts>::bitmap_move_bit_back(int startingIndex, int endingIndex) 
+inline void SWmeta<Type_Key,Type_Ts>::bitmap_move_bit_back(uint32_t threadID, int startingIndex, int endingIndex) 
+//Inclusive: [startingIndex,endingIndex] and startingIndex < endingIndex
+{
+    bitmap_move_bit_back(m_bitmap[threadID], startingIndex, endingIndex);
+    bitmap_summary_update(threadID, startingIndex >> 6, endingIndex >> 6);
+}
+
+template<class Type_Key, class Type_Ts>
+inline void SWmeta<Type_Key,Type_Ts>::bitmap_move_bit_back(vector<uint64_t> & bitmap, int startingIndex, int endingIndex) 
 //Inclusive: [startingIndex,endingIndex] and startingIndex < endingIndex
+//Bit i moves to i+1 for i in [startingIndex,endingIndex), bit startingIndex is unchanged
 {
-    if (static_cast<int>(endingIndex >> 6) == m_bitmap.size())
+    if (static_cast<int>(endingIndex >> 6) == bitmap.size())
     {
-        m_bitmap.push_back(0); //When end exceeds last pos (end == m_numSeg)
+        bitmap.push_back(0); //When end exceeds last pos (end == number of slots in the partition)
     }
 
     int bitmapPos = startingIndex >> 6;
@@ -3709,152 +2932,135 @@ inline void SWmeta<Type_Key,Type_Ts>::bitmap_move_bit_back(int startingIndex, in
     int bitmapPosEnd = endingIndex >> 6;
     int bitPosEnd = endingIndex - (bitmapPosEnd << 6);
 
-    bool previousBitValue = static_cast<bool>(m_bitmap[bitmapPos] & (1ULL << bitPos));
-
-    while (!(bitmapPos == bitmapPosEnd && bitPos == bitPosEnd))
+    //Shift one word at a time from the end, the lower word is still unshifted when its top bit is carried
+    for (int i = bitmapPosEnd; i >= bitmapPos; i--)
     {
-        if (bitPos == 63)
-        {
-            bitPos = 0;
-            bitmapPos++;
-        }
-        else
-        {
-            bitPos++;
-        }
-
-        bool temp = static_cast<bool>(m_bitmap[bitmapPos] & (1ULL << bitPos));
-        if (previousBitValue)
-        {
-            m_bitmap[bitmapPos] |= (1ULL << bitPos);
-        }
-        else
-        {
-            m_bitmap[bitmapPos] &= ~(1ULL << bitPos);
-        }
-        previousBitValue = temp;
+        uint64_t shifted = (bitmap[i] << 1) | ((i > bitmapPos) ? (bitmap[i-1] >> 63) : 0);
+        uint64_t mask = bit_range_mask((i == bitmapPos) ? bitPos + 1 : 0, (i == bitmapPosEnd) ? bitPosEnd : 63);
+        bitmap[i] = (bitmap[i] & ~mask) | (shifted & mask);
     }
     return;
 }
 
 template<class Type_Key, class Type_Ts>
-inline void SWmeta<Type_Key,Type_Ts>::bitmap_move_bit_back(vector<uint64_t> & bitmap, int startingIndex, int endingIndex) 
-//Inclusive: [startingIndex,endingIndex] and startingIndex < endingIndex
+inline void SWmeta<Type_Key,Type_Ts>::bitmap_move_bit_front(uint32_t threadID, int startingIndex, int endingIndex) 
+//Inclusive: [startingIndex,endingIndex] and startingIndex > endingIndex
 {
-    if (static_cast<int>(endingIndex >> 6) == bitmap.size())
-    {
-        bitmap.push_back(0); //When end exceeds last pos (end == m_numSeg)
-    }
+    bitmap_move_bit_front(m_bitmap[threadID], startingIndex, endingIndex);
+    bitmap_summary_update(threadID, endingIndex >> 6, startingIndex >> 6);
+}
 
+template<class Type_Key, class Type_Ts>
+inline void SWmeta<Type_Key,Type_Ts>::bitmap_move_bit_front(vector<uint64_t> & bitmap, int startingIndex, int endingIndex) 
+//Inclusive: [startingIndex,endingIndex] and startingIndex > endingIndex
+//Bit i moves to i-1 for i in (endingIndex,startingIndex], bit startingIndex is unchanged
+{
     int bitmapPos = startingIndex >> 6;
     int bitPos = startingIndex - (bitmapPos << 6);
 
     int bitmapPosEnd = endingIndex >> 6;
     int bitPosEnd = endingIndex - (bitmapPosEnd << 6);
 
-    bool previousBitValue = static_cast<bool>(bitmap[bitmapPos] & (1ULL << bitPos));
-
-    while (!(bitmapPos == bitmapPosEnd && bitPos == bitPosEnd))
+    //Shift one word at a time from the end, the higher word is still unshifted when its bottom bit is carried
+    for (int i = bitmapPosEnd; i <= bitmapPos; i++)
     {
-        if (bitPos == 63)
-        {
-            bitPos = 0;
-            bitmapPos++;
-        }
-        else
-        {
-            bitPos++;
-        }
-
-        bool temp = static_cast<bool>(bitmap[bitmapPos] & (1ULL << bitPos));
-        if (previousBitValue)
-        {
-            bitmap[bitmapPos] |= (1ULL << bitPos);
-        }
-        else
-        {
-            bitmap[bitmapPos] &= ~(1ULL << bitPos);
-        }
-        previousBitValue = temp;
+        uint64_t shifted = (bitmap[i] >> 1) | ((i < bitmapPos) ? (bitmap[i+1] << 63) : 0);
+        uint64_t mask = bit_range_mask((i == bitmapPosEnd) ? bitPosEnd : 0, (i == bitmapPos) ? bitPos - 1 : 63);
+        bitmap[i] = (bitmap[i] & ~mask) | (shifted & mask);
     }
     return;
 }
 
 template<class Type_Key, class Type_Ts>
-inline void SWmeta<Type_Key,Type_Ts>::bitmap_move_bit_front(int startingIndex, int endingIndex) 
-//Inclusive: [startingIndex,endingIndex] and startingIndex > endingIndex
+inline void SWmeta<Type_Key,Type_Ts>::bitmap_summary_update(uint32_t threadID, int bitmapPos)
 {
-    int bitmapPos = startingIndex >> 6;
-    int bitPos = startingIndex - (bitmapPos << 6);
+    int summaryPos = bitmapPos >> 6;
+    if (summaryPos >= m_bitmapSummary[threadID].size())
+    {
+        m_bitmapSummary[threadID].resize(summaryPos + 1, 0);
+        m_bitmapFullSummary[threadID].resize(summaryPos + 1, 0);
+    }
 
-    int bitmapPosEnd = endingIndex >> 6;
-    int bitPosEnd = endingIndex - (bitmapPosEnd << 6);
+    uint64_t bit = 1ULL << (bitmapPos & 63);
+    uint64_t word = m_bitmap[threadID][bitmapPos];
+    m_bitmapSummary[threadID][summaryPos] = (word != 0) ? (m_bitmapSummary[threadID][summaryPos] | bit) 
+                                                        : (m_bitmapSummary[threadID][summaryPos] & ~bit);
+    m_bitmapFullSummary[threadID][summaryPos] = (word == numeric_limits<uint64_t>::max()) ? (m_bitmapFullSummary[threadID][summaryPos] | bit) 
+                                                                                        : (m_bitmapFullSummary[threadID][summaryPos] & ~bit);
+}
 
-    bool previousBitValue = static_cast<bool>(m_bitmap[bitmapPos] & (1ULL << bitPos));
+template<class Type_Key, class Type_Ts>
+inline void SWmeta<Type_Key,Type_Ts>::bitmap_summary_update(uint32_t threadID, int startBitmapPos, int endBitmapPos)
+{
+    for (int i = startBitmapPos; i <= endBitmapPos; i++)
+    {
+        bitmap_summary_update(threadID, i);
+    }
+}
+
+template<class Type_Key, class Type_Ts>
+void SWmeta<Type_Key,Type_Ts>::bitmap_summary_rebuild(uint32_t threadID)
+{
+    m_bitmapSummary[threadID].assign((m_bitmap[threadID].size() + 63) >> 6, 0);
+    m_bitmapFullSummary[threadID].assign((m_bitmap[threadID].size() + 63) >> 6, 0);
+    bitmap_summary_update(threadID, 0, static_cast<int>(m_bitmap[threadID].size()) - 1);
+}
 
-    while (!(bitmapPos == bitmapPosEnd && bitPos == bitPosEnd))
+template<class Type_Key, class Type_Ts>
+inline int SWmeta<Type_Key,Type_Ts>::bitmap_summary_next(uint32_t threadID, const vector<uint64_t> & summary, uint64_t flip, int bitmapPos) const
+//First word at or after bitmapPos with its summary bit (xor flip) set, m_bitmap[threadID].size() if none
+{
+    if (bitmapPos >= m_bitmap[threadID].size())
     {
-        if (bitPos == 0)
-        {
-            bitPos = 63;
-            bitmapPos--;
-        }
-        else
-        {
-            bitPos--;
-        }
+        return m_bitmap[threadID].size();
+    }
 
-        bool temp = static_cast<bool>(m_bitmap[bitmapPos] & (1ULL << bitPos));
-        if (previousBitValue)
-        {
-            m_bitmap[bitmapPos] |= (1ULL << bitPos);
-        }
-        else
+    int summaryPos = bitmapPos >> 6;
+    int summaryEnd = (m_bitmap[threadID].size() + 63) >> 6;
+
+    uint64_t currentSummary = ((summaryPos < summary.size()) ? summary[summaryPos] : 0) ^ flip;
+    currentSummary &= ~((1ULL << (bitmapPos & 63)) - 1);
+
+    while (currentSummary == 0)
+    {
+        summaryPos++;
+        if (summaryPos >= summaryEnd)
         {
-            m_bitmap[bitmapPos] &= ~(1ULL << bitPos);
+            return m_bitmap[threadID].size();
         }
-        previousBitValue = temp;
+        currentSummary = ((summaryPos < summary.size()) ? summary[summaryPos] : 0) ^ flip;
     }
-    return;
+
+    return min<int>((summaryPos << 6) + static_cast<int>(_tzcnt_u64(currentSummary)), m_bitmap[threadID].size());
 }
 
 template<class Type_Key, class Type_Ts>
-inline void SWmeta<Type_Key,Type_Ts>::bitmap_move_bit_front(vector<uint64_t> & bitmap, int startingIndex, int endingIndex) 
-//Inclusive: [startingIndex,endingIndex] and startingIndex > endingIndex
+inline int SWmeta<Type_Key,Type_Ts>::bitmap_summary_prev(const vector<uint64_t> & summary, uint64_t flip, int bitmapPos) const
+//Last word at or before bitmapPos with its summary bit (xor flip) set, -1 if none
 {
-    int bitmapPos = startingIndex >> 6;
-    int bitPos = startingIndex - (bitmapPos << 6);
+    if (bitmapPos < 0)
+    {
+        return -1;
+    }
 
-    int bitmapPosEnd = endingIndex >> 6;
-    int bitPosEnd = endingIndex - (bitmapPosEnd << 6);
+    int summaryPos = bitmapPos >> 6;
 
-    bool previousBitValue = static_cast<bool>(bitmap[bitmapPos] & (1ULL << bitPos));
+    uint64_t currentSummary = ((summaryPos < summary.size()) ? summary[summaryPos] : 0) ^ flip;
+    currentSummary &= bit_range_mask(0, bitmapPos & 63);
 
-    while (!(bitmapPos == bitmapPosEnd && bitPos == bitPosEnd))
+    while (currentSummary == 0)
     {
-        if (bitPos == 0)
-        {
-            bitPos = 63;
-            bitmapPos--;
-        }
-        else
-        {
-            bitPos--;
-        }
-
-        bool temp = static_cast<bool>(bitmap[bitmapPos] & (1ULL << bitPos));
-        if (previousBitValue)
+        summaryPos--;
+        if (summaryPos < 0)
         {
-            bitmap[bitmapPos] |= (1ULL << bitPos);
-        }
-        else
-        {
-            bitmap[bitmapPos] &= ~(1ULL << bitPos);
+            return -1;
         }
-        previousBitValue = temp;
+        currentSummary = ((summaryPos < summary.size()) ? summary[summaryPos] : 0) ^ flip;
     }
-    return;
+
+    return (summaryPos << 6) + (63 - static_cast<int>(_lzcnt_u64(currentSummary)));
 }
 
 }
-#endif
\ No newline at end of file
+
+#endif
@@ -17,14 +17,6 @@ typedef uint64_t key_type;
 typedef uint64_t time_type;
 typedef tuple<bool,int,int,int> search_bound_type;
 
-mutex thread_lock[NUM_THREADS];
-condition_variable thread_cv[NUM_THREADS];
-bool thread_occupied[NUM_THREADS];
-
-atomic<int> thread_retraining(-1); //Indicates which thread is retraining
-
-moodycamel::ConcurrentQueue<tuple<key_type,SWseg<key_type,time_type>*,bool>> retrain_insertion_queue(NUM_SEARCH_PER_ROUND + NUM_UPDATE_PER_ROUND*2);
-
 // There is meta thread in this version of Parallel pswix, all threads are worker threads.
 
 template<class Type_Key, class Type_Ts> 
@@ -52,8 +44,17 @@ private:
     vector<uint64_t> m_bitmap;
     vector<uint64_t> m_retrainBitmap;
     vector<vector<Type_Key>> m_keys;
+
+    //Summary of m_bitmap, one bit per m_bitmap word (words past the end of the summary are empty).
+    //Partitions sharing a summary word update it with atomic bit operations.
+    vector<uint64_t> m_bitmapSummary; //word has a non-gap
+    vector<uint64_t> m_bitmapFullSummary; //word has no gap
     vector<vector<SWseg<Type_Key,Type_Ts>*>> m_ptr;
 
+    unique_ptr<SWlock[]> m_threadLock; //Lock of each thread (numThreads)
+    atomic<int> m_threadRetraining; //Thread retraining the model * 10 + retrain method, -1 = none
+    moodycamel::ConcurrentQueue<tuple<Type_Key,SWseg<Type_Key,Type_Ts>*,bool>> m_retrainInsertionQueue; //Segments inserted during a retrain
+
 //Functions
 public:
     //Constructors & Deconstructors
@@ -65,7 +66,7 @@ public:
     //Bulk Load
     void bulk_load(int numThreads, const vector<pair<Type_Key, Type_Ts>> & stream);
 private:
-    void split_data(const vector<pair<Type_Key,Type_Ts>> & data, vector<pair<Type_Key, SWseg<Type_Key,Type_Ts> * >> & splitedDataPtr);
+    void split_data(int numThreads, const vector<pair<Type_Key,Type_Ts>> & data, vector<pair<Type_Key, SWseg<Type_Key,Type_Ts> * >> & splitedDataPtr);
     void partition_data_into_threads(int numThreads, vector<Type_Key> & keys, vector<SWseg<Type_Key,Type_Ts>*> & ptr);
 
 public:
@@ -76,6 +77,7 @@ public:
     int lookup(uint32_t threadID, Type_Key key, Type_Ts timestamp, tuple<bool,int,int,int> & predictBound);
 
     int range_query(uint32_t threadID, Type_Key lowerBound, Type_Ts timestamp, Type_Key upperBound, tuple<bool,int,int,int> & predictBound);
+    SWaggregate<Type_Key> range_aggregate(uint32_t threadID, Type_Key lowerBound, Type_Ts timestamp, Type_Key upperBound, tuple<bool,int,int,int> & predictBound);
 
     int insert(uint32_t threadID, Type_Key key, Type_Ts timestamp, tuple<bool,int,int,int> & predictBound);
 
@@ -86,6 +88,9 @@ private:
     vector<uint32_t> predict_thread(Type_Key lowerBound, Type_Key upperBound, vector<tuple<bool,int,int,int>> & predictBound);
     
     //Search helpers
+    template<class Type_Result>
+    void range_query_result(uint32_t threadID, Type_Key lowerBound, Type_Ts timestamp, Type_Key upperBound, 
+                            tuple<bool,int,int,int> & predictBound, Type_Result & result);
     int meta_model_search(uint32_t threadID, Type_Key targetKey, tuple<bool,int,int,int> & predictBound);
     int meta_non_model_search(uint32_t threadID, Type_Key targetKey, tuple<bool,int,int,int> & searchBound);
 
@@ -157,6 +162,7 @@ public:
     size_t get_meta_size();
     size_t get_no_seg();
     int get_split_error();
+    int get_thread_retraining();
     void set_split_error(int error);
     void print();
     void print_all();
@@ -183,6 +189,11 @@ private:
     void bitmap_move_bit_back(vector<uint64_t> & bitmap, int startingIndex, int endingIndex);
     void bitmap_move_bit_front(int startingIndex, int endingIndex);
     void bitmap_move_bit_front(vector<uint64_t> & bitmap, int startingIndex, int endingIndex);
+    void bitmap_summary_update(int bitmapPos);
+    void bitmap_summary_update(int startBitmapPos, int endBitmapPos);
+    void bitmap_summary_rebuild();
+    int bitmap_summary_next(const vector<uint64_t> & summary, uint64_t flip, int bitmapPos) const;
+    int bitmap_summary_prev(const vector<uint64_t> & summary, uint64_t flip, int bitmapPos) const;
 };
 
 /*
@@ -191,11 +202,12 @@ Constructors & Deconstructors
 template<class Type_Key, class Type_Ts> 
 SWmeta<Type_Key,Type_Ts>::SWmeta()
 :m_rightSearchBound(0), m_leftSearchBound(0), m_numSeg(0), m_numSegExist(0), splitError(0), m_slope(-1), m_maxSearchError(0), 
- m_startKey(numeric_limits<Type_Key>::min()){}
+ m_startKey(numeric_limits<Type_Key>::min()), m_threadRetraining(-1){}
 
 template<class Type_Key, class Type_Ts> 
 SWmeta<Type_Key,Type_Ts>::SWmeta(int numThreads, const pair<Type_Key, Type_Ts> & arrivalTuple)
-:m_rightSearchBound(0), m_leftSearchBound(0), m_numSeg(0), m_numSegExist(0), m_slope(-1), m_maxSearchError(0), m_startKey(0)
+:m_rightSearchBound(0), m_leftSearchBound(0), m_numSeg(0), m_numSegExist(0), m_slope(-1), m_maxSearchError(0), m_startKey(0),
+ m_threadLock(new SWlock[numThreads]), m_threadRetraining(-1), m_retrainInsertionQueue(NUM_SEARCH_PER_ROUND + NUM_UPDATE_PER_ROUND*2)
 {
     #ifdef DEBUG
     DEBUG_ENTER_FUNCTION("SWmeta","Constructor(singleData)");
@@ -232,7 +244,8 @@ SWmeta<Type_Key,Type_Ts>::SWmeta(int numThreads, const pair<Type_Key, Type_Ts> &
 
 template<class Type_Key, class Type_Ts> 
 SWmeta<Type_Key,Type_Ts>::SWmeta(int numThreads, const vector<pair<Type_Key, Type_Ts>> & stream)
-:m_rightSearchBound(0), m_leftSearchBound(0), m_numSeg(0), m_numSegExist(0), m_slope(0), m_maxSearchError(0)
+:m_rightSearchBound(0), m_leftSearchBound(0), m_numSeg(0), m_numSegExist(0), m_slope(0), m_maxSearchError(0),
+ m_threadLock(new SWlock[numThreads]), m_threadRetraining(-1), m_retrainInsertionQueue(NUM_SEARCH_PER_ROUND + NUM_UPDATE_PER_ROUND*2)
 {
     #ifdef DEBUG
     DEBUG_ENTER_FUNCTION("SWmeta","Constructor(data)");
@@ -287,11 +300,11 @@ void SWmeta<Type_Key,Type_Ts>::bulk_load(int numThreads, const vector<pair<Type_
 
     vector<pair<Type_Key, Type_Ts>> data(stream);
 
-    sort(data.begin(), data.end());
+    parallel_sort(data.begin(), data.end(), less<pair<Type_Key, Type_Ts>>(), bulk_load_threads(data.size(), numThreads));
 
     vector<pair<Type_Key, SWseg<Type_Key,Type_Ts> * >> splitedDataPtr;
 
-    split_data(data, splitedDataPtr);
+    split_data(numThreads, data, splitedDataPtr);
 
     vector<Type_Key> tempKeys;
     vector<SWseg<Type_Key,Type_Ts> *> tempPtr;
@@ -370,6 +383,7 @@ void SWmeta<Type_Key,Type_Ts>::bulk_load(int numThreads, const vector<pair<Type_
         m_numSegExist = 1;
         m_bitmap = temp;
         m_retrainBitmap = temp;
+        bitmap_summary_rebuild();
         bitmap_set_bit(0);
         
         splitedDataPtr[0].second->m_parentIndex = 0;
@@ -387,94 +401,69 @@ void SWmeta<Type_Key,Type_Ts>::bulk_load(int numThreads, const vector<pair<Type_
 }
 
 template<class Type_Key, class Type_Ts>
-void SWmeta<Type_Key,Type_Ts>::split_data(const vector<pair<Type_Key,Type_Ts>> & data, 
+void SWmeta<Type_Key,Type_Ts>::split_data(int numThreads, const vector<pair<Type_Key,Type_Ts>> & data, 
                                 vector<pair<Type_Key, SWseg<Type_Key,Type_Ts> * >> & splitedDataPtr)
 {  
     #ifdef DEBUG
     DEBUG_ENTER_FUNCTION("SWmeta","split_data");
     #endif
 
+    numThreads = bulk_load_threads(data.size(), numThreads);
+
     vector<tuple<int,int,double>> splitIndexSlopeVector;
-    calculate_split_derivative((int)(TIME_WINDOW * 0.00001), data, splitIndexSlopeVector);
+    //At least one split, windows below 100000 would otherwise give 0
+    calculate_split_derivative(max(1,(int)(TIME_WINDOW * 0.00001)), data, splitIndexSlopeVector, numThreads);
 
-    if (splitIndexSlopeVector.size() != 1)
-    {
-        Type_Key firstKey = data[get<0>(splitIndexSlopeVector.front())].first;
-        double normalizedKey = 0, sumKey = 0, sumIndex = 0, sumKeyIndex = 0, sumKeySquared = 0;
-        int cnt = 0;
-        
-        for (auto it = splitIndexSlopeVector.begin(); it != splitIndexSlopeVector.end()-1; it++)
-        {
-            SWseg<Type_Key,Type_Ts> * SWsegPtr = new SWseg<Type_Key,Type_Ts>(get<0>(*it), get<1>(*it) ,get<2>(*it), data);
-            if(splitedDataPtr.size() > 0)
-            {
-                SWsegPtr->m_leftSibling = splitedDataPtr[splitedDataPtr.size() - 1].second;
-                splitedDataPtr[splitedDataPtr.size() - 1].second->m_rightSibling = SWsegPtr;
-            }
-            splitedDataPtr.push_back(make_pair( data[get<0>(*it)].first, SWsegPtr));
+    //Static schedule: each thread builds the SWseg of a contiguous key range, roughly the partition it later serves
+    vector<SWseg<Type_Key,Type_Ts> *> segPtr(splitIndexSlopeVector.size());
 
-            normalizedKey = (double)data[get<0>(*it)].first - (double)firstKey;
-            sumKey += normalizedKey;
-            sumIndex += cnt;
-            sumKeyIndex += normalizedKey * cnt;
-            sumKeySquared += pow(normalizedKey,2);
-            ++cnt;
-        }
+    #pragma omp parallel for num_threads(numThreads) schedule(static)
+    for (int i = 0; i < segPtr.size(); i++)
+    {
+        auto & split = splitIndexSlopeVector[i];
 
         //Dealing with last segment with only one point
-        if (get<0>(splitIndexSlopeVector.back())  != get<1>(splitIndexSlopeVector.back()))
+        if (i == segPtr.size()-1 && get<0>(split) == get<1>(split))
         {
-            SWseg<Type_Key,Type_Ts> * SWsegPtr = new SWseg<Type_Key,Type_Ts>(get<0>(splitIndexSlopeVector.back()), get<1>(splitIndexSlopeVector.back()) ,get<2>(splitIndexSlopeVector.back()), data);
-            if(splitedDataPtr.size() > 0)
-            {
-                SWsegPtr->m_leftSibling = splitedDataPtr[splitedDataPtr.size() - 1].second;
-                splitedDataPtr[splitedDataPtr.size() - 1].second->m_rightSibling = SWsegPtr;
-            }
-            splitedDataPtr.push_back(make_pair( data[get<0>(splitIndexSlopeVector.back())].first, SWsegPtr));
-
-            normalizedKey = (double)data[get<0>(splitIndexSlopeVector.back())].first - (double)firstKey;
-            sumKey += normalizedKey;
-            sumIndex += cnt;
-            sumKeyIndex += normalizedKey * cnt;
-            sumKeySquared += pow(normalizedKey,2);
-            ++cnt;
-        }
-        else //Single Point 
-        {        
-            SWseg<Type_Key,Type_Ts> * SWsegPtr = new SWseg<Type_Key,Type_Ts>(data.back());
-            if(splitedDataPtr.size() > 0)
-            {
-                SWsegPtr->m_leftSibling = splitedDataPtr[splitedDataPtr.size() - 1].second;
-                splitedDataPtr[splitedDataPtr.size() - 1].second->m_rightSibling = SWsegPtr;
-            }
-            splitedDataPtr.push_back(make_pair( data.back().first, SWsegPtr));
-
-            normalizedKey = (double)data.back().first - (double)firstKey;
-            sumKey += normalizedKey;
-            sumIndex += cnt;
-            sumKeyIndex += normalizedKey * cnt;
-            sumKeySquared += pow(normalizedKey,2);
-            ++cnt;
+            segPtr[i] = new SWseg<Type_Key,Type_Ts>(data.back());
         }
+        else
+        {
+            segPtr[i] = new SWseg<Type_Key,Type_Ts>(get<0>(split), get<1>(split), get<2>(split), data);
+        }
+    }
 
-        m_slope =  (sumKeyIndex - sumKey *(sumIndex/cnt))/(sumKeySquared - sumKey*(sumKey/cnt)) * 1.05;
+    if (segPtr.size() == 1 && get<0>(splitIndexSlopeVector[0]) == get<1>(splitIndexSlopeVector[0]))
+    {
+        printf("WARNING: entire data is one point \n");
     }
-    else //Single Segment in SWmeta
+
+    Type_Key firstKey = data[get<0>(splitIndexSlopeVector.front())].first;
+    double normalizedKey = 0, sumKey = 0, sumIndex = 0, sumKeyIndex = 0, sumKeySquared = 0;
+    int cnt = 0;
+
+    for (int i = 0; i < segPtr.size(); i++)
     {
-        if (get<0>(splitIndexSlopeVector[0]) != get<1>(splitIndexSlopeVector[0]))
-        {
-            SWseg<Type_Key,Type_Ts> * SWsegPtr = new SWseg<Type_Key,Type_Ts>(get<0>(splitIndexSlopeVector[0]), get<1>(splitIndexSlopeVector[0]), get<2>(splitIndexSlopeVector[0]), data);
-            splitedDataPtr.push_back(make_pair( data[get<0>(splitIndexSlopeVector[0])].first, SWsegPtr));
-        }
-        else
+        Type_Key startKey = data[get<0>(splitIndexSlopeVector[i])].first;
+
+        if(splitedDataPtr.size() > 0)
         {
-            printf("WARNING: entire data is one point \n");
-            SWseg<Type_Key,Type_Ts> * SWsegPtr = new SWseg<Type_Key,Type_Ts>(data.back());
-            splitedDataPtr.push_back(make_pair( data.back().first, SWsegPtr));
+            segPtr[i]->m_leftSibling = splitedDataPtr.back().second;
+            splitedDataPtr.back().second->m_rightSibling = segPtr[i];
         }
-        m_slope = -1;
+        splitedDataPtr.push_back(make_pair(startKey, segPtr[i]));
+
+        normalizedKey = (double)startKey - (double)firstKey;
+        sumKey += normalizedKey;
+        sumIndex += cnt;
+        sumKeyIndex += normalizedKey * cnt;
+        sumKeySquared += pow(normalizedKey,2);
+        ++cnt;
     }
 
+    //Single Segment in SWmeta
+    m_slope = (segPtr.size() != 1) ? (sumKeyIndex - sumKey *(sumIndex/cnt))/(sumKeySquared - sumKey*(sumKey/cnt)) * 1.05 : -1;
+
     if (splitedDataPtr.front().second->m_leftSibling != nullptr)
     {
         printf("WARNING: left sibling of first segment not null \n");
@@ -846,7 +835,7 @@ int SWmeta<Type_Key,Type_Ts>::lookup(uint32_t threadID, Type_Key key, Type_Ts ti
     tuple<pswix::seg_update_type,int,Type_Key> updateSeg = make_tuple(pswix::seg_update_type::NONE,0,0);
     Type_Ts expiryTime =  ((double)timestamp - TIME_WINDOW < numeric_limits<Type_Ts>::min()) ? numeric_limits<Type_Ts>::min(): timestamp - TIME_WINDOW;
     
-    unique_lock<mutex> lock(thread_lock[threadID]);
+    unique_lock<mutex> lock(m_threadLock[threadID].lock);
     lock_thread(threadID, lock);
 
     if (m_numSeg == 1)
@@ -891,9 +880,9 @@ int SWmeta<Type_Key,Type_Ts>::lookup(uint32_t threadID, Type_Key key, Type_Ts ti
         vector<tuple<pswix::seg_update_type,int,Type_Key>> updateSegVector = {updateSeg};
         int metaRetrainStatus = thread_dispatch_update_seg(threadID, expiryTime, updateSegVector);
     
-        if (metaRetrainStatus > 0 && thread_retraining == -1)
+        if (metaRetrainStatus > 0 && m_threadRetraining == -1)
         {
-            thread_retraining = threadID*10 + metaRetrainStatus;
+            m_threadRetraining = threadID*10 + metaRetrainStatus;
         }
     }
     unlock_thread(threadID, lock);
@@ -917,6 +906,25 @@ Range Query
 */
 template<class Type_Key, class Type_Ts>
 int SWmeta<Type_Key,Type_Ts>::range_query(uint32_t threadID, Type_Key lowerBound, Type_Ts timestamp, Type_Key upperBound, tuple<bool,int,int,int> & predictBound)
+{
+    int count = 0;
+    range_query_result(threadID, lowerBound, timestamp, upperBound, predictBound, count);
+    return count;
+}
+
+//COUNT/SUM/MIN/MAX of the keys in range, same maintenance as range_query but nothing is materialized
+template<class Type_Key, class Type_Ts>
+SWaggregate<Type_Key> SWmeta<Type_Key,Type_Ts>::range_aggregate(uint32_t threadID, Type_Key lowerBound, Type_Ts timestamp, Type_Key upperBound, tuple<bool,int,int,int> & predictBound)
+{
+    SWaggregate<Type_Key> aggregate;
+    range_query_result(threadID, lowerBound, timestamp, upperBound, predictBound, aggregate);
+    return aggregate;
+}
+
+template<class Type_Key, class Type_Ts>
+template<class Type_Result>
+void SWmeta<Type_Key,Type_Ts>::range_query_result(uint32_t threadID, Type_Key lowerBound, Type_Ts timestamp, Type_Key upperBound, 
+                                                    tuple<bool,int,int,int> & predictBound, Type_Result & result)
 {
     #ifdef DEBUG
     DEBUG_ENTER_FUNCTION("SWmeta","range_query");
@@ -929,17 +937,16 @@ int SWmeta<Type_Key,Type_Ts>::range_query(uint32_t threadID, Type_Key lowerBound
     }
     #endif
 
-    int count = 0;
     int startIndex = m_partitionIndex[threadID];
     vector<tuple<pswix::seg_update_type,int,Type_Key>> updateSeg;
     Type_Ts expiryTime =  ((double)timestamp - TIME_WINDOW < numeric_limits<Type_Ts>::min()) ? numeric_limits<Type_Ts>::min(): timestamp - TIME_WINDOW;
     
-    unique_lock<mutex> lock(thread_lock[threadID]);
+    unique_lock<mutex> lock(m_threadLock[threadID].lock);
     lock_thread(threadID, lock);
 
     if (m_numSeg == 1)
     {
-        count = m_ptr[0][0]->range_search(0,m_numSeg-1,lowerBound,expiryTime,upperBound,updateSeg);
+        m_ptr[0][0]->range_search(0,m_numSeg-1,lowerBound,expiryTime,upperBound,updateSeg,result);
     }
     else
     {
@@ -974,13 +981,13 @@ int SWmeta<Type_Key,Type_Ts>::range_query(uint32_t threadID, Type_Key lowerBound
                     if (foundPos == -1 || m_keys[threadID][foundPos-startIndex] > upperBound) 
                     {
                         unlock_thread(threadID, lock);
-                        return 0; 
+                        return; 
                     }
                 }
             }
 
-            count = m_ptr[threadID][foundPos-startIndex]->range_search(find_first_segment_in_partition(threadID), find_last_segment_in_partition(threadID),
-                                        lowerBound,expiryTime,upperBound,updateSeg);
+            m_ptr[threadID][foundPos-startIndex]->range_search(find_first_segment_in_partition(threadID), find_last_segment_in_partition(threadID),
+                                        lowerBound,expiryTime,upperBound,updateSeg,result);
         }
         //Scan (get<1>predictBound == -1 indicates scans)
         else
@@ -992,12 +999,12 @@ int SWmeta<Type_Key,Type_Ts>::range_query(uint32_t threadID, Type_Key lowerBound
                 if (foundPos == -1 || m_keys[threadID][foundPos-startIndex] > upperBound) 
                 {
                     unlock_thread(threadID, lock);
-                    return 0; 
+                    return; 
                 }
             }
 
-            count = m_ptr[threadID][foundPos-startIndex]->range_scan(find_first_segment_in_partition(threadID), find_last_segment_in_partition(threadID),
-                                        lowerBound,expiryTime,upperBound,updateSeg);
+            m_ptr[threadID][foundPos-startIndex]->range_scan(find_first_segment_in_partition(threadID), find_last_segment_in_partition(threadID),
+                                        lowerBound,expiryTime,upperBound,updateSeg,result);
         }
     }
 
@@ -1005,15 +1012,13 @@ int SWmeta<Type_Key,Type_Ts>::range_query(uint32_t threadID, Type_Key lowerBound
     {
         int metaRetrainStatus = thread_dispatch_update_seg(threadID, expiryTime, updateSeg);
 
-        if (metaRetrainStatus > 0 && thread_retraining == -1)
+        if (metaRetrainStatus > 0 && m_threadRetraining == -1)
         {
-            thread_retraining = threadID*10 + metaRetrainStatus;
+            m_threadRetraining = threadID*10 + metaRetrainStatus;
         }
     }
     unlock_thread(threadID,lock);
 
-    return count;
-
     #ifdef DEBUG
     DEBUG_EXIT_FUNCTION("SWmeta","range_query");
     #endif
@@ -1050,7 +1055,7 @@ int SWmeta<Type_Key,Type_Ts>::insert(uint32_t threadID, Type_Key key, Type_Ts ti
     
     m_parititonMaxTime[threadID] = timestamp;
 
-    unique_lock<mutex> lock(thread_lock[threadID]);
+    unique_lock<mutex> lock(m_threadLock[threadID].lock);
     lock_thread(threadID, lock);
 
     if (m_numSeg == 1)
@@ -1096,9 +1101,9 @@ int SWmeta<Type_Key,Type_Ts>::insert(uint32_t threadID, Type_Key key, Type_Ts ti
     {
         int metaRetrainStatus = thread_dispatch_update_seg(threadID, expiryTime, updateSeg);
 
-        if (metaRetrainStatus > 0 || thread_retraining == -1)
+        if (metaRetrainStatus > 0 || m_threadRetraining == -1)
         {
-            thread_retraining = threadID*10 + metaRetrainStatus;
+            m_threadRetraining = threadID*10 + metaRetrainStatus;
         }
     }
     unlock_thread(threadID,lock);
@@ -1409,9 +1414,9 @@ int SWmeta<Type_Key,Type_Ts>::thread_insert(uint32_t threadID, Type_Key key, SWs
     }
     #endif
 
-    if (thread_retraining != -1) //Retrain is in progress (Do not insert)
+    if (m_threadRetraining != -1) //Retrain is in progress (Do not insert)
     {
-        retrain_insertion_queue.enqueue(make_tuple(key,segPtr,currentRetrainStatus));
+        m_retrainInsertionQueue.enqueue(make_tuple(key,segPtr,currentRetrainStatus));
         return 2;
     }
     
@@ -1763,8 +1768,8 @@ int SWmeta<Type_Key,Type_Ts>::insert_model_no_gap(uint32_t threadID, int inserti
         if (retrianFlag)
         {
             //Add key to queue and insert after retraining.
-            retrain_insertion_queue.enqueue(make_tuple(key,segPtr,currentRetrainStatus));
-            if (thread_retraining == -1) {thread_retraining = threadID*10+2;}
+            m_retrainInsertionQueue.enqueue(make_tuple(key,segPtr,currentRetrainStatus));
+            if (m_threadRetraining == -1) {m_threadRetraining = threadID*10+2;}
             return 2;
         }
         if (insertionPos < gapPos) //Mimics Right Shift
@@ -1969,7 +1974,7 @@ template<class Type_Key, class Type_Ts>
 void SWmeta<Type_Key,Type_Ts>::meta_retrain()
 {
     //Load retrain method
-    int retrainMethod = thread_retraining % 10; //1 = extend, 2 = retrain
+    int retrainMethod = m_threadRetraining % 10; //1 = extend, 2 = retrain
     retrainMethod = ((double)m_numSegExist/(m_numSeg*1.05) < 0.5) ? 2 : retrainMethod;
 
     //Retrain Meta (calculate slope) without lock
@@ -2022,14 +2027,14 @@ void SWmeta<Type_Key,Type_Ts>::meta_retrain()
     vector<Type_Key> tempKey;
     vector<SWseg<Type_Key,Type_Ts>*> tempPtr;
 
-    LOG_INFO("[Thread %u finish retraining model]", thread_retraining.load()/10);
+    LOG_INFO("[Thread %u finish retraining model]", m_threadRetraining.load()/10);
 
     //Lock all threads
     vector<unique_lock<mutex>> locks(m_partitionIndex.size());
     for (uint32_t threadID = 0; threadID < m_partitionIndex.size(); ++threadID)
     {
-        locks[threadID] = unique_lock<mutex>(thread_lock[threadID]);
-        lock_thread(threadID+1,locks[threadID]);
+        locks[threadID] = unique_lock<mutex>(m_threadLock[threadID].lock);
+        lock_thread(threadID,locks[threadID]);
     }
 
     //Find max timestamp 
@@ -2046,18 +2051,18 @@ void SWmeta<Type_Key,Type_Ts>::meta_retrain()
         retrain_combine_data(expiryTime, tempKey, tempPtr);
     }
 
-    LOG_DEBUG_SHOW("[Thread %u finish changing meta]", thread_retraining.load()/10);
+    LOG_DEBUG_SHOW("[Thread %u finish changing meta]", m_threadRetraining.load()/10);
 
     partition_data_into_threads(m_partitionIndex.size(), tempKey, tempPtr);
 
     m_parititonMaxTime = vector<Type_Ts>(m_partitionIndex.size(),maxTimeStamp);
 
-    thread_retraining = -1;
+    m_threadRetraining = -1;
     
     //Unlock all threads
     for (uint32_t threadID = 0; threadID < m_partitionIndex.size(); ++threadID)
     {
-        unlock_thread(threadID+1,locks[threadID]);
+        unlock_thread(threadID,locks[threadID]);
     }
 
     LOG_DEBUG_SHOW("Retrain Partition finished");
@@ -2071,10 +2076,10 @@ vector<tuple<key_type,SWseg<key_type,time_type>*,bool>> SWmeta<Type_Key,Type_Ts>
 {
     //Unload all segments from retrain insertion queue
     vector<tuple<key_type,SWseg<key_type,time_type>*,bool>> insertionQueue;
-    insertionQueue.reserve(retrain_insertion_queue.size_approx());
+    insertionQueue.reserve(m_retrainInsertionQueue.size_approx());
 
     tuple<key_type,SWseg<key_type,time_type>*,bool> insertionSeg;
-    bool found = retrain_insertion_queue.try_dequeue(insertionSeg);
+    bool found = m_retrainInsertionQueue.try_dequeue(insertionSeg);
     while (found)
     {
         if (get<1>(insertionSeg)->m_maxTimeStamp >= expiryTime)
@@ -2085,7 +2090,7 @@ vector<tuple<key_type,SWseg<key_type,time_type>*,bool>> SWmeta<Type_Key,Type_Ts>
         {
             delete get<1>(insertionSeg);
         }
-        found = retrain_insertion_queue.try_dequeue(insertionSeg);
+        found = m_retrainInsertionQueue.try_dequeue(insertionSeg);
     }
     insertionQueue.shrink_to_fit();
 
@@ -2219,6 +2224,7 @@ void SWmeta<Type_Key,Type_Ts>::retrain_model_combine_data(Type_Ts expiryTime, ve
     m_maxSearchError = min(8192,(int)ceil(0.6*tempKey.size()));
     m_bitmap = tempBitmap;
     m_retrainBitmap = tempRetrainBitmap;
+    bitmap_summary_rebuild();
     m_numSeg = tempKey.size();
     tempKey.shrink_to_fit();
     tempPtr.shrink_to_fit();
@@ -2343,6 +2349,7 @@ void SWmeta<Type_Key,Type_Ts>::retrain_combine_data(Type_Ts expiryTime, vector<T
 
         m_bitmap = tempBitmap;
         m_retrainBitmap = tempRetrainBitmap;
+        bitmap_summary_rebuild();
         m_numSeg = tempKey.size();
         tempKey.shrink_to_fit();
         tempPtr.shrink_to_fit();
@@ -2373,6 +2380,7 @@ void SWmeta<Type_Key,Type_Ts>::retrain_combine_data(Type_Ts expiryTime, vector<T
         m_numSegExist = 1;
         m_bitmap = temp;
         m_retrainBitmap = temp;
+        bitmap_summary_rebuild();
         bitmap_set_bit(0);
 
         if (retrainFlag)
@@ -2801,7 +2809,7 @@ bool SWmeta<Type_Key,Type_Ts>::borrow_gap_position_from_end(uint32_t threadID, i
     int startIndex = m_partitionIndex[threadID];
     int endIndex = m_partitionIndex[threadID+1]-1;
 
-    unique_lock<mutex> lock(thread_lock[threadID]);
+    unique_lock<mutex> lock(m_threadLock[threadID].lock);
     lock_thread(threadID, lock);
     if (m_numSegExistsPerPartition[threadID] == m_numSegPerPartition[threadID]) {return false;}
 
@@ -2837,7 +2845,7 @@ bool SWmeta<Type_Key,Type_Ts>::borrow_gap_position_from_begin(uint32_t threadID,
     int startIndex = m_partitionIndex[threadID];
     int endIndex = (threadID == m_partitionIndex.size()-1)? m_numSeg.load() :m_partitionIndex[threadID+1]-1;
 
-    unique_lock<mutex> lock(thread_lock[threadID]);
+    unique_lock<mutex> lock(m_threadLock[threadID].lock);
     lock_thread(threadID, lock);
     if (m_numSegExistsPerPartition[threadID] == m_numSegPerPartition[threadID]) {return false;}
 
@@ -2910,18 +2918,18 @@ void SWmeta<Type_Key,Type_Ts>::update_seg_parent_index_normalized(uint32_t threa
 template<class Type_Key, class Type_Ts>
 inline void SWmeta<Type_Key,Type_Ts>::lock_thread(uint32_t threadID, unique_lock<mutex> & lock)
 {
-    while (thread_occupied[threadID])
+    while (m_threadLock[threadID].occupied)
     {
-        thread_cv[threadID].wait(lock);
+        m_threadLock[threadID].cv.wait(lock);
     }
 }
 
 template<class Type_Key, class Type_Ts>
 inline void SWmeta<Type_Key,Type_Ts>::unlock_thread(uint32_t threadID, unique_lock<mutex> & lock)
 {
-    thread_occupied[threadID] = false;
+    m_threadLock[threadID].occupied = false;
     lock.unlock();
-    thread_cv[threadID].notify_one();
+    m_threadLock[threadID].cv.notify_one();
 }
 
 /*
@@ -2945,6 +2953,12 @@ inline int SWmeta<Type_Key,Type_Ts>::get_split_error()
     return splitError;
 }
 
+template<class Type_Key, class Type_Ts>
+inline int SWmeta<Type_Key,Type_Ts>::get_thread_retraining()
+{
+    return m_threadRetraining.load();
+}
+
 template<class Type_Key, class Type_Ts>
 inline  void SWmeta<Type_Key,Type_Ts>::set_split_error(int error)
 {
@@ -3021,7 +3035,7 @@ inline uint64_t SWmeta<Type_Key,Type_Ts>::memory_usage()
             sizeof(vector<int>)*3 + sizeof(int)*m_partitionIndex.size() + 
             sizeof(vector<Type_Ts>) + sizeof(Type_Ts)*m_partitionIndex.size() +
             sizeof(vector<Type_Key>) + sizeof(Type_Key)*m_partitionIndex.size() +
-            sizeof(vector<uint64_t>)*2 + sizeof(uint64_t)*(m_bitmap.size()*2) +
+            sizeof(vector<uint64_t>)*4 + sizeof(uint64_t)*(m_bitmap.size()*2 + m_bitmapSummary.size()*2) +
             sizeof(vector<vector<Type_Key>>) + sizeof(vector<Type_Key>)*m_keys.size() + sizeof(Type_Key)*m_numSeg +
             sizeof(vector<vector<SWseg<Type_Key,Type_Ts>*>>) + sizeof(vector<SWseg<Type_Key,Type_Ts>*>)*m_ptr.size() 
                                                                 + sizeof(SWseg<Type_Key,Type_Ts>*)*m_numSeg + segSize;
@@ -3070,6 +3084,7 @@ inline void SWmeta<Type_Key,Type_Ts>::bitmap_set_bit(int index)
     int bitPos = index - (bitmapPos << 6);
 
     m_bitmap[bitmapPos] |= (1ULL << bitPos); 
+    bitmap_summary_update(bitmapPos);
 }
 
 template<class Type_Key, class Type_Ts>
@@ -3087,6 +3102,7 @@ inline void SWmeta<Type_Key,Type_Ts>::bitmap_erase_bit(int index)
     int bitmapPos = index >> 6;
     int bitPos = index - (bitmapPos << 6);
     m_bitmap[bitmapPos] &= ~(1ULL << bitPos);
+    bitmap_summary_update(bitmapPos);
 }
 
 template<class Type_Key, class Type_Ts>
@@ -3112,7 +3128,7 @@ inline int SWmeta<Type_Key,Type_Ts>::bitmap_closest_left_nongap(int index, int l
     while(currentBitmap == 0) 
     //If current set of bitmap is empty (find previous bitmap that is not empty)
     {
-        --bitmapPos;
+        bitmapPos = bitmap_summary_prev(m_bitmapSummary, 0, bitmapPos - 1);
         if (bitmapPos < boundaryBitmapPos )
         {
             return -1; //Out of bounds
@@ -3139,7 +3155,7 @@ inline int SWmeta<Type_Key,Type_Ts>::bitmap_closest_right_nongap(int index, int
     while(currentBitmap == 0) 
     //If current set of bitmap is empty (find next bitmap that is not empty)
     {
-        ++bitmapPos;
+        bitmapPos = bitmap_summary_next(m_bitmapSummary, 0, bitmapPos + 1);
         if (bitmapPos > boundaryBitmapPos)
         {
             return -1;
@@ -3164,7 +3180,7 @@ inline int SWmeta<Type_Key,Type_Ts>::bitmap_closest_left_gap(int index, int left
     int leftBoundaryBitmapPos = leftBoundary >> 6;
     while(currentBitmap == 0) 
     {
-        --bitmapPos;
+        bitmapPos = bitmap_summary_prev(m_bitmapFullSummary, numeric_limits<uint64_t>::max(), bitmapPos - 1);
         if (bitmapPos < leftBoundaryBitmapPos )
         {
             return -1;
@@ -3188,7 +3204,7 @@ inline int SWmeta<Type_Key,Type_Ts>::bitmap_closest_right_gap(int index, int rig
     int rightBoundaryBitmapPos = rightBoundary >> 6;
     while(currentBitmap == 0) 
     {
-        bitmapPos++;
+        bitmapPos = bitmap_summary_next(m_bitmapFullSummary, numeric_limits<uint64_t>::max(), bitmapPos + 1);
         if (bitmapPos > rightBoundaryBitmapPos)
         {
            return -1;
@@ -3211,8 +3227,7 @@ inline int SWmeta<Type_Key,Type_Ts>::bitmap_closest_gap(int index)
        (bitmapPos == m_bitmap.size()-1 && _mm_popcnt_u64(m_bitmap[bitmapPos]) == (m_numSeg-((m_bitmap.size()-1)<<6))) //last block full
        )
     {
-        int maxLeftBlockDist = bitmapPos;
-        int maxRightBlockDist =  ((m_numSeg-1) >> 6) - bitmapPos;
+        int rightBound = ((m_numSeg-1) >> 6);
 
         if (m_bitmap.size() == 1)
         {
@@ -3224,100 +3239,31 @@ inline int SWmeta<Type_Key,Type_Ts>::bitmap_closest_gap(int index)
             return m_numSegExist;
         }
 
-        int blockDist = 1;
-        int maxBothBlockDist = min<int>(maxLeftBlockDist,maxRightBlockDist);
-        
-        while (blockDist <= maxBothBlockDist)
-        {
-            uint64_t rightBitmap = m_bitmap[bitmapPos + blockDist];
-            uint64_t leftBitmap = m_bitmap[bitmapPos - blockDist];
+        //Closest blocks with a gap on each side
+        int leftBitmapPos = bitmap_summary_prev(m_bitmapFullSummary, numeric_limits<uint64_t>::max(), bitmapPos - 1);
+        int rightBitmapPos = (bitmapPos < rightBound) ? bitmap_summary_next(m_bitmapFullSummary, numeric_limits<uint64_t>::max(), bitmapPos + 1) : rightBound + 1;
 
-            //Both blocks have gaps (find closest)
-            if (leftBitmap != numeric_limits<uint64_t>::max() && rightBitmap != numeric_limits<uint64_t>::max())
-            {
-                int rightGap = ((bitmapPos + blockDist) << 6) + static_cast<int>(_tzcnt_u64(~rightBitmap));
-                int leftGap = ((bitmapPos - blockDist + 1) << 6) - static_cast<int>(_lzcnt_u64(~leftBitmap)) - 1;
+        if (leftBitmapPos >= 0 && rightBitmapPos <= rightBound)
+        {
+            int rightGap = (rightBitmapPos << 6) + static_cast<int>(_tzcnt_u64(~m_bitmap[rightBitmapPos]));
+            int leftGap = ((leftBitmapPos + 1) << 6) - static_cast<int>(_lzcnt_u64(~m_bitmap[leftBitmapPos])) - 1;
 
-                if (rightGap - index < index - leftGap)
-                {
-                    return rightGap; //Can also be last position (need to check outside to append)
-                }
-                else
-                {
-                    return leftGap;
-                }
-            }
-            //Gap in right block only (Also need to check leftblock-1 if bitPos < 32)
-            else if (rightBitmap != numeric_limits<uint64_t>::max())
+            if (rightGap - index < index - leftGap)
             {
-                int rightGap = ((bitmapPos + blockDist) << 6) + static_cast<int>(_tzcnt_u64(~rightBitmap));
-
-                if (bitPos < 32 && bitmapPos - blockDist > 0 &&
-                    m_bitmap[bitmapPos - blockDist - 1] != numeric_limits<uint64_t>::max())
-                {
-                    int leftGap = ((bitmapPos - blockDist) << 6) - static_cast<int>(_lzcnt_u64(~m_bitmap[bitmapPos - blockDist - 1])) - 1;
-
-                    if (rightGap - index < index - leftGap)
-                    {
-                        return rightGap; //Can also be last position (need to check outside to append)
-                    }
-                    else
-                    {
-                        return leftGap;
-                    }
-                }
-                else
-                {
-                    return rightGap;
-                }
+                return rightGap; //Can also be last position (need to check outside to append)
             }
-            //Gap in left block only (Also need to check rightblock+1 if bitPos > 32)
-            else if (leftBitmap != numeric_limits<uint64_t>::max())
+            else
             {
-                int leftGap = ((bitmapPos - blockDist + 1) << 6) - static_cast<int>(_lzcnt_u64(~leftBitmap)) - 1;
-
-                if (bitPos > 32 && bitmapPos + blockDist + 1 < m_bitmap.size() && 
-                    m_bitmap[bitmapPos + blockDist + 1] != numeric_limits<uint64_t>::max())
-                {
-                    int rightGap = ((bitmapPos + blockDist+1) << 6) + static_cast<int>(_tzcnt_u64(~m_bitmap[bitmapPos + blockDist + 1]));
-
-                    if (rightGap - index < index - leftGap)
-                    {
-                        return rightGap; //Can also be last position (need to check outside to append)
-                    }
-                    else
-                    {
-                        return leftGap;
-                    } 
-                }
-                else
-                {
-                    return leftGap;
-                }
+                return leftGap;
             }
-            blockDist++;
         }
-
-        if (maxLeftBlockDist > maxRightBlockDist)
+        else if (rightBitmapPos <= rightBound)
         {
-            for (int i = bitmapPos - blockDist; i >= 0; i--)
-            {
-                if (m_bitmap[i] != numeric_limits<uint64_t>::max())
-                {
-                    return ((i + 1) << 6) - static_cast<int>(_lzcnt_u64(~m_bitmap[i])) - 1;
-                }
-            }
+            return (rightBitmapPos << 6) + static_cast<int>(_tzcnt_u64(~m_bitmap[rightBitmapPos]));
         }
-        else
+        else if (leftBitmapPos >= 0)
         {
-            int rightBound = ((m_numSeg-1) >> 6);
-            for (int i = bitmapPos + blockDist; i <= rightBound; i++)
-            {
-                if (m_bitmap[i] != numeric_limits<uint64_t>::max())
-                {
-                    return (i << 6) + static_cast<int>(_tzcnt_u64(~m_bitmap[i]));
-                }
-            }
+            return ((leftBitmapPos + 1) << 6) - static_cast<int>(_lzcnt_u64(~m_bitmap[leftBitmapPos])) - 1;
         }
         return -1; //Something went wrong (No Gap)
 
@@ -3374,7 +3320,7 @@ inline int SWmeta<Type_Key,Type_Ts>::bitmap_closest_gap(int index, int leftBound
     int leftBoundaryBitmapPos = leftBoundary >> 6;
     while(currentBitmap == 0) 
     {
-        --bitmapPos;
+        bitmapPos = bitmap_summary_prev(m_bitmapFullSummary, numeric_limits<uint64_t>::max(), bitmapPos - 1);
         if (bitmapPos < leftBoundaryBitmapPos )
         {
             leftIndex = -1; //Out of bounds
@@ -3382,7 +3328,10 @@ inline int SWmeta<Type_Key,Type_Ts>::bitmap_closest_gap(int index, int leftBound
         }
         currentBitmap = m_bitmap[bitmapPos] ^ numeric_limits<uint64_t>::max();
     }
-    leftIndex = (bitmapPos << 6) + (63-static_cast<int>(_lzcnt_u64(currentBitmap)));
+    if (currentBitmap)
+    {
+        leftIndex = (bitmapPos << 6) + (63-static_cast<int>(_lzcnt_u64(currentBitmap)));
+    }
 
     if (leftIndex < leftBoundary)
     {
@@ -3397,7 +3346,7 @@ inline int SWmeta<Type_Key,Type_Ts>::bitmap_closest_gap(int index, int leftBound
     int rightBoundaryBitmapPos = rightBoundary >> 6;
     while(currentBitmap == 0) 
     {
-        bitmapPos++;
+        bitmapPos = bitmap_summary_next(m_bitmapFullSummary, numeric_limits<uint64_t>::max(), bitmapPos + 1);
         if (bitmapPos > rightBoundaryBitmapPos)
         {
             rightIndex = -1; //Out of bounds
@@ -3406,7 +3355,10 @@ inline int SWmeta<Type_Key,Type_Ts>::bitmap_closest_gap(int index, int leftBound
         currentBitmap = m_bitmap[bitmapPos] ^ numeric_limits<uint64_t>::max();
     }
 
-    rightIndex = bit_get_index(bitmapPos,bit_extract_rightmost_bit(currentBitmap));
+    if (currentBitmap)
+    {
+        rightIndex = bit_get_index(bitmapPos,bit_extract_rightmost_bit(currentBitmap));
+    }
 
     if (rightIndex > rightBoundary)
     {
@@ -3536,48 +3488,14 @@ template<class Type_Key, class Type_Ts>
 inline void SWmeta<Type_Key,Type_Ts>::bitmap_move_bit_back(int startingIndex, int endingIndex) 
 //Inclusive: [startingIndex,endingIndex] and startingIndex < endingIndex
 {
-    if (static_cast<int>(endingIndex >> 6) == m_bitmap.size())
-    {
-        m_bitmap.push_back(0); //When end exceeds last pos (end == m_numSeg)
-    }
-
-    int bitmapPos = startingIndex >> 6;
-    int bitPos = startingIndex - (bitmapPos << 6);
-
-    int bitmapPosEnd = endingIndex >> 6;
-    int bitPosEnd = endingIndex - (bitmapPosEnd << 6);
-
-    bool previousBitValue = static_cast<bool>(m_bitmap[bitmapPos] & (1ULL << bitPos));
-
-    while (!(bitmapPos == bitmapPosEnd && bitPos == bitPosEnd))
-    {
-        if (bitPos == 63)
-        {
-            bitPos = 0;
-            bitmapPos++;
-        }
-        else
-        {
-            bitPos++;
-        }
-
-        bool temp = static_cast<bool>(m_bitmap[bitmapPos] & (1ULL << bitPos));
-        if (previousBitValue)
-        {
-            m_bitmap[bitmapPos] |= (1ULL << bitPos);
-        }
-        else
-        {
-            m_bitmap[bitmapPos] &= ~(1ULL << bitPos);
-        }
-        previousBitValue = temp;
-    }
-    return;
+    bitmap_move_bit_back(m_bitmap, startingIndex, endingIndex);
+    bitmap_summary_update(startingIndex >> 6, endingIndex >> 6);
 }
 
 template<class Type_Key, class Type_Ts>
 inline void SWmeta<Type_Key,Type_Ts>::bitmap_move_bit_back(vector<uint64_t> & bitmap, int startingIndex, int endingIndex) 
 //Inclusive: [startingIndex,endingIndex] and startingIndex < endingIndex
+//Bit i moves to i+1 for i in [startingIndex,endingIndex), bit startingIndex is unchanged
 {
     if (static_cast<int>(endingIndex >> 6) == bitmap.size())
     {
@@ -3590,30 +3508,12 @@ inline void SWmeta<Type_Key,Type_Ts>::bitmap_move_bit_back(vector<uint64_t> & bi
     int bitmapPosEnd = endingIndex >> 6;
     int bitPosEnd = endingIndex - (bitmapPosEnd << 6);
 
-    bool previousBitValue = static_cast<bool>(bitmap[bitmapPos] & (1ULL << bitPos));
-
-    while (!(bitmapPos == bitmapPosEnd && bitPos == bitPosEnd))
+    //Shift one word at a time from the end, the lower word is still unshifted when its top bit is carried
+    for (int i = bitmapPosEnd; i >= bitmapPos; i--)
     {
-        if (bitPos == 63)
-        {
-            bitPos = 0;
-            bitmapPos++;
-        }
-        else
-        {
-            bitPos++;
-        }
-
-        bool temp = static_cast<bool>(bitmap[bitmapPos] & (1ULL << bitPos));
-        if (previousBitValue)
-        {
-            bitmap[bitmapPos] |= (1ULL << bitPos);
-        }
-        else
-        {
-            bitmap[bitmapPos] &= ~(1ULL << bitPos);
-        }
-        previousBitValue = temp;
+        uint64_t shifted = (bitmap[i] << 1) | ((i > bitmapPos) ? (bitmap[i-1] >> 63) : 0);
+        uint64_t mask = bit_range_mask((i == bitmapPos) ? bitPos + 1 : 0, (i == bitmapPosEnd) ? bitPosEnd : 63);
+        bitmap[i] = (bitmap[i] & ~mask) | (shifted & mask);
     }
     return;
 }
@@ -3621,6 +3521,15 @@ inline void SWmeta<Type_Key,Type_Ts>::bitmap_move_bit_back(vector<uint64_t> & bi
 template<class Type_Key, class Type_Ts>
 inline void SWmeta<Type_Key,Type_Ts>::bitmap_move_bit_front(int startingIndex, int endingIndex) 
 //Inclusive: [startingIndex,endingIndex] and startingIndex > endingIndex
+{
+    bitmap_move_bit_front(m_bitmap, startingIndex, endingIndex);
+    bitmap_summary_update(endingIndex >> 6, startingIndex >> 6);
+}
+
+template<class Type_Key, class Type_Ts>
+inline void SWmeta<Type_Key,Type_Ts>::bitmap_move_bit_front(vector<uint64_t> & bitmap, int startingIndex, int endingIndex) 
+//Inclusive: [startingIndex,endingIndex] and startingIndex > endingIndex
+//Bit i moves to i-1 for i in (endingIndex,startingIndex], bit startingIndex is unchanged
 {
     int bitmapPos = startingIndex >> 6;
     int bitPos = startingIndex - (bitmapPos << 6);
@@ -3628,70 +3537,117 @@ inline void SWmeta<Type_Key,Type_Ts>::bitmap_move_bit_front(int startingIndex, i
     int bitmapPosEnd = endingIndex >> 6;
     int bitPosEnd = endingIndex - (bitmapPosEnd << 6);
 
-    bool previousBitValue = static_cast<bool>(m_bitmap[bitmapPos] & (1ULL << bitPos));
+    //Shift one word at a time from the end, the higher word is still unshifted when its bottom bit is carried
+    for (int i = bitmapPosEnd; i <= bitmapPos; i++)
+    {
+        uint64_t shifted = (bitmap[i] >> 1) | ((i < bitmapPos) ? (bitmap[i+1] << 63) : 0);
+        uint64_t mask = bit_range_mask((i == bitmapPosEnd) ? bitPosEnd : 0, (i == bitmapPos) ? bitPos - 1 : 63);
+        bitmap[i] = (bitmap[i] & ~mask) | (shifted & mask);
+    }
+    return;
+}
 
-    while (!(bitmapPos == bitmapPosEnd && bitPos == bitPosEnd))
+template<class Type_Key, class Type_Ts>
+inline void SWmeta<Type_Key,Type_Ts>::bitmap_summary_update(int bitmapPos)
+{
+    int summaryPos = bitmapPos >> 6;
+    if (summaryPos >= m_bitmapSummary.size())
     {
-        if (bitPos == 0)
-        {
-            bitPos = 63;
-            bitmapPos--;
-        }
-        else
-        {
-            bitPos--;
-        }
+        m_bitmapSummary.resize(summaryPos + 1, 0);
+        m_bitmapFullSummary.resize(summaryPos + 1, 0);
+    }
 
-        bool temp = static_cast<bool>(m_bitmap[bitmapPos] & (1ULL << bitPos));
-        if (previousBitValue)
-        {
-            m_bitmap[bitmapPos] |= (1ULL << bitPos);
-        }
-        else
-        {
-            m_bitmap[bitmapPos] &= ~(1ULL << bitPos);
-        }
-        previousBitValue = temp;
+    uint64_t bit = 1ULL << (bitmapPos & 63);
+    uint64_t word = m_bitmap[bitmapPos];
+    if (word != 0)
+    {
+        __atomic_fetch_or(&m_bitmapSummary[summaryPos], bit, __ATOMIC_RELAXED);
+    }
+    else
+    {
+        __atomic_fetch_and(&m_bitmapSummary[summaryPos], ~bit, __ATOMIC_RELAXED);
+    }
+
+    if (word == numeric_limits<uint64_t>::max())
+    {
+        __atomic_fetch_or(&m_bitmapFullSummary[summaryPos], bit, __ATOMIC_RELAXED);
+    }
+    else
+    {
+        __atomic_fetch_and(&m_bitmapFullSummary[summaryPos], ~bit, __ATOMIC_RELAXED);
     }
-    return;
 }
 
 template<class Type_Key, class Type_Ts>
-inline void SWmeta<Type_Key,Type_Ts>::bitmap_move_bit_front(vector<uint64_t> & bitmap, int startingIndex, int endingIndex) 
-//Inclusive: [startingIndex,endingIndex] and startingIndex > endingIndex
+inline void SWmeta<Type_Key,Type_Ts>::bitmap_summary_update(int startBitmapPos, int endBitmapPos)
 {
-    int bitmapPos = startingIndex >> 6;
-    int bitPos = startingIndex - (bitmapPos << 6);
+    for (int i = startBitmapPos; i <= endBitmapPos; i++)
+    {
+        bitmap_summary_update(i);
+    }
+}
 
-    int bitmapPosEnd = endingIndex >> 6;
-    int bitPosEnd = endingIndex - (bitmapPosEnd << 6);
+template<class Type_Key, class Type_Ts>
+void SWmeta<Type_Key,Type_Ts>::bitmap_summary_rebuild()
+{
+    m_bitmapSummary.assign((m_bitmap.size() + 63) >> 6, 0);
+    m_bitmapFullSummary.assign((m_bitmap.size() + 63) >> 6, 0);
+    bitmap_summary_update(0, static_cast<int>(m_bitmap.size()) - 1);
+}
 
-    bool previousBitValue = static_cast<bool>(bitmap[bitmapPos] & (1ULL << bitPos));
+template<class Type_Key, class Type_Ts>
+inline int SWmeta<Type_Key,Type_Ts>::bitmap_summary_next(const vector<uint64_t> & summary, uint64_t flip, int bitmapPos) const
+//First word at or after bitmapPos with its summary bit (xor flip) set, m_bitmap.size() if none
+{
+    if (bitmapPos >= m_bitmap.size())
+    {
+        return m_bitmap.size();
+    }
+
+    int summaryPos = bitmapPos >> 6;
+    int summaryEnd = (m_bitmap.size() + 63) >> 6;
+
+    uint64_t currentSummary = ((summaryPos < summary.size()) ? __atomic_load_n(&summary[summaryPos], __ATOMIC_RELAXED) : 0) ^ flip;
+    currentSummary &= ~((1ULL << (bitmapPos & 63)) - 1);
 
-    while (!(bitmapPos == bitmapPosEnd && bitPos == bitPosEnd))
+    while (currentSummary == 0)
     {
-        if (bitPos == 0)
-        {
-            bitPos = 63;
-            bitmapPos--;
-        }
-        else
+        summaryPos++;
+        if (summaryPos >= summaryEnd)
         {
-            bitPos--;
+            return m_bitmap.size();
         }
+        currentSummary = ((summaryPos < summary.size()) ? __atomic_load_n(&summary[summaryPos], __ATOMIC_RELAXED) : 0) ^ flip;
+    }
 
-        bool temp = static_cast<bool>(bitmap[bitmapPos] & (1ULL << bitPos));
-        if (previousBitValue)
-        {
-            bitmap[bitmapPos] |= (1ULL << bitPos);
-        }
-        else
+    return min<int>((summaryPos << 6) + static_cast<int>(_tzcnt_u64(currentSummary)), m_bitmap.size());
+}
+
+template<class Type_Key, class Type_Ts>
+inline int SWmeta<Type_Key,Type_Ts>::bitmap_summary_prev(const vector<uint64_t> & summary, uint64_t flip, int bitmapPos) const
+//Last word at or before bitmapPos with its summary bit (xor flip) set, -1 if none
+{
+    if (bitmapPos < 0)
+    {
+        return -1;
+    }
+
+    int summaryPos = bitmapPos >> 6;
+
+    uint64_t currentSummary = ((summaryPos < summary.size()) ? __atomic_load_n(&summary[summaryPos], __ATOMIC_RELAXED) : 0) ^ flip;
+    currentSummary &= bit_range_mask(0, bitmapPos & 63);
+
+    while (currentSummary == 0)
+    {
+        summaryPos--;
+        if (summaryPos < 0)
         {
-            bitmap[bitmapPos] &= ~(1ULL << bitPos);
+            return -1;
         }
-        previousBitValue = temp;
+        currentSummary = ((summaryPos < summary.size()) ? __atomic_load_n(&summary[summaryPos], __ATOMIC_RELAXED) : 0) ^ flip;
     }
-    return;
+
+    return (summaryPos << 6) + (63 - static_cast<int>(_lzcnt_u64(currentSummary)));
 }
 
 }
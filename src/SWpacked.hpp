@@ -0,0 +1,423 @@
+#ifndef __SWIX_PACKED_HPP__
+#define __SWIX_PACKED_HPP__
+
+#pragma once
+#include <cstring>
+#include "helper.hpp"
+#include "SWpool.hpp"
+
+using namespace std;
+
+namespace swix {
+
+/*
+Packed Array
+*/
+//Array of T stored as 2, 4 or sizeof(T) byte codes (COMPRESSED_SEG). Narrow codes are offsets from a per-array base:
+//0 stays 0 (gap timestamps), other values v >= base are stored as v - base + 1. Codes keep the order of the values, so
+//searches compare codes without decoding. Storing a value that does not fit re-encodes the array with a wider code.
+//Unsigned integer types only are narrowed, other types are stored as they are.
+template<class T>
+class SWpackedArray
+{
+private:
+    vector<uint8_t, SWallocator<uint8_t>> m_codes;
+    T m_base = 0;
+    int m_width = sizeof(T);
+    int m_size = 0;
+
+    static constexpr bool packable = is_unsigned<T>::value && sizeof(T) > 2;
+
+public:
+    //Proxy returned by the non-const operator[] and back()
+    class reference
+    {
+    private:
+        SWpackedArray<T> & m_array;
+        int m_index;
+
+    public:
+        reference(SWpackedArray<T> & array, int index)
+        :m_array(array), m_index(index) {}
+
+        inline operator T() const
+        {
+            return m_array.get(m_index);
+        }
+
+        inline reference & operator=(T value)
+        {
+            m_array.set(m_index, value);
+            return *this;
+        }
+
+        inline reference & operator=(const reference & other)
+        {
+            return *this = static_cast<T>(other);
+        }
+    };
+
+    SWpackedArray(SWpool * pool = nullptr)
+    :m_codes(pool) {}
+
+    //Empties the array and picks the code width for values in [base, maxValue] (half of the codes left for later values)
+    inline void reset(T base, T maxValue)
+    {
+        m_codes.clear();
+        m_size = 0;
+        m_base = base;
+        m_width = fit_width(base, maxValue);
+    }
+
+    inline int size() const {return m_size;}
+    inline int width() const {return m_width;}
+    inline const char * address(int index) const {return reinterpret_cast<const char*>(m_codes.data()) + (size_t)index * m_width;}
+    inline uint64_t size_in_bytes() const {return (uint64_t)m_size * m_width;}
+    inline SWallocator<uint8_t> get_allocator() const {return m_codes.get_allocator();}
+
+    inline T operator[](int index) const {return get(index);}
+    inline reference operator[](int index) {return reference(*this, index);}
+    inline T back() const {return get(m_size-1);}
+    inline reference back() {return reference(*this, m_size-1);}
+
+    inline T get(int index) const
+    {
+        if (m_width == sizeof(T))
+        {
+            return reinterpret_cast<const T*>(m_codes.data())[index];
+        }
+        else if (m_width == 4)
+        {
+            return decode(reinterpret_cast<const uint32_t*>(m_codes.data())[index]);
+        }
+        return decode(reinterpret_cast<const uint16_t*>(m_codes.data())[index]);
+    }
+
+    inline void set(int index, T value)
+    {
+        if (!fits(value))
+        {
+            widen(value);
+        }
+        put(index, value);
+    }
+
+    inline void push_back(T value)
+    {
+        resize(m_size+1, value);
+    }
+
+    //Grows the array to numValue entries of value (or shrinks it)
+    inline void resize(int numValue, T value)
+    {
+        if (!fits(value))
+        {
+            widen(value);
+        }
+
+        int oldSize = m_size;
+        m_codes.resize((size_t)numValue * m_width);
+        m_size = numValue;
+        for (int i = oldSize; i < numValue; i++)
+        {
+            put(i, value);
+        }
+    }
+
+    inline void insert(int index, T value)
+    {
+        resize(m_size+1, value);
+        shift_right(index, m_size-1);
+        put(index, value);
+    }
+
+    //Moves [first, last) to [first+1, last+1)
+    inline void shift_right(int first, int last)
+    {
+        uint8_t * codes = m_codes.data();
+        memmove(codes + (size_t)(first+1) * m_width, codes + (size_t)first * m_width, (size_t)(last - first) * m_width);
+    }
+
+    //Moves [first, last) to [first-1, last-1)
+    inline void shift_left(int first, int last)
+    {
+        uint8_t * codes = m_codes.data();
+        memmove(codes + (size_t)(first-1) * m_width, codes + (size_t)first * m_width, (size_t)(last - first) * m_width);
+    }
+
+    //Calls visitor with the codes as uint16_t *, uint32_t * or T *
+    template<class Visitor>
+    inline void visit_codes(Visitor && visitor)
+    {
+        if (m_width == sizeof(T))
+        {
+            visitor(reinterpret_cast<T*>(m_codes.data()));
+        }
+        else if (m_width == 4)
+        {
+            visitor(reinterpret_cast<uint32_t*>(m_codes.data()));
+        }
+        else
+        {
+            visitor(reinterpret_cast<uint16_t*>(m_codes.data()));
+        }
+    }
+
+    template<class Type_Code>
+    inline T decode(Type_Code code) const
+    {
+        if constexpr (sizeof(Type_Code) == sizeof(T))
+        {
+            return code;
+        }
+        else
+        {
+            return code ? m_base + static_cast<T>(code - 1) : 0;
+        }
+    }
+
+    //Largest code of a value <= value
+    inline uint64_t code_upper(T value) const
+    {
+        if (m_width == sizeof(T))
+        {
+            return value;
+        }
+        if (value < m_base)
+        {
+            return 0;
+        }
+        return ((uint64_t)(value - m_base) >= max_code(m_width)) ? max_code(m_width) : (uint64_t)(value - m_base) + 1;
+    }
+
+    //Smallest code of a non-zero value >= value (above every code if there is none)
+    inline uint64_t code_lower(T value) const
+    {
+        if (m_width == sizeof(T))
+        {
+            return value;
+        }
+        if (value <= m_base)
+        {
+            return 1;
+        }
+        return ((uint64_t)(value - m_base) >= max_code(m_width)) ? max_code(m_width) + 1 : (uint64_t)(value - m_base) + 1;
+    }
+
+    //First index in [first, last) with a value >= targetValue (last if none), compares codes
+    template<SWsearch policy>
+    inline int lower_bound(int first, int last, T targetValue) const
+    {
+        if (m_width == sizeof(T))
+        {
+            return search_codes<policy>(reinterpret_cast<const T*>(m_codes.data()), first, last, targetValue);
+        }
+
+        uint64_t targetCode;
+        if (!targetValue)
+        {
+            targetCode = 0;
+        }
+        else if (targetValue < m_base) //Smaller than every non-zero value
+        {
+            targetCode = 1;
+        }
+        else if ((uint64_t)(targetValue - m_base) >= max_code(m_width)) //Larger than every value
+        {
+            return last;
+        }
+        else
+        {
+            targetCode = (uint64_t)(targetValue - m_base) + 1;
+        }
+
+        if (m_width == 4)
+        {
+            return search_codes<policy>(reinterpret_cast<const uint32_t*>(m_codes.data()), first, last, static_cast<uint32_t>(targetCode));
+        }
+        return search_codes<policy>(reinterpret_cast<const uint16_t*>(m_codes.data()), first, last, static_cast<uint16_t>(targetCode));
+    }
+
+private:
+    static inline uint64_t max_code(int width)
+    {
+        return (width >= 8) ? numeric_limits<uint64_t>::max() : (1ULL << (8*width)) - 1;
+    }
+
+    static inline int fit_width(T base, T maxValue)
+    {
+        if constexpr (packable)
+        {
+            uint64_t span = (maxValue > base) ? (uint64_t)(maxValue - base) + 1 : 1;
+            if (span < (max_code(2) >> 1))
+            {
+                return 2;
+            }
+            if (sizeof(T) > 4 && span < (max_code(4) >> 1))
+            {
+                return 4;
+            }
+        }
+        return sizeof(T);
+    }
+
+    inline bool fits(T value) const
+    {
+        return m_width == sizeof(T) || !value || (value >= m_base && (uint64_t)(value - m_base) < max_code(m_width));
+    }
+
+    inline void put(int index, T value)
+    {
+        if (m_width == sizeof(T))
+        {
+            reinterpret_cast<T*>(m_codes.data())[index] = value;
+        }
+        else if (m_width == 4)
+        {
+            reinterpret_cast<uint32_t*>(m_codes.data())[index] = value ? static_cast<uint32_t>(value - m_base + 1) : 0;
+        }
+        else
+        {
+            reinterpret_cast<uint16_t*>(m_codes.data())[index] = value ? static_cast<uint16_t>(value - m_base + 1) : 0;
+        }
+    }
+
+    //Re-encodes the array so value fits, rare (a key below the first key of the SWseg or far beyond its last one)
+    void widen(T value)
+    {
+        vector<T> values(m_size);
+        T minValue = value, maxValue = value;
+        for (int i = 0; i < m_size; i++)
+        {
+            values[i] = get(i);
+            if (values[i])
+            {
+                minValue = (!minValue || values[i] < minValue) ? values[i] : minValue;
+                maxValue = values[i] > maxValue ? values[i] : maxValue;
+            }
+        }
+
+        int numValue = m_size;
+        reset(minValue, maxValue);
+        m_codes.resize((size_t)numValue * m_width);
+        m_size = numValue;
+        for (int i = 0; i < numValue; i++)
+        {
+            put(i, values[i]);
+        }
+    }
+
+    template<SWsearch policy, class Type_Code>
+    static inline int search_codes(const Type_Code * codes, int first, int last, Type_Code targetCode)
+    {
+        if constexpr (policy == SEARCH_LINEAR)
+        {
+            return linear_search_lower_bound(codes, first, last, targetCode);
+        }
+        else if constexpr (policy == SEARCH_BINARY)
+        {
+            return binary_search_lower_bound(codes, first, last, targetCode);
+        }
+        else
+        {
+            return std::lower_bound(codes + first, codes + last, targetCode) - codes;
+        }
+    }
+};
+
+/*
+Model Array Operations
+*/
+//SWseg's model arrays are vectors or, with COMPRESSED_SEG, SWpackedArray. SWseg goes through these for the operations
+//that differ between the two (iterators, raw pointers).
+
+template<class T, class Alloc>
+inline const char * element_address(const vector<T,Alloc> & array, int index)
+{
+    return reinterpret_cast<const char*>(array.data() + index);
+}
+
+template<class T>
+inline const char * element_address(const SWpackedArray<T> & array, int index)
+{
+    return array.address(index);
+}
+
+template<class T, class Alloc>
+inline uint64_t array_size_in_bytes(const vector<T,Alloc> & array, int numValue)
+{
+    return sizeof(T) * numValue;
+}
+
+template<class T>
+inline uint64_t array_size_in_bytes(const SWpackedArray<T> & array, int numValue)
+{
+    return array.size_in_bytes();
+}
+
+//Moves [first, last) to [first+1, last+1)
+template<class T, class Alloc>
+inline void shift_right(vector<T,Alloc> & array, int first, int last)
+{
+    move_backward(array.begin()+first, array.begin()+last, array.begin()+last+1);
+}
+
+template<class T>
+inline void shift_right(SWpackedArray<T> & array, int first, int last)
+{
+    array.shift_right(first, last);
+}
+
+//Moves [first, last) to [first-1, last-1)
+template<class T, class Alloc>
+inline void shift_left(vector<T,Alloc> & array, int first, int last)
+{
+    move(array.begin()+first, array.begin()+last, array.begin()+first-1);
+}
+
+template<class T>
+inline void shift_left(SWpackedArray<T> & array, int first, int last)
+{
+    array.shift_left(first, last);
+}
+
+template<class T, class Alloc>
+inline void insert_at(vector<T,Alloc> & array, int index, T value)
+{
+    array.insert(array.begin()+index, value);
+}
+
+template<class T>
+inline void insert_at(SWpackedArray<T> & array, int index, T value)
+{
+    array.insert(index, value);
+}
+
+//First index in [first, last) with a value >= targetValue (last if none). SEARCH_EXPONENTIAL is a plain lower_bound
+//over the range left by the exponential search.
+template<SWsearch policy, class T, class Alloc>
+inline int search_lower_bound(const vector<T,Alloc> & array, int first, int last, const T & targetValue)
+{
+    if constexpr (policy == SEARCH_LINEAR)
+    {
+        return linear_search_lower_bound(array.data(), first, last, targetValue);
+    }
+    else if constexpr (policy == SEARCH_BINARY)
+    {
+        return binary_search_lower_bound(array.data(), first, last, targetValue);
+    }
+    else
+    {
+        return lower_bound(array.begin()+first, array.begin()+last, targetValue) - array.begin();
+    }
+}
+
+template<SWsearch policy, class T>
+inline int search_lower_bound(const SWpackedArray<T> & array, int first, int last, const T & targetValue)
+{
+    return array.template lower_bound<policy>(first, last, targetValue);
+}
+
+}
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef __SWIX_PAYLOAD_HPP__
+#define __SWIX_PAYLOAD_HPP__
+
+#pragma once
+#include "helper.hpp"
+#include "SWpool.hpp"
+
+using namespace std;
+
+namespace swix {
+
+/*
+Payload Column
+*/
+//Default payload of SWmeta and SWseg, nothing is stored
+struct SWnoPayload {};
+
+template<class Type_Payload>
+constexpr bool has_payload = !is_same<Type_Payload, SWnoPayload>::value;
+
+//Payload column of SWnoPayload: the vector operations SWseg uses, storing nothing
+template<class T>
+class SWemptyColumn
+{
+private:
+    static inline T m_value{};
+
+public:
+    SWemptyColumn(SWpool * pool = nullptr) {}
+
+    inline T & operator[](int index) {return m_value;}
+    inline const T & operator[](int index) const {return m_value;}
+    inline size_t capacity() const {return 0;}
+    inline void push_back(const T & value) {}
+    inline void resize(size_t numValue, const T & value = T()) {}
+    inline void reserve(size_t numValue) {}
+    inline void clear() {}
+    inline void swap(SWemptyColumn<T> & other) {}
+};
+
+//Payloads of an SWseg (and of the data it is trained from) are kept apart from the keys and timestamps, index i of the
+//column belongs to index i of the key array, gaps included. Searches never touch it.
+template<class Type_Payload>
+using SWpayloadColumn = typename conditional<has_payload<Type_Payload>,
+                                            vector<Type_Payload, SWallocator<Type_Payload>>,
+                                            SWemptyColumn<Type_Payload>>::type;
+
+template<class T, class Alloc>
+inline uint64_t column_size_in_bytes(const vector<T,Alloc> & column)
+{
+    return sizeof(column) + sizeof(T) * column.capacity();
+}
+
+template<class T>
+inline uint64_t column_size_in_bytes(const SWemptyColumn<T> & column)
+{
+    return 0;
+}
+
+//Same operations as for the model arrays (SWpacked.hpp)
+template<class T>
+inline void shift_right(SWemptyColumn<T> & column, int first, int last) {}
+
+template<class T>
+inline void shift_left(SWemptyColumn<T> & column, int first, int last) {}
+
+template<class T>
+inline void insert_at(SWemptyColumn<T> & column, int index, const T & value) {}
+
+/*
+Payload Result
+*/
+//Range search result carrying the payload of each tuple, payloads[i] belongs to tuples[i]
+template<class Type_Key, class Type_Ts, class Type_Payload>
+struct SWpayloadResult
+{
+    vector<pair<Type_Key,Type_Ts>> tuples;
+    vector<Type_Payload> payloads;
+
+    inline void clear()
+    {
+        tuples.clear();
+        payloads.clear();
+    }
+};
+
+template<class Type_Result>
+struct is_payload_result : false_type {};
+
+template<class Type_Key, class Type_Ts, class Type_Payload>
+struct is_payload_result<SWpayloadResult<Type_Key,Type_Ts,Type_Payload>> : true_type {};
+
+template<class Type_Key, class Type_Ts, class Type_Payload>
+inline void append_result(SWpayloadResult<Type_Key,Type_Ts,Type_Payload> & rangeSearchResult, Type_Key key, Type_Ts timeStamp, const Type_Payload & payload)
+{
+    rangeSearchResult.tuples.push_back(make_pair(key,timeStamp));
+    rangeSearchResult.payloads.push_back(payload);
+}
+
+//visitor(key, timeStamp, payload), or visitor(key, timeStamp) for visitors that do not take the payload
+template<class Visitor, class Type_Key, class Type_Ts, class Type_Payload>
+inline bool visit_tuple(Visitor & visitor, Type_Key key, Type_Ts timeStamp, const Type_Payload & payload)
+{
+    if constexpr (is_invocable<Visitor&, Type_Key, Type_Ts, const Type_Payload &>::value)
+    {
+        return visitor(key, timeStamp, payload);
+    }
+    else
+    {
+        return visitor(key, timeStamp);
+    }
+}
+
+}
+
+#endif
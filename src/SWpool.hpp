@@ -0,0 +1,206 @@
+#ifndef __SWIX_POOL_HPP__
+#define __SWIX_POOL_HPP__
+
+#pragma once
+#include "helper.hpp"
+
+using namespace std;
+
+namespace swix {
+
+//Allocator statistics of an SWpool
+struct SWpoolStats
+{
+    uint64_t reservedBytes = 0; //chunks taken from the system
+    uint64_t usedBytes = 0; //blocks handed out (rounded up to their size class)
+    uint64_t freeBytes = 0; //blocks waiting in the free lists
+    uint64_t largeBytes = 0; //blocks larger than a size class (served by operator new)
+    uint64_t numAllocations = 0;
+    uint64_t numReused = 0; //allocations served from a free list
+};
+
+//Per-index pool for SWseg objects and their key/timestamp arrays.
+//Blocks are rounded up to a size class (4 per power of two, multiples of 16 bytes) and recycled through free lists.
+//Chunks are only returned to the system when the pool is destroyed. Not thread safe.
+class SWpool
+{
+private:
+    static const size_t CHUNK_SIZE = (size_t)1 << POOL_CHUNK_LOG;
+    static const size_t MAX_BLOCK_SIZE = CHUNK_SIZE >> 2;
+    static const int NUM_SIZE_CLASSES = 4 * (POOL_CHUNK_LOG - 7);
+
+    void * m_freeLists[NUM_SIZE_CLASSES];
+    vector<char*> m_chunks;
+    char * m_chunkPos;
+    size_t m_chunkRemaining;
+    SWpoolStats m_stats;
+
+public:
+    SWpool()
+    :m_chunkPos(nullptr), m_chunkRemaining(0)
+    {
+        fill(m_freeLists, m_freeLists + NUM_SIZE_CLASSES, nullptr);
+    }
+
+    ~SWpool()
+    {
+        for (auto & it : m_chunks)
+        {
+            ::operator delete(it, align_val_t(64));
+        }
+    }
+
+    SWpool(const SWpool &) = delete;
+    SWpool & operator=(const SWpool &) = delete;
+
+    inline void * allocate(size_t bytes)
+    {
+        m_stats.numAllocations++;
+
+        if (bytes > MAX_BLOCK_SIZE)
+        {
+            m_stats.largeBytes += bytes;
+            return ::operator new(bytes);
+        }
+
+        int sizeClass = size_class(bytes);
+        size_t blockSize = class_size(sizeClass);
+        m_stats.usedBytes += blockSize;
+
+        if (m_freeLists[sizeClass])
+        {
+            void * block = m_freeLists[sizeClass];
+            m_freeLists[sizeClass] = *reinterpret_cast<void**>(block);
+            m_stats.freeBytes -= blockSize;
+            m_stats.numReused++;
+            return block;
+        }
+
+        if (m_chunkRemaining < blockSize)
+        {
+            new_chunk();
+        }
+
+        void * block = m_chunkPos;
+        m_chunkPos += blockSize;
+        m_chunkRemaining -= blockSize;
+        return block;
+    }
+
+    inline void deallocate(void * block, size_t bytes)
+    {
+        if (bytes > MAX_BLOCK_SIZE)
+        {
+            m_stats.largeBytes -= bytes;
+            ::operator delete(block);
+            return;
+        }
+
+        int sizeClass = size_class(bytes);
+        m_stats.usedBytes -= class_size(sizeClass);
+        push_free(block, sizeClass);
+    }
+
+    const SWpoolStats & get_stats() const
+    {
+        return m_stats;
+    }
+
+private:
+    //Classes 0-3: 16, 32, 48, 64 bytes. Above 64 bytes: 4 classes per power of two.
+    static inline int size_class(size_t bytes)
+    {
+        if (bytes <= 64)
+        {
+            return (bytes == 0) ? 0 : (int)((bytes - 1) >> 4);
+        }
+
+        size_t b = bytes - 1;
+        int p = 63 - static_cast<int>(_lzcnt_u64(b));
+        return 4 + ((p - 6) << 2) + (int)((b >> (p - 2)) & 3);
+    }
+
+    static inline size_t class_size(int sizeClass)
+    {
+        if (sizeClass < 4)
+        {
+            return (size_t)(sizeClass + 1) << 4;
+        }
+
+        int p = ((sizeClass - 4) >> 2) + 6;
+        return (size_t)(5 + ((sizeClass - 4) & 3)) << (p - 2);
+    }
+
+    inline void push_free(void * block, int sizeClass)
+    {
+        *reinterpret_cast<void**>(block) = m_freeLists[sizeClass];
+        m_freeLists[sizeClass] = block;
+        m_stats.freeBytes += class_size(sizeClass);
+    }
+
+    //The tail of the current chunk is split into free blocks before moving on
+    void new_chunk()
+    {
+        while (m_chunkRemaining >= 16)
+        {
+            int sizeClass = size_class(m_chunkRemaining);
+            if (class_size(sizeClass) > m_chunkRemaining)
+            {
+                sizeClass--;
+            }
+            push_free(m_chunkPos, sizeClass);
+            m_chunkPos += class_size(sizeClass);
+            m_chunkRemaining -= class_size(sizeClass);
+        }
+
+        m_chunks.push_back(static_cast<char*>(::operator new(CHUNK_SIZE, align_val_t(64))));
+        m_chunkPos = m_chunks.back();
+        m_chunkRemaining = CHUNK_SIZE;
+        m_stats.reservedBytes += CHUNK_SIZE;
+    }
+};
+
+//std allocator over an SWpool, falls back to operator new without a pool
+template<class T>
+struct SWallocator
+{
+    typedef T value_type;
+    typedef true_type propagate_on_container_move_assignment;
+    typedef true_type propagate_on_container_swap;
+
+    SWpool * m_pool;
+
+    SWallocator(SWpool * pool = nullptr) noexcept
+    :m_pool(pool) {}
+
+    template<class U>
+    SWallocator(const SWallocator<U> & other) noexcept
+    :m_pool(other.m_pool) {}
+
+    inline T * allocate(size_t n)
+    {
+        return static_cast<T*>(m_pool ? m_pool->allocate(n * sizeof(T)) : ::operator new(n * sizeof(T)));
+    }
+
+    inline void deallocate(T * block, size_t n)
+    {
+        if (m_pool)
+        {
+            m_pool->deallocate(block, n * sizeof(T));
+        }
+        else
+        {
+            ::operator delete(block);
+        }
+    }
+};
+
+template<class T, class U>
+inline bool operator==(const SWallocator<T> & a, const SWallocator<U> & b) {return a.m_pool == b.m_pool;}
+
+template<class T, class U>
+inline bool operator!=(const SWallocator<T> & a, const SWallocator<U> & b) {return a.m_pool != b.m_pool;}
+
+}
+
+#endif
@@ -3,14 +3,79 @@
 
 #pragma once
 #include "helper.hpp"
+#include "SWpool.hpp"
+#include "SWpacked.hpp"
+#include "SWpayload.hpp"
 
 using namespace std;
 
 namespace swix {
 
-template<class Type_Key, class Type_Ts> class SWmeta;
+template<class Type_Key, class Type_Ts, class Type_Payload = SWnoPayload> class SWmeta;
+template<class Type_Key, class Type_Ts, class Type_Payload = SWnoPayload> class SWseg;
 
-template<class Type_Key, class Type_Ts>
+#ifdef BACKGROUND_RETRAIN
+//Retrain handed to SWmeta's background thread, the SWseg being replaced keep serving and log their inserts
+template<class Type_Key, class Type_Ts, class Type_Payload>
+struct SWretrainTask
+{
+    vector<SWseg<Type_Key,Type_Ts,Type_Payload>*> oldSegs; // SWseg being replaced, in key order
+    vector<pair<Type_Key,Type_Ts>> data; // copy of the live tuples of oldSegs when requested
+    SWpayloadColumn<Type_Payload> payloads; // payloads of data
+    vector<pair<Type_Key,Type_Ts>> delta; // tuples inserted into oldSegs since the copy, replayed on publish
+    SWpayloadColumn<Type_Payload> deltaPayloads; // payloads of delta
+    vector<pair<Type_Key, SWseg<Type_Key,Type_Ts,Type_Payload>*>> newSegs; // built by the background thread
+    Type_Ts lowerLimit;
+    int splitError;
+    int numBufferInsert;
+    bool cancelled = false; // an SWseg of oldSegs was freed, newSegs are discarded on publish
+};
+#endif
+
+#ifdef INLINE_SEG_MODEL
+//Copy of an SWseg's model kept next to its SWmeta slot (32 bytes for 8 byte keys, 56 with TWO_PIECE_SEG).
+//Only used to prefetch m_localKeys, a stale copy costs a wasted prefetch.
+template<class Type_Key>
+struct SWsegModel
+{
+    Type_Key startKey;
+    double slope;
+    const char * localKeys;
+    int numPair;
+    #ifdef COMPRESSED_SEG
+    int keyWidth; // bytes per code of m_localKeys
+    #endif
+    #ifdef TWO_PIECE_SEG
+    int breakPos;
+    Type_Key breakKey;
+    double breakSlope;
+    #endif
+
+    inline void prefetch_search(Type_Key targetKey) const
+    {
+        if (numPair)
+        {
+            int predictPos = static_cast<int>(floor(slope * ((double)targetKey - (double)startKey)));
+            #ifdef TWO_PIECE_SEG
+            if (breakPos)
+            {
+                predictPos = (targetKey < breakKey) ? min(predictPos, breakPos) 
+                                                    : breakPos + static_cast<int>(floor(breakSlope * ((double)targetKey - (double)breakKey)));
+            }
+            #endif
+            predictPos = predictPos < 0 ? 0 : predictPos;
+            predictPos = predictPos > numPair-1 ? numPair-1 : predictPos;
+            #ifdef COMPRESSED_SEG
+            _mm_prefetch(localKeys + (size_t)predictPos * keyWidth, _MM_HINT_T0);
+            #else
+            _mm_prefetch(localKeys + (size_t)predictPos * sizeof(Type_Key), _MM_HINT_T0);
+            #endif
+        }
+    }
+};
+#endif
+
+template<class Type_Key, class Type_Ts, class Type_Payload>
 class SWseg
 {
 private:
@@ -22,102 +87,197 @@ private:
     int m_numPairBuffer;
     int m_maxSearchError;
     int m_tuneStage;
+    int m_expirySlot = -1; // slot in SWmeta's expiry queue, -1 if not queued
+    int m_bufferHint = BUFFER_INITIAL_SIZE; // capacity reserved by the first buffered insert
+    int m_numBufferInsert = 0; // buffered inserts since construction (observed insert rate)
+    #ifdef INCREMENTAL_META_RETRAIN
+    int m_rebuildIndex = -1; // slot in SWmeta's arrays under construction, -1 if not placed yet
+    #endif
+    #ifndef STATIC_PARAMS
+    int m_maxBufferSize;
+    #endif
 
     Type_Ts m_maxTimeStamp;
+    Type_Ts m_minTimeStamp; // lower bound of live timestamps (not raised on expiry)
     double m_slope;
+    #ifdef TWO_PIECE_SEG
+    //Second piece of the model, keys >= m_breakKey are predicted from m_breakPos with m_breakSlope.
+    //m_breakPos is 0 for a single piece SWseg.
+    int m_breakPos = 0;
+    Type_Key m_breakKey;
+    double m_breakSlope;
+    #endif
 
     Type_Key m_startKey; // first key of seg
     Type_Key m_currentNodeStartKey; // existing first key of seg/node
 
-    vector<pair<Type_Key,Type_Ts>> m_buffer;
-    vector<pair<Type_Key,Type_Ts>> m_localData;
+    //Structure of arrays, searches only touch the key arrays
+    vector<Type_Key, SWallocator<Type_Key>> m_bufferKeys;
+    vector<Type_Ts, SWallocator<Type_Ts>> m_bufferTs;
+    #ifdef COMPRESSED_SEG
+    SWpackedArray<Type_Key> m_localKeys; // codes from the first key, see SWpacked.hpp
+    SWpackedArray<Type_Ts> m_localTs; // codes from the smallest trained timestamp
+    #else
+    vector<Type_Key, SWallocator<Type_Key>> m_localKeys;
+    vector<Type_Ts, SWallocator<Type_Ts>> m_localTs;
+    #endif
+    //Payload columns, parallel to the buffer and model arrays (empty for SWnoPayload, see SWpayload.hpp)
+    [[no_unique_address]] SWpayloadColumn<Type_Payload> m_bufferPayloads;
+    [[no_unique_address]] SWpayloadColumn<Type_Payload> m_localPayloads;
+
+    SWseg<Type_Key,Type_Ts,Type_Payload> * m_leftSibling = nullptr;
+    SWseg<Type_Key,Type_Ts,Type_Payload> * m_rightSibling = nullptr;
 
-    SWseg<Type_Key,Type_Ts> * m_leftSibling = nullptr;
-    SWseg<Type_Key,Type_Ts> * m_rightSibling = nullptr;
+    #ifdef BACKGROUND_RETRAIN
+    SWretrainTask<Type_Key,Type_Ts,Type_Payload> * m_retrainTask = nullptr; // pending background retrain replacing this SWseg
+    #endif
     
 
 public:
     //Constructors
-    SWseg(int startSplitIndex, int endSplitIndex, vector<pair<Type_Key,Type_Ts>> & data);
-    SWseg(int startSplitIndex, int endSplitIndex, double slope, vector<pair<Type_Key,Type_Ts>> & data);
-    SWseg(pair<Type_Key,Type_Ts> & singleData);
+    //payloads is indexed like data
+    SWseg(int startSplitIndex, int endSplitIndex, vector<pair<Type_Key,Type_Ts>> & data, SWpayloadColumn<Type_Payload> & payloads, int maxBufferSize = MAX_BUFFER_SIZE, SWpool * pool = nullptr);
+    SWseg(int startSplitIndex, int endSplitIndex, double slope, vector<pair<Type_Key,Type_Ts>> & data, SWpayloadColumn<Type_Payload> & payloads, int maxBufferSize = MAX_BUFFER_SIZE, SWpool * pool = nullptr);
+    SWseg(pair<Type_Key,Type_Ts> & singleData, const Type_Payload & singlePayload, int maxBufferSize = MAX_BUFFER_SIZE, SWpool * pool = nullptr);
+    #ifdef TWO_PIECE_SEG
+    SWseg(int startSplitIndex, int endSplitIndex, double slope, int breakSplitIndex, double breakSlope, 
+            vector<pair<Type_Key,Type_Ts>> & data, SWpayloadColumn<Type_Payload> & payloads, int maxBufferSize = MAX_BUFFER_SIZE, SWpool * pool = nullptr);
+    #endif
 
 private:
     //Training and filtering date in segment
     void local_train(int & startSplitIndex, int & endSplitIndex, double & slope, 
-                    vector<pair<Type_Key,Type_Ts>> & data);
+                    vector<pair<Type_Key,Type_Ts>> & data, SWpayloadColumn<Type_Payload> & payloads, int breakSplitIndex = -1, double breakSlope = 0);
     
-    void merge_data(vector<pair<Type_Key,Type_Ts>> & mergedData, Type_Ts & lowerLimit);
+    void merge_data(vector<pair<Type_Key,Type_Ts>> & mergedData, SWpayloadColumn<Type_Payload> & mergedPayloads, Type_Ts & lowerLimit);
 
 public:
     //Operations
     void lookup(Type_Key & newKey, Type_Ts & lowerLimit, Type_Key & resultCount);
 
+    //Type_Result: vector<pair<Type_Key,Type_Ts>>, SWaggregate<Type_Key> or SWpayloadResult<Type_Key,Type_Ts,Type_Payload>
+    template<class Type_Result>
     void range_search(  Type_Key & newKey, Type_Ts & newTimeStamp, Type_Ts & lowerLimit,
                                 Type_Key & lowerBound, Type_Key & upperBound, 
-                                vector<pair<Type_Key, Type_Ts>> & rangeSearchResult,
+                                Type_Result & rangeSearchResult,
                                 vector<pair<Type_Key,int >> & updateSeg);
 
+    template<class Visitor>
+    uint64_t range_for_each(Type_Key & lowerBound, Type_Key & upperBound, Type_Ts & lowerLimit, Visitor & visitor, uint64_t limit);
+
 private:
     //Range Search Helper
+    template<class Type_Result>
     void range_scan(  int startSearchPos, int startSearchBufferPos, 
                     Type_Key & newKey, Type_Ts & newTimeStamp, Type_Ts & lowerLimit,
                     Type_Key & lowerBound, Type_Key & upperBound,
-                    vector<pair<Type_Key, Type_Ts>> &  rangeSearchResult, 
+                    Type_Result &  rangeSearchResult, 
                     vector<pair<Type_Key,int >> & updateSeg);
 
+    template<class Type_Result>
+    void range_scan_seg(int & startSearchPos, int & startSearchBufferPos, Type_Ts & lowerLimit, Type_Key & upperBound,
+                        Type_Result & rangeSearchResult,
+                        vector<pair<Type_Key,int >> & updateSeg);
+
+    void find_scan_start(Type_Key & lowerBound, int & actualPos, int & bufferPos);
+    void prefetch_right_sibling() const;
+
+    template<bool checkExpiry, class Type_Result>
+    static int scan_kernel(Type_Key * keys, Type_Ts * timeStamps, int & pos, int endPos, 
+                            Type_Key & upperBound, Type_Ts & lowerLimit,
+                            Type_Result & rangeSearchResult);
+
+    template<bool checkExpiry, class Type_Result>
+    int scan_model(int & pos, Type_Key & upperBound, Type_Ts & lowerLimit, Type_Result & rangeSearchResult);
+
+    template<bool checkExpiry, class Type_Result>
+    int scan_buffer(int & pos, Type_Key & upperBound, Type_Ts & lowerLimit, Type_Result & rangeSearchResult);
+
+    template<bool checkExpiry, class Type_KeyArray, class Type_TsArray, class Type_Result>
+    static int scan_payload(const Type_KeyArray & keys, Type_TsArray & timeStamps, const SWpayloadColumn<Type_Payload> & payloads, int & pos, int endPos,
+                            Type_Key & upperBound, Type_Ts & lowerLimit, Type_Result & rangeSearchResult);
+
 public:
+    //Eager expiry
+    int expire(Type_Ts & lowerLimit);
+
     //Insertion
-    void insert(Type_Key & newKey, Type_Ts & newTimeStamp, Type_Ts & lowerLimit, 
+    void insert(Type_Key & newKey, Type_Ts & newTimeStamp, const Type_Payload & newPayload, Type_Ts & lowerLimit, 
                             vector<pair<Type_Key,int >> & updateSeg);
 
 private:
     //Insertion Helpers
-    void insert_current(Type_Key & newKey, Type_Ts & newTimeStamp, Type_Ts & lowerLimit,
+    void insert_current(Type_Key & newKey, Type_Ts & newTimeStamp, const Type_Payload & newPayload, Type_Ts & lowerLimit,
                             vector<pair<Type_Key,int >> & updateSeg);
 
-    void insert_model( int & insertionPos, Type_Key & newKey, Type_Ts & newTimeStamp,  Type_Ts & lowerLimit, 
+    void insert_model( int & insertionPos, Type_Key & newKey, Type_Ts & newTimeStamp, const Type_Payload & newPayload,  Type_Ts & lowerLimit, 
                     bool & gapAddError, vector<pair<Type_Key,int >> & updateSeg);
 
-    void insert_model_end( int & lastPos, Type_Key & newKey, Type_Ts & newTimeStamp,  Type_Ts & lowerLimit, 
+    void insert_model_end( int & lastPos, Type_Key & newKey, Type_Ts & newTimeStamp, const Type_Payload & newPayload,  Type_Ts & lowerLimit, 
                         vector<pair<Type_Key,int >> & updateSeg);
 
-    void insert_model_append(  int & insertionPos, Type_Key & newKey, Type_Ts & newTimeStamp,  Type_Ts & lowerLimit, 
+    void insert_model_append(  int & insertionPos, Type_Key & newKey, Type_Ts & newTimeStamp, const Type_Payload & newPayload,  Type_Ts & lowerLimit, 
                             vector<pair<Type_Key,int >> & updateSeg);
     
-    void insert_buffer( int insertionPos, Type_Key & newKey, Type_Ts & newTimeStamp,  Type_Ts & lowerLimit,
+    void insert_buffer( int insertionPos, Type_Key & newKey, Type_Ts & newTimeStamp, const Type_Payload & newPayload,  Type_Ts & lowerLimit,
                         vector<pair<Type_Key,int >> & updateSeg);
 
     //Util functions
+    int predict_pos(const Type_Key & targetKey) const;
     void find_predict_pos_bound(Type_Key & targetKey, int & predictPos, int & predictPosMin, int & predictPosMax);
+    SWsearch search_policy() const;
+    void search_model_right(Type_Key & targetKey, int & foundPos, int maxSearchBound);
+    void search_model_left(Type_Key & targetKey, int & foundPos, int maxSearchBound);
+    template<SWsearch policy>
+    void policy_search_model_right(Type_Key & targetKey, int & foundPos, int maxSearchBound);
+    template<SWsearch policy>
+    void policy_search_model_left(Type_Key & targetKey, int & foundPos, int maxSearchBound);
     void exponential_search_model_right(Type_Key & targetKey, int & foundPos, int maxSearchBound);
     void exponential_search_model_left(Type_Key & targetKey, int & foundPos, int maxSearchBound);
     void binary_search_lower_bound_buffer(Type_Key & targetKey, int & foundPos);
     bool index_exists_model(int index, Type_Ts lowerLimit);
     bool index_exists_buffer(int index, Type_Ts lowerLimit);
+    void reserve_buffer(int numPairBuffer);
+    int find_gap_buffer(int insertionPos, int maxDistance, Type_Ts & lowerLimit);
+    void prefetch_search(Type_Key & targetKey) const;
+    #ifdef INLINE_SEG_MODEL
+    void copy_model(SWsegModel<Type_Key> & model) const;
+    #endif
+
+    inline int max_buffer_size() const
+    {
+        #ifdef STATIC_PARAMS
+        return MAX_BUFFER_SIZE;
+        #else
+        return m_maxBufferSize;
+        #endif
+    }
 
 public:
     void print();
     uint64_t get_total_size_in_bytes();
     uint64_t get_no_keys(Type_Ts lowerLimit);
 
-    friend class SWmeta<Type_Key,Type_Ts>;
+    friend class SWmeta<Type_Key,Type_Ts,Type_Payload>;
 };
 
 /* 
 Constructors & Destructors
 */
-template<class Type_Key, class Type_Ts>
-SWseg<Type_Key,Type_Ts>::SWseg(int startSplitIndex, int endSplitIndex, vector<pair<Type_Key,Type_Ts>> & data)
-:m_rightSearchBound(0), m_leftSearchBound(0), m_numPair(0), m_numPairBuffer(0), m_maxTimeStamp(0), m_parentIndex(0), m_maxSearchError(0)
+template<class Type_Key, class Type_Ts, class Type_Payload>
+SWseg<Type_Key,Type_Ts,Type_Payload>::SWseg(int startSplitIndex, int endSplitIndex, vector<pair<Type_Key,Type_Ts>> & data, SWpayloadColumn<Type_Payload> & payloads, int maxBufferSize, SWpool * pool)
+:m_rightSearchBound(0), m_leftSearchBound(0), m_numPair(0), m_numPairBuffer(0), m_maxTimeStamp(0), m_minTimeStamp(0), m_parentIndex(0), m_maxSearchError(0),
+m_bufferKeys(pool), m_bufferTs(pool), m_localKeys(pool), m_localTs(pool), m_bufferPayloads(pool), m_localPayloads(pool)
 {
     #ifdef DEBUG
     cout << "[Debug Info:] Class {SWseg} :: Construct Function {SWseg(startSplitIndex, endSplitIndex, data)} Begin" << endl;
     cout << endl;
     #endif
 
-    m_buffer.reserve(MAX_BUFFER_SIZE);
-    local_train_calculate_slope(startSplitIndex, endSplitIndex, data);
+    #ifndef STATIC_PARAMS
+    m_maxBufferSize = maxBufferSize;
+    #endif
+    local_train_calculate_slope(startSplitIndex, endSplitIndex, data, payloads);
 
     #ifdef TUNE
     m_tuneStage = tuneStage;
@@ -129,17 +289,20 @@ SWseg<Type_Key,Type_Ts>::SWseg(int startSplitIndex, int endSplitIndex, vector<pa
     #endif
 }
 
-template<class Type_Key, class Type_Ts>
-SWseg<Type_Key,Type_Ts>::SWseg(int startSplitIndex, int endSplitIndex, double slope, vector<pair<Type_Key,Type_Ts>> & data)
-:m_rightSearchBound(0), m_leftSearchBound(0), m_numPair(0), m_numPairBuffer(0), m_maxTimeStamp(0), m_parentIndex(0), m_maxSearchError(0)
+template<class Type_Key, class Type_Ts, class Type_Payload>
+SWseg<Type_Key,Type_Ts,Type_Payload>::SWseg(int startSplitIndex, int endSplitIndex, double slope, vector<pair<Type_Key,Type_Ts>> & data, SWpayloadColumn<Type_Payload> & payloads, int maxBufferSize, SWpool * pool)
+:m_rightSearchBound(0), m_leftSearchBound(0), m_numPair(0), m_numPairBuffer(0), m_maxTimeStamp(0), m_minTimeStamp(0), m_parentIndex(0), m_maxSearchError(0),
+m_bufferKeys(pool), m_bufferTs(pool), m_localKeys(pool), m_localTs(pool), m_bufferPayloads(pool), m_localPayloads(pool)
 {
     #ifdef DEBUG
     cout << "[Debug Info:] Class {SWseg} :: Construct Function {SWseg(startSplitIndex, endSplitIndex, slope, data)} Begin" << endl;
     cout << endl;
     #endif
 
-    m_buffer.reserve(MAX_BUFFER_SIZE);
-    local_train(startSplitIndex, endSplitIndex, slope, data);
+    #ifndef STATIC_PARAMS
+    m_maxBufferSize = maxBufferSize;
+    #endif
+    local_train(startSplitIndex, endSplitIndex, slope, data, payloads);
 
     #ifdef TUNE
     m_tuneStage = tuneStage;
@@ -151,23 +314,58 @@ SWseg<Type_Key,Type_Ts>::SWseg(int startSplitIndex, int endSplitIndex, double sl
     #endif
 }
 
-template<class Type_Key, class Type_Ts>
-SWseg<Type_Key,Type_Ts>::SWseg(pair<Type_Key,Type_Ts> & singleData)
-:m_rightSearchBound(0), m_leftSearchBound(0), m_numPair(0), m_numPairExist(0), m_slope(0), m_parentIndex(0), m_maxSearchError(0)
+#ifdef TWO_PIECE_SEG
+//Two-piece SWseg over [startSplitIndex, endSplitIndex], the second piece starts at breakSplitIndex
+template<class Type_Key, class Type_Ts, class Type_Payload>
+SWseg<Type_Key,Type_Ts,Type_Payload>::SWseg(int startSplitIndex, int endSplitIndex, double slope, int breakSplitIndex, double breakSlope, 
+                                vector<pair<Type_Key,Type_Ts>> & data, SWpayloadColumn<Type_Payload> & payloads, int maxBufferSize, SWpool * pool)
+:m_rightSearchBound(0), m_leftSearchBound(0), m_numPair(0), m_numPairBuffer(0), m_maxTimeStamp(0), m_minTimeStamp(0), m_parentIndex(0), m_maxSearchError(0),
+m_bufferKeys(pool), m_bufferTs(pool), m_localKeys(pool), m_localTs(pool), m_bufferPayloads(pool), m_localPayloads(pool)
 {
     #ifdef DEBUG
-    cout << "[Debug Info:] Class {SWseg} :: Construct Function {SWseg(singleData)} Begin" << endl;
+    cout << "[Debug Info:] Class {SWseg} :: Construct Function {SWseg(startSplitIndex, endSplitIndex, slope, breakSplitIndex, breakSlope, data)} Begin" << endl;
+    cout << endl;
+    #endif
+
+    #ifndef STATIC_PARAMS
+    m_maxBufferSize = maxBufferSize;
+    #endif
+    local_train(startSplitIndex, endSplitIndex, slope, data, payloads, breakSplitIndex, breakSlope);
+
+    #ifdef TUNE
+    m_tuneStage = tuneStage;
+    #endif
+
+    #ifdef DEBUG
+    cout << "[Debug Info:] Class {SWseg} :: Construct Function {SWseg(startSplitIndex, endSplitIndex, slope, breakSplitIndex, breakSlope, data)} End" << endl;
     cout << endl;
     #endif
+}
+#endif
 
-    m_buffer.reserve(MAX_BUFFER_SIZE);
+template<class Type_Key, class Type_Ts, class Type_Payload>
+SWseg<Type_Key,Type_Ts,Type_Payload>::SWseg(pair<Type_Key,Type_Ts> & singleData, const Type_Payload & singlePayload, int maxBufferSize, SWpool * pool)
+:m_rightSearchBound(0), m_leftSearchBound(0), m_numPair(0), m_numPairExist(0), m_slope(0), m_parentIndex(0), m_maxSearchError(0),
+m_bufferKeys(pool), m_bufferTs(pool), m_localKeys(pool), m_localTs(pool), m_bufferPayloads(pool), m_localPayloads(pool)
+{
+    #ifdef DEBUG
+    cout << "[Debug Info:] Class {SWseg} :: Construct Function {SWseg(singleData)} Begin" << endl;
+    cout << endl;
+    #endif
 
-    m_buffer.push_back(singleData);
+    #ifndef STATIC_PARAMS
+    m_maxBufferSize = maxBufferSize;
+    #endif
+    reserve_buffer(1);
+    m_bufferKeys.push_back(singleData.first);
+    m_bufferTs.push_back(singleData.second);
+    m_bufferPayloads.push_back(singlePayload);
     m_numPairBuffer = 1;
 
     m_startKey = singleData.first;
     m_currentNodeStartKey = m_startKey;
     m_maxTimeStamp = singleData.second;
+    m_minTimeStamp = singleData.second;
 
     #ifdef TUNE
     m_tuneStage = tuneStage;
@@ -182,8 +380,9 @@ SWseg<Type_Key,Type_Ts>::SWseg(pair<Type_Key,Type_Ts> & singleData)
 /*
 Local Load and Add Gap
 */
-template<class Type_Key, class Type_Ts>
-void SWseg<Type_Key,Type_Ts>::local_train(int & startSplitIndex, int & endSplitIndex, double & slope, vector<pair<Type_Key,Type_Ts>> & data)
+template<class Type_Key, class Type_Ts, class Type_Payload>
+void SWseg<Type_Key,Type_Ts,Type_Payload>::local_train(int & startSplitIndex, int & endSplitIndex, double & slope, vector<pair<Type_Key,Type_Ts>> & data,
+                                        SWpayloadColumn<Type_Payload> & payloads, int breakSplitIndex, double breakSlope)
 {
     #ifdef DEBUG
     cout << "[Debug Info:] Class {SWseg} :: Member Function {local_train()} Begin" << endl;
@@ -195,53 +394,88 @@ void SWseg<Type_Key,Type_Ts>::local_train(int & startSplitIndex, int & endSplitI
     
     m_slope = slope * 1.05;
 
-    m_localData.push_back(data[startSplitIndex]);
+    #ifdef COMPRESSED_SEG
+    Type_Ts minTs = data[startSplitIndex].second, maxTs = data[startSplitIndex].second;
+    for (int i = startSplitIndex + 1; i <= endSplitIndex; i++)
+    {
+        minTs = (data[i].second < minTs) ? data[i].second : minTs;
+        maxTs = (data[i].second > maxTs) ? data[i].second : maxTs;
+    }
+    m_localKeys.reset(m_startKey, data[endSplitIndex].first);
+    m_localTs.reset(minTs, maxTs);
+    #endif
+
+    m_localKeys.push_back(data[startSplitIndex].first);
+    m_localTs.push_back(data[startSplitIndex].second);
+    m_localPayloads.push_back(payloads[startSplitIndex]);
     
     int currentSplitIndex = startSplitIndex + 1;
     int currentInsertionPos = 1;
     int predictedPos;
 
     m_maxTimeStamp = data[startSplitIndex].second;
+    m_minTimeStamp = data[startSplitIndex].second;
     
     while(currentSplitIndex <= endSplitIndex)
     {
-        predictedPos = static_cast<int>(floor(m_slope * ((double)data[currentSplitIndex].first - (double)m_startKey)));
+        #ifdef TWO_PIECE_SEG
+        //Second piece starts where the first one ended, so its bound is measured like a separate SWseg
+        if (currentSplitIndex == breakSplitIndex && !m_breakPos)
+        {
+            m_breakPos = currentInsertionPos;
+            m_breakKey = data[breakSplitIndex].first;
+            m_breakSlope = breakSlope * 1.05;
+        }
+        #endif
+        predictedPos = predict_pos(data[currentSplitIndex].first);
 
         if(predictedPos == currentInsertionPos)
         {
 
-            m_localData.push_back(data[currentSplitIndex]);
+            m_localKeys.push_back(data[currentSplitIndex].first);
+            m_localTs.push_back(data[currentSplitIndex].second);
+            m_localPayloads.push_back(payloads[currentSplitIndex]);
 
             m_maxTimeStamp = (data[currentSplitIndex].second > m_maxTimeStamp) 
                         ? data[currentSplitIndex].second 
                         : m_maxTimeStamp;
+            m_minTimeStamp = (data[currentSplitIndex].second < m_minTimeStamp) 
+                        ? data[currentSplitIndex].second 
+                        : m_minTimeStamp;
 
             currentSplitIndex++;
         }
         else if(predictedPos < currentInsertionPos)
         {
-            m_localData.push_back(data[currentSplitIndex]);
+            m_localKeys.push_back(data[currentSplitIndex].first);
+            m_localTs.push_back(data[currentSplitIndex].second);
+            m_localPayloads.push_back(payloads[currentSplitIndex]);
 
             m_rightSearchBound = (currentInsertionPos - predictedPos) > m_rightSearchBound ? (currentInsertionPos - predictedPos) : m_rightSearchBound ;
 
             m_maxTimeStamp = (data[currentSplitIndex].second > m_maxTimeStamp) 
                         ? data[currentSplitIndex].second 
                         : m_maxTimeStamp;
+            m_minTimeStamp = (data[currentSplitIndex].second < m_minTimeStamp) 
+                        ? data[currentSplitIndex].second 
+                        : m_minTimeStamp;
             
             currentSplitIndex++;
         }
         else
         {
-            m_localData.push_back( make_pair(m_localData.back().first,0));
+            m_localKeys.push_back(m_localKeys.back());
+            m_localTs.push_back(0);
+            m_localPayloads.push_back(Type_Payload());
 
         }
         currentInsertionPos++;
     }
 
     m_rightSearchBound += 1; //Must be greater than value itself.
-    m_numPair = m_localData.size();
+    m_numPair = m_localKeys.size();
     m_numPairExist = (endSplitIndex - startSplitIndex + 1);
-    // m_localData.shrink_to_fit();
+    // m_localKeys.shrink_to_fit();
     
     m_maxSearchError = min(8192,(int)ceil(0.6*m_numPair));
 
@@ -252,7 +486,7 @@ void SWseg<Type_Key,Type_Ts>::local_train(int & startSplitIndex, int & endSplitI
     cout << "[Debug Info:] m_slope =  " << m_slope << endl;
     cout << "[Debug Info:] m_numPair =  " << m_numPair << endl;
     cout << "[Debug Info:] m_numPairExist =  " << m_numPairExist << endl;
-    cout << "[Debug Info:] m_localData.size() =  " << m_localData.size() << endl;
+    cout << "[Debug Info:] m_localKeys.size() =  " << m_localKeys.size() << endl;
     cout << endl;
     #endif
 
@@ -262,8 +496,8 @@ void SWseg<Type_Key,Type_Ts>::local_train(int & startSplitIndex, int & endSplitI
 Combining Data and Buffer and Remove Gaps
 */
 
-template<class Type_Key, class Type_Ts>
-void SWseg<Type_Key,Type_Ts>::merge_data(vector<pair<Type_Key,Type_Ts>> & mergedData, Type_Ts & lowerLimit)
+template<class Type_Key, class Type_Ts, class Type_Payload>
+void SWseg<Type_Key,Type_Ts,Type_Payload>::merge_data(vector<pair<Type_Key,Type_Ts>> & mergedData, SWpayloadColumn<Type_Payload> & mergedPayloads, Type_Ts & lowerLimit)
 {
     #ifdef TUNE_TIME
     uint64_t temp = 0;
@@ -277,42 +511,46 @@ void SWseg<Type_Key,Type_Ts>::merge_data(vector<pair<Type_Key,Type_Ts>> & merged
     
     while(localDataIndex  < m_numPair && bufferIndex  < m_numPairBuffer)
     {
-        if (m_localData[localDataIndex].first < m_buffer[bufferIndex].first)
+        if (m_localKeys[localDataIndex] < m_bufferKeys[bufferIndex])
         {
-            if (m_localData[localDataIndex].second >= lowerLimit)
+            if (m_localTs[localDataIndex] >= lowerLimit)
             {
-                mergedData.push_back(m_localData[localDataIndex]);
+                mergedData.push_back(make_pair(m_localKeys[localDataIndex],m_localTs[localDataIndex]));
+                mergedPayloads.push_back(m_localPayloads[localDataIndex]);
             }
             localDataIndex++;
         }
-        else if (m_localData[localDataIndex].first > m_buffer[bufferIndex].first)
+        else if (m_localKeys[localDataIndex] > m_bufferKeys[bufferIndex])
         {
-            if (m_buffer[bufferIndex].second >= lowerLimit)
+            if (m_bufferTs[bufferIndex] >= lowerLimit)
             {
-                mergedData.push_back(m_buffer[bufferIndex]);
+                mergedData.push_back(make_pair(m_bufferKeys[bufferIndex],m_bufferTs[bufferIndex]));
+                mergedPayloads.push_back(m_bufferPayloads[bufferIndex]);
             }
             bufferIndex++;
         }
         else
         {
-            cout << "ERROR: buffer and m_localData have same value (" << m_localData[localDataIndex].first << ")" << endl;
+            cout << "ERROR: buffer and m_localKeys have same value (" << m_localKeys[localDataIndex] << ")" << endl;
         }
     }
 
     while(localDataIndex  < m_numPair)
     {
-        if (m_localData[localDataIndex].second >= lowerLimit)
+        if (m_localTs[localDataIndex] >= lowerLimit)
         {
-            mergedData.push_back(m_localData[localDataIndex]);
+            mergedData.push_back(make_pair(m_localKeys[localDataIndex],m_localTs[localDataIndex]));
+            mergedPayloads.push_back(m_localPayloads[localDataIndex]);
         }
         localDataIndex++;
     }
 
     while (bufferIndex < m_numPairBuffer)
     {
-        if (m_buffer[bufferIndex].second >= lowerLimit)
+        if (m_bufferTs[bufferIndex] >= lowerLimit)
         {
-            mergedData.push_back(m_buffer[bufferIndex]);
+            mergedData.push_back(make_pair(m_bufferKeys[bufferIndex],m_bufferTs[bufferIndex]));
+            mergedPayloads.push_back(m_bufferPayloads[bufferIndex]);
         }
         bufferIndex++;
     }
@@ -332,8 +570,8 @@ void SWseg<Type_Key,Type_Ts>::merge_data(vector<pair<Type_Key,Type_Ts>> & merged
 /*
 Point Lookup
 */
-template<class Type_Key, class Type_Ts>
-void SWseg<Type_Key,Type_Ts>::lookup(Type_Key & newKey, Type_Ts & lowerLimit, Type_Key & resultCount)
+template<class Type_Key, class Type_Ts, class Type_Payload>
+void SWseg<Type_Key,Type_Ts,Type_Payload>::lookup(Type_Key & newKey, Type_Ts & lowerLimit, Type_Key & resultCount)
 {
     #if defined DEBUG 
     cout << "[Debug Info:] Class {SWseg} :: Member Function {lookup()} Begin" << endl;
@@ -358,13 +596,13 @@ void SWseg<Type_Key,Type_Ts>::lookup(Type_Key & newKey, Type_Ts & lowerLimit, Ty
             predictPos = predictPos > predictPosMax ? predictPosMax : predictPos;
             actualPos = predictPos;
 
-            if (newKey < m_localData[predictPos].first) // Left of predictedPos
+            if (newKey < m_localKeys[predictPos]) // Left of predictedPos
             {  
-                exponential_search_model_left(newKey, actualPos, predictPos-predictPosMin);
+                search_model_left(newKey, actualPos, predictPos-predictPosMin);
             }
-            else if (newKey > m_localData[predictPos].first)
+            else if (newKey > m_localKeys[predictPos])
             {
-                exponential_search_model_right(newKey, actualPos, predictPosMax-predictPos);
+                search_model_right(newKey, actualPos, predictPosMax-predictPos);
             }
 
         }
@@ -385,7 +623,13 @@ void SWseg<Type_Key,Type_Ts>::lookup(Type_Key & newKey, Type_Ts & lowerLimit, Ty
 
         }
 
-        if (m_localData[actualPos].first == newKey && m_localData[actualPos].second && m_localData[actualPos].second >= lowerLimit)
+        //Gaps appended by insert_model_append repeat the previous key, step back to the tuple itself
+        while (actualPos > 0 && m_localKeys[actualPos-1] == newKey)
+        {
+            actualPos--;
+        }
+
+        if (m_localKeys[actualPos] == newKey && m_localTs[actualPos] && m_localTs[actualPos] >= lowerLimit)
         {
             resultCount++;
             return;
@@ -394,13 +638,10 @@ void SWseg<Type_Key,Type_Ts>::lookup(Type_Key & newKey, Type_Ts & lowerLimit, Ty
 
     if (m_numPairBuffer)
     {
-        auto it = lower_bound(m_buffer.begin(),m_buffer.end(),newKey,
-                    [](const pair<Type_Key,Type_Ts>& data, Type_Key value)
-                    {
-                        return data.first < value;
-                    });
+        int bufferPos;
+        binary_search_lower_bound_buffer(newKey, bufferPos);
         
-        if (it != m_buffer.end() && it->first == newKey && it->second && it->second >= lowerLimit)
+        if (bufferPos != m_numPairBuffer && m_bufferKeys[bufferPos] == newKey && m_bufferTs[bufferPos] && m_bufferTs[bufferPos] >= lowerLimit)
         {
             resultCount++;
             return;
@@ -422,10 +663,11 @@ void SWseg<Type_Key,Type_Ts>::lookup(Type_Key & newKey, Type_Ts & lowerLimit, Ty
 /*
 Range Search
 */
-template<class Type_Key, class Type_Ts>
-void SWseg<Type_Key,Type_Ts>::range_search( Type_Key & newKey, Type_Ts & newTimeStamp, Type_Ts & lowerLimit, 
+template<class Type_Key, class Type_Ts, class Type_Payload>
+template<class Type_Result>
+void SWseg<Type_Key,Type_Ts,Type_Payload>::range_search( Type_Key & newKey, Type_Ts & newTimeStamp, Type_Ts & lowerLimit, 
                                                     Type_Key & lowerBound, Type_Key & upperBound, 
-                                                    vector<pair<Type_Key, Type_Ts>> & rangeSearchResult,
+                                                    Type_Result & rangeSearchResult,
                                                     vector<pair<Type_Key,int >> & updateSeg)
 {    
     #if defined DEBUG 
@@ -458,21 +700,64 @@ void SWseg<Type_Key,Type_Ts>::range_search( Type_Key & newKey, Type_Ts & newTime
     startTimer(&timer);
     #endif
     
-    int actualPos, predictPos, predictPosMin, predictPosMax, bufferPos;
+    int actualPos, bufferPos;
+    find_scan_start(lowerBound, actualPos, bufferPos);
+
+    #if defined(TUNE_TIME) || defined(TIME_BREAKDOWN)
+    stopTimer(&timer);
+    searchCycle += timer;
+    #endif
+    
+    #ifdef TUNE
+    segNoScan++;
+    #endif
+
+    #if defined(TUNE_TIME) || defined(TIME_BREAKDOWN)
+    #ifdef TUNE_TIME
+    segNoScan++;
+    #endif
+    timer = 0;
+    startTimer(&timer);
+    #endif
+
+    range_scan( actualPos, bufferPos, newKey, newTimeStamp, lowerLimit, lowerBound, upperBound, rangeSearchResult, updateSeg);
+
+    #if defined(TUNE_TIME) || defined(TIME_BREAKDOWN)
+    stopTimer(&timer);
+    scanCycle += timer;
+    #endif
+
+    #if defined DEBUG 
+    cout << "[Debug Info:] Class {SWseg} :: Member Function {range_search()} End" << endl;
+    cout << endl;
+    #elif defined DEBUG_KEY
+    if(DEBUG_KEY == newKey)
+    {
+        cout << "[Debug Info:] Class {SWseg} :: Member Function {range_search()} End" << endl;
+        cout << endl;
+    }
+    #endif
+}
+
+//First model and buffer positions with key >= lowerBound
+template<class Type_Key, class Type_Ts, class Type_Payload>
+void SWseg<Type_Key,Type_Ts,Type_Payload>::find_scan_start(Type_Key & lowerBound, int & actualPos, int & bufferPos)
+{
+    int predictPos, predictPosMin, predictPosMax;
     find_predict_pos_bound(lowerBound, predictPos, predictPosMin, predictPosMax);
 
     binary_search_lower_bound_buffer(lowerBound,bufferPos);
     
     #if defined DEBUG 
-    cout << "[Debug Info:] Class {SWseg} :: Member Function {range_search()} After Predicting Pos" << endl;
+    cout << "[Debug Info:] Class {SWseg} :: Member Function {find_scan_start()}" << endl;
     cout << "[Debug Info:] predictPosMin = " << predictPosMin << endl;
     cout << "[Debug Info:] predictPosMax = " << predictPosMax << endl;
     cout << "[Debug Info:] bufferPos = " << bufferPos << endl;
     cout << endl;
     #elif defined DEBUG_KEY
-    if(DEBUG_KEY == newKey)
+    if(DEBUG_KEY == lowerBound)
     {
-        cout << "[Debug Info:] Class {SWseg} :: Member Function {range_search()} After Predicting Pos" << endl;
+        cout << "[Debug Info:] Class {SWseg} :: Member Function {find_scan_start()}" << endl;
         cout << "[Debug Info:] predictPosMin = " << predictPosMin << endl;
         cout << "[Debug Info:] predictPosMax = " << predictPosMax << endl;
         cout << "[Debug Info:] bufferPos = " << bufferPos << endl;
@@ -485,15 +770,15 @@ void SWseg<Type_Key,Type_Ts>::range_search( Type_Key & newKey, Type_Ts & newTime
         predictPos = predictPos < predictPosMin ? predictPosMin : predictPos;
         predictPos = predictPos > predictPosMax ? predictPosMax : predictPos;
 
-        if (lowerBound < m_localData[predictPos].first) // Left of predictedPos
+        if (lowerBound < m_localKeys[predictPos]) // Left of predictedPos
         {
             actualPos = predictPos;
-            exponential_search_model_left(lowerBound, actualPos, predictPos-predictPosMin);
+            search_model_left(lowerBound, actualPos, predictPos-predictPosMin);
         }
-        else if (lowerBound > m_localData[predictPos].first) //Right of predictedPos
+        else if (lowerBound > m_localKeys[predictPos]) //Right of predictedPos
         {
             actualPos = predictPos;
-            exponential_search_model_right(lowerBound, actualPos, predictPosMax-predictPos);
+            search_model_right(lowerBound, actualPos, predictPosMax-predictPos);
         }
         else // targetKey == Key at predictedPos
         {
@@ -516,47 +801,18 @@ void SWseg<Type_Key,Type_Ts>::range_search( Type_Key & newKey, Type_Ts & newTime
         }
     }
 
-    #if defined(TUNE_TIME) || defined(TIME_BREAKDOWN)
-    stopTimer(&timer);
-    searchCycle += timer;
-    #endif
-    
-    #ifdef TUNE
-    segNoScan++;
-    #endif
-
-    #if defined(TUNE_TIME) || defined(TIME_BREAKDOWN)
-    #ifdef TUNE_TIME
-    segNoScan++;
-    #endif
-    timer = 0;
-    startTimer(&timer);
-    #endif
-
-    range_scan( actualPos, bufferPos, newKey, newTimeStamp, lowerLimit, lowerBound, upperBound, rangeSearchResult, updateSeg);
-
-    #if defined(TUNE_TIME) || defined(TIME_BREAKDOWN)
-    stopTimer(&timer);
-    scanCycle += timer;
-    #endif
-
-    #if defined DEBUG 
-    cout << "[Debug Info:] Class {SWseg} :: Member Function {range_search()} End" << endl;
-    cout << endl;
-    #elif defined DEBUG_KEY
-    if(DEBUG_KEY == newKey)
+    while (actualPos > 0 && actualPos < m_numPair && m_localKeys[actualPos-1] == lowerBound)
     {
-        cout << "[Debug Info:] Class {SWseg} :: Member Function {range_search()} End" << endl;
-        cout << endl;
+        actualPos--;
     }
-    #endif
 }
 
-template<class Type_Key, class Type_Ts>
-void SWseg<Type_Key,Type_Ts>::range_scan( int startSearchPos, int startSearchBufferPos,
+template<class Type_Key, class Type_Ts, class Type_Payload>
+template<class Type_Result>
+void SWseg<Type_Key,Type_Ts,Type_Payload>::range_scan( int startSearchPos, int startSearchBufferPos,
                                             Type_Key & newKey, Type_Ts & newTimeStamp, Type_Ts & lowerLimit, 
                                             Type_Key & lowerBound, Type_Key & upperBound, 
-                                            vector<pair<Type_Key, Type_Ts>> &  rangeSearchResult,
+                                            Type_Result &  rangeSearchResult,
                                             vector<pair<Type_Key,int >> & updateSeg)
 {
     #if defined DEBUG 
@@ -573,124 +829,515 @@ void SWseg<Type_Key,Type_Ts>::range_scan( int startSearchPos, int startSearchBuf
         cout << "[Debug Info:] m_maxTimeStamp = " << m_maxTimeStamp << endl;
         cout << "[Debug Info:] startSearchPos = " << startSearchPos << endl;
         cout << "[Debug Info:] startSearchBufferPos = " << startSearchBufferPos << endl;
-        cout << "[Debug Info:] m_numPair = " << m_numPair << "," << m_localData.size() << endl;
+        cout << "[Debug Info:] m_numPair = " << m_numPair << "," << m_localKeys.size() << endl;
         cout << "[Debug Info:] m_numPairExist = " << m_numPairExist << endl;
-        cout << "[Debug Info:] m_numPairBuffer = " << m_numPairBuffer << "," << m_buffer.size() << endl;
+        cout << "[Debug Info:] m_numPairBuffer = " << m_numPairBuffer << "," << m_bufferKeys.size() << endl;
+        cout << endl;
+    }
+    #endif
+
+    SWseg<Type_Key,Type_Ts,Type_Payload> * currentSeg = this;
+
+    while (true)
+    {
+        currentSeg->prefetch_right_sibling();
+        currentSeg->range_scan_seg(startSearchPos, startSearchBufferPos, lowerLimit, upperBound, rangeSearchResult, updateSeg);
+
+        #ifdef TUNE
+        segScanNoSeg++;
+        #endif
+
+        #ifdef TUNE_TIME
+        segScanNoSeg++;
+        #endif
+
+        if(!currentSeg->m_rightSibling || currentSeg->m_rightSibling->m_currentNodeStartKey > upperBound)
+        {
+            break;
+        }
+
+        #if defined DEBUG 
+        cout << "[Debug Info:] Class {SWseg} :: Member Function {range_scan()} go to sibling" << endl;
+        cout << endl;
+        #elif defined DEBUG_KEY
+        if(DEBUG_KEY == newKey)
+        {
+            cout << "[Debug Info:] Class {SWseg} :: Member Function {range_scan()} go to sibling" << endl;
+            cout << endl;
+        }
+        #endif
+
+        currentSeg = currentSeg->m_rightSibling;
+        startSearchPos = 0;
+        startSearchBufferPos = 0;
+    }
+
+    #if defined DEBUG 
+    cout << "[Debug Info:] Class {SWseg} :: Member Function {range_scan()} End" << endl;
+    cout << "[Debug Info:] stop seg pos = " << startSearchPos << endl;
+    cout << "[Debug Info:] stop buffer pos = " << startSearchBufferPos << endl;
+    cout << endl;
+    #elif defined DEBUG_KEY
+    if(DEBUG_KEY == newKey)
+    {
+        cout << "[Debug Info:] Class {SWseg} :: Member Function {range_scan()} End" << endl;
+        cout << "[Debug Info:] stop seg pos = " << startSearchPos << endl;
+        cout << "[Debug Info:] stop buffer pos = " << startSearchBufferPos << endl;
         cout << endl;
     }
     #endif
+}
 
+//Scan a single segment, range_scan walks the siblings
+template<class Type_Key, class Type_Ts, class Type_Payload>
+template<class Type_Result>
+inline void SWseg<Type_Key,Type_Ts,Type_Payload>::range_scan_seg(int & startSearchPos, int & startSearchBufferPos, Type_Ts & lowerLimit, Type_Key & upperBound,
+                                                    Type_Result & rangeSearchResult,
+                                                    vector<pair<Type_Key,int >> & updateSeg)
+{
     if (m_maxTimeStamp >= lowerLimit)
     {
-        while(startSearchPos < m_numPair && m_localData[startSearchPos].first <= upperBound)
+        if (m_minTimeStamp >= lowerLimit) //Nothing expired, only skip gaps
         {
-            if (m_localData[startSearchPos].second && m_localData[startSearchPos].second >= lowerLimit)
-            {
-                rangeSearchResult.push_back(m_localData[startSearchPos]);
-            }
-            else
+            scan_model<false>(startSearchPos, upperBound, lowerLimit, rangeSearchResult);
+            scan_buffer<false>(startSearchBufferPos, upperBound, lowerLimit, rangeSearchResult);
+        }
+        else
+        {
+            m_numPairExist -= scan_model<true>(startSearchPos, upperBound, lowerLimit, rangeSearchResult);
+            scan_buffer<true>(startSearchBufferPos, upperBound, lowerLimit, rangeSearchResult);
+        }
+
+        if ((double)m_numPairExist/m_numPair < 0.5)
+        {
+            updateSeg.push_back(make_pair(m_currentNodeStartKey,m_parentIndex));
+        }
+    }
+    else //Delete Segment
+    {        
+        if (m_leftSibling)
+        {
+            m_leftSibling->m_rightSibling = m_rightSibling;
+        }
+        if (m_rightSibling)
+        {
+            m_rightSibling->m_leftSibling = m_leftSibling;
+        }
+        updateSeg.push_back(make_pair(numeric_limits<Type_Key>::max(),m_parentIndex));
+    }
+}
+
+//Prefetch the right sibling's arrays (its header was prefetched one segment earlier) and the header of the segment after it
+template<class Type_Key, class Type_Ts, class Type_Payload>
+inline void SWseg<Type_Key,Type_Ts,Type_Payload>::prefetch_right_sibling() const
+{
+    if (m_rightSibling)
+    {
+        _mm_prefetch(element_address(m_rightSibling->m_localKeys, 0), _MM_HINT_T0);
+        _mm_prefetch(element_address(m_rightSibling->m_localTs, 0), _MM_HINT_T0);
+        _mm_prefetch(reinterpret_cast<const char*>(m_rightSibling->m_bufferKeys.data()), _MM_HINT_T0);
+
+        if (m_rightSibling->m_rightSibling)
+        {
+            _mm_prefetch(reinterpret_cast<const char*>(m_rightSibling->m_rightSibling), _MM_HINT_T0);
+            _mm_prefetch(reinterpret_cast<const char*>(m_rightSibling->m_rightSibling) + 64, _MM_HINT_T0);
+        }
+    }
+}
+
+/*
+Range Visit
+*/
+
+//Read-only range scan, calls visitor(key, timeStamp) for each live tuple in ascending key order (model and buffer merged),
+//or visitor(key, timeStamp, payload) if the visitor takes the payload.
+//Stops when visitor returns false or after limit tuples, returns the number of tuples visited.
+//Expired tuples and segments are skipped but not removed, that is left to range_search and insert.
+template<class Type_Key, class Type_Ts, class Type_Payload>
+template<class Visitor>
+uint64_t SWseg<Type_Key,Type_Ts,Type_Payload>::range_for_each(Type_Key & lowerBound, Type_Key & upperBound, Type_Ts & lowerLimit, Visitor & visitor, uint64_t limit)
+{
+    uint64_t numVisited = 0;
+
+    if (!limit)
+    {
+        return numVisited;
+    }
+
+    int pos, bufferPos;
+    find_scan_start(lowerBound, pos, bufferPos);
+
+    SWseg<Type_Key,Type_Ts,Type_Payload> * currentSeg = this;
+
+    while (true)
+    {
+        currentSeg->prefetch_right_sibling();
+
+        if (currentSeg->m_maxTimeStamp >= lowerLimit)
+        {
+            const auto & keys = currentSeg->m_localKeys;
+            const auto & timeStamps = currentSeg->m_localTs;
+            const Type_Key * bufferKeys = currentSeg->m_bufferKeys.data();
+            const Type_Ts * bufferTimeStamps = currentSeg->m_bufferTs.data();
+            const auto & payloads = currentSeg->m_localPayloads;
+            const auto & bufferPayloads = currentSeg->m_bufferPayloads;
+            int numPair = currentSeg->m_numPair;
+            int numPairBuffer = currentSeg->m_numPairBuffer;
+
+            while (true)
             {
-                if (m_localData[startSearchPos].second)
+                bool inModel = pos < numPair && keys[pos] <= upperBound;
+                bool inBuffer = bufferPos < numPairBuffer && bufferKeys[bufferPos] <= upperBound;
+                Type_Key key;
+                Type_Ts timeStamp;
+                const Type_Payload * payload;
+
+                if (inModel && (!inBuffer || keys[pos] < bufferKeys[bufferPos]))
+                {
+                    key = keys[pos];
+                    timeStamp = timeStamps[pos];
+                    payload = &payloads[pos];
+                    pos++;
+                }
+                else if (inBuffer)
+                {
+                    key = bufferKeys[bufferPos];
+                    timeStamp = bufferTimeStamps[bufferPos];
+                    payload = &bufferPayloads[bufferPos];
+                    bufferPos++;
+                }
+                else
                 {
-                    m_localData[startSearchPos].second = 0;
-                    m_numPairExist--;
+                    break;
+                }
+
+                if (timeStamp && timeStamp >= lowerLimit)
+                {
+                    numVisited++;
+                    if (!visit_tuple(visitor, key, timeStamp, *payload) || numVisited == limit)
+                    {
+                        return numVisited;
+                    }
                 }
             }
-            startSearchPos++;
         }
 
-        while(startSearchBufferPos < m_numPairBuffer && m_buffer[startSearchBufferPos].first <= upperBound)
+        if(!currentSeg->m_rightSibling || currentSeg->m_rightSibling->m_currentNodeStartKey > upperBound)
         {
-            if (m_buffer[startSearchBufferPos].second && m_buffer[startSearchBufferPos].second >= lowerLimit)
+            break;
+        }
+
+        currentSeg = currentSeg->m_rightSibling;
+        pos = 0;
+        bufferPos = 0;
+    }
+
+    return numVisited;
+}
+
+/*
+Range Scan Kernel
+*/
+
+//Appends tuples in [pos, endPos) with key <= upperBound and a live timestamp to rangeSearchResult (see append_result), stopping pos at the first key > upperBound.
+//With checkExpiry, expired timestamps are set to 0 (gap) and their count is returned. Without it, only gaps (timestamp 0) are skipped.
+//Uses AVX-512 (compress-store) or AVX2 for unsigned 64-bit keys and timestamps, and the scalar loop otherwise and for the tail.
+template<class Type_Key, class Type_Ts, class Type_Payload>
+template<bool checkExpiry, class Type_Result>
+inline int SWseg<Type_Key,Type_Ts,Type_Payload>::scan_kernel(Type_Key * keys, Type_Ts * timeStamps, int & pos, int endPos, 
+                                                Type_Key & upperBound, Type_Ts & lowerLimit,
+                                                Type_Result & rangeSearchResult)
+{
+    int numExpired = 0;
+
+    #if defined(__AVX512F__) || defined(__AVX2__)
+    if constexpr (is_unsigned<Type_Key>::value && is_unsigned<Type_Ts>::value && sizeof(Type_Key) == 8 && sizeof(Type_Ts) == 8)
+    {
+        pair<Type_Key, Type_Ts> matchBuffer[8];
+
+        #if defined(__AVX512F__)
+        //Bit i of the 4 bit match mask -> bits 2i, 2i+1 of the interleaved (key,ts) mask
+        static const uint8_t pairMask[16] = {0x00,0x03,0x0C,0x0F,0x30,0x33,0x3C,0x3F,0xC0,0xC3,0xCC,0xCF,0xF0,0xF3,0xFC,0xFF};
+        const __m512i upper = _mm512_set1_epi64(static_cast<long long>(upperBound));
+        const __m512i lower = _mm512_set1_epi64(static_cast<long long>(lowerLimit));
+        const __m512i interleaveLo = _mm512_set_epi64(11,3,10,2,9,1,8,0);
+        const __m512i interleaveHi = _mm512_set_epi64(15,7,14,6,13,5,12,4);
+
+        for (; pos + 8 <= endPos; pos += 8)
+        {
+            __m512i key = _mm512_loadu_si512(keys + pos);
+            if (_mm512_cmple_epu64_mask(key, upper) != 0xFF)
             {
-                rangeSearchResult.push_back(m_buffer[startSearchBufferPos]);
+                break;
             }
-            else
+
+            __m512i ts = _mm512_loadu_si512(timeStamps + pos);
+            __mmask8 nonGap = _mm512_test_epi64_mask(ts, ts);
+            __mmask8 live = nonGap;
+
+            if constexpr (checkExpiry)
             {
-                if (m_buffer[startSearchBufferPos].second)
+                live = _mm512_mask_cmpge_epu64_mask(nonGap, ts, lower);
+                __mmask8 expired = nonGap & ~live;
+                if (expired)
                 {
-                    m_buffer[startSearchBufferPos].second = 0;
+                    _mm512_mask_storeu_epi64(timeStamps + pos, expired, _mm512_setzero_si512());
+                    numExpired += _mm_popcnt_u32(expired);
                 }
             }
-            startSearchBufferPos++;
+
+            if (live)
+            {
+                __m512i pairLo = _mm512_permutex2var_epi64(key, interleaveLo, ts);
+                __m512i pairHi = _mm512_permutex2var_epi64(key, interleaveHi, ts);
+                int numLo = _mm_popcnt_u32(live & 0xF);
+                _mm512_mask_compressstoreu_epi64(matchBuffer, pairMask[live & 0xF], pairLo);
+                _mm512_mask_compressstoreu_epi64(matchBuffer + numLo, pairMask[live >> 4], pairHi);
+                append_result(rangeSearchResult, matchBuffer, _mm_popcnt_u32(live));
+            }
         }
+        #else
+        //AVX2 only has signed 64 bit compares, flip the sign bit for unsigned order
+        const __m256i signFlip = _mm256_set1_epi64x(static_cast<long long>(1ULL << 63));
+        const __m256i upper = _mm256_xor_si256(_mm256_set1_epi64x(static_cast<long long>(upperBound)), signFlip);
+        const __m256i lower = _mm256_xor_si256(_mm256_set1_epi64x(static_cast<long long>(lowerLimit)), signFlip);
 
-        if ((double)m_numPairExist/m_numPair < 0.5)
+        for (; pos + 4 <= endPos; pos += 4)
         {
-            updateSeg.push_back(make_pair(m_currentNodeStartKey,m_parentIndex));
+            __m256i key = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + pos));
+            if (_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(_mm256_xor_si256(key, signFlip), upper))))
+            {
+                break;
+            }
+
+            __m256i ts = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(timeStamps + pos));
+            __m256i gap = _mm256_cmpeq_epi64(ts, _mm256_setzero_si256());
+            __m256i dead = gap;
+
+            if constexpr (checkExpiry)
+            {
+                __m256i expired = _mm256_andnot_si256(gap, _mm256_cmpgt_epi64(lower, _mm256_xor_si256(ts, signFlip)));
+                int expiredMask = _mm256_movemask_pd(_mm256_castsi256_pd(expired));
+                if (expiredMask)
+                {
+                    _mm256_storeu_si256(reinterpret_cast<__m256i*>(timeStamps + pos), _mm256_andnot_si256(expired, ts));
+                    numExpired += _mm_popcnt_u32(expiredMask);
+                }
+                dead = _mm256_or_si256(gap, expired);
+            }
+
+            int live = ~_mm256_movemask_pd(_mm256_castsi256_pd(dead)) & 0xF;
+
+            if (live == 0xF)
+            {
+                __m256i pairLo = _mm256_unpacklo_epi64(key, ts); //k0,t0,k2,t2
+                __m256i pairHi = _mm256_unpackhi_epi64(key, ts); //k1,t1,k3,t3
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(matchBuffer), _mm256_permute2x128_si256(pairLo, pairHi, 0x20));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(matchBuffer + 2), _mm256_permute2x128_si256(pairLo, pairHi, 0x31));
+                append_result(rangeSearchResult, matchBuffer, 4);
+            }
+            else if (live)
+            {
+                int numMatch = 0;
+                for (int i = 0; i < 4; i++)
+                {
+                    if (live & (1 << i))
+                    {
+                        matchBuffer[numMatch++] = make_pair(keys[pos + i], timeStamps[pos + i]);
+                    }
+                }
+                append_result(rangeSearchResult, matchBuffer, numMatch);
+            }
         }
+        #endif
     }
-    else //Delete Segment
-    {        
-        if (m_leftSibling)
+    #endif
+
+    while(pos < endPos && keys[pos] <= upperBound)
+    {
+        if (timeStamps[pos] && (!checkExpiry || timeStamps[pos] >= lowerLimit))
         {
-            m_leftSibling->m_rightSibling = m_rightSibling;
+            append_result(rangeSearchResult, keys[pos], timeStamps[pos]);
         }
-        if (m_rightSibling)
+        else if (checkExpiry && timeStamps[pos])
         {
-            m_rightSibling->m_leftSibling = m_leftSibling;
+            timeStamps[pos] = 0;
+            numExpired++;
         }
-        updateSeg.push_back(make_pair(numeric_limits<Type_Key>::max(),m_parentIndex));
+        pos++;
     }
 
+    return numExpired;
+}
 
-    #if defined DEBUG 
-    cout << "[Debug Info:] Class {SWseg} :: Member Function {range_scan()} go to sibling" << endl;
-    cout << endl;
-    #elif defined DEBUG_KEY
-    if(DEBUG_KEY == newKey)
+//scan_kernel over m_localKeys/m_localTs from pos to m_numPair. With COMPRESSED_SEG only matches are decoded.
+template<class Type_Key, class Type_Ts, class Type_Payload>
+template<bool checkExpiry, class Type_Result>
+inline int SWseg<Type_Key,Type_Ts,Type_Payload>::scan_model(int & pos, Type_Key & upperBound, Type_Ts & lowerLimit, Type_Result & rangeSearchResult)
+{
+    if constexpr (is_payload_result<Type_Result>::value)
     {
-        cout << "[Debug Info:] Class {SWseg} :: Member Function {range_scan()} go to sibling" << endl;
-        // cout << m_rightSibling->m_currentNodeStartKey << endl;
-        cout << endl;
+        return scan_payload<checkExpiry>(m_localKeys, m_localTs, m_localPayloads, pos, m_numPair, upperBound, lowerLimit, rangeSearchResult);
     }
-    #endif
+    else
+    {
+        #ifdef COMPRESSED_SEG
+        //Compares codes, one loop per pair of code widths. Blocks of 8 below upperBound (keys are sorted, the last key of the
+        //block decides) are decoded into matchBuffer and appended at once.
+        int numExpired = 0;
+        uint64_t upperCode = m_localKeys.code_upper(upperBound);
+        uint64_t lowerCode = m_localTs.code_lower(lowerLimit);
+
+        m_localKeys.visit_codes([&](auto * keyCodes)
+        {
+            m_localTs.visit_codes([&](auto * tsCodes)
+            {
+                pair<Type_Key, Type_Ts> matchBuffer[8];
+
+                for (; pos + 8 <= m_numPair && keyCodes[pos+7] <= upperCode; pos += 8)
+                {
+                    int numMatch = 0;
+                    for (int i = pos; i < pos + 8; i++)
+                    {
+                        if (tsCodes[i] && (!checkExpiry || tsCodes[i] >= lowerCode))
+                        {
+                            matchBuffer[numMatch++] = make_pair(m_localKeys.decode(keyCodes[i]), m_localTs.decode(tsCodes[i]));
+                        }
+                        else if (checkExpiry && tsCodes[i])
+                        {
+                            tsCodes[i] = 0;
+                            numExpired++;
+                        }
+                    }
+                    append_result(rangeSearchResult, matchBuffer, numMatch);
+                }
 
-    if(m_rightSibling && m_rightSibling->m_currentNodeStartKey <= upperBound)
+                while(pos < m_numPair && keyCodes[pos] <= upperCode)
+                {
+                    if (tsCodes[pos] && (!checkExpiry || tsCodes[pos] >= lowerCode))
+                    {
+                        append_result(rangeSearchResult, m_localKeys.decode(keyCodes[pos]), m_localTs.decode(tsCodes[pos]));
+                    }
+                    else if (checkExpiry && tsCodes[pos])
+                    {
+                        tsCodes[pos] = 0;
+                        numExpired++;
+                    }
+                    pos++;
+                }
+            });
+        });
+
+        return numExpired;
+        #else
+        return scan_kernel<checkExpiry>(m_localKeys.data(), m_localTs.data(), pos, m_numPair, upperBound, lowerLimit, rangeSearchResult);
+        #endif
+    }
+}
+
+//scan_kernel over m_bufferKeys/m_bufferTs from pos to m_numPairBuffer
+template<class Type_Key, class Type_Ts, class Type_Payload>
+template<bool checkExpiry, class Type_Result>
+inline int SWseg<Type_Key,Type_Ts,Type_Payload>::scan_buffer(int & pos, Type_Key & upperBound, Type_Ts & lowerLimit, Type_Result & rangeSearchResult)
+{
+    if constexpr (is_payload_result<Type_Result>::value)
+    {
+        return scan_payload<checkExpiry>(m_bufferKeys, m_bufferTs, m_bufferPayloads, pos, m_numPairBuffer, upperBound, lowerLimit, rangeSearchResult);
+    }
+    else
     {
-        m_rightSibling->range_scan(0,0, newKey, newTimeStamp, lowerLimit, lowerBound, upperBound, rangeSearchResult, updateSeg);
+        return scan_kernel<checkExpiry>(m_bufferKeys.data(), m_bufferTs.data(), pos, m_numPairBuffer, upperBound, lowerLimit, rangeSearchResult);
     }
+}
 
-    #if defined DEBUG 
-    cout << "[Debug Info:] Class {SWseg} :: Member Function {range_scan()} back from sibling" << endl;
-    cout << endl;
-    #elif defined DEBUG_KEY
-    if(DEBUG_KEY == newKey)
+//Scalar scan_kernel that also appends the payload of each match (SWpayloadResult), only range searches asking for
+//payloads read the payload columns
+template<class Type_Key, class Type_Ts, class Type_Payload>
+template<bool checkExpiry, class Type_KeyArray, class Type_TsArray, class Type_Result>
+inline int SWseg<Type_Key,Type_Ts,Type_Payload>::scan_payload(const Type_KeyArray & keys, Type_TsArray & timeStamps, const SWpayloadColumn<Type_Payload> & payloads, 
+                                                                int & pos, int endPos, Type_Key & upperBound, Type_Ts & lowerLimit, Type_Result & rangeSearchResult)
+{
+    int numExpired = 0;
+
+    while(pos < endPos && keys[pos] <= upperBound)
     {
-        cout << "[Debug Info:] Class {SWseg} :: Member Function {range_scan()} back from sibling" << endl;
-        cout << endl;
+        Type_Ts timeStamp = timeStamps[pos];
+        if (timeStamp && (!checkExpiry || timeStamp >= lowerLimit))
+        {
+            append_result(rangeSearchResult, static_cast<Type_Key>(keys[pos]), timeStamp, payloads[pos]);
+        }
+        else if (checkExpiry && timeStamp)
+        {
+            timeStamps[pos] = 0;
+            numExpired++;
+        }
+        pos++;
     }
-    #endif
 
-    #ifdef TUNE
-    segScanNoSeg++;
-    #endif
+    return numExpired;
+}
 
-    #ifdef TUNE_TIME
-    segScanNoSeg++;
-    #endif
+/*
+Expiry
+*/
 
-    #if defined DEBUG 
-    cout << "[Debug Info:] Class {SWseg} :: Member Function {range_scan()} End" << endl;
-    cout << "[Debug Info:] stop seg pos = " << startSearchPos << endl;
-    cout << "[Debug Info:] stop buffer pos = " << startSearchBufferPos << endl;
-    cout << endl;
-    #elif defined DEBUG_KEY
-    if(DEBUG_KEY == newKey)
+//Zeroes expired tuples in the model (kept as gaps), drops expired tuples and gaps from the buffer and tightens m_minTimeStamp.
+//Returns the number of tuples removed.
+template <class Type_Key, class Type_Ts, class Type_Payload>
+int SWseg<Type_Key,Type_Ts,Type_Payload>::expire(Type_Ts & lowerLimit)
+{
+    int numExpired = 0;
+    Type_Ts minTimeStamp = m_maxTimeStamp;
+
+    for (int i = 0; i < m_numPair; i++)
     {
-        cout << "[Debug Info:] Class {SWseg} :: Member Function {range_scan()} End" << endl;
-        cout << "[Debug Info:] stop seg pos = " << startSearchPos << endl;
-        cout << "[Debug Info:] stop buffer pos = " << startSearchBufferPos << endl;
-        cout << endl;
+        if (!m_localTs[i])
+        {
+            continue;
+        }
+
+        if (m_localTs[i] < lowerLimit)
+        {
+            m_localTs[i] = 0;
+            numExpired++;
+        }
+        else if (m_localTs[i] < minTimeStamp)
+        {
+            minTimeStamp = m_localTs[i];
+        }
     }
-    #endif
+    m_numPairExist -= numExpired;
+
+    int writePos = 0;
+    for (int i = 0; i < m_numPairBuffer; i++)
+    {
+        if (m_bufferTs[i] && m_bufferTs[i] >= lowerLimit)
+        {
+            m_bufferKeys[writePos] = m_bufferKeys[i];
+            m_bufferTs[writePos] = m_bufferTs[i];
+            m_bufferPayloads[writePos] = m_bufferPayloads[i];
+            minTimeStamp = (m_bufferTs[i] < minTimeStamp) ? m_bufferTs[i] : minTimeStamp;
+            writePos++;
+        }
+        else if (m_bufferTs[i])
+        {
+            numExpired++;
+        }
+    }
+    m_bufferKeys.resize(writePos);
+    m_bufferTs.resize(writePos);
+    m_bufferPayloads.resize(writePos);
+    m_numPairBuffer = writePos;
+
+    m_minTimeStamp = minTimeStamp;
+    return numExpired;
 }
 
 /*
 Insertion
 */
-template <class Type_Key, class Type_Ts>
-void SWseg<Type_Key,Type_Ts>::insert(Type_Key & newKey, Type_Ts & newTimeStamp, Type_Ts & lowerLimit, 
+template <class Type_Key, class Type_Ts, class Type_Payload>
+void SWseg<Type_Key,Type_Ts,Type_Payload>::insert(Type_Key & newKey, Type_Ts & newTimeStamp, const Type_Payload & newPayload, Type_Ts & lowerLimit, 
                                     vector<pair<Type_Key,int >> & updateSeg)
 {
     #if defined DEBUG 
@@ -726,7 +1373,15 @@ void SWseg<Type_Key,Type_Ts>::insert(Type_Key & newKey, Type_Ts & newTimeStamp,
 
     if (m_maxTimeStamp >= lowerLimit)
     {
-        insert_current(newKey, newTimeStamp, lowerLimit, updateSeg);
+        insert_current(newKey, newTimeStamp, newPayload, lowerLimit, updateSeg);
+
+        #ifdef BACKGROUND_RETRAIN
+        if (m_retrainTask)
+        {
+            m_retrainTask->delta.push_back(make_pair(newKey, newTimeStamp));
+            m_retrainTask->deltaPayloads.push_back(newPayload);
+        }
+        #endif
 
         if (!updateSeg.size() && (double)m_numPairExist/m_numPair < 0.5)
         {
@@ -757,9 +1412,21 @@ void SWseg<Type_Key,Type_Ts>::insert(Type_Key & newKey, Type_Ts & newTimeStamp,
             }
             #endif
             
-            m_leftSibling->m_buffer.push_back(make_pair(newKey,newTimeStamp));
+            m_leftSibling->reserve_buffer(m_leftSibling->m_numPairBuffer+1);
+            m_leftSibling->m_bufferKeys.push_back(newKey);
+            m_leftSibling->m_bufferTs.push_back(newTimeStamp);
+            m_leftSibling->m_bufferPayloads.push_back(newPayload);
 
             m_leftSibling->m_numPairBuffer++;
+            m_leftSibling->m_numBufferInsert++;
+
+            #ifdef BACKGROUND_RETRAIN
+            if (m_leftSibling->m_retrainTask)
+            {
+                m_leftSibling->m_retrainTask->delta.push_back(make_pair(newKey, newTimeStamp));
+                m_leftSibling->m_retrainTask->deltaPayloads.push_back(newPayload);
+            }
+            #endif
 
             m_leftSibling->m_rightSibling = m_rightSibling;
 
@@ -769,8 +1436,9 @@ void SWseg<Type_Key,Type_Ts>::insert(Type_Key & newKey, Type_Ts & newTimeStamp,
             }
 
             m_leftSibling->m_maxTimeStamp = m_leftSibling->m_maxTimeStamp < newTimeStamp ? newTimeStamp : m_leftSibling->m_maxTimeStamp;
+            m_leftSibling->m_minTimeStamp = m_leftSibling->m_minTimeStamp > newTimeStamp ? newTimeStamp : m_leftSibling->m_minTimeStamp;
 
-            if (m_leftSibling->m_numPairBuffer >= MAX_BUFFER_SIZE-1)
+            if (m_leftSibling->m_numPairBuffer >= m_leftSibling->max_buffer_size()-1)
             {
                 updateSeg.push_back(make_pair(m_leftSibling->m_currentNodeStartKey, m_leftSibling->m_parentIndex*10+1));
                 
@@ -789,12 +1457,21 @@ void SWseg<Type_Key,Type_Ts>::insert(Type_Key & newKey, Type_Ts & newTimeStamp,
             }
             #endif
 
-            m_rightSibling->insert_buffer(0, newKey, newTimeStamp, lowerLimit, updateSeg);
+            m_rightSibling->insert_buffer(0, newKey, newTimeStamp, newPayload, lowerLimit, updateSeg);
+
+            #ifdef BACKGROUND_RETRAIN
+            if (m_rightSibling->m_retrainTask)
+            {
+                m_rightSibling->m_retrainTask->delta.push_back(make_pair(newKey, newTimeStamp));
+                m_rightSibling->m_retrainTask->deltaPayloads.push_back(newPayload);
+            }
+            #endif
 
             m_rightSibling->m_leftSibling = m_leftSibling;
             m_rightSibling->m_currentNodeStartKey = newKey;
 
             m_rightSibling->m_maxTimeStamp = m_rightSibling->m_maxTimeStamp < newTimeStamp ? newTimeStamp : m_rightSibling->m_maxTimeStamp;
+            m_rightSibling->m_minTimeStamp = m_rightSibling->m_minTimeStamp > newTimeStamp ? newTimeStamp : m_rightSibling->m_minTimeStamp;
 
             if (updateSeg.size() == 1) //If retrain == null
             {
@@ -816,7 +1493,7 @@ void SWseg<Type_Key,Type_Ts>::insert(Type_Key & newKey, Type_Ts & newTimeStamp,
     #if defined DEBUG 
     cout << "[Debug Info:] Class {SWseg} :: Member Function {insert()} End" << endl;
 
-    cout << "[Debug Info:] Printing m_localData after insertion : " << endl;
+    cout << "[Debug Info:] Printing m_localKeys after insertion : " << endl;
     cout << "[Debug Info:] m_numPair =  " << m_numPair << endl;
     cout << "[Debug Info:] m_numPairExist =  " << m_numPairExist << endl;
     cout << "[Debug Info:] m_numPairBuffer = " << m_numPairBuffer << endl; 
@@ -840,8 +1517,8 @@ void SWseg<Type_Key,Type_Ts>::insert(Type_Key & newKey, Type_Ts & newTimeStamp,
 }
 
 
-template <class Type_Key, class Type_Ts>
-void SWseg<Type_Key,Type_Ts>::insert_current(   Type_Key & newKey, Type_Ts & newTimeStamp, Type_Ts & lowerLimit, 
+template <class Type_Key, class Type_Ts, class Type_Payload>
+void SWseg<Type_Key,Type_Ts,Type_Payload>::insert_current(   Type_Key & newKey, Type_Ts & newTimeStamp, const Type_Payload & newPayload, Type_Ts & lowerLimit, 
                                                     vector<pair<Type_Key,int >> & updateSeg)
 {
     #if defined(TUNE_TIME) || defined(TIME_BREAKDOWN)
@@ -866,7 +1543,7 @@ void SWseg<Type_Key,Type_Ts>::insert_current(   Type_Key & newKey, Type_Ts & new
         }
         #endif
         
-        insert_buffer(-1, newKey, newTimeStamp, lowerLimit, updateSeg);
+        insert_buffer(-1, newKey, newTimeStamp, newPayload, lowerLimit, updateSeg);
         //NOTE: There may be cases where you insert into the first segment before m_startKey, then do we need to update the tree? 
     }
     else
@@ -894,15 +1571,15 @@ void SWseg<Type_Key,Type_Ts>::insert_current(   Type_Key & newKey, Type_Ts & new
             predictPos = predictPos < predictPosMin ? predictPosMin : predictPos;
             predictPos = predictPos > predictPosMax ? predictPosMax : predictPos;
 
-            if (newKey < m_localData[predictPos].first) // Left of predictedPos
+            if (newKey < m_localKeys[predictPos]) // Left of predictedPos
             {
                 insertionPos = predictPos;
-                exponential_search_model_left(newKey, insertionPos, predictPos-predictPosMin);
+                search_model_left(newKey, insertionPos, predictPos-predictPosMin);
             }
-            else if (newKey > m_localData[predictPos].first) //Right of predictedPos
+            else if (newKey > m_localKeys[predictPos]) //Right of predictedPos
             {
                 insertionPos = predictPos;
-                exponential_search_model_right(newKey, insertionPos, predictPosMax-predictPos);
+                search_model_right(newKey, insertionPos, predictPosMax-predictPos);
             }
             else // newKey == Key at predictedPos (Will not trigger, but nesscary to keep this else)
             {
@@ -923,13 +1600,15 @@ void SWseg<Type_Key,Type_Ts>::insert_current(   Type_Key & newKey, Type_Ts & new
             //Insert if insertion pos is less than last index
             if (insertionPos < m_numPair)
             {                
-                insert_model(insertionPos, newKey, newTimeStamp, lowerLimit, gapAddError, updateSeg);
+                insert_model(insertionPos, newKey, newTimeStamp, newPayload, lowerLimit, gapAddError, updateSeg);
             }
             //Else append
             else
             {
                 //Append and increment m_rightSearchBound
-                m_localData.push_back(make_pair(newKey,newTimeStamp));
+                m_localKeys.push_back(newKey);
+                m_localTs.push_back(newTimeStamp);
+                m_localPayloads.push_back(newPayload);
                 m_numPair++;
                 m_numPairExist++;
                 m_rightSearchBound++;
@@ -944,7 +1623,7 @@ void SWseg<Type_Key,Type_Ts>::insert_current(   Type_Key & newKey, Type_Ts & new
             searchCycle += temp2 - temp3;
             #endif
 
-            insert_model_end(predictPosMin, newKey, newTimeStamp, lowerLimit, updateSeg);
+            insert_model_end(predictPosMin, newKey, newTimeStamp, newPayload, lowerLimit, updateSeg);
 
         }
         //Insertion is append type 
@@ -957,13 +1636,14 @@ void SWseg<Type_Key,Type_Ts>::insert_current(   Type_Key & newKey, Type_Ts & new
 
             insertionPos = predictPosMin + m_leftSearchBound;
 
-            insert_model_append(insertionPos, newKey, newTimeStamp, lowerLimit, updateSeg);
+            insert_model_append(insertionPos, newKey, newTimeStamp, newPayload, lowerLimit, updateSeg);
         }
         
         m_maxSearchError = min(8192,(int)ceil(0.6*m_numPair));
     }
 
     m_maxTimeStamp = (m_maxTimeStamp < newTimeStamp)? newTimeStamp: m_maxTimeStamp;
+    m_minTimeStamp = (m_minTimeStamp > newTimeStamp)? newTimeStamp: m_minTimeStamp;
 
     #if defined(TUNE_TIME) || defined(TIME_BREAKDOWN)
     stopTimer(&temp);
@@ -975,8 +1655,8 @@ void SWseg<Type_Key,Type_Ts>::insert_current(   Type_Key & newKey, Type_Ts & new
 }
 
 
-template <class Type_Key, class Type_Ts>
-void SWseg<Type_Key,Type_Ts>::insert_model(int & insertionPos, Type_Key & newKey, Type_Ts & newTimeStamp, Type_Ts & lowerLimit,
+template <class Type_Key, class Type_Ts, class Type_Payload>
+void SWseg<Type_Key,Type_Ts,Type_Payload>::insert_model(int & insertionPos, Type_Key & newKey, Type_Ts & newTimeStamp, const Type_Payload & newPayload, Type_Ts & lowerLimit,
                                         bool & gapAddError, vector<pair<Type_Key,int >> & updateSeg)
 {
     //If insertionPos is not a gap
@@ -984,7 +1664,7 @@ void SWseg<Type_Key,Type_Ts>::insert_model(int & insertionPos, Type_Key & newKey
     {
         if (m_leftSearchBound + m_rightSearchBound >= m_maxSearchError)
         {
-            insert_buffer(-1, newKey, newTimeStamp, lowerLimit, updateSeg);
+            insert_buffer(-1, newKey, newTimeStamp, newPayload, lowerLimit, updateSeg);
         }
         else
         {
@@ -1010,7 +1690,7 @@ void SWseg<Type_Key,Type_Ts>::insert_model(int & insertionPos, Type_Key & newKey
             int rightGapPos, leftGapPos;
 
             //Find Left Gap
-            int minDiffGap = (insertionPos-MAX_BUFFER_SIZE < 0)? 0 : insertionPos-MAX_BUFFER_SIZE;
+            int minDiffGap = (insertionPos-max_buffer_size() < 0)? 0 : insertionPos-max_buffer_size();
             for (leftGapPos = insertionPos; leftGapPos >= minDiffGap; leftGapPos--)
             {
                 if (!index_exists_model(leftGapPos, lowerLimit))
@@ -1022,7 +1702,7 @@ void SWseg<Type_Key,Type_Ts>::insert_model(int & insertionPos, Type_Key & newKey
             }
 
             //Find Right Gap
-            minDiffGap = (gapPos == -1) ? insertionPos + MAX_BUFFER_SIZE : insertionPos + (insertionPos - gapPos);
+            minDiffGap = (gapPos == -1) ? insertionPos + max_buffer_size() : insertionPos + (insertionPos - gapPos);
             minDiffGap = (minDiffGap > m_numPair) ? m_numPair : minDiffGap;
             for (rightGapPos = insertionPos; rightGapPos < minDiffGap; rightGapPos++)
             {
@@ -1035,7 +1715,7 @@ void SWseg<Type_Key,Type_Ts>::insert_model(int & insertionPos, Type_Key & newKey
                 }
             }
 
-            //No Gap and reached the end (end is still within MAX_BUFFER_SIZE)
+            //No Gap and reached the end (end is still within max_buffer_size())
             if (rightGapPos == m_numPair)
             {
                 gapPos = m_numPair;
@@ -1056,7 +1736,7 @@ void SWseg<Type_Key,Type_Ts>::insert_model(int & insertionPos, Type_Key & newKey
                 }
                 #endif
 
-                insert_buffer(-1, newKey, newTimeStamp, lowerLimit, updateSeg);
+                insert_buffer(-1, newKey, newTimeStamp, newPayload, lowerLimit, updateSeg);
                 
             }
             //Gap exist within shiftcost
@@ -1069,7 +1749,7 @@ void SWseg<Type_Key,Type_Ts>::insert_model(int & insertionPos, Type_Key & newKey
                         #if defined DEBUG 
                         cout << "[Debug Info:] Shift towards a gap right of the insertionPos" << endl;
                         cout << "[Debug Info:] InsertionPos = " << insertionPos << endl;
-                        cout << "[Debug Info:] key at InsertionPos = " << m_localData[insertionPos].first << endl;
+                        cout << "[Debug Info:] key at InsertionPos = " << m_localKeys[insertionPos] << endl;
                         cout << "[Debug Info:] Shift Bound = (" << insertionPos << "," << gapPos << ")" << endl;
                         cout << endl;
                         #elif defined DEBUG_KEY
@@ -1077,16 +1757,19 @@ void SWseg<Type_Key,Type_Ts>::insert_model(int & insertionPos, Type_Key & newKey
                         {
                             cout << "[Debug Info:] Shift towards a gap right of the insertionPos" << endl;
                             cout << "[Debug Info:] InsertionPos = " << insertionPos << endl;
-                            cout << "[Debug Info:] key at InsertionPos = " << m_localData[insertionPos].first << endl;
+                            cout << "[Debug Info:] key at InsertionPos = " << m_localKeys[insertionPos] << endl;
                             cout << "[Debug Info:] Shift Bound = (" << insertionPos << "," << gapPos << ")" << endl;
                             cout << endl;
                         }
                         #endif
 
-                        vector<pair<Type_Key,Type_Ts>> tempMove(m_localData.begin()+insertionPos,m_localData.begin()+gapPos);
-                        move(tempMove.begin(),tempMove.end(),m_localData.begin()+insertionPos+1);
+                        shift_right(m_localKeys, insertionPos, gapPos);
+                        shift_right(m_localTs, insertionPos, gapPos);
+                        shift_right(m_localPayloads, insertionPos, gapPos);
                         
-                        m_localData[insertionPos] = make_pair(newKey,newTimeStamp);
+                        m_localKeys[insertionPos] = newKey;
+                        m_localTs[insertionPos] = newTimeStamp;
+                        m_localPayloads[insertionPos] = newPayload;
                         m_numPairExist++;
                         m_rightSearchBound++;
 
@@ -1097,7 +1780,7 @@ void SWseg<Type_Key,Type_Ts>::insert_model(int & insertionPos, Type_Key & newKey
                         #if defined DEBUG 
                         cout << "[Debug Info:] Shift towards a gap left of the insertionPos" << endl;
                         cout << "[Debug Info:] InsertionPos = " << insertionPos-1  << endl;
-                        cout << "[Debug Info:] key at InsertionPos = " << m_localData[insertionPos-1 ].first << endl;
+                        cout << "[Debug Info:] key at InsertionPos = " << m_localKeys[insertionPos-1 ] << endl;
                         cout << "[Debug Info:] Shift Bound = (" << gapPos << "," << insertionPos-1 << ")" << endl;
                         cout << endl;
                         #elif defined DEBUG_KEY
@@ -1105,17 +1788,20 @@ void SWseg<Type_Key,Type_Ts>::insert_model(int & insertionPos, Type_Key & newKey
                         {
                             cout << "[Debug Info:] Shift towards a gap left of the insertionPos" << endl;
                             cout << "[Debug Info:] InsertionPos = " << insertionPos-1  << endl;
-                            cout << "[Debug Info:] key at InsertionPos = " << m_localData[insertionPos-1 ].first << endl;
+                            cout << "[Debug Info:] key at InsertionPos = " << m_localKeys[insertionPos-1 ] << endl;
                             cout << "[Debug Info:] Shift Bound = (" << gapPos << "," << insertionPos-1 << ")" << endl;
                             cout << endl;
                         }
                         #endif
 
                         insertionPos--;
-                        vector<pair<Type_Key,Type_Ts>> tempMove(m_localData.begin()+gapPos+1,m_localData.begin()+insertionPos+1);
-                        move(tempMove.begin(),tempMove.end(),m_localData.begin()+gapPos);
+                        shift_left(m_localKeys, gapPos+1, insertionPos+1);
+                        shift_left(m_localTs, gapPos+1, insertionPos+1);
+                        shift_left(m_localPayloads, gapPos+1, insertionPos+1);
 
-                        m_localData[insertionPos] = make_pair(newKey,newTimeStamp);
+                        m_localKeys[insertionPos] = newKey;
+                        m_localTs[insertionPos] = newTimeStamp;
+                        m_localPayloads[insertionPos] = newPayload;
                         m_numPairExist++;
                         m_leftSearchBound++;
                     }                            
@@ -1125,20 +1811,22 @@ void SWseg<Type_Key,Type_Ts>::insert_model(int & insertionPos, Type_Key & newKey
                     #if defined DEBUG 
                     cout << "[Debug Info:] Minimium distance is to the end of the seg, there insert at insertion positon" << endl;
                     cout << "[Debug Info:] InsertionPos = " << insertionPos  << endl;
-                    cout << "[Debug Info:] key at InsertionPos = " << m_localData[insertionPos].first << endl;
+                    cout << "[Debug Info:] key at InsertionPos = " << m_localKeys[insertionPos] << endl;
                     cout << endl;
                     #elif defined DEBUG_KEY
                     if(DEBUG_KEY == newKey)
                     {
                         cout << "[Debug Info:] Minimium distance is to the end of the seg, there insert at insertion positon" << endl;
                         cout << "[Debug Info:] InsertionPos = " << insertionPos  << endl;
-                        cout << "[Debug Info:] key at InsertionPos = " << m_localData[insertionPos].first << endl;
+                        cout << "[Debug Info:] key at InsertionPos = " << m_localKeys[insertionPos] << endl;
                         cout << endl;
                     }
                     #endif
                     
                     //Insert without gaps
-                    m_localData.insert(m_localData.begin()+insertionPos,make_pair(newKey,newTimeStamp));
+                    insert_at(m_localKeys, insertionPos, newKey);
+                    insert_at(m_localTs, insertionPos, newTimeStamp);
+                    insert_at(m_localPayloads, insertionPos, newPayload);
                     m_numPair++;
                     m_numPairExist++;
                     m_rightSearchBound++;
@@ -1152,32 +1840,33 @@ void SWseg<Type_Key,Type_Ts>::insert_model(int & insertionPos, Type_Key & newKey
     {
         if (gapAddError && m_leftSearchBound + m_rightSearchBound >= m_maxSearchError)
         {
-            insert_buffer(-1, newKey, newTimeStamp, lowerLimit, updateSeg);
+            insert_buffer(-1, newKey, newTimeStamp, newPayload, lowerLimit, updateSeg);
         }
         else
         {
             #if defined DEBUG 
             cout << "[Debug Info:] Insertion Position is a Gap, change all empty keys after insertionPos to have key = newKey" << endl;
             cout << "[Debug Info:] InsertionPos = " << insertionPos  << endl;
-            cout << "[Debug Info:] key at InsertionPos = " << m_localData[insertionPos].first << endl;
+            cout << "[Debug Info:] key at InsertionPos = " << m_localKeys[insertionPos] << endl;
             cout << endl;
             #elif defined DEBUG_KEY
             if(DEBUG_KEY == newKey)
             {
                 cout << "[Debug Info:] Insertion Position is a Gap, change all empty keys after insertionPos to have key = newKey" << endl;
                 cout << "[Debug Info:] InsertionPos = " << insertionPos  << endl;
-                cout << "[Debug Info:] key at InsertionPos = " << m_localData[insertionPos].first << endl;
+                cout << "[Debug Info:] key at InsertionPos = " << m_localKeys[insertionPos] << endl;
                 cout << endl;
             }
             #endif
             
-            m_localData[insertionPos].first = newKey;
-            m_localData[insertionPos].second = newTimeStamp;
+            m_localKeys[insertionPos] = newKey;
+            m_localTs[insertionPos] = newTimeStamp;
+            m_localPayloads[insertionPos] = newPayload;
             m_numPairExist++;
             int nextPos = insertionPos + 1;
-            while (nextPos < m_numPair && m_localData[nextPos].first < newKey)
+            while (nextPos < m_numPair && m_localKeys[nextPos] < newKey)
             {
-                m_localData[nextPos].first = newKey;
+                m_localKeys[nextPos] = newKey;
                 nextPos++;
             }
             
@@ -1190,63 +1879,67 @@ void SWseg<Type_Key,Type_Ts>::insert_model(int & insertionPos, Type_Key & newKey
 }
 
 
-template <class Type_Key, class Type_Ts>
-void SWseg<Type_Key,Type_Ts>::insert_model_end(int & lastPos, Type_Key & newKey, Type_Ts & newTimeStamp, Type_Ts & lowerLimit, 
+template <class Type_Key, class Type_Ts, class Type_Payload>
+void SWseg<Type_Key,Type_Ts,Type_Payload>::insert_model_end(int & lastPos, Type_Key & newKey, Type_Ts & newTimeStamp, const Type_Payload & newPayload, Type_Ts & lowerLimit, 
                                             vector<pair<Type_Key,int >> & updateSeg)
 {
     //If last key in not a gap
     if (index_exists_model(lastPos, lowerLimit))
     {
-        if (newKey < m_localData[lastPos].first)
+        if (newKey < m_localKeys[lastPos])
         {
             #if defined DEBUG 
             cout << "[Debug Info:] newKey is smaller than last key, insert into last key position" << endl;
             cout << "[Debug Info:] InsertionPos = " << lastPos  << endl;
-            cout << "[Debug Info:] key at InsertionPos = " << m_localData[lastPos].first << endl;
+            cout << "[Debug Info:] key at InsertionPos = " << m_localKeys[lastPos] << endl;
             cout << endl;
             #elif defined DEBUG_KEY
             if(DEBUG_KEY == newKey)
             {
                 cout << "[Debug Info:] newKey is smaller than last key, insert into last key position" << endl;
                 cout << "[Debug Info:] InsertionPos = " << lastPos  << endl;
-                cout << "[Debug Info:] key at InsertionPos = " << m_localData[lastPos].first << endl;
+                cout << "[Debug Info:] key at InsertionPos = " << m_localKeys[lastPos] << endl;
                 cout << endl;
             }
             #endif
 
             if (m_leftSearchBound + m_rightSearchBound >= m_maxSearchError)
             {
-                insert_buffer(-1, newKey, newTimeStamp, lowerLimit, updateSeg);
+                insert_buffer(-1, newKey, newTimeStamp, newPayload, lowerLimit, updateSeg);
             }
             else
             {
                 //Insert and increment m_rightSearchBound
-                m_localData.insert(m_localData.end()-1,make_pair(newKey,newTimeStamp));
+                insert_at(m_localKeys, (int)m_localKeys.size()-1, newKey);
+                insert_at(m_localTs, (int)m_localTs.size()-1, newTimeStamp);
+                insert_at(m_localPayloads, m_numPair-1, newPayload);
                 m_numPair++;
                 m_numPairExist++;
                 m_rightSearchBound++;
             }
 
         }
-        else //newKey > m_localData[lastPos].first 
+        else //newKey > m_localKeys[lastPos] 
         {
             #if defined DEBUG 
             cout << "[Debug Info:] newKey is larger than last key, append after the last position" << endl;
             cout << "[Debug Info:] InsertionPos = " << lastPos  << endl;
-            cout << "[Debug Info:] key at InsertionPos = " << m_localData[lastPos].first << endl;
+            cout << "[Debug Info:] key at InsertionPos = " << m_localKeys[lastPos] << endl;
             cout << endl;
             #elif defined DEBUG_KEY
             if(DEBUG_KEY == newKey)
             {
                 cout << "[Debug Info:] newKey is larger than last key, append after the last position" << endl;
                 cout << "[Debug Info:] InsertionPos = " << lastPos  << endl;
-                cout << "[Debug Info:] key at InsertionPos = " << m_localData[lastPos].first << endl;
+                cout << "[Debug Info:] key at InsertionPos = " << m_localKeys[lastPos] << endl;
                 cout << endl;
             }
             #endif
 
             //Append and increment m_rightSearchBound
-            m_localData.push_back(make_pair(newKey,newTimeStamp));
+            m_localKeys.push_back(newKey);
+            m_localTs.push_back(newTimeStamp);
+            m_localPayloads.push_back(newPayload);
             m_numPair++;
             m_numPairExist++;
         }
@@ -1257,26 +1950,27 @@ void SWseg<Type_Key,Type_Ts>::insert_model_end(int & lastPos, Type_Key & newKey,
         #if defined DEBUG 
         cout << "[Debug Info:] Last key is a gap" << endl;
         cout << "[Debug Info:] InsertionPos = " << lastPos  << endl;
-        cout << "[Debug Info:] key at InsertionPos = " << m_localData[lastPos].first << endl;
+        cout << "[Debug Info:] key at InsertionPos = " << m_localKeys[lastPos] << endl;
         cout << endl;
         #elif defined DEBUG_KEY
         if(DEBUG_KEY == newKey)
         {
             cout << "[Debug Info:] Last key is a gap" << endl;
             cout << "[Debug Info:] InsertionPos = " << lastPos  << endl;
-            cout << "[Debug Info:] key at InsertionPos = " << m_localData[lastPos].first << endl;
+            cout << "[Debug Info:] key at InsertionPos = " << m_localKeys[lastPos] << endl;
             cout << endl;
         }
         #endif
 
-        m_localData[lastPos].first = newKey;
-        m_localData[lastPos].second = newTimeStamp;
+        m_localKeys[lastPos] = newKey;
+        m_localTs[lastPos] = newTimeStamp;
+        m_localPayloads[lastPos] = newPayload;
         m_numPairExist++;
     }
 }
 
-template <class Type_Key, class Type_Ts>
-void SWseg<Type_Key,Type_Ts>::insert_model_append( int & insertionPos, Type_Key & newKey, Type_Ts & newTimeStamp, Type_Ts & lowerLimit,
+template <class Type_Key, class Type_Ts, class Type_Payload>
+void SWseg<Type_Key,Type_Ts,Type_Payload>::insert_model_append( int & insertionPos, Type_Key & newKey, Type_Ts & newTimeStamp, const Type_Payload & newPayload, Type_Ts & lowerLimit,
                                                 vector<pair<Type_Key,int >> & updateSeg)
 {
     //If gaps makes the segment very empty.
@@ -1296,7 +1990,7 @@ void SWseg<Type_Key,Type_Ts>::insert_model_append( int & insertionPos, Type_Key
         #endif
 
         //Insert into buffer
-        insert_buffer(-1, newKey, newTimeStamp, lowerLimit, updateSeg);
+        insert_buffer(-1, newKey, newTimeStamp, newPayload, lowerLimit, updateSeg);
     }
     else
     {
@@ -1314,22 +2008,22 @@ void SWseg<Type_Key,Type_Ts>::insert_model_append( int & insertionPos, Type_Key
         #endif
 
         //Append and copy last key to every position before insertion pos
-        pair<Type_Key,Type_Ts> lastKeyForGaps = make_pair(m_localData.back().first,0);
+        Type_Key lastKeyForGaps = m_localKeys.back();
 
-        for (int index = m_numPair; index <= insertionPos; index++)
-        {
-            m_localData.push_back(lastKeyForGaps);
-        }
-        m_localData.back().first = newKey;
-        m_localData.back().second = newTimeStamp;
+        m_localKeys.resize(insertionPos+1, lastKeyForGaps);
+        m_localTs.resize(insertionPos+1, 0);
+        m_localPayloads.resize(insertionPos+1);
+        m_localKeys.back() = newKey;
+        m_localTs.back() = newTimeStamp;
+        m_localPayloads[insertionPos] = newPayload;
 
-        m_numPair = m_localData.size();
+        m_numPair = m_localKeys.size();
         m_numPairExist++;
     }
 }
 
-template <class Type_Key, class Type_Ts>
-void SWseg<Type_Key,Type_Ts>::insert_buffer(int insertionPos, Type_Key & newKey, Type_Ts & newTimeStamp, Type_Ts & lowerLimit,
+template <class Type_Key, class Type_Ts, class Type_Payload>
+void SWseg<Type_Key,Type_Ts,Type_Payload>::insert_buffer(int insertionPos, Type_Key & newKey, Type_Ts & newTimeStamp, const Type_Payload & newPayload, Type_Ts & lowerLimit,
                                             vector<pair<Type_Key,int >> & updateSeg)
 {
     
@@ -1337,6 +2031,8 @@ void SWseg<Type_Key,Type_Ts>::insert_buffer(int insertionPos, Type_Key & newKey,
     {
         binary_search_lower_bound_buffer(newKey, insertionPos);
     }
+
+    m_numBufferInsert++;
     
     //If buffer is not empty
     if (m_numPairBuffer && insertionPos != m_numPairBuffer)
@@ -1359,14 +2055,42 @@ void SWseg<Type_Key,Type_Ts>::insert_buffer(int insertionPos, Type_Key & newKey,
             if (insertionPos && !index_exists_buffer(insertionPos-1, lowerLimit))
             {
                 //Directly replace keys with insertion key
-                m_buffer[insertionPos-1].first = newKey;
-                m_buffer[insertionPos-1].second = newTimeStamp;
+                m_bufferKeys[insertionPos-1] = newKey;
+                m_bufferTs[insertionPos-1] = newTimeStamp;
+                m_bufferPayloads[insertionPos-1] = newPayload;
 
             }
-            else //Shift Buffer
+            else
             {
-                m_buffer.insert(m_buffer.begin()+insertionPos, make_pair(newKey,newTimeStamp));
-                m_numPairBuffer++;
+                //Shift towards the nearest gap, only grow the buffer if the end is closer
+                int gapPos = find_gap_buffer(insertionPos, m_numPairBuffer-insertionPos, lowerLimit);
+
+                if (gapPos == -1)
+                {
+                    reserve_buffer(m_numPairBuffer+1);
+                    m_bufferKeys.insert(m_bufferKeys.begin()+insertionPos, newKey);
+                    m_bufferTs.insert(m_bufferTs.begin()+insertionPos, newTimeStamp);
+                    insert_at(m_bufferPayloads, insertionPos, newPayload);
+                    m_numPairBuffer++;
+                }
+                else if (gapPos < insertionPos)
+                {
+                    move(m_bufferKeys.begin()+gapPos+1, m_bufferKeys.begin()+insertionPos, m_bufferKeys.begin()+gapPos);
+                    move(m_bufferTs.begin()+gapPos+1, m_bufferTs.begin()+insertionPos, m_bufferTs.begin()+gapPos);
+                    shift_left(m_bufferPayloads, gapPos+1, insertionPos);
+                    m_bufferKeys[insertionPos-1] = newKey;
+                    m_bufferTs[insertionPos-1] = newTimeStamp;
+                    m_bufferPayloads[insertionPos-1] = newPayload;
+                }
+                else
+                {
+                    move_backward(m_bufferKeys.begin()+insertionPos, m_bufferKeys.begin()+gapPos, m_bufferKeys.begin()+gapPos+1);
+                    move_backward(m_bufferTs.begin()+insertionPos, m_bufferTs.begin()+gapPos, m_bufferTs.begin()+gapPos+1);
+                    shift_right(m_bufferPayloads, insertionPos, gapPos);
+                    m_bufferKeys[insertionPos] = newKey;
+                    m_bufferTs[insertionPos] = newTimeStamp;
+                    m_bufferPayloads[insertionPos] = newPayload;
+                }
             }
         }
         //Gap in buffer
@@ -1375,21 +2099,22 @@ void SWseg<Type_Key,Type_Ts>::insert_buffer(int insertionPos, Type_Key & newKey,
             #if defined DEBUG 
             cout << "[Debug Info:] Buffer insertion - insertionPos is a gap" << endl;
             cout << "[Debug Info:] InsertionPos = " << insertionPos  << endl;
-            // cout << "[Debug Info:] key at bufferPos = " << m_buffer[insertionPos].first << endl;
+            // cout << "[Debug Info:] key at bufferPos = " << m_bufferKeys[insertionPos] << endl;
             cout << endl;
             #elif defined DEBUG_KEY
             if(DEBUG_KEY == newKey)
             {
                 cout << "[Debug Info:] Buffer insertion - insertionPos is a gap" << endl;
                 cout << "[Debug Info:] InsertionPos = " << insertionPos  << endl;
-                // cout << "[Debug Info:] key at bufferPos = " << m_buffer[insertionPos].first << endl;
+                // cout << "[Debug Info:] key at bufferPos = " << m_bufferKeys[insertionPos] << endl;
                 cout << endl;
             }
             #endif
             
             //Directly replace keys with insertion key
-            m_buffer[insertionPos].first = newKey;
-            m_buffer[insertionPos].second = newTimeStamp;
+            m_bufferKeys[insertionPos] = newKey;
+            m_bufferTs[insertionPos] = newTimeStamp;
+            m_bufferPayloads[insertionPos] = newPayload;
         }
     }
     else
@@ -1405,11 +2130,14 @@ void SWseg<Type_Key,Type_Ts>::insert_buffer(int insertionPos, Type_Key & newKey,
         }
         #endif
           
-        m_buffer.push_back(make_pair(newKey,newTimeStamp));
+        reserve_buffer(m_numPairBuffer+1);
+        m_bufferKeys.push_back(newKey);
+        m_bufferTs.push_back(newTimeStamp);
+        m_bufferPayloads.push_back(newPayload);
         m_numPairBuffer++;
     }
 
-    if (m_numPairBuffer >= MAX_BUFFER_SIZE-1)
+    if (m_numPairBuffer >= max_buffer_size()-1)
     {
         updateSeg.push_back(make_pair(m_currentNodeStartKey, m_parentIndex*10+1));
 
@@ -1423,8 +2151,63 @@ void SWseg<Type_Key,Type_Ts>::insert_buffer(int insertionPos, Type_Key & newKey,
 Util Functions
 */
 
-template<class Type_Key, class Type_Ts>
-inline void SWseg<Type_Key,Type_Ts>::find_predict_pos_bound(Type_Key & targetKey, int & predictPos, int & predictPosMin, int & predictPosMax)
+//Used by SWmeta batch search, prefetch the predicted slot of m_localKeys and the middle of m_bufferKeys
+template<class Type_Key, class Type_Ts, class Type_Payload>
+inline void SWseg<Type_Key,Type_Ts,Type_Payload>::prefetch_search(Type_Key & targetKey) const
+{
+    if (m_numPair)
+    {
+        int predictPos = predict_pos(targetKey);
+        predictPos = predictPos < 0 ? 0 : predictPos;
+        predictPos = predictPos > m_numPair-1 ? m_numPair-1 : predictPos;
+        _mm_prefetch(element_address(m_localKeys, predictPos), _MM_HINT_T0);
+    }
+
+    if (m_numPairBuffer)
+    {
+        _mm_prefetch(reinterpret_cast<const char*>(&m_bufferKeys[m_numPairBuffer >> 1]), _MM_HINT_T0);
+    }
+}
+
+#ifdef INLINE_SEG_MODEL
+template<class Type_Key, class Type_Ts, class Type_Payload>
+inline void SWseg<Type_Key,Type_Ts,Type_Payload>::copy_model(SWsegModel<Type_Key> & model) const
+{
+    model.startKey = m_startKey;
+    model.slope = m_slope;
+    model.localKeys = element_address(m_localKeys, 0);
+    #ifdef COMPRESSED_SEG
+    model.keyWidth = m_localKeys.width();
+    #endif
+    model.numPair = m_numPair;
+    #ifdef TWO_PIECE_SEG
+    model.breakPos = m_breakPos;
+    model.breakKey = m_breakKey;
+    model.breakSlope = m_breakSlope;
+    #endif
+}
+#endif
+
+//Keys before m_breakKey are capped at m_breakPos, so a two-piece model stays monotone and the search bounds measured
+//by local_train and the insertions hold for every key
+template<class Type_Key, class Type_Ts, class Type_Payload>
+inline int SWseg<Type_Key,Type_Ts,Type_Payload>::predict_pos(const Type_Key & targetKey) const
+{
+    int predictPos = static_cast<int>(floor(m_slope * ((double)targetKey - (double)m_startKey)));
+
+    #ifdef TWO_PIECE_SEG
+    if (m_breakPos)
+    {
+        predictPos = (targetKey < m_breakKey) ? min(predictPos, m_breakPos) 
+                                              : m_breakPos + static_cast<int>(floor(m_breakSlope * ((double)targetKey - (double)m_breakKey)));
+    }
+    #endif
+
+    return predictPos;
+}
+
+template<class Type_Key, class Type_Ts, class Type_Payload>
+inline void SWseg<Type_Key,Type_Ts,Type_Payload>::find_predict_pos_bound(Type_Key & targetKey, int & predictPos, int & predictPosMin, int & predictPosMax)
 {
     #ifdef TUNE_TIME
     segNoPredict++;
@@ -1432,7 +2215,7 @@ inline void SWseg<Type_Key,Type_Ts>::find_predict_pos_bound(Type_Key & targetKey
     startTimer(&temp);
     #endif
 
-    predictPos = static_cast<int>(floor(m_slope * ((double)targetKey - (double)m_startKey)));
+    predictPos = predict_pos(targetKey);
     predictPosMin = predictPos - m_leftSearchBound;
     predictPosMin = predictPosMin < 0 ? 0 : predictPosMin;
 
@@ -1445,8 +2228,119 @@ inline void SWseg<Type_Key,Type_Ts>::find_predict_pos_bound(Type_Key & targetKey
     #endif 
 }
 
-template<class Type_Key, class Type_Ts>
-inline void SWseg<Type_Key,Type_Ts>::exponential_search_model_right(Type_Key & targetKey, int & foundPos, int maxSearchBound)
+//Search of the SWseg's current search bound (m_leftSearchBound + m_rightSearchBound), bounds only grow with insertions
+template<class Type_Key, class Type_Ts, class Type_Payload>
+inline SWsearch SWseg<Type_Key,Type_Ts,Type_Payload>::search_policy() const
+{
+    int searchBound = m_leftSearchBound + m_rightSearchBound;
+    return (searchBound <= SEARCH_LINEAR_MAX) ? SEARCH_LINEAR 
+            : (searchBound <= SEARCH_BINARY_MAX) ? SEARCH_BINARY : SEARCH_EXPONENTIAL;
+}
+
+template<class Type_Key, class Type_Ts, class Type_Payload>
+inline void SWseg<Type_Key,Type_Ts,Type_Payload>::search_model_right(Type_Key & targetKey, int & foundPos, int maxSearchBound)
+{
+    switch (search_policy())
+    {
+        case SEARCH_LINEAR:
+            policy_search_model_right<SEARCH_LINEAR>(targetKey, foundPos, maxSearchBound);
+            break;
+        case SEARCH_BINARY:
+            policy_search_model_right<SEARCH_BINARY>(targetKey, foundPos, maxSearchBound);
+            break;
+        default:
+            policy_search_model_right<SEARCH_EXPONENTIAL>(targetKey, foundPos, maxSearchBound);
+    }
+}
+
+template<class Type_Key, class Type_Ts, class Type_Payload>
+inline void SWseg<Type_Key,Type_Ts,Type_Payload>::search_model_left(Type_Key & targetKey, int & foundPos, int maxSearchBound)
+{
+    switch (search_policy())
+    {
+        case SEARCH_LINEAR:
+            policy_search_model_left<SEARCH_LINEAR>(targetKey, foundPos, maxSearchBound);
+            break;
+        case SEARCH_BINARY:
+            policy_search_model_left<SEARCH_BINARY>(targetKey, foundPos, maxSearchBound);
+            break;
+        default:
+            policy_search_model_left<SEARCH_EXPONENTIAL>(targetKey, foundPos, maxSearchBound);
+    }
+}
+
+//Same result as exponential_search_model_right: lower bound of targetKey in [foundPos, foundPos + maxSearchBound),
+//moved one further if that key is smaller and not a gap
+template<class Type_Key, class Type_Ts, class Type_Payload>
+template<SWsearch policy>
+inline void SWseg<Type_Key,Type_Ts,Type_Payload>::policy_search_model_right(Type_Key & targetKey, int & foundPos, int maxSearchBound)
+{
+    if constexpr (policy == SEARCH_EXPONENTIAL)
+    {
+        exponential_search_model_right(targetKey, foundPos, maxSearchBound);
+    }
+    else
+    {
+        #ifdef TUNE
+        int predictPos = foundPos;
+        #endif
+
+        foundPos = search_lower_bound<policy>(m_localKeys, foundPos, foundPos + maxSearchBound, targetKey);
+
+        if (m_localKeys[foundPos] < targetKey && m_localTs[foundPos])
+        {
+            foundPos++;
+        }
+
+        #ifdef TUNE
+        if (m_tuneStage == tuneStage)
+        {
+            segNoExponentialSearch++;
+            segLengthExponentialSearch += foundPos - predictPos;
+        }
+        segNoExponentialSearchAll++;
+        segLengthExponentialSearchAll += foundPos - predictPos;
+        #endif
+    }
+}
+
+//Same result as exponential_search_model_left: lower bound of targetKey in [foundPos - maxSearchBound, foundPos),
+//moved one further if that key is smaller and not a gap
+template<class Type_Key, class Type_Ts, class Type_Payload>
+template<SWsearch policy>
+inline void SWseg<Type_Key,Type_Ts,Type_Payload>::policy_search_model_left(Type_Key & targetKey, int & foundPos, int maxSearchBound)
+{
+    if constexpr (policy == SEARCH_EXPONENTIAL)
+    {
+        exponential_search_model_left(targetKey, foundPos, maxSearchBound);
+    }
+    else
+    {
+        #ifdef TUNE
+        int predictPos = foundPos;
+        #endif
+
+        foundPos = search_lower_bound<policy>(m_localKeys, foundPos - maxSearchBound, foundPos, targetKey);
+
+        if (m_localKeys[foundPos] < targetKey && m_localTs[foundPos])
+        {
+            foundPos++;
+        }
+
+        #ifdef TUNE
+        if (m_tuneStage == tuneStage)
+        {
+            segNoExponentialSearch++;
+            segLengthExponentialSearch += predictPos-foundPos;
+        }
+        segNoExponentialSearchAll++;
+        segLengthExponentialSearchAll += predictPos-foundPos;
+        #endif
+    }
+}
+
+template<class Type_Key, class Type_Ts, class Type_Payload>
+inline void SWseg<Type_Key,Type_Ts,Type_Payload>::exponential_search_model_right(Type_Key & targetKey, int & foundPos, int maxSearchBound)
 {
     #ifdef TUNE
     int predictPos = foundPos;
@@ -1459,27 +2353,18 @@ inline void SWseg<Type_Key,Type_Ts>::exponential_search_model_right(Type_Key & t
     #endif
 
     int index = 1;
-    while (index <= maxSearchBound && m_localData[foundPos + index].first < targetKey)
+    while (index <= maxSearchBound && m_localKeys[foundPos + index] < targetKey)
     {
         index *= 2;
     }
     
-    auto startIt = m_localData.begin() + (foundPos + static_cast<int>(index/2));
-    auto endIt = m_localData.begin() + (foundPos + min(index,maxSearchBound));
-
-    auto lowerBoundIt = lower_bound(startIt,endIt,targetKey,
-                        [](const pair<Type_Key,Type_Ts>& data, Type_Key value)
-                        {
-                            return data.first < value;
-                        });
+    foundPos = search_lower_bound<SEARCH_EXPONENTIAL>(m_localKeys, foundPos + static_cast<int>(index/2), foundPos + min(index,maxSearchBound), targetKey);
     
-    if (lowerBoundIt->first < targetKey && lowerBoundIt->second)
+    if (m_localKeys[foundPos] < targetKey && m_localTs[foundPos])
     {
-        lowerBoundIt++;
+        foundPos++;
     }
 
-    foundPos = lowerBoundIt - m_localData.begin();
-
     #ifdef TUNE
     if (m_tuneStage == tuneStage)
     {
@@ -1506,8 +2391,8 @@ inline void SWseg<Type_Key,Type_Ts>::exponential_search_model_right(Type_Key & t
     #endif
 }
 
-template<class Type_Key, class Type_Ts>
-inline void SWseg<Type_Key,Type_Ts>::exponential_search_model_left(Type_Key & targetKey, int & foundPos, int maxSearchBound)
+template<class Type_Key, class Type_Ts, class Type_Payload>
+inline void SWseg<Type_Key,Type_Ts,Type_Payload>::exponential_search_model_left(Type_Key & targetKey, int & foundPos, int maxSearchBound)
 {
     #ifdef TUNE
     int predictPos = foundPos;
@@ -1520,27 +2405,18 @@ inline void SWseg<Type_Key,Type_Ts>::exponential_search_model_left(Type_Key & ta
     #endif
 
     int index = 1;
-    while (index <= maxSearchBound && m_localData[foundPos - index].first >= targetKey)
+    while (index <= maxSearchBound && m_localKeys[foundPos - index] >= targetKey)
     {
         index *= 2;
     }
     
-    auto startIt = m_localData.begin() + (foundPos - min(index,maxSearchBound));
-    auto endIt = m_localData.begin() + (foundPos - static_cast<int>(index/2));
-
-    auto lowerBoundIt = lower_bound(startIt,endIt,targetKey,
-                        [](const pair<Type_Key,Type_Ts>& data, Type_Key value)
-                        {
-                            return data.first < value;
-                        });
+    foundPos = search_lower_bound<SEARCH_EXPONENTIAL>(m_localKeys, foundPos - min(index,maxSearchBound), foundPos - static_cast<int>(index/2), targetKey);
     
-    if (lowerBoundIt->first < targetKey && lowerBoundIt->second)
+    if (m_localKeys[foundPos] < targetKey && m_localTs[foundPos])
     {
-        lowerBoundIt++;
+        foundPos++;
     }
 
-    foundPos = lowerBoundIt - m_localData.begin();
-
     #ifdef TUNE
     if (m_tuneStage == tuneStage)
     {
@@ -1568,8 +2444,8 @@ inline void SWseg<Type_Key,Type_Ts>::exponential_search_model_left(Type_Key & ta
 }
 
 
-template<class Type_Key, class Type_Ts>
-inline void SWseg<Type_Key,Type_Ts>::binary_search_lower_bound_buffer(Type_Key & targetKey, int & foundPos)
+template<class Type_Key, class Type_Ts, class Type_Payload>
+inline void SWseg<Type_Key,Type_Ts,Type_Payload>::binary_search_lower_bound_buffer(Type_Key & targetKey, int & foundPos)
 {
     #ifdef TUNE_TIME
     bufferNoSearch++;   
@@ -1578,13 +2454,7 @@ inline void SWseg<Type_Key,Type_Ts>::binary_search_lower_bound_buffer(Type_Key &
     startTimer(&temp);
     #endif
 
-    auto lowerBoundIt = lower_bound(m_buffer.begin(),m_buffer.end(),targetKey,
-                        [](const pair<Type_Key,Type_Ts>& data, Type_Key value)
-                        {
-                            return data.first < value;
-                        });
-
-    foundPos = lowerBoundIt - m_buffer.begin();
+    foundPos = lower_bound(m_bufferKeys.begin(),m_bufferKeys.end(),targetKey) - m_bufferKeys.begin();
 
     #ifdef TUNE_TIME
     stopTimer(&temp);
@@ -1596,14 +2466,14 @@ inline void SWseg<Type_Key,Type_Ts>::binary_search_lower_bound_buffer(Type_Key &
     #endif
 }
 
-template <class Type_Key, class Type_Ts>
-inline bool SWseg<Type_Key,Type_Ts>::index_exists_model(int index, Type_Ts lowerLimit)
+template <class Type_Key, class Type_Ts, class Type_Payload>
+inline bool SWseg<Type_Key,Type_Ts,Type_Payload>::index_exists_model(int index, Type_Ts lowerLimit)
 {   
-    if(m_localData[index].second)
+    if(m_localTs[index])
     {
-        if (m_localData[index].second < lowerLimit)
+        if (m_localTs[index] < lowerLimit)
         {
-            m_localData[index].second = 0 ;
+            m_localTs[index] = 0 ;
             m_numPairExist--;
             return false;
         }
@@ -1612,14 +2482,14 @@ inline bool SWseg<Type_Key,Type_Ts>::index_exists_model(int index, Type_Ts lower
     return false;
 }
 
-template <class Type_Key, class Type_Ts>
-inline bool SWseg<Type_Key,Type_Ts>::index_exists_buffer(int index, Type_Ts lowerLimit)
+template <class Type_Key, class Type_Ts, class Type_Payload>
+inline bool SWseg<Type_Key,Type_Ts,Type_Payload>::index_exists_buffer(int index, Type_Ts lowerLimit)
 {   
-    if(m_buffer[index].second)
+    if(m_bufferTs[index])
     {
-        if(m_buffer[index].second < lowerLimit)
+        if(m_bufferTs[index] < lowerLimit)
         {
-            m_buffer[index].second = 0;
+            m_bufferTs[index] = 0;
             return false;
         }
         return true;
@@ -1627,18 +2497,55 @@ inline bool SWseg<Type_Key,Type_Ts>::index_exists_buffer(int index, Type_Ts lowe
     return false;
 }
 
-template <class Type_Key, class Type_Ts>
-inline void SWseg<Type_Key,Type_Ts>::print()
+//Buffer is allocated by the first buffered insert (m_bufferHint), then doubles up to max_buffer_size()
+template <class Type_Key, class Type_Ts, class Type_Payload>
+inline void SWseg<Type_Key,Type_Ts,Type_Payload>::reserve_buffer(int numPairBuffer)
+{
+    int capacity = m_bufferKeys.capacity();
+    if (numPairBuffer <= capacity)
+    {
+        return;
+    }
+
+    int newCapacity = capacity ? min(capacity*2, max_buffer_size()) : m_bufferHint;
+    newCapacity = max(newCapacity, numPairBuffer);
+
+    m_bufferKeys.reserve(newCapacity);
+    m_bufferTs.reserve(newCapacity);
+    m_bufferPayloads.reserve(newCapacity);
+}
+
+//Nearest gap on either side of insertionPos (insertionPos-1 and insertionPos are not gaps), -1 if none within maxDistance
+template <class Type_Key, class Type_Ts, class Type_Payload>
+inline int SWseg<Type_Key,Type_Ts,Type_Payload>::find_gap_buffer(int insertionPos, int maxDistance, Type_Ts & lowerLimit)
+{
+    for (int distance = 1; distance < maxDistance; distance++)
+    {
+        if (insertionPos+distance < m_numPairBuffer && !index_exists_buffer(insertionPos+distance, lowerLimit))
+        {
+            return insertionPos+distance;
+        }
+
+        if (insertionPos-1-distance >= 0 && !index_exists_buffer(insertionPos-1-distance, lowerLimit))
+        {
+            return insertionPos-1-distance;
+        }
+    }
+    return -1;
+}
+
+template <class Type_Key, class Type_Ts, class Type_Payload>
+inline void SWseg<Type_Key,Type_Ts,Type_Payload>::print()
 {
     cout << "start key:" << m_currentNodeStartKey << ", slope:" << m_slope << endl;
     if (m_numPair)
     {
         cout << "data:" << endl;
-        cout << m_localData[0].first << "(" << m_localData[0].second << ")";
+        cout << m_localKeys[0] << "(" << m_localTs[0] << ")";
         for (int i = 1; i < m_numPair; i++)
         {
             cout << ",";
-            cout << m_localData[i].first << "(" << m_localData[i].second << ")";
+            cout << m_localKeys[i] << "(" << m_localTs[i] << ")";
         }
         cout << endl;
     }
@@ -1646,32 +2553,53 @@ inline void SWseg<Type_Key,Type_Ts>::print()
     if (m_numPairBuffer)
     {
         cout << "buffer:" << endl;
-        cout << m_buffer[0].first << "(" << m_buffer[0].second << ")";
+        cout << m_bufferKeys[0] << "(" << m_bufferTs[0] << ")";
         for (int i = 1; i < m_numPairBuffer; i++)
         {
             cout << ",";
-            cout << m_buffer[i].first << "(" << m_buffer[i].second << ")";
+            cout << m_bufferKeys[i] << "(" << m_bufferTs[i] << ")";
         }
         cout << endl;
     }
 }
 
-template <class Type_Key, class Type_Ts>
-inline uint64_t SWseg<Type_Key,Type_Ts>::get_total_size_in_bytes()
+template <class Type_Key, class Type_Ts, class Type_Payload>
+inline uint64_t SWseg<Type_Key,Type_Ts,Type_Payload>::get_total_size_in_bytes()
 {
-    return sizeof(int)*8 + sizeof(Type_Ts) + sizeof(double) + sizeof(Type_Key)*2 + sizeof(vector<pair<Type_Key,Type_Ts>>)*2 +
-    sizeof(pair<Type_Key,Type_Ts>)*(m_numPairBuffer + m_numPair) + sizeof(SWseg<Type_Key,Type_Ts>*)*2;
+    #ifdef STATIC_PARAMS
+    int numIntMembers = 11;
+    #else
+    int numIntMembers = 12;
+    #endif
+    #ifdef INCREMENTAL_META_RETRAIN
+    numIntMembers++;
+    #endif
+
+    int numPtrMembers = 2;
+    #ifdef BACKGROUND_RETRAIN
+    numPtrMembers++;
+    #endif
+
+    uint64_t modelBytes = sizeof(double);
+    #ifdef TWO_PIECE_SEG
+    modelBytes += sizeof(int) + sizeof(Type_Key) + sizeof(double);
+    #endif
+
+    //Buffers are allocated on demand, count their capacity
+    return sizeof(int)*numIntMembers + sizeof(Type_Ts)*2 + modelBytes + sizeof(Type_Key)*2 + sizeof(m_bufferKeys) + sizeof(m_bufferTs) + sizeof(m_localKeys) + sizeof(m_localTs) +
+    sizeof(Type_Key)*m_bufferKeys.capacity() + sizeof(Type_Ts)*m_bufferTs.capacity() + array_size_in_bytes(m_localKeys, m_numPair) + array_size_in_bytes(m_localTs, m_numPair) + sizeof(SWseg<Type_Key,Type_Ts,Type_Payload>*)*numPtrMembers +
+    column_size_in_bytes(m_bufferPayloads) + column_size_in_bytes(m_localPayloads);
 }
 
-template <class Type_Key, class Type_Ts>
-inline uint64_t SWseg<Type_Key,Type_Ts>::get_no_keys(Type_Ts lowerLimit)
+template <class Type_Key, class Type_Ts, class Type_Payload>
+inline uint64_t SWseg<Type_Key,Type_Ts,Type_Payload>::get_no_keys(Type_Ts lowerLimit)
 {
     uint64_t cnt = 0;
     if (m_numPair)
     {
-        for (int i = 0; i < m_localData.size(); ++i)
+        for (int i = 0; i < m_localTs.size(); ++i)
         {
-            if (m_localData[i].second >= lowerLimit)
+            if (m_localTs[i] >= lowerLimit)
             {
                 ++cnt;
             }
@@ -1680,9 +2608,9 @@ inline uint64_t SWseg<Type_Key,Type_Ts>::get_no_keys(Type_Ts lowerLimit)
 
     if (m_numPairBuffer)
     {
-        for (int i = 0; i < m_buffer.size(); ++i)
+        for (int i = 0; i < m_bufferTs.size(); ++i)
         {
-            if (m_buffer[i].second >= lowerLimit)
+            if (m_bufferTs[i] >= lowerLimit)
             {
                 ++cnt;
             }
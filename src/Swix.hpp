@@ -4,11 +4,19 @@
 #pragma once
 #include "SWseg.hpp"
 
+#ifdef BACKGROUND_RETRAIN
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#endif
+
 using namespace std;
 
 namespace swix {
 
-template<class Type_Key, class Type_Ts>
+template<class Type_Key, class Type_Ts, class Type_Payload>
 class SWmeta
 {
 private:
@@ -25,49 +33,184 @@ private:
     vector<uint64_t> m_bitmap;
     vector<uint64_t> m_retrainBitmap;
     vector<Type_Key> m_keys;
-    vector<SWseg<Type_Key,Type_Ts>*> m_ptr;
+    vector<SWseg<Type_Key,Type_Ts,Type_Payload>*> m_ptr;
+
+    //Summary of m_bitmap, one bit per m_bitmap word (words past the end of the summary are empty)
+    vector<uint64_t> m_bitmapSummary; //word has a non-gap
+    vector<uint64_t> m_bitmapFullSummary; //word has no gap
+
+    #ifdef INLINE_SEG_MODEL
+    //Model of the SWseg in each slot, refreshed whenever the SWseg is used (may be stale or shorter than m_keys)
+    vector<SWsegModel<Type_Key>> m_segModel;
+    #endif
+
+    //Expiry queue: (max timestamp when queued, slot), a slot holds its SWseg until the SWseg is freed
+    priority_queue<pair<Type_Ts,int>, vector<pair<Type_Ts,int>>, greater<pair<Type_Ts,int>>> m_expiryQueue;
+    vector<SWseg<Type_Key,Type_Ts,Type_Payload>*> m_expirySlots;
+    vector<int> m_expiryFreeSlots;
+
+    #ifdef SEG_POOL
+    SWpool m_pool;
+    #endif
+
+    #ifdef INCREMENTAL_META_RETRAIN
+    //SWmeta arrays under construction, built META_REBUILD_STEP slots per insert while the arrays above serve
+    int m_rebuildStage = 0; // 0 idle, 1 fitting the model, 2 placing SWseg, -1 next rebuild runs at once
+    int m_rebuildCursor = 0; // next slot of m_keys to visit
+    int m_rebuildCnt;
+    int m_rebuildNumPairExist;
+    int m_rebuildRightSearchBound;
+    double m_rebuildSlope;
+    double m_rebuildSum[4]; // key, index, key*index, key^2
+    Type_Key m_rebuildStartKey;
+    Type_Key m_rebuildMaxKey; // largest key when stage 2 started, larger SWseg go to m_rebuildPending like keys appended after a rebuild
+    bool m_rebuildVisited; // stage 2 visited an SWseg
+    Type_Key m_rebuildLastKey; // key of the last SWseg visited in stage 2, SWseg inserted at or below it go to m_rebuildPending
+    bool m_rebuildRelocate; // SWmeta insertions may have shifted slots around m_rebuildCursor
+    vector<Type_Key> m_rebuildKeys;
+    vector<SWseg<Type_Key,Type_Ts,Type_Payload>*> m_rebuildPtr;
+    vector<uint64_t> m_rebuildBitmap;
+    vector<pair<Type_Key, SWseg<Type_Key,Type_Ts,Type_Payload>*>> m_rebuildPending;
+    #endif
+
+    #ifdef BACKGROUND_RETRAIN
+    //SWseg retraining thread, requests and finished retrains are exchanged under m_retrainMutex
+    thread m_retrainThread;
+    mutex m_retrainMutex;
+    condition_variable m_retrainCv; // new request or stop (background thread waits)
+    condition_variable m_retrainDoneCv; // finished retrain (wait_retrain waits)
+    deque<SWretrainTask<Type_Key,Type_Ts,Type_Payload>*> m_retrainRequests;
+    vector<SWretrainTask<Type_Key,Type_Ts,Type_Payload>*> m_retrainDone;
+    atomic<int> m_retrainNumDone{0}; // size of m_retrainDone, polled by inserts without locking
+    bool m_retrainStop = false;
+    int m_retrainNumPending = 0; // requested and not published yet
+    bool m_retrainPublishing = false; // replaying a delta log, nested inserts do not publish
+    #endif
+
+    #ifndef STATIC_PARAMS
+    SWparams m_params;
+    #endif
 
 public:
     //Constructors & Deconstructors
-    SWmeta(pair<Type_Key, Type_Ts> & arrivalTuple);
-    SWmeta(const vector<pair<Type_Key, Type_Ts>> & stream);
+    SWmeta(pair<Type_Key, Type_Ts> & arrivalTuple, const SWparams & params = SWparams());
+    SWmeta(pair<Type_Key, Type_Ts> & arrivalTuple, const Type_Payload & payload, const SWparams & params = SWparams());
+    SWmeta(const vector<pair<Type_Key, Type_Ts>> & stream, const SWparams & params = SWparams());
+    SWmeta(const vector<pair<Type_Key, Type_Ts>> & stream, const vector<Type_Payload> & payloads, const SWparams & params = SWparams());
     ~SWmeta();
 
 public:
     //Initial Bulk Load
-    void bulk_load(const vector<pair<Type_Key, Type_Ts>> & stream);
+    void bulk_load(const vector<pair<Type_Key, Type_Ts>> & stream, const vector<Type_Payload> & payloads);
     
 private:
     //Bulk load helpers & retraining SWseg
-    void split_data_slope(vector<pair<Type_Key,Type_Ts>> & data, vector<pair<Type_Key, SWseg<Type_Key,Type_Ts> * >> & splitedDataPtr);
-    void retrain_seg(pair<int,int> SWsegIndexes, Type_Ts & lowerLimit, vector<pair<Type_Key, SWseg<Type_Key,Type_Ts> * >> & splitedDataPtr);
+    void split_data_slope(vector<pair<Type_Key,Type_Ts>> & data, SWpayloadColumn<Type_Payload> & payloads, vector<pair<Type_Key, SWseg<Type_Key,Type_Ts,Type_Payload> * >> & splitedDataPtr);
+    void retrain_seg(pair<int,int> SWsegIndexes, Type_Ts & lowerLimit, vector<pair<Type_Key, SWseg<Type_Key,Type_Ts,Type_Payload> * >> & splitedDataPtr);
+    void build_seg(vector<pair<Type_Key,Type_Ts>> & data, SWpayloadColumn<Type_Payload> & payloads, int segSplitError, int numBufferInsert, bool pooled, 
+                    vector<pair<Type_Key, SWseg<Type_Key,Type_Ts,Type_Payload> * >> & splitedDataPtr);
 
 public:
     //Operations
     void lookup(pair<Type_Key, Type_Ts> & arrivalTuple, Type_Key & resultCount);
-    void range_search(tuple<Type_Key, Type_Ts, Type_Key> & arrivalTuple, vector<pair<Type_Key, Type_Ts>> & rangeSearchResult);
+    template<class Type_Result> //vector<pair<Type_Key,Type_Ts>> or SWaggregate<Type_Key>
+    void range_search(tuple<Type_Key, Type_Ts, Type_Key> & arrivalTuple, Type_Result & rangeSearchResult);
+    SWaggregate<Type_Key> range_aggregate(tuple<Type_Key, Type_Ts, Type_Key> & arrivalTuple);
     void range_search_ordered_data(tuple<Type_Key, Type_Ts, Type_Key> & arrivalTuple, vector<pair<Type_Key, Type_Ts>> & rangeSearchResult);
-    void insert(pair<Type_Key, Type_Ts> & arrivalTuple);
+
+    template<class Visitor>
+    uint64_t range_for_each(Type_Key lowerBound, Type_Key upperBound, Type_Ts timeStamp, Visitor visitor, uint64_t limit = numeric_limits<uint64_t>::max());
+    void insert(pair<Type_Key, Type_Ts> & arrivalTuple, const Type_Payload & payload = Type_Payload());
+    void insert_batch(vector<pair<Type_Key, Type_Ts>> & batch);
+    void insert_batch(vector<pair<Type_Key, Type_Ts>> & batch, vector<Type_Payload> & payloads);
+
+    //Batched Operations (interleaved in groups of BATCH_GROUP_SIZE)
+    void lookup_batch(vector<pair<Type_Key, Type_Ts>> & arrivalTuples, vector<Type_Key> & resultCounts);
+    void range_search_batch(vector<tuple<Type_Key, Type_Ts, Type_Key>> & arrivalTuples, vector<vector<pair<Type_Key, Type_Ts>>> & rangeSearchResults);
+
+    //Eager expiry
+    uint64_t expire_until(Type_Ts lowerLimit);
+
+    #ifdef BACKGROUND_RETRAIN
+    //Blocks until every requested SWseg retrain is published
+    void wait_retrain();
+    #endif
 
 private:
     //Operation Helpers
-    void meta_insertion(pair<Type_Key, SWseg<Type_Key,Type_Ts>*> & insertKeyPtr, int & retrainExtendFlag, bool retrainSetBit);
-    void meta_insertion_model(int & insertionPos, pair<Type_Key, SWseg<Type_Key,Type_Ts>*> & insertKeyPtr, bool & gapAddError, int & retrainExtendFlag, bool & retrainSetBit);
-    void meta_insertion_end(pair<Type_Key, SWseg<Type_Key,Type_Ts>*> & insertKeyPtr, int & retrainExtendFlag, bool & retrainSetBit);
-    void meta_insertion_append(int & insertionPos, pair<Type_Key, SWseg<Type_Key,Type_Ts>*> & insertKeyPtr, int & retrainExtendFlag, bool & retrainSetBit);
+    void meta_insertion(pair<Type_Key, SWseg<Type_Key,Type_Ts,Type_Payload>*> & insertKeyPtr, int & retrainExtendFlag, bool retrainSetBit);
+    void meta_insertion_model(int & insertionPos, pair<Type_Key, SWseg<Type_Key,Type_Ts,Type_Payload>*> & insertKeyPtr, bool & gapAddError, int & retrainExtendFlag, bool & retrainSetBit);
+    void meta_insertion_end(pair<Type_Key, SWseg<Type_Key,Type_Ts,Type_Payload>*> & insertKeyPtr, int & retrainExtendFlag, bool & retrainSetBit);
+    void meta_insertion_append(int & insertionPos, pair<Type_Key, SWseg<Type_Key,Type_Ts,Type_Payload>*> & insertKeyPtr, int & retrainExtendFlag, bool & retrainSetBit);
 
     void meta_extend_retrain(int & retrainExtendFlag, Type_Ts & lowerLimit);
 
+    #ifdef INCREMENTAL_META_RETRAIN
+    //Incremental SWmeta rebuild
+    bool meta_rebuild_start(int & retrainExtendFlag, Type_Ts & lowerLimit);
+    void meta_rebuild_step(Type_Ts & lowerLimit, int maxSlots);
+    void meta_rebuild_swap(Type_Ts & lowerLimit);
+    void meta_rebuild_erase(SWseg<Type_Key,Type_Ts,Type_Payload> * segPtr);
+    void meta_rebuild_insert(pair<Type_Key, SWseg<Type_Key,Type_Ts,Type_Payload>*> & insertKeyPtr);
+    #endif
+
+    bool find_insert_seg(Type_Key & newKey, int & foundPos);
+    void update_seg_retrain(pair<int,int> retrainSegmentIndex, Type_Ts & lowerLimit, int & retrainExtendFlag);
+    void update_seg_swap(pair<int,int> retrainSegmentIndex, vector<pair<Type_Key, SWseg<Type_Key,Type_Ts,Type_Payload> * >> & newSegs, int & retrainExtendFlag);
+    void update_seg_replace(Type_Key newStartKey, int index, int & retrainExtendFlag);
+    void update_seg_delete(int index);
+    void insert_batch_retrain(vector<pair<SWseg<Type_Key,Type_Ts,Type_Payload>*,int>> & pendingRetrain, Type_Ts & lowerLimit, int & retrainExtendFlag);
+
+    bool find_search_seg(Type_Key & newKey, Type_Key & upperBound, int & foundPos);
+
+    #ifdef INLINE_SEG_MODEL
+    void seg_model_prefetch(int index, Type_Key targetKey);
+    void seg_model_refresh(int index);
+    #endif
+
+    //SWseg allocation (from m_pool with SEG_POOL)
+    template<class... Args>
+    SWseg<Type_Key,Type_Ts,Type_Payload> * new_seg(Args &&... args);
+
+    //Expiry queue helpers
+    void expiry_register(SWseg<Type_Key,Type_Ts,Type_Payload> * segPtr);
+    void release_seg(SWseg<Type_Key,Type_Ts,Type_Payload> * segPtr);
+    void expiry_rebuild();
+    uint64_t expire_step(Type_Ts & lowerLimit, int maxSteps);
+
+    #ifdef BACKGROUND_RETRAIN
+    //Background SWseg retraining
+    void retrain_request(pair<int,int> retrainSegmentIndex, Type_Ts & lowerLimit);
+    void retrain_worker();
+    void retrain_publish();
+    void retrain_cancel(SWretrainTask<Type_Key,Type_Ts,Type_Payload> * task);
+    void retrain_stop();
+    #endif
+
+    void range_search_update(Type_Key & newKey, Type_Ts & lowerLimit, vector<pair<Type_Key,int >> & updateSeg);
+    void locate_batch(Type_Key * targetKeys, Type_Key * upperBounds, int groupSize, SWseg<Type_Key,Type_Ts,Type_Payload> ** segs);
+
     void predict_search(Type_Key & targetKey, int & foundPos);
+    void predict_search_bound(Type_Key & targetKey, int predictPos, int predictPosMin, int predictPosMax, int & foundPos);
     void exponential_search(Type_Key & targetKey, int & foundPos);
     void exponential_search_insert(Type_Key & targetKey, int & foundPos);
 
     void find_predict_pos_bound(Type_Key & targetKey, int & predictPos, int & predictPosMin, int & predictPosMax);
+    void find_predict_pos_batch(Type_Key * targetKeys, int groupSize, int * predictPos);
+    void predict_pos_bound(int predictPos, int & predictPosMin, int & predictPosMax);
     void exponential_search_right(Type_Key & targetKey, int & foundPos, int maxSearchBound);
     void exponential_search_right_insert(Type_Key & targetKey, int & foundPos, int maxSearchBound);
     void exponential_search_left(Type_Key & targetKey, int & foundPos, int maxSearchBound);
     void exponential_search_left_insert(Type_Key & targetKey, int & foundPos, int maxSearchBound);
 
+    //Per-instance parameters (compile-time constants with STATIC_PARAMS)
+    inline uint64_t time_window() const;
+    inline int max_buffer_size() const;
+    inline int initial_error() const;
+    inline SWsplit bulk_load_split() const;
+    inline SWsplit retrain_split() const;
+    inline Type_Ts calculate_lower_limit(Type_Ts timestamp) const;
+
 public:
     //Getters & Setters
     size_t get_meta_size();
@@ -78,7 +221,10 @@ public:
     void print_all();
     void print_stats();
     uint64_t get_total_size_in_bytes();
+    uint64_t get_total_size_in_bytes(SWpoolStats & poolStats);
     uint64_t get_no_keys(Type_Ts Timestamp);
+    uint64_t get_time_window() {return time_window();}
+    uint64_t get_auto_tune_size();
 
     #ifdef TUNE_TIME
     int get_meta_error()
@@ -116,19 +262,31 @@ private:
     void bitmap_move_bit_back(vector<uint64_t> & bitmap, int startingIndex, int endingIndex);
     void bitmap_move_bit_front(int startingIndex, int endingIndex);
     void bitmap_move_bit_front(vector<uint64_t> & bitmap, int startingIndex, int endingIndex);
+    void bitmap_summary_update(int bitmapPos);
+    void bitmap_summary_update(int startBitmapPos, int endBitmapPos);
+    void bitmap_summary_rebuild();
+    int bitmap_summary_next(const vector<uint64_t> & summary, uint64_t flip, int bitmapPos) const;
+    int bitmap_summary_prev(const vector<uint64_t> & summary, uint64_t flip, int bitmapPos) const;
 
 };
 
-template<class Type_Key, class Type_Ts>
-SWmeta<Type_Key,Type_Ts>::SWmeta(pair<Type_Key, Type_Ts> & arrivalTuple)
+template<class Type_Key, class Type_Ts, class Type_Payload>
+SWmeta<Type_Key,Type_Ts,Type_Payload>::SWmeta(pair<Type_Key, Type_Ts> & arrivalTuple, const SWparams & params)
+:SWmeta(arrivalTuple, Type_Payload(), params) {}
+
+template<class Type_Key, class Type_Ts, class Type_Payload>
+SWmeta<Type_Key,Type_Ts,Type_Payload>::SWmeta(pair<Type_Key, Type_Ts> & arrivalTuple, const Type_Payload & payload, const SWparams & params)
 :m_rightSearchBound(0), m_leftSearchBound(0), m_numPairExist(0), m_slope(-1), m_maxSearchError(0), m_startKey(0)
+#ifndef STATIC_PARAMS
+, m_params(params)
+#endif
 {
     #ifdef DEBUG
     cout << "[Debug Info:] Class {SWmeta} :: Construct Function {SWmeta()}" << endl;
     cout << endl;
     #endif
 
-    SWseg<Type_Key,Type_Ts> * SWsegPtr = new SWseg<Type_Key,Type_Ts>(arrivalTuple);
+    SWseg<Type_Key,Type_Ts,Type_Payload> * SWsegPtr = new_seg(arrivalTuple, payload);
     SWsegPtr->m_leftSibling = nullptr;
     SWsegPtr->m_rightSibling = nullptr;
     SWsegPtr->m_parentIndex = 0;
@@ -141,13 +299,22 @@ SWmeta<Type_Key,Type_Ts>::SWmeta(pair<Type_Key, Type_Ts> & arrivalTuple)
     m_bitmap.push_back(0);
     m_retrainBitmap.push_back(0);
     bitmap_set_bit(0);
+    expiry_register(SWsegPtr);
 
-    splitError = INITIAL_ERROR;
+    splitError = initial_error();
 }
 
-template<class Type_Key, class Type_Ts>
-SWmeta<Type_Key,Type_Ts>::SWmeta(const vector<pair<Type_Key, Type_Ts>> & stream)
+template<class Type_Key, class Type_Ts, class Type_Payload>
+SWmeta<Type_Key,Type_Ts,Type_Payload>::SWmeta(const vector<pair<Type_Key, Type_Ts>> & stream, const SWparams & params)
+:SWmeta(stream, vector<Type_Payload>(), params) {}
+
+//payloads[i] is the payload of stream[i], an empty payloads gives every tuple Type_Payload()
+template<class Type_Key, class Type_Ts, class Type_Payload>
+SWmeta<Type_Key,Type_Ts,Type_Payload>::SWmeta(const vector<pair<Type_Key, Type_Ts>> & stream, const vector<Type_Payload> & payloads, const SWparams & params)
 :m_rightSearchBound(0), m_leftSearchBound(0), m_numPairExist(0), m_slope(0), m_maxSearchError(0)
+#ifndef STATIC_PARAMS
+, m_params(params)
+#endif
 {
     #ifdef DEBUG
     cout << "[Debug Info:] Class {SWmeta} :: Construct Function {SWmeta(stream)}" << endl;
@@ -155,20 +322,31 @@ SWmeta<Type_Key,Type_Ts>::SWmeta(const vector<pair<Type_Key, Type_Ts>> & stream)
     #endif
 
     // m_maxTs = arrivalTuple.second;
-    bulk_load(stream);
+    bulk_load(stream, payloads);
 
-    splitError = INITIAL_ERROR;
+    splitError = initial_error();
 }
 
-template<class Type_Key, class Type_Ts>
-SWmeta<Type_Key,Type_Ts>::~SWmeta()
+template<class Type_Key, class Type_Ts, class Type_Payload>
+SWmeta<Type_Key,Type_Ts,Type_Payload>::~SWmeta()
 {
+    #ifdef INCREMENTAL_META_RETRAIN
+    m_rebuildStage = 0;
+    #endif
+
+    #ifdef BACKGROUND_RETRAIN
+    retrain_stop();
+    #endif
+
     if (m_ptr.size())
     {
         for (auto & it: m_ptr)
         {
-            delete it;
-            it = nullptr;
+            if (it)
+            {
+                release_seg(it);
+                it = nullptr;
+            }
         }
     }
 }
@@ -176,21 +354,41 @@ SWmeta<Type_Key,Type_Ts>::~SWmeta()
 /*
 Bulk Load
 */
-template<class Type_Key, class Type_Ts>
-void SWmeta<Type_Key,Type_Ts>::bulk_load(const vector<pair<Type_Key, Type_Ts>> & stream)
+template<class Type_Key, class Type_Ts, class Type_Payload>
+void SWmeta<Type_Key,Type_Ts,Type_Payload>::bulk_load(const vector<pair<Type_Key, Type_Ts>> & stream, const vector<Type_Payload> & payloads)
 {
     #ifdef DEBUG
     cout << "[Debug Info:] Class {SWmeta} :: Member Function {bulk_load()} Begin" << endl;
     cout << endl;
     #endif
 
-    vector<pair<Type_Key, Type_Ts>>  data(stream);
+    vector<pair<Type_Key, Type_Ts>>  data;
+    SWpayloadColumn<Type_Payload> dataPayloads;
 
-    sort(data.begin(), data.end());
+    if constexpr (has_payload<Type_Payload>)
+    {
+        //Sort positions, then gather the tuples and payloads once
+        vector<int> order(stream.size());
+        iota(order.begin(), order.end(), 0);
+        parallel_sort(order.begin(), order.end(), [&](int i, int j) {return stream[i] < stream[j];}, bulk_load_threads(stream.size()));
+
+        data.reserve(stream.size());
+        dataPayloads.reserve(stream.size());
+        for (auto & it : order)
+        {
+            data.push_back(stream[it]);
+            dataPayloads.push_back(payloads.empty() ? Type_Payload() : payloads[it]);
+        }
+    }
+    else
+    {
+        data = stream;
+        parallel_sort(data.begin(), data.end(), less<pair<Type_Key, Type_Ts>>(), bulk_load_threads(data.size()));
+    }
 
-    vector<pair<Type_Key, SWseg<Type_Key,Type_Ts> * >> splitedDataPtr;
+    vector<pair<Type_Key, SWseg<Type_Key,Type_Ts,Type_Payload> * >> splitedDataPtr;
 
-    split_data_slope(data, splitedDataPtr);
+    split_data_slope(data, dataPayloads, splitedDataPtr);
 
     if (m_slope != -1)
     {
@@ -255,13 +453,14 @@ void SWmeta<Type_Key,Type_Ts>::bulk_load(const vector<pair<Type_Key, Type_Ts>> &
     }
     else //Single Segment in SWmeta
     {        
-        int bitmapSize = ceil(MAX_BUFFER_SIZE/64.);
+        int bitmapSize = ceil(max_buffer_size()/64.);
         vector<uint64_t> temp(bitmapSize,0);
         
         m_startKey = splitedDataPtr[0].first;
         m_numPairExist = 1;
         m_bitmap = temp;
         m_retrainBitmap = temp;
+        bitmap_summary_rebuild();
         bitmap_set_bit(0);
         
         splitedDataPtr[0].second->m_parentIndex = 0;
@@ -269,6 +468,11 @@ void SWmeta<Type_Key,Type_Ts>::bulk_load(const vector<pair<Type_Key, Type_Ts>> &
         m_ptr.push_back(splitedDataPtr[0].second);
     }
 
+    for (auto & it : splitedDataPtr)
+    {
+        expiry_register(it.second);
+    }
+
     #ifdef DEBUG
     cout << "[Debug Info:] Class {SWmeta} :: Member Function {bulk_load()} End" << endl;
     cout << endl;
@@ -279,100 +483,84 @@ void SWmeta<Type_Key,Type_Ts>::bulk_load(const vector<pair<Type_Key, Type_Ts>> &
 /*
 Split Segment functions
 */
-template<class Type_Key, class Type_Ts>
-void SWmeta<Type_Key,Type_Ts>::split_data_slope(vector<pair<Type_Key,Type_Ts>> & data, 
-                                vector<pair<Type_Key, SWseg<Type_Key,Type_Ts> * >> & splitedDataPtr)
+template<class Type_Key, class Type_Ts, class Type_Payload>
+void SWmeta<Type_Key,Type_Ts,Type_Payload>::split_data_slope(vector<pair<Type_Key,Type_Ts>> & data, SWpayloadColumn<Type_Payload> & payloads,
+                                vector<pair<Type_Key, SWseg<Type_Key,Type_Ts,Type_Payload> * >> & splitedDataPtr)
 {  
     #ifdef DEBUG
     cout << "[Debug Info:] Class {SWmeta} :: Member Function {split_data_slope()} Begin" << endl;
     cout << endl;
     #endif
 
-    vector<tuple<int,int,double>> splitIndexSlopeVector;
+    int numThreads = bulk_load_threads(data.size());
 
-    calculate_split_derivative(128, data, splitIndexSlopeVector);
+    vector<tuple<int,int,double>> splitIndexSlopeVector;
 
-    if (splitIndexSlopeVector.size() != 1)
-    {
-        double sumKey = 0, sumIndex = 0, sumKeyIndex = 0, sumKeySquared = 0;
-        int cnt = 0;
-        
-        for (auto it = splitIndexSlopeVector.begin(); it != splitIndexSlopeVector.end()-1; it++)
-        {
-            SWseg<Type_Key,Type_Ts> * SWsegPtr = new SWseg<Type_Key,Type_Ts>(get<0>(*it), get<1>(*it) ,get<2>(*it), data);
+    calculate_split_parallel(bulk_load_split(), 128, initial_error(), numThreads, data, splitIndexSlopeVector);
 
-            if(splitedDataPtr.size() > 0)
-            {
-                SWsegPtr->m_leftSibling = splitedDataPtr[splitedDataPtr.size() - 1].second;
-                splitedDataPtr[splitedDataPtr.size() - 1].second->m_rightSibling = SWsegPtr;
-            }
+    #ifdef TWO_PIECE_SEG
+    vector<pair<int,double>> breakIndexSlopeVector;
+    pair_split_two_piece(data, splitIndexSlopeVector, breakIndexSlopeVector);
+    #endif
 
-            splitedDataPtr.push_back(make_pair( data[get<0>(*it)].first, SWsegPtr));
+    //SWpool is not thread safe, so with several threads the SWseg come from operator new (like the background retrain ones)
+    vector<SWseg<Type_Key,Type_Ts,Type_Payload> *> segPtr(splitIndexSlopeVector.size());
 
-            sumKey += (double)data[get<0>(*it)].first;
-            sumIndex += cnt;
-            sumKeyIndex += (double)data[get<0>(*it)].first * cnt;
-            sumKeySquared += (double)pow(data[get<0>(*it)].first,2);
-            cnt++;
-        }
+    #pragma omp parallel for num_threads(numThreads) schedule(dynamic)
+    for (int i = 0; i < segPtr.size(); i++)
+    {
+        auto & split = splitIndexSlopeVector[i];
 
         //Dealing with last segment with only one point
-        if (get<0>(splitIndexSlopeVector.back())  != get<1>(splitIndexSlopeVector.back()))
+        if (i == segPtr.size()-1 && get<0>(split) == get<1>(split))
         {
-            SWseg<Type_Key,Type_Ts> * SWsegPtr = new SWseg<Type_Key,Type_Ts>(get<0>(splitIndexSlopeVector.back()), get<1>(splitIndexSlopeVector.back()) ,get<2>(splitIndexSlopeVector.back()), data);
-
-            if(splitedDataPtr.size() > 0)
-            {
-                SWsegPtr->m_leftSibling = splitedDataPtr[splitedDataPtr.size() - 1].second;
-                splitedDataPtr[splitedDataPtr.size() - 1].second->m_rightSibling = SWsegPtr;
-            }
-
-            splitedDataPtr.push_back(make_pair( data[get<0>(splitIndexSlopeVector.back())].first, SWsegPtr));
-
-            sumKey += (double)data[get<0>(splitIndexSlopeVector.back())].first;
-            sumIndex += cnt;
-            sumKeyIndex += (double)data[get<0>(splitIndexSlopeVector.back())].first * cnt;
-            sumKeySquared += (double)pow(data[get<0>(splitIndexSlopeVector.back())].first,2);
-            cnt++;
+            segPtr[i] = (numThreads > 1) ? new SWseg<Type_Key,Type_Ts,Type_Payload>(data.back(), payloads[data.size()-1], max_buffer_size()) : new_seg(data.back(), payloads[data.size()-1]);
         }
-        else //Single Point 
-        {        
-            SWseg<Type_Key,Type_Ts> * SWsegPtr = new SWseg<Type_Key,Type_Ts>(data.back());
-
-            if(splitedDataPtr.size() > 0)
-            {
-                SWsegPtr->m_leftSibling = splitedDataPtr[splitedDataPtr.size() - 1].second;
-                splitedDataPtr[splitedDataPtr.size() - 1].second->m_rightSibling = SWsegPtr;
-            }
-
-            splitedDataPtr.push_back(make_pair( data.back().first, SWsegPtr));
-
-            sumKey += (double)data.back().first;
-            sumIndex += cnt;
-            sumKeyIndex += (double)data.back().first * cnt;
-            sumKeySquared += (double)pow(data.back().first,2);
-            cnt++;
+        #ifdef TWO_PIECE_SEG
+        else if (breakIndexSlopeVector[i].first != -1)
+        {
+            auto & breakSplit = breakIndexSlopeVector[i];
+            segPtr[i] = (numThreads > 1) ? new SWseg<Type_Key,Type_Ts,Type_Payload>(get<0>(split), get<1>(split), get<2>(split), breakSplit.first, breakSplit.second, data, payloads, max_buffer_size()) 
+                                         : new_seg(get<0>(split), get<1>(split), get<2>(split), breakSplit.first, breakSplit.second, data, payloads);
+        }
+        #endif
+        else
+        {
+            segPtr[i] = (numThreads > 1) ? new SWseg<Type_Key,Type_Ts,Type_Payload>(get<0>(split), get<1>(split), get<2>(split), data, payloads, max_buffer_size()) 
+                                         : new_seg(get<0>(split), get<1>(split), get<2>(split), data, payloads);
         }
+    }
 
-        m_slope =  (sumKeyIndex - sumKey *(sumIndex/cnt))/(sumKeySquared - sumKey*(sumKey/cnt)) * 1.05;
+    if (segPtr.size() == 1 && get<0>(splitIndexSlopeVector[0]) == get<1>(splitIndexSlopeVector[0]))
+    {
+        cout << "WARNING: entire data is one point" << endl;
     }
-    else //Single Segment in SWmeta
+
+    double sumKey = 0, sumIndex = 0, sumKeyIndex = 0, sumKeySquared = 0;
+    int cnt = 0;
+
+    for (int i = 0; i < segPtr.size(); i++)
     {
-        if (get<0>(splitIndexSlopeVector[0]) != get<1>(splitIndexSlopeVector[0]))
-        {
-            SWseg<Type_Key,Type_Ts> * SWsegPtr = new SWseg<Type_Key,Type_Ts>(get<0>(splitIndexSlopeVector[0]), get<1>(splitIndexSlopeVector[0]), get<2>(splitIndexSlopeVector[0]), data);
-            splitedDataPtr.push_back(make_pair( data[get<0>(splitIndexSlopeVector[0])].first, SWsegPtr));
-        }
-        else
+        Type_Key startKey = data[get<0>(splitIndexSlopeVector[i])].first;
+
+        if(splitedDataPtr.size() > 0)
         {
-            cout << "WARNING: entire data is one point" << endl;
-            SWseg<Type_Key,Type_Ts> * SWsegPtr = new SWseg<Type_Key,Type_Ts>(data.back());
-            splitedDataPtr.push_back(make_pair( data.back().first, SWsegPtr));
+            segPtr[i]->m_leftSibling = splitedDataPtr.back().second;
+            splitedDataPtr.back().second->m_rightSibling = segPtr[i];
         }
-        
-        m_slope = -1;
+
+        splitedDataPtr.push_back(make_pair(startKey, segPtr[i]));
+
+        sumKey += (double)startKey;
+        sumIndex += cnt;
+        sumKeyIndex += (double)startKey * cnt;
+        sumKeySquared += (double)pow(startKey,2);
+        cnt++;
     }
 
+    //Single Segment in SWmeta
+    m_slope = (segPtr.size() != 1) ? (sumKeyIndex - sumKey *(sumIndex/cnt))/(sumKeySquared - sumKey*(sumKey/cnt)) * 1.05 : -1;
+
     if (splitedDataPtr.front().second->m_leftSibling != nullptr)
     {
         cout << "first left sibling not null" << endl;
@@ -393,9 +581,9 @@ void SWmeta<Type_Key,Type_Ts>::split_data_slope(vector<pair<Type_Key,Type_Ts>> &
 Retrain Segments
 */
 
-template<class Type_Key, class Type_Ts>
-void SWmeta<Type_Key,Type_Ts>::retrain_seg(pair<int,int> SWsegIndexes, Type_Ts & lowerLimit,
-                                vector<pair<Type_Key, SWseg<Type_Key,Type_Ts> * >> & splitedDataPtr)
+template<class Type_Key, class Type_Ts, class Type_Payload>
+void SWmeta<Type_Key,Type_Ts,Type_Payload>::retrain_seg(pair<int,int> SWsegIndexes, Type_Ts & lowerLimit,
+                                vector<pair<Type_Key, SWseg<Type_Key,Type_Ts,Type_Payload> * >> & splitedDataPtr)
 {  
     #ifdef DEBUG
     cout << "[Debug Info:] Class {SWmeta} :: Member Function {retrain_seg()} Begin" << endl;
@@ -403,6 +591,8 @@ void SWmeta<Type_Key,Type_Ts>::retrain_seg(pair<int,int> SWsegIndexes, Type_Ts &
     #endif
     
     vector<pair<Type_Key,Type_Ts>> data;
+    SWpayloadColumn<Type_Payload> payloads;
+    int numBufferInsert = 0; //Buffered inserts observed by the retrained segments
     if (SWsegIndexes.first == SWsegIndexes.second) //Retrain Alone
     {
         #ifdef DEBUG
@@ -410,7 +600,8 @@ void SWmeta<Type_Key,Type_Ts>::retrain_seg(pair<int,int> SWsegIndexes, Type_Ts &
         cout << endl;
         #endif
 
-        m_ptr[SWsegIndexes.first]->merge_data(data,lowerLimit);
+        m_ptr[SWsegIndexes.first]->merge_data(data, payloads, lowerLimit);
+        numBufferInsert += m_ptr[SWsegIndexes.first]->m_numBufferInsert;
     }
     else //Retrain with neighbours
     {
@@ -423,7 +614,8 @@ void SWmeta<Type_Key,Type_Ts>::retrain_seg(pair<int,int> SWsegIndexes, Type_Ts &
         {
             if (bitmap_exists(SWsegIndexes.first))
             { 
-                m_ptr[SWsegIndexes.first]->merge_data(data,lowerLimit);
+                m_ptr[SWsegIndexes.first]->merge_data(data, payloads, lowerLimit);
+                numBufferInsert += m_ptr[SWsegIndexes.first]->m_numBufferInsert;
 
             }
             SWsegIndexes.first++;
@@ -435,17 +627,76 @@ void SWmeta<Type_Key,Type_Ts>::retrain_seg(pair<int,int> SWsegIndexes, Type_Ts &
     startTimer(&temp);
     #endif
 
-    vector<tuple<int,int,double>> splitIndexSlopeVector;
+    build_seg(data, payloads, splitError, numBufferInsert, true, splitedDataPtr);
 
     #ifdef TUNE
-    calculate_split_index_one_pass(data,splitIndexSlopeVector,splitError);
+    segLengthRetrain += data.size();
+    #endif
+
+    #ifdef TUNE_TIME
+    stopTimer(&temp);
+    segRetrainCycle += temp;
+    segLengthRetrain += data.size();
+    segRetrainCyclePerLength += (double)temp/data.size();
+    #endif
+
+    if (splitedDataPtr.front().second->m_leftSibling != nullptr)
+    {
+        cout << "first left sibling not null" << endl;
+    }
+
+    if (splitedDataPtr.back().second->m_rightSibling != nullptr)
+    {
+        cout << "last right sibling not null" << endl;
+    }
+
+    #ifdef DEBUG
+    cout << "[Debug Info:] Class {SWmeta} :: Member Function {retrain_seg()} End" << endl;
+    cout << endl;
+    #endif
+}
+
+//Splits merged data into new SWseg appended to splitedDataPtr. Does not touch SWmeta, so the background retrain
+//thread can run it with pooled = false (SWpool is not thread safe, the SWseg and their arrays come from operator new).
+template<class Type_Key, class Type_Ts, class Type_Payload>
+void SWmeta<Type_Key,Type_Ts,Type_Payload>::build_seg(vector<pair<Type_Key,Type_Ts>> & data, SWpayloadColumn<Type_Payload> & payloads, int segSplitError, int numBufferInsert, bool pooled,
+                                vector<pair<Type_Key, SWseg<Type_Key,Type_Ts,Type_Payload> * >> & splitedDataPtr)
+{
+    auto newSeg = [&](auto &&... args)
+    {
+        return pooled ? new_seg(args...) : new SWseg<Type_Key,Type_Ts,Type_Payload>(args..., max_buffer_size());
+    };
+
+    vector<tuple<int,int,double>> splitIndexSlopeVector;
+
+    #if defined TUNE || !defined STATIC_PARAMS
+    calculate_split(retrain_split(), 0, segSplitError, data, splitIndexSlopeVector);
     #else
-    calculate_split_index_one_pass(data,splitIndexSlopeVector);
+    calculate_split(retrain_split(), 0, INITIAL_ERROR, data, splitIndexSlopeVector);
+    #endif
+
+    #ifdef TWO_PIECE_SEG
+    vector<pair<int,double>> breakIndexSlopeVector;
+    pair_split_two_piece(data, splitIndexSlopeVector, breakIndexSlopeVector);
     #endif
 
+    auto newSplitSeg = [&](int i)
+    {
+        auto & split = splitIndexSlopeVector[i];
+        #ifdef TWO_PIECE_SEG
+        if (breakIndexSlopeVector[i].first != -1)
+        {
+            return newSeg(get<0>(split), get<1>(split), get<2>(split), breakIndexSlopeVector[i].first, breakIndexSlopeVector[i].second, data, payloads);
+        }
+        #endif
+        return newSeg(get<0>(split), get<1>(split), get<2>(split), data, payloads);
+    };
+
+    int firstNewSeg = splitedDataPtr.size();
+
     for (auto it = splitIndexSlopeVector.begin(); it != splitIndexSlopeVector.end()-1; it++)
     {
-        SWseg<Type_Key,Type_Ts> * SWsegPtr = new SWseg<Type_Key,Type_Ts>(get<0>(*it), get<1>(*it) ,get<2>(*it), data);
+        SWseg<Type_Key,Type_Ts,Type_Payload> * SWsegPtr = newSplitSeg(it - splitIndexSlopeVector.begin());
         
         if(splitedDataPtr.size() > 0)
         {
@@ -460,7 +711,7 @@ void SWmeta<Type_Key,Type_Ts>::retrain_seg(pair<int,int> SWsegIndexes, Type_Ts &
     //Dealing with last segment with only one point
     if (get<0>(splitIndexSlopeVector.back())  != get<1>(splitIndexSlopeVector.back()))
     {
-        SWseg<Type_Key,Type_Ts> * SWsegPtr = new SWseg<Type_Key,Type_Ts>(get<0>(splitIndexSlopeVector.back()), get<1>(splitIndexSlopeVector.back()) ,get<2>(splitIndexSlopeVector.back()), data);
+        SWseg<Type_Key,Type_Ts,Type_Payload> * SWsegPtr = newSplitSeg(splitIndexSlopeVector.size()-1);
         
         if(splitedDataPtr.size() > 0)
         {
@@ -474,7 +725,7 @@ void SWmeta<Type_Key,Type_Ts>::retrain_seg(pair<int,int> SWsegIndexes, Type_Ts &
     else //Single Point 
     {
 
-        SWseg<Type_Key,Type_Ts> * SWsegPtr = new SWseg<Type_Key,Type_Ts>(data.back());
+        SWseg<Type_Key,Type_Ts,Type_Payload> * SWsegPtr = newSeg(data.back(), payloads[data.size()-1]);
 
         if(splitedDataPtr.size() > 0)
         {
@@ -485,39 +736,22 @@ void SWmeta<Type_Key,Type_Ts>::retrain_seg(pair<int,int> SWsegIndexes, Type_Ts &
         splitedDataPtr.push_back(make_pair( data.back().first, SWsegPtr));
     }
 
-    #ifdef TUNE
-    segLengthRetrain += data.size();
-    #endif
-
-    #ifdef TUNE_TIME
-    stopTimer(&temp);
-    segRetrainCycle += temp;
-    segLengthRetrain += data.size();
-    segRetrainCyclePerLength += (double)temp/data.size();
-    #endif
-
-    if (splitedDataPtr.front().second->m_leftSibling != nullptr)
-    {
-        cout << "first left sibling not null" << endl;
-    }
-
-    if (splitedDataPtr.back().second->m_rightSibling != nullptr)
+    //Size the first buffer allocation of each new segment from the insert rate of the segments it replaces
+    double bufferInsertRate = (double)numBufferInsert/data.size();
+    for (int i = firstNewSeg; i < splitedDataPtr.size(); i++)
     {
-        cout << "last right sibling not null" << endl;
+        SWseg<Type_Key,Type_Ts,Type_Payload> * SWsegPtr = splitedDataPtr[i].second;
+        int expectedBufferInsert = ceil(bufferInsertRate * (SWsegPtr->m_numPairExist + SWsegPtr->m_numPairBuffer));
+        SWsegPtr->m_bufferHint = min(max(expectedBufferInsert, BUFFER_INITIAL_SIZE), SWsegPtr->max_buffer_size());
     }
-
-    #ifdef DEBUG
-    cout << "[Debug Info:] Class {SWmeta} :: Member Function {retrain_seg()} End" << endl;
-    cout << endl;
-    #endif
 }
 
 /*
 Point Lookup
 */
 
-template<class Type_Key, class Type_Ts>
-void SWmeta<Type_Key,Type_Ts>::lookup(pair<Type_Key, Type_Ts> & arrivalTuple, Type_Key & resultCount)
+template<class Type_Key, class Type_Ts, class Type_Payload>
+void SWmeta<Type_Key,Type_Ts,Type_Payload>::lookup(pair<Type_Key, Type_Ts> & arrivalTuple, Type_Key & resultCount)
 {
     #if defined DEBUG 
     cout << "[Debug Info:] Class {SWmeta} :: Member Function {lookup()} Begin" << endl;
@@ -534,7 +768,7 @@ void SWmeta<Type_Key,Type_Ts>::lookup(pair<Type_Key, Type_Ts> & arrivalTuple, Ty
     Type_Key newKey = arrivalTuple.first;
     Type_Ts newTimeStamp = arrivalTuple.second;
     // Type_Ts lowerLimit =  ((double)m_maxTs - TIME_WINDOW < numeric_limits<Type_Ts>::min()) ? numeric_limits<Type_Ts>::min(): m_maxTs - TIME_WINDOW;
-    Type_Ts lowerLimit =  ((double)newTimeStamp - TIME_WINDOW < numeric_limits<Type_Ts>::min()) ? numeric_limits<Type_Ts>::min(): newTimeStamp - TIME_WINDOW;
+    Type_Ts lowerLimit = calculate_lower_limit(newTimeStamp);
 
     int foundPos = 0;
 
@@ -554,12 +788,20 @@ void SWmeta<Type_Key,Type_Ts>::lookup(pair<Type_Key, Type_Ts> & arrivalTuple, Ty
 
         if (!bitmap_exists(foundPos))
         {
-            foundPos = bitmap_closest_left_nongap(foundPos);
+            int leftClosest = bitmap_closest_left_nongap(foundPos);
 
-            //Assumption: if it does not exist in left of search key, it does not exist.
-            if (foundPos == -1)
+            if (leftClosest == -1)
             {
-                return;
+                //Keys below the first SWseg are inserted into it (find_insert_seg)
+                foundPos = bitmap_closest_right_nongap(foundPos);
+                if (foundPos == m_keys.size())
+                {
+                    return;
+                }
+            }
+            else
+            {
+                foundPos = leftClosest;
             }
         }
     }
@@ -571,8 +813,16 @@ void SWmeta<Type_Key,Type_Ts>::lookup(pair<Type_Key, Type_Ts> & arrivalTuple, Ty
         }
     }
     
+    #ifdef INLINE_SEG_MODEL
+    seg_model_prefetch(foundPos, newKey);
+    #endif
+
     m_ptr[foundPos]->lookup(newKey, lowerLimit, resultCount);
 
+    #ifdef INLINE_SEG_MODEL
+    seg_model_refresh(foundPos);
+    #endif
+
     #if defined DEBUG 
     cout << "[Debug Info:] Class {SWmeta} :: Member Function {lookup()} End" << endl;
     cout << endl;
@@ -589,9 +839,10 @@ void SWmeta<Type_Key,Type_Ts>::lookup(pair<Type_Key, Type_Ts> & arrivalTuple, Ty
 Range Search
 */
 
-template<class Type_Key, class Type_Ts>
-void SWmeta<Type_Key,Type_Ts>::range_search(tuple<Type_Key, Type_Ts, Type_Key> & arrivalTuple,
-                                                vector<pair<Type_Key, Type_Ts>> & rangeSearchResult)
+template<class Type_Key, class Type_Ts, class Type_Payload>
+template<class Type_Result>
+void SWmeta<Type_Key,Type_Ts,Type_Payload>::range_search(tuple<Type_Key, Type_Ts, Type_Key> & arrivalTuple,
+                                                Type_Result & rangeSearchResult)
 {
     #if defined DEBUG 
     cout << "[Debug Info:] Class {SWmeta} :: Member Function {range_search()} Begin" << endl;
@@ -616,10 +867,60 @@ void SWmeta<Type_Key,Type_Ts>::range_search(tuple<Type_Key, Type_Ts, Type_Key> &
     Type_Ts newTimeStamp = get<1>(arrivalTuple);
     Type_Key upperBound = get<2>(arrivalTuple);
     // Type_Ts lowerLimit =  ((double)m_maxTs - TIME_WINDOW < numeric_limits<Type_Ts>::min()) ? numeric_limits<Type_Ts>::min(): m_maxTs - TIME_WINDOW;
-    Type_Ts lowerLimit =  ((double)newTimeStamp - TIME_WINDOW < numeric_limits<Type_Ts>::min()) ? numeric_limits<Type_Ts>::min(): newTimeStamp - TIME_WINDOW;
+    Type_Ts lowerLimit = calculate_lower_limit(newTimeStamp);
 
     int foundPos = 0;
     
+    if (!find_search_seg(newKey, upperBound, foundPos))
+    {
+        return;
+    }
+
+    #if defined(TUNE_TIME) || defined(TIME_BREAKDOWN)
+    stopTimer(&timer);
+    searchCycle += timer;
+    #endif
+
+    #ifdef INLINE_SEG_MODEL
+    seg_model_prefetch(foundPos, newKey);
+    #endif
+
+    vector<pair<Type_Key,int >> updateSeg;
+    m_ptr[foundPos]->range_search(newKey, newTimeStamp, lowerLimit, newKey, upperBound, rangeSearchResult, updateSeg);
+
+    #ifdef INLINE_SEG_MODEL
+    seg_model_refresh(foundPos);
+    #endif
+
+    range_search_update(newKey, lowerLimit, updateSeg);
+
+    #if defined DEBUG 
+    cout << "[Debug Info:] Class {SWmeta} :: Member Function {range_search()} End" << endl;
+    cout << endl;
+    #elif defined DEBUG_KEY
+    if(DEBUG_KEY == newKey)
+    {
+        cout << "[Debug Info:] Class {SWmeta} :: Member Function {range_search()} End" << endl;
+        cout << endl;
+    }
+    #endif
+}
+
+//COUNT/SUM/MIN/MAX of the keys in range, same maintenance as range_search but nothing is materialized
+template<class Type_Key, class Type_Ts, class Type_Payload>
+SWaggregate<Type_Key> SWmeta<Type_Key,Type_Ts,Type_Payload>::range_aggregate(tuple<Type_Key, Type_Ts, Type_Key> & arrivalTuple)
+{
+    SWaggregate<Type_Key> aggregate;
+    range_search(arrivalTuple, aggregate);
+    return aggregate;
+}
+
+//Position of the SWseg to start a range scan from, false if no segment can overlap [newKey, upperBound]
+template<class Type_Key, class Type_Ts, class Type_Payload>
+inline bool SWmeta<Type_Key,Type_Ts,Type_Payload>::find_search_seg(Type_Key & newKey, Type_Key & upperBound, int & foundPos)
+{
+    foundPos = 0;
+
     if (m_keys.size() > 1)
     {
         if (newKey > m_startKey)
@@ -640,11 +941,12 @@ void SWmeta<Type_Key,Type_Ts>::range_search(tuple<Type_Key, Type_Ts, Type_Key> &
 
             if (leftClosest == -1)
             {
+                //Keys below the first SWseg are inserted into it (find_insert_seg), even when its start key is above upperBound
                 int rightClosest = bitmap_closest_right_nongap(foundPos);
 
-                if (rightClosest == m_keys.size() || m_keys[rightClosest] > upperBound)
+                if (rightClosest == m_keys.size())
                 {
-                    return;
+                    return false;
                 }
                 else
                 {
@@ -665,17 +967,75 @@ void SWmeta<Type_Key,Type_Ts>::range_search(tuple<Type_Key, Type_Ts, Type_Key> &
         }
     }
 
-    #if defined(TUNE_TIME) || defined(TIME_BREAKDOWN)
-    stopTimer(&timer);
-    searchCycle += timer;
+    return true;
+}
+
+#ifdef INLINE_SEG_MODEL
+//Prefetches the predicted m_localKeys line of the SWseg in slot index from the slot's model copy, 
+//so the load overlaps with reading the SWseg itself
+template<class Type_Key, class Type_Ts, class Type_Payload>
+inline void SWmeta<Type_Key,Type_Ts,Type_Payload>::seg_model_prefetch(int index, Type_Key targetKey)
+{
+    if (index < m_segModel.size())
+    {
+        m_segModel[index].prefetch_search(targetKey);
+    }
+}
+
+//Copies the model of the SWseg in slot index (called after it was used, while it is in cache)
+template<class Type_Key, class Type_Ts, class Type_Payload>
+inline void SWmeta<Type_Key,Type_Ts,Type_Payload>::seg_model_refresh(int index)
+{
+    if (m_segModel.size() != m_keys.size())
+    {
+        m_segModel.resize(m_keys.size(), SWsegModel<Type_Key>{0, 0, nullptr, 0});
+    }
+
+    if (index < m_keys.size() && m_ptr[index] != nullptr)
+    {
+        m_ptr[index]->copy_model(m_segModel[index]);
+    }
+}
+#endif
+
+/*
+Range Visit
+*/
+
+//Calls visitor(key, timeStamp) for the live tuples in [lowerBound, upperBound] in ascending key order without materializing them.
+//The visitor returns false to stop early, limit caps the number of tuples visited. Returns the number of tuples visited.
+//Read-only: expired tuples are skipped, their removal is left to range_search and insert.
+template<class Type_Key, class Type_Ts, class Type_Payload>
+template<class Visitor>
+uint64_t SWmeta<Type_Key,Type_Ts,Type_Payload>::range_for_each(Type_Key lowerBound, Type_Key upperBound, Type_Ts timeStamp, Visitor visitor, uint64_t limit)
+{
+    Type_Ts lowerLimit = calculate_lower_limit(timeStamp);
+
+    int foundPos;
+    if (!find_search_seg(lowerBound, upperBound, foundPos))
+    {
+        return 0;
+    }
+
+    #ifdef INLINE_SEG_MODEL
+    seg_model_prefetch(foundPos, lowerBound);
     #endif
 
-    vector<pair<Type_Key,int >> updateSeg;
-    m_ptr[foundPos]->range_search(newKey, newTimeStamp, lowerLimit, newKey, upperBound, rangeSearchResult, updateSeg);
+    uint64_t numVisited = m_ptr[foundPos]->range_for_each(lowerBound, upperBound, lowerLimit, visitor, limit);
 
+    #ifdef INLINE_SEG_MODEL
+    seg_model_refresh(foundPos);
+    #endif
+
+    return numVisited;
+}
 
+//Apply the segment deletions and rendezvous retrains reported by SWseg::range_search
+template<class Type_Key, class Type_Ts, class Type_Payload>
+void SWmeta<Type_Key,Type_Ts,Type_Payload>::range_search_update(Type_Key & newKey, Type_Ts & lowerLimit, vector<pair<Type_Key,int >> & updateSeg)
+{
     #if defined(TUNE_TIME) || defined(TIME_BREAKDOWN)
-    timer = 0;
+    uint64_t timer = 0;
     startTimer(&timer);
     #endif
 
@@ -697,7 +1057,7 @@ void SWmeta<Type_Key,Type_Ts>::range_search(tuple<Type_Key, Type_Ts, Type_Key> &
         }
         else
         {
-            delete m_ptr[it.second];
+            release_seg(m_ptr[it.second]);
             m_ptr[it.second] = nullptr;
             bitmap_erase_bit(it.second);
             bitmap_erase_bit(m_retrainBitmap,it.second);
@@ -718,7 +1078,7 @@ void SWmeta<Type_Key,Type_Ts>::range_search(tuple<Type_Key, Type_Ts, Type_Key> &
         }
     }
 
-    vector<pair<Type_Key, SWseg<Type_Key,Type_Ts> * >> insertionNodes;
+    vector<pair<Type_Key, SWseg<Type_Key,Type_Ts,Type_Payload> * >> insertionNodes;
     for (auto & it: retrainSegIndex)
     {       
         
@@ -731,8 +1091,13 @@ void SWmeta<Type_Key,Type_Ts>::range_search(tuple<Type_Key, Type_Ts, Type_Key> &
             #ifdef TUNE_TIME
             segNoRetrain++;
             #endif
+
+            #ifdef BACKGROUND_RETRAIN
+            retrain_request(bitmap_retrain_range(it), lowerLimit);
+            continue;
+            #endif
             
-            vector<pair<Type_Key, SWseg<Type_Key,Type_Ts> * >> tempInsertionNodes;
+            vector<pair<Type_Key, SWseg<Type_Key,Type_Ts,Type_Payload> * >> tempInsertionNodes;
 
             pair<int,int> retrainSegmentIndex = bitmap_retrain_range(it);
             retrain_seg(retrainSegmentIndex, lowerLimit, tempInsertionNodes);
@@ -753,7 +1118,7 @@ void SWmeta<Type_Key,Type_Ts>::range_search(tuple<Type_Key, Type_Ts, Type_Key> &
 
             if (retrainSegmentIndex.first == retrainSegmentIndex.second)
             {
-                    delete m_ptr[retrainSegmentIndex.first];
+                    release_seg(m_ptr[retrainSegmentIndex.first]);
                     m_ptr[retrainSegmentIndex.first] = nullptr;
                     bitmap_erase_bit(retrainSegmentIndex.first);
                     bitmap_erase_bit(m_retrainBitmap, retrainSegmentIndex.first);
@@ -765,7 +1130,7 @@ void SWmeta<Type_Key,Type_Ts>::range_search(tuple<Type_Key, Type_Ts, Type_Key> &
                 {
                     if (bitmap_exists(i))
                     {
-                        delete m_ptr[i];
+                        release_seg(m_ptr[i]);
                         m_ptr[i] = nullptr;
                         bitmap_erase_bit(i);
                         bitmap_erase_bit(m_retrainBitmap,i);
@@ -840,28 +1205,15 @@ void SWmeta<Type_Key,Type_Ts>::range_search(tuple<Type_Key, Type_Ts, Type_Key> &
     stopTimer(&timer);
     retrainCycle += timer;
     #endif
-
-    #if defined DEBUG 
-    cout << "[Debug Info:] Class {SWmeta} :: Member Function {range_search()} End" << endl;
-    cout << endl;
-    #elif defined DEBUG_KEY
-    if(DEBUG_KEY == newKey)
-    {
-        cout << "[Debug Info:] Class {SWmeta} :: Member Function {range_search()} End" << endl;
-        cout << endl;
-    }
-    #endif
 }
 
-
 //For Append Workload, Remove dangling tuples at the start of the index.
-template<class Type_Key, class Type_Ts>
-void SWmeta<Type_Key,Type_Ts>::range_search_ordered_data(tuple<Type_Key, Type_Ts, Type_Key> & arrivalTuple,
+template<class Type_Key, class Type_Ts, class Type_Payload>
+void SWmeta<Type_Key,Type_Ts,Type_Payload>::range_search_ordered_data(tuple<Type_Key, Type_Ts, Type_Key> & arrivalTuple,
                                                 vector<pair<Type_Key, Type_Ts>> & rangeSearchResult)
 {    
     // Type_Ts lowerLimit =  ((double)m_maxTs - TIME_WINDOW < numeric_limits<Type_Ts>::min()) ? numeric_limits<Type_Ts>::min(): m_maxTs - TIME_WINDOW;
-    Type_Ts lowerLimit =  ((double)get<1>(arrivalTuple) - TIME_WINDOW < numeric_limits<Type_Ts>::min()) 
-                            ? numeric_limits<Type_Ts>::min(): get<1>(arrivalTuple) - TIME_WINDOW;
+    Type_Ts lowerLimit = calculate_lower_limit(get<1>(arrivalTuple));
 
     for (int i = 0; i < m_ptr.size(); ++i)
     {
@@ -874,7 +1226,7 @@ void SWmeta<Type_Key,Type_Ts>::range_search_ordered_data(tuple<Type_Key, Type_Ts
                     m_ptr[i]->m_rightSibling->m_leftSibling = nullptr;
                 }
                 
-                delete m_ptr[i];
+                release_seg(m_ptr[i]);
                 m_ptr[i] = nullptr;
                 bitmap_erase_bit(i);
                 bitmap_erase_bit(m_retrainBitmap,i);
@@ -890,14 +1242,254 @@ void SWmeta<Type_Key,Type_Ts>::range_search_ordered_data(tuple<Type_Key, Type_Ts
     return range_search(arrivalTuple, rangeSearchResult);
 }
 
-template<class Type_Key, class Type_Ts>
-void SWmeta<Type_Key,Type_Ts>::insert(pair<Type_Key, Type_Ts> & arrivalTuple)
+/*
+Batch Search
+*/
+
+//Locates the SWseg of a group of keys in stages (predict -> m_keys -> m_ptr -> SWseg -> m_localKeys). 
+//Each stage prefetches the next level for every key of the group before moving on, so the misses overlap.
+//upperBounds == nullptr gives lookup semantics (left closest segment only), otherwise range search semantics.
+//segs[i] is set to nullptr when the key cannot have a match.
+template<class Type_Key, class Type_Ts, class Type_Payload>
+void SWmeta<Type_Key,Type_Ts,Type_Payload>::locate_batch(Type_Key * targetKeys, Type_Key * upperBounds, int groupSize, SWseg<Type_Key,Type_Ts,Type_Payload> ** segs)
 {
-    #if defined DEBUG 
-    cout << "[Debug Info:] Class {SWmeta} :: Member Function {insert()} Begin" << endl;
-    cout << endl;
-    #elif defined DEBUG_KEY
-    if(DEBUG_KEY == arrivalTuple.first)
+    int predictPos[BATCH_GROUP_SIZE];
+    int foundPos[BATCH_GROUP_SIZE];
+    int predictPosMin, predictPosMax;
+
+    if (m_keys.size() <= 1)
+    {
+        if (!bitmap_exists(0))
+        {
+            throw invalid_argument("SWmeta is empty");
+        }
+
+        for (int i = 0; i < groupSize; i++)
+        {
+            segs[i] = m_ptr[0];
+        }
+    }
+    else
+    {
+        //Stage 1: Predict & prefetch m_keys
+        if (m_slope != -1)
+        {
+            find_predict_pos_batch(targetKeys, groupSize, predictPos);
+
+            for (int i = 0; i < groupSize; i++)
+            {
+                predict_pos_bound(predictPos[i], predictPosMin, predictPosMax);
+                int prefetchPos = predictPos[i] < predictPosMin ? predictPosMin : predictPos[i];
+                prefetchPos = prefetchPos > predictPosMax ? predictPosMax : prefetchPos;
+                _mm_prefetch(reinterpret_cast<const char*>(&m_keys[prefetchPos]), _MM_HINT_T0);
+            }
+        }
+
+        //Stage 2: Search m_keys & prefetch m_bitmap, m_ptr
+        for (int i = 0; i < groupSize; i++)
+        {
+            foundPos[i] = 0;
+
+            if (targetKeys[i] > m_startKey)
+            {
+                if (m_slope == -1)
+                {
+                    exponential_search(targetKeys[i], foundPos[i]);
+                }
+                else if (targetKeys[i] > m_keys[m_keys.size()-1])
+                {
+                    foundPos[i] = m_keys.size()-1;
+                }
+                else
+                {
+                    predict_pos_bound(predictPos[i], predictPosMin, predictPosMax);
+                    predict_search_bound(targetKeys[i], predictPos[i], predictPosMin, predictPosMax, foundPos[i]);
+                }
+            }
+
+            _mm_prefetch(reinterpret_cast<const char*>(&m_bitmap[foundPos[i] >> 6]), _MM_HINT_T0);
+            _mm_prefetch(reinterpret_cast<const char*>(&m_ptr[foundPos[i]]), _MM_HINT_T0);
+            #ifdef INLINE_SEG_MODEL
+            if (foundPos[i] < m_segModel.size())
+            {
+                _mm_prefetch(reinterpret_cast<const char*>(&m_segModel[foundPos[i]]), _MM_HINT_T0);
+            }
+            #endif
+        }
+
+        //Stage 3: Resolve gaps & load SWseg pointers
+        for (int i = 0; i < groupSize; i++)
+        {
+            segs[i] = nullptr;
+
+            if (!bitmap_exists(foundPos[i]))
+            {
+                int leftClosest = bitmap_closest_left_nongap(foundPos[i]);
+
+                if (leftClosest == -1)
+                {
+                    //Keys below the first SWseg are inserted into it (find_insert_seg)
+                    int rightClosest = bitmap_closest_right_nongap(foundPos[i]);
+
+                    if (rightClosest == m_keys.size())
+                    {
+                        continue;
+                    }
+
+                    foundPos[i] = rightClosest;
+                }
+                else
+                {
+                    foundPos[i] = leftClosest;
+                }
+            }
+
+            segs[i] = m_ptr[foundPos[i]];
+
+            #ifdef INLINE_SEG_MODEL
+            seg_model_prefetch(foundPos[i], targetKeys[i]);
+            #endif
+        }
+    }
+
+    //Stage 3 (cont.): Prefetch SWseg header (model, bounds & vector pointers)
+    for (int i = 0; i < groupSize; i++)
+    {
+        if (segs[i] != nullptr)
+        {
+            _mm_prefetch(reinterpret_cast<const char*>(segs[i]), _MM_HINT_T0);
+            _mm_prefetch(reinterpret_cast<const char*>(segs[i]) + 64, _MM_HINT_T0);
+        }
+    }
+
+    //Stage 4: Predict in SWseg & prefetch m_localKeys, m_bufferKeys
+    //With INLINE_SEG_MODEL m_localKeys was prefetched in stage 3, the slot copies are refreshed instead
+    for (int i = 0; i < groupSize; i++)
+    {
+        if (segs[i] != nullptr)
+        {
+            #ifdef INLINE_SEG_MODEL
+            seg_model_refresh(segs[i]->m_parentIndex);
+            #else
+            segs[i]->prefetch_search(targetKeys[i]);
+            #endif
+        }
+    }
+}
+
+template<class Type_Key, class Type_Ts, class Type_Payload>
+void SWmeta<Type_Key,Type_Ts,Type_Payload>::lookup_batch(vector<pair<Type_Key, Type_Ts>> & arrivalTuples, vector<Type_Key> & resultCounts)
+{
+    #if defined DEBUG 
+    cout << "[Debug Info:] Class {SWmeta} :: Member Function {lookup_batch()} Begin" << endl;
+    cout << endl;
+    #endif
+
+    //Does not include deletion
+    resultCounts.assign(arrivalTuples.size(), 0);
+
+    Type_Key targetKeys[BATCH_GROUP_SIZE];
+    SWseg<Type_Key,Type_Ts,Type_Payload> * segs[BATCH_GROUP_SIZE];
+
+    for (int groupStart = 0; groupStart < arrivalTuples.size(); groupStart += BATCH_GROUP_SIZE)
+    {
+        int groupSize = min((int)arrivalTuples.size() - groupStart, BATCH_GROUP_SIZE);
+
+        for (int i = 0; i < groupSize; i++)
+        {
+            targetKeys[i] = arrivalTuples[groupStart + i].first;
+        }
+
+        locate_batch(targetKeys, nullptr, groupSize, segs);
+
+        //Stage 5: Search SWseg
+        for (int i = 0; i < groupSize; i++)
+        {
+            if (segs[i] != nullptr)
+            {
+                Type_Ts lowerLimit = calculate_lower_limit(arrivalTuples[groupStart + i].second);
+                segs[i]->lookup(targetKeys[i], lowerLimit, resultCounts[groupStart + i]);
+            }
+        }
+    }
+
+    #if defined DEBUG 
+    cout << "[Debug Info:] Class {SWmeta} :: Member Function {lookup_batch()} End" << endl;
+    cout << endl;
+    #endif
+}
+
+template<class Type_Key, class Type_Ts, class Type_Payload>
+void SWmeta<Type_Key,Type_Ts,Type_Payload>::range_search_batch(vector<tuple<Type_Key, Type_Ts, Type_Key>> & arrivalTuples,
+                                                vector<vector<pair<Type_Key, Type_Ts>>> & rangeSearchResults)
+{
+    #if defined DEBUG 
+    cout << "[Debug Info:] Class {SWmeta} :: Member Function {range_search_batch()} Begin" << endl;
+    cout << endl;
+    #endif
+
+    rangeSearchResults.resize(arrivalTuples.size());
+
+    Type_Key targetKeys[BATCH_GROUP_SIZE];
+    Type_Key upperBounds[BATCH_GROUP_SIZE];
+    SWseg<Type_Key,Type_Ts,Type_Payload> * segs[BATCH_GROUP_SIZE];
+    vector<pair<Type_Key,int >> updateSeg;
+
+    for (int groupStart = 0; groupStart < arrivalTuples.size(); groupStart += BATCH_GROUP_SIZE)
+    {
+        int groupSize = min((int)arrivalTuples.size() - groupStart, BATCH_GROUP_SIZE);
+
+        for (int i = 0; i < groupSize; i++)
+        {
+            targetKeys[i] = get<0>(arrivalTuples[groupStart + i]);
+            upperBounds[i] = get<2>(arrivalTuples[groupStart + i]);
+        }
+
+        locate_batch(targetKeys, upperBounds, groupSize, segs);
+
+        //Stage 5: Search SWseg
+        for (int i = 0; i < groupSize; i++)
+        {
+            rangeSearchResults[groupStart + i].clear();
+
+            if (segs[i] == nullptr)
+            {
+                continue;
+            }
+
+            Type_Ts newTimeStamp = get<1>(arrivalTuples[groupStart + i]);
+            Type_Ts lowerLimit = calculate_lower_limit(newTimeStamp);
+
+            updateSeg.clear();
+            segs[i]->range_search(targetKeys[i], newTimeStamp, lowerLimit, targetKeys[i], upperBounds[i], rangeSearchResults[groupStart + i], updateSeg);
+
+            if (updateSeg.size())
+            {
+                range_search_update(targetKeys[i], lowerLimit, updateSeg);
+
+                //SWmeta changed, relocate the rest of the group
+                if (i + 1 < groupSize)
+                {
+                    locate_batch(targetKeys + i + 1, upperBounds + i + 1, groupSize - i - 1, segs + i + 1);
+                }
+            }
+        }
+    }
+
+    #if defined DEBUG 
+    cout << "[Debug Info:] Class {SWmeta} :: Member Function {range_search_batch()} End" << endl;
+    cout << endl;
+    #endif
+}
+
+template<class Type_Key, class Type_Ts, class Type_Payload>
+void SWmeta<Type_Key,Type_Ts,Type_Payload>::insert(pair<Type_Key, Type_Ts> & arrivalTuple, const Type_Payload & payload)
+{
+    #if defined DEBUG 
+    cout << "[Debug Info:] Class {SWmeta} :: Member Function {insert()} Begin" << endl;
+    cout << endl;
+    #elif defined DEBUG_KEY
+    if(DEBUG_KEY == arrivalTuple.first)
     {
         cout << "[Debug Info:] Class {SWmeta} :: Member Function {insert()} Begin" << endl;
         cout << "[Debug Info:] m_startKey =  " << m_startKey << endl;
@@ -918,13 +1510,406 @@ void SWmeta<Type_Key,Type_Ts>::insert(pair<Type_Key, Type_Ts> & arrivalTuple)
     startTimer(&timer);
     #endif
 
-    Type_Key newKey = arrivalTuple.first;
-    Type_Ts newTimeStamp = arrivalTuple.second;
-    // m_maxTs = (m_maxTs < newTimeStamp)? newTimeStamp: m_maxTs;
-    // Type_Ts lowerLimit =  ((double)m_maxTs - TIME_WINDOW < numeric_limits<Type_Ts>::min()) ? numeric_limits<Type_Ts>::min(): m_maxTs - TIME_WINDOW;
-    Type_Ts lowerLimit =  ((double)newTimeStamp - TIME_WINDOW < numeric_limits<Type_Ts>::min()) ? numeric_limits<Type_Ts>::min(): newTimeStamp - TIME_WINDOW;
+    Type_Key newKey = arrivalTuple.first;
+    Type_Ts newTimeStamp = arrivalTuple.second;
+    // m_maxTs = (m_maxTs < newTimeStamp)? newTimeStamp: m_maxTs;
+    // Type_Ts lowerLimit =  ((double)m_maxTs - TIME_WINDOW < numeric_limits<Type_Ts>::min()) ? numeric_limits<Type_Ts>::min(): m_maxTs - TIME_WINDOW;
+    Type_Ts lowerLimit = calculate_lower_limit(newTimeStamp);
+
+    int foundPos = 0;
+    if (!find_insert_seg(newKey, foundPos))
+    {
+        return;
+    }
+
+    #if defined(TUNE_TIME) || defined(TIME_BREAKDOWN)
+    stopTimer(&timer);
+    searchCycle += timer;
+    #endif
+
+    #ifdef INLINE_SEG_MODEL
+    seg_model_prefetch(foundPos, newKey);
+    #endif
+
+    vector<pair<Type_Key,int >> updateSeg;
+    m_ptr[foundPos]->insert(newKey, newTimeStamp, payload, lowerLimit, updateSeg);
+
+    #ifdef INLINE_SEG_MODEL
+    seg_model_refresh(foundPos);
+    #endif
+
+    //Insert into SWmeta and Retrain if neccessary
+    if (updateSeg.size() > 1)
+    {
+        if (updateSeg[1].first == numeric_limits<Type_Key>::max())
+        {
+            swap(updateSeg[0], updateSeg[1]);
+        }
+
+        if (updateSeg.size() > 2)
+        {
+            cout << "Error: Insertion No Update Seg > 2" << endl; //Check: Delete later
+        }
+
+        if (updateSeg[0].first != numeric_limits<Type_Key>::max() &&  updateSeg[1].first != numeric_limits<Type_Key>::max())
+        {
+            cout << "Error: Insertion Two Segments and not deleting any" << endl; //Check: Delete later
+        }
+    }
+
+    for (auto &it : updateSeg)
+    {
+        if (it.first != numeric_limits<Type_Key>::max())
+        {
+            int retrainExtendFlag = 0;
+
+            if (it.second%10 == 1)
+            {               
+                it.second /= 10;
+
+                if (bitmap_exists(m_retrainBitmap,it.second))
+                {
+                    update_seg_retrain(bitmap_retrain_range(it.second), lowerLimit, retrainExtendFlag);
+                }
+                else
+                {
+                    bitmap_set_bit(m_retrainBitmap,it.second);
+                }
+            }
+            else //Replace SWseg
+            {
+                it.second /= 10;
+                update_seg_replace(it.first, it.second, retrainExtendFlag);
+            }
+
+            #if defined(TUNE_TIME) || defined(TIME_BREAKDOWN)
+            timer = 0;
+            startTimer(&timer);
+            #endif
+
+            if (retrainExtendFlag)
+            {               
+                #if defined DEBUG 
+                cout << "[Debug Info:] Class {SWmeta} :: Member Function {retrain()}" << endl;
+                cout << endl;
+                #elif defined DEBUG_KEY
+                if(DEBUG_KEY == arrivalTuple.first)
+                {
+                    cout << "[Debug Info:] Class {SWmeta} :: Member Function {retrain()}" << endl;
+                    cout << endl;
+                }
+                #endif
+                meta_extend_retrain(retrainExtendFlag, lowerLimit);
+            }
+
+            #if defined(TUNE_TIME) || defined(TIME_BREAKDOWN)
+            stopTimer(&timer);
+            retrainCycle += timer;
+            #endif
+        }
+        else
+        {
+            update_seg_delete(it.second);
+        }
+    }
+
+    #ifdef EAGER_EXPIRY
+    expire_step(lowerLimit, EXPIRY_STEP_SIZE);
+    #endif
+
+    #ifdef BACKGROUND_RETRAIN
+    if (m_retrainNumDone.load(memory_order_relaxed))
+    {
+        retrain_publish();
+    }
+    #endif
+
+    #ifdef INCREMENTAL_META_RETRAIN
+    if (m_rebuildStage > 0)
+    {
+        meta_rebuild_step(lowerLimit, META_REBUILD_STEP);
+    }
+    #endif
+
+    #if defined DEBUG 
+    cout << "[Debug Info:] Class {SWmeta} :: Member Function {insert()} End" << endl;
+    cout << endl;
+    #elif defined DEBUG_KEY
+    if(DEBUG_KEY == arrivalTuple.first)
+    {
+        cout << "[Debug Info:] Class {SWmeta} :: Member Function {insert()} End" << endl;
+        cout << endl;
+    }
+    #endif
+}
+
+
+/*
+Batch Insert
+*/
+//Inserts a micro-batch in key order. Segments are found by walking m_keys forward from the previous key.
+//SWseg retraining and SWmeta extend/retrain are deferred to the end of the batch.
+template<class Type_Key, class Type_Ts, class Type_Payload>
+void SWmeta<Type_Key,Type_Ts,Type_Payload>::insert_batch(vector<pair<Type_Key, Type_Ts>> & batch)
+{
+    vector<Type_Payload> payloads;
+    insert_batch(batch, payloads);
+}
+
+//payloads[i] is the payload of batch[i] (sorted along with batch), an empty payloads gives every tuple Type_Payload()
+template<class Type_Key, class Type_Ts, class Type_Payload>
+void SWmeta<Type_Key,Type_Ts,Type_Payload>::insert_batch(vector<pair<Type_Key, Type_Ts>> & batch, vector<Type_Payload> & payloads)
+{
+    #if defined DEBUG 
+    cout << "[Debug Info:] Class {SWmeta} :: Member Function {insert_batch()} Begin" << endl;
+    cout << "[Debug Info:] batch.size() =  " << batch.size() << endl;
+    cout << endl;
+    #endif
+
+    if (batch.empty())
+    {
+        return;
+    }
+
+    if (payloads.empty())
+    {
+        sort(batch.begin(), batch.end());
+    }
+    else
+    {
+        vector<int> order(batch.size());
+        iota(order.begin(), order.end(), 0);
+        sort(order.begin(), order.end(), [&](int i, int j) {return batch[i] < batch[j];});
+
+        vector<pair<Type_Key, Type_Ts>> sortedBatch;
+        vector<Type_Payload> sortedPayloads;
+        sortedBatch.reserve(batch.size());
+        sortedPayloads.reserve(batch.size());
+        for (auto & it : order)
+        {
+            sortedBatch.push_back(batch[it]);
+            sortedPayloads.push_back(move(payloads[it]));
+        }
+        batch.swap(sortedBatch);
+        payloads.swap(sortedPayloads);
+    }
+    const Type_Payload defaultPayload = Type_Payload();
+
+    Type_Ts maxTimeStamp = batch.front().second;
+    for (auto & it : batch)
+    {
+        maxTimeStamp = (it.second > maxTimeStamp) ? it.second : maxTimeStamp;
+    }
+    Type_Ts batchLowerLimit = calculate_lower_limit(maxTimeStamp);
+
+    vector<pair<SWseg<Type_Key,Type_Ts,Type_Payload>*,int>> pendingRetrain; //segment, number of retrain requests in batch
+    vector<pair<Type_Key,int >> updateSeg;
+    int batchExtendFlag = 0;
+    int foundPos = -1;
+
+    for (int i = 0; i < batch.size(); i++)
+    {
+        Type_Key newKey = batch[i].first;
+        Type_Ts newTimeStamp = batch[i].second;
+        const Type_Payload & newPayload = payloads.empty() ? defaultPayload : payloads[i];
+        Type_Ts lowerLimit = calculate_lower_limit(newTimeStamp);
+
+        #if defined(TUNE_TIME) || defined(TIME_BREAKDOWN)
+        #ifdef TUNE_TIME
+        rootNoSearch++;
+        #endif
+        uint64_t timer = 0;
+        startTimer(&timer);
+        #endif
+
+        //Merge-join walk from the previous segment, fall back to model search on long walks or after SWmeta changed
+        if (foundPos != -1)
+        {
+            int walkLength = 0;
+            int nextPos = (foundPos+1 < m_keys.size()) ? bitmap_closest_right_nongap(foundPos+1) : m_keys.size();
+
+            while (nextPos < m_keys.size() && m_keys[nextPos] <= newKey)
+            {
+                if (++walkLength > BATCH_MAX_WALK)
+                {
+                    foundPos = -1;
+                    break;
+                }
+                foundPos = nextPos;
+                nextPos = (foundPos+1 < m_keys.size()) ? bitmap_closest_right_nongap(foundPos+1) : m_keys.size();
+            }
+        }
+
+        if (foundPos == -1 && !find_insert_seg(newKey, foundPos))
+        {
+            return;
+        }
+
+        #if defined(TUNE_TIME) || defined(TIME_BREAKDOWN)
+        stopTimer(&timer);
+        searchCycle += timer;
+        #endif
+
+        #ifdef INLINE_SEG_MODEL
+        seg_model_prefetch(foundPos, newKey);
+        #endif
+
+        updateSeg.clear();
+        m_ptr[foundPos]->insert(newKey, newTimeStamp, newPayload, lowerLimit, updateSeg);
+
+        #ifdef INLINE_SEG_MODEL
+        seg_model_refresh(foundPos);
+        #endif
+
+        if (updateSeg.empty())
+        {
+            continue;
+        }
+
+        //Retrain requests are deferred (indexes are converted to segments as SWmeta may shift)
+        for (auto & itSeg : updateSeg)
+        {
+            if (itSeg.first != numeric_limits<Type_Key>::max() && itSeg.second%10 == 1)
+            {
+                SWseg<Type_Key,Type_Ts,Type_Payload> * segPtr = m_ptr[itSeg.second/10];
+                auto itPending = find_if(pendingRetrain.begin(), pendingRetrain.end(), 
+                                        [segPtr](const pair<SWseg<Type_Key,Type_Ts,Type_Payload>*,int> & p) { return p.first == segPtr; });
+                if (itPending == pendingRetrain.end())
+                {
+                    pendingRetrain.push_back(make_pair(segPtr,1));
+                }
+                else
+                {
+                    itPending->second++;
+                }
+            }
+        }
+
+        if (updateSeg.size() > 1 && updateSeg[1].first == numeric_limits<Type_Key>::max())
+        {
+            swap(updateSeg[0], updateSeg[1]);
+        }
+
+        for (auto & itSeg : updateSeg)
+        {
+            int retrainExtendFlag = 0;
+
+            if (itSeg.first == numeric_limits<Type_Key>::max())
+            {
+                SWseg<Type_Key,Type_Ts,Type_Payload> * segPtr = m_ptr[itSeg.second];
+                pendingRetrain.erase(remove_if(pendingRetrain.begin(), pendingRetrain.end(), 
+                                    [segPtr](const pair<SWseg<Type_Key,Type_Ts,Type_Payload>*,int> & p) { return p.first == segPtr; }), 
+                                    pendingRetrain.end());
+                update_seg_delete(itSeg.second);
+            }
+            else if (itSeg.second%10 == 0)
+            {
+                update_seg_replace(itSeg.first, itSeg.second/10, retrainExtendFlag);
+            }
+
+            if (retrainExtendFlag)
+            {
+                if (m_slope == -1) //Single segment SWmeta is sized by max_buffer_size(), retrain now
+                {
+                    insert_batch_retrain(pendingRetrain, lowerLimit, retrainExtendFlag);
+                    meta_extend_retrain(retrainExtendFlag, lowerLimit);
+                }
+                else
+                {
+                    batchExtendFlag = max(batchExtendFlag, retrainExtendFlag);
+                }
+            }
+        }
+
+        foundPos = -1;
+    }
+
+    insert_batch_retrain(pendingRetrain, batchLowerLimit, batchExtendFlag);
+
+    if (batchExtendFlag)
+    {
+        #if defined(TUNE_TIME) || defined(TIME_BREAKDOWN)
+        uint64_t timer = 0;
+        startTimer(&timer);
+        #endif
+
+        meta_extend_retrain(batchExtendFlag, batchLowerLimit);
+
+        #if defined(TUNE_TIME) || defined(TIME_BREAKDOWN)
+        stopTimer(&timer);
+        retrainCycle += timer;
+        #endif
+    }
+
+    #ifdef EAGER_EXPIRY
+    expire_step(batchLowerLimit, EXPIRY_STEP_SIZE * (int)batch.size());
+    #endif
+
+    #ifdef BACKGROUND_RETRAIN
+    if (m_retrainNumDone.load(memory_order_relaxed))
+    {
+        retrain_publish();
+    }
+    #endif
+
+    #ifdef INCREMENTAL_META_RETRAIN
+    if (m_rebuildStage > 0)
+    {
+        meta_rebuild_step(batchLowerLimit, META_REBUILD_STEP * (int)batch.size());
+    }
+    #endif
+
+    #if defined DEBUG 
+    cout << "[Debug Info:] Class {SWmeta} :: Member Function {insert_batch()} End" << endl;
+    cout << endl;
+    #endif
+}
+
+//Applies the deferred retrain requests (same rendezvous as insert: first request flags, second retrains)
+template<class Type_Key, class Type_Ts, class Type_Payload>
+void SWmeta<Type_Key,Type_Ts,Type_Payload>::insert_batch_retrain(vector<pair<SWseg<Type_Key,Type_Ts,Type_Payload>*,int>> & pendingRetrain, Type_Ts & lowerLimit, int & retrainExtendFlag)
+{
+    while (!pendingRetrain.empty())
+    {
+        SWseg<Type_Key,Type_Ts,Type_Payload> * segPtr = pendingRetrain.back().first;
+        int noRequest = pendingRetrain.back().second;
+        pendingRetrain.pop_back();
+
+        int index = segPtr->m_parentIndex;
+
+        if (!bitmap_exists(m_retrainBitmap,index) && noRequest < 2)
+        {
+            bitmap_set_bit(m_retrainBitmap,index);
+            continue;
+        }
+        bitmap_set_bit(m_retrainBitmap,index);
+
+        pair<int,int> retrainSegmentIndex = bitmap_retrain_range(index);
 
-    int foundPos = 0;
+        for (int i = retrainSegmentIndex.first; i < retrainSegmentIndex.second+1; i++)
+        {
+            if (bitmap_exists(i))
+            {
+                SWseg<Type_Key,Type_Ts,Type_Payload> * retrainPtr = m_ptr[i];
+                pendingRetrain.erase(remove_if(pendingRetrain.begin(), pendingRetrain.end(), 
+                                    [retrainPtr](const pair<SWseg<Type_Key,Type_Ts,Type_Payload>*,int> & p) { return p.first == retrainPtr; }), 
+                                    pendingRetrain.end());
+            }
+        }
+
+        int tempExtendFlag = 0;
+        update_seg_retrain(retrainSegmentIndex, lowerLimit, tempExtendFlag);
+        retrainExtendFlag = max(retrainExtendFlag, tempExtendFlag);
+    }
+}
+
+/*
+Update Segment Helpers
+*/
+template<class Type_Key, class Type_Ts, class Type_Payload>
+bool SWmeta<Type_Key,Type_Ts,Type_Payload>::find_insert_seg(Type_Key & newKey, int & foundPos)
+{
+    foundPos = 0;
     if (m_keys.size() > 1)
     {
         if (newKey > m_startKey)
@@ -950,7 +1935,7 @@ void SWmeta<Type_Key,Type_Ts>::insert(pair<Type_Key, Type_Ts> & arrivalTuple)
                 if (rightClosest == m_keys.size())
                 {
                     cout << "Error: Entire Index is Empty" << endl;
-                    return;
+                    return false;
                 }
                 else
                 {
@@ -970,250 +1955,577 @@ void SWmeta<Type_Key,Type_Ts>::insert(pair<Type_Key, Type_Ts> & arrivalTuple)
             throw invalid_argument("SWmeta is empty");
         }
     }
+    return true;
+}
+
+//Retrains SWseg in [retrainSegmentIndex.first, retrainSegmentIndex.second] and inserts the new SWseg into SWmeta
+template<class Type_Key, class Type_Ts, class Type_Payload>
+void SWmeta<Type_Key,Type_Ts,Type_Payload>::update_seg_retrain(pair<int,int> retrainSegmentIndex, Type_Ts & lowerLimit, int & retrainExtendFlag)
+{
+    #ifdef TUNE
+    segNoRetrain++;
+    #endif
+    
+    #if defined(TUNE_TIME) || defined(TIME_BREAKDOWN)
+    #ifdef TUNE_TIME
+    segNoRetrain++;
+    #endif
+    uint64_t timer = 0;
+    startTimer(&timer);
+    #endif
+
+    #ifdef BACKGROUND_RETRAIN
+    retrain_request(retrainSegmentIndex, lowerLimit);
+    #else
+    vector<pair<Type_Key, SWseg<Type_Key,Type_Ts,Type_Payload> * >> tempInsertionNodes;
+
+    retrain_seg(retrainSegmentIndex, lowerLimit, tempInsertionNodes);
+    #endif
 
     #if defined(TUNE_TIME) || defined(TIME_BREAKDOWN)
     stopTimer(&timer);
-    searchCycle += timer;
+    retrainCycle += timer;
     #endif
 
-    vector<pair<Type_Key,int >> updateSeg;
-    m_ptr[foundPos]->insert(newKey, newTimeStamp, lowerLimit, updateSeg);
+    #ifndef BACKGROUND_RETRAIN
+    update_seg_swap(retrainSegmentIndex, tempInsertionNodes, retrainExtendFlag);
+    #endif
+}
 
-    //Insert into SWmeta and Retrain if neccessary
-    if (updateSeg.size() > 1)
+//Replaces the SWseg in [retrainSegmentIndex.first, retrainSegmentIndex.second] by their retrained SWseg
+template<class Type_Key, class Type_Ts, class Type_Payload>
+void SWmeta<Type_Key,Type_Ts,Type_Payload>::update_seg_swap(pair<int,int> retrainSegmentIndex, vector<pair<Type_Key, SWseg<Type_Key,Type_Ts,Type_Payload> * >> & newSegs, int & retrainExtendFlag)
+{
+    if (m_ptr[retrainSegmentIndex.first]->m_leftSibling)
     {
-        if (updateSeg[1].first == numeric_limits<Type_Key>::max())
+        m_ptr[retrainSegmentIndex.first]->m_leftSibling->m_rightSibling = newSegs.front().second;
+        newSegs.front().second->m_leftSibling = m_ptr[retrainSegmentIndex.first]->m_leftSibling;
+    }
+
+    if (m_ptr[retrainSegmentIndex.second]->m_rightSibling)
+    {
+        m_ptr[retrainSegmentIndex.second]->m_rightSibling->m_leftSibling = newSegs.back().second;
+        newSegs.back().second->m_rightSibling = m_ptr[retrainSegmentIndex.second]->m_rightSibling;
+    }
+
+    for (int i = retrainSegmentIndex.first; i < retrainSegmentIndex.second+1; i++)
+    {
+        if (bitmap_exists(i))
         {
-            swap(updateSeg[0], updateSeg[1]);
+            release_seg(m_ptr[i]);
+            m_ptr[i] = nullptr;
+            bitmap_erase_bit(i);
+            bitmap_erase_bit(m_retrainBitmap,i);
+            m_numPairExist--;
         }
+    }
 
-        if (updateSeg.size() > 2)
+    if (retrainSegmentIndex.first) // if it.second == 0 -> first index no need to replace previous keys
+    {
+        Type_Key previousKey = m_keys[retrainSegmentIndex.first-1];
+        m_keys[retrainSegmentIndex.first] = previousKey;
+        retrainSegmentIndex.first++;
+
+        while (!bitmap_exists(retrainSegmentIndex.first) && retrainSegmentIndex.first < m_keys.size())
         {
-            cout << "Error: Insertion No Update Seg > 2" << endl; //Check: Delete later
+            m_keys[retrainSegmentIndex.first] = previousKey;
+            retrainSegmentIndex.first++;
         }
+    }
 
-        if (updateSeg[0].first != numeric_limits<Type_Key>::max() &&  updateSeg[1].first != numeric_limits<Type_Key>::max())
+    //Insert into keysPtr
+    for (auto & itTemp : newSegs)
+    {                                                
+        meta_insertion(itTemp,retrainExtendFlag,false);
+    }
+}
+
+//Reinserts SWseg at index with its new start key
+template<class Type_Key, class Type_Ts, class Type_Payload>
+void SWmeta<Type_Key,Type_Ts,Type_Payload>::update_seg_replace(Type_Key newStartKey, int index, int & retrainExtendFlag)
+{
+    pair<Type_Key, SWseg<Type_Key,Type_Ts,Type_Payload>*> tempPair = make_pair(newStartKey,m_ptr[index]);
+    bool tempBitmap = (bitmap_exists(m_retrainBitmap,index)) ? true : false;
+
+    #ifdef INCREMENTAL_META_RETRAIN
+    meta_rebuild_erase(m_ptr[index]);
+    #endif
+
+    m_ptr[index] = nullptr;
+    bitmap_erase_bit(index);
+    bitmap_erase_bit(m_retrainBitmap,index);
+    m_numPairExist--;
+
+    if (index) // if index == 0 -> first index no need to replace previous keys
+    {
+        Type_Key previousKey = m_keys[index-1];
+        m_keys[index] = previousKey;
+        index++;
+
+        while (!bitmap_exists(index) && index < m_keys.size())
         {
-            cout << "Error: Insertion Two Segments and not deleting any" << endl; //Check: Delete later
+            m_keys[index] = previousKey;
+            index++;
         }
     }
+    
+    meta_insertion(tempPair,retrainExtendFlag,tempBitmap);
+}
 
-    for (auto &it : updateSeg)
+//Deletes expired SWseg at index
+template<class Type_Key, class Type_Ts, class Type_Payload>
+void SWmeta<Type_Key,Type_Ts,Type_Payload>::update_seg_delete(int index)
+{
+    release_seg(m_ptr[index]);
+    m_ptr[index] = nullptr;
+    bitmap_erase_bit(index);
+    bitmap_erase_bit(m_retrainBitmap,index);
+    m_numPairExist--;
+    
+    if (index) // if index == 0 -> first index no need to replace previous keys
     {
-        if (it.first != numeric_limits<Type_Key>::max())
+        Type_Key previousKey = m_keys[index-1];
+        m_keys[index] = previousKey;
+        index++;
+
+        while (!bitmap_exists(index) && index < m_keys.size())
         {
-            if (it.second%10 == 1)
-            {               
-                it.second /= 10;
+            m_keys[index] = previousKey;
+            index++;
+        }
+    }
+}
 
-                if (bitmap_exists(m_retrainBitmap,it.second))
-                {
-                    #ifdef TUNE
-                    segNoRetrain++;
-                    #endif
-                    
-                    #if defined(TUNE_TIME) || defined(TIME_BREAKDOWN)
-                    #ifdef TUNE_TIME
-                    segNoRetrain++;
-                    #endif
-                    timer = 0;
-                    startTimer(&timer);
-                    #endif
-                    
-                    vector<pair<Type_Key, SWseg<Type_Key,Type_Ts> * >> tempInsertionNodes;
+/*
+Eager Expiry
+*/
 
-                    pair<int,int> retrainSegmentIndex = bitmap_retrain_range(it.second);
+//Removes every tuple with timestamp < lowerLimit, touching only the SWseg queued with an older max timestamp.
+//Returns the number of tuples removed.
+template<class Type_Key, class Type_Ts, class Type_Payload>
+uint64_t SWmeta<Type_Key,Type_Ts,Type_Payload>::expire_until(Type_Ts lowerLimit)
+{
+    return expire_step(lowerLimit, numeric_limits<int>::max());
+}
 
-                    retrain_seg(retrainSegmentIndex, lowerLimit, tempInsertionNodes);
-                    
-                    if (m_ptr[retrainSegmentIndex.first]->m_leftSibling)
-                    {
-                        m_ptr[retrainSegmentIndex.first]->m_leftSibling->m_rightSibling = tempInsertionNodes.front().second;
-                        tempInsertionNodes.front().second->m_leftSibling = m_ptr[retrainSegmentIndex.first]->m_leftSibling;
-                    }
+//Pops up to maxSteps queue entries older than lowerLimit. Fully expired SWseg are deleted, 
+//the others were appended to since they were queued: their expired tuples are removed (retrain if under half full) and they are requeued.
+template<class Type_Key, class Type_Ts, class Type_Payload>
+uint64_t SWmeta<Type_Key,Type_Ts,Type_Payload>::expire_step(Type_Ts & lowerLimit, int maxSteps)
+{
+    uint64_t numExpired = 0;
+    int retrainExtendFlag = 0;
 
-                    if (m_ptr[retrainSegmentIndex.second]->m_rightSibling)
-                    {
-                        m_ptr[retrainSegmentIndex.second]->m_rightSibling->m_leftSibling = tempInsertionNodes.back().second;
-                        tempInsertionNodes.back().second->m_rightSibling = m_ptr[retrainSegmentIndex.second]->m_rightSibling;
-                    }
+    while (maxSteps-- > 0 && !m_expiryQueue.empty() && m_expiryQueue.top().first < lowerLimit)
+    {
+        int slot = m_expiryQueue.top().second;
+        m_expiryQueue.pop();
+        SWseg<Type_Key,Type_Ts,Type_Payload> * segPtr = m_expirySlots[slot];
 
-                    #if defined(TUNE_TIME) || defined(TIME_BREAKDOWN)
-                    stopTimer(&timer);
-                    retrainCycle += timer;
-                    #endif
+        if (!segPtr) //Already freed by a scan, insert or retrain
+        {
+            m_expiryFreeSlots.push_back(slot);
+            continue;
+        }
 
-                    if (retrainSegmentIndex.first == retrainSegmentIndex.second)
-                    {
-                        delete m_ptr[it.second];
-                        m_ptr[it.second] = nullptr;
-                        bitmap_erase_bit(it.second);
-                        bitmap_erase_bit(m_retrainBitmap,it.second);
-                        m_numPairExist--;
-                    }
-                    else
-                    {
-                        for (int i = retrainSegmentIndex.first; i < retrainSegmentIndex.second+1; i++)
-                        {
-                            if (bitmap_exists(i))
-                            {
-                                delete m_ptr[i];
-                                m_ptr[i] = nullptr;
-                                bitmap_erase_bit(i);
-                                bitmap_erase_bit(m_retrainBitmap,i);
-                                m_numPairExist--;
-                            }
-                        }
-                    }
+        if (segPtr->m_maxTimeStamp < lowerLimit)
+        {
+            if (!segPtr->m_leftSibling && !segPtr->m_rightSibling) //Keep the last SWseg, inserts need a segment to land in
+            {
+                m_expiryQueue.push(make_pair(segPtr->m_maxTimeStamp, slot));
+                break;
+            }
 
-                    if (retrainSegmentIndex.first) // if it.second == 0 -> first index no need to replace previous keys
-                    {
-                        Type_Key previousKey = m_keys[retrainSegmentIndex.first-1];
-                        m_keys[retrainSegmentIndex.first] = previousKey;
-                        retrainSegmentIndex.first++;
+            numExpired += segPtr->m_numPairExist + segPtr->m_numPairBuffer;
 
-                        while (!bitmap_exists(retrainSegmentIndex.first) && retrainSegmentIndex.first < m_keys.size())
-                        {
-                            m_keys[retrainSegmentIndex.first] = previousKey;
-                            retrainSegmentIndex.first++;
-                        }
-                    }
+            if (segPtr->m_leftSibling)
+            {
+                segPtr->m_leftSibling->m_rightSibling = segPtr->m_rightSibling;
+            }
+            if (segPtr->m_rightSibling)
+            {
+                segPtr->m_rightSibling->m_leftSibling = segPtr->m_leftSibling;
+            }
 
-                    //Insert into keysPtr
-                    int retrainExtendFlag = 0;
-                    for (auto & itTemp : tempInsertionNodes)
-                    {                                                
-                        meta_insertion(itTemp,retrainExtendFlag,false);
-                    }
+            segPtr->m_expirySlot = -1;
+            m_expirySlots[slot] = nullptr;
+            m_expiryFreeSlots.push_back(slot);
+            update_seg_delete(segPtr->m_parentIndex);
+        }
+        else
+        {
+            numExpired += segPtr->expire(lowerLimit);
+            m_expiryQueue.push(make_pair(segPtr->m_maxTimeStamp, slot));
 
-                    #if defined(TUNE_TIME) || defined(TIME_BREAKDOWN)
-                    timer = 0;
-                    startTimer(&timer);
-                    #endif
-
-                    if (retrainExtendFlag)
-                    {               
-                        #if defined DEBUG 
-                        cout << "[Debug Info:] Class {SWmeta} :: Member Function {retrain()}" << endl;
-                        cout << endl;
-                        #elif defined DEBUG_KEY
-                        if(DEBUG_KEY == arrivalTuple.first)
-                        {
-                            cout << "[Debug Info:] Class {SWmeta} :: Member Function {retrain()}" << endl;
-                            cout << endl;
-                        }
-                        #endif
-                        meta_extend_retrain(retrainExtendFlag, lowerLimit);
-                    }
+            if ((double)segPtr->m_numPairExist/segPtr->m_numPair < 0.5)
+            {
+                int index = segPtr->m_parentIndex;
+                bitmap_set_bit(m_retrainBitmap,index);
 
-                    #if defined(TUNE_TIME) || defined(TIME_BREAKDOWN)
-                    stopTimer(&timer);
-                    retrainCycle += timer;
-                    #endif
-                }
-                else
-                {
-                    bitmap_set_bit(m_retrainBitmap,it.second);
-                }
+                int tempExtendFlag = 0;
+                update_seg_retrain(bitmap_retrain_range(index), lowerLimit, tempExtendFlag);
+                retrainExtendFlag = max(retrainExtendFlag, tempExtendFlag);
+            }
+        }
+    }
+
+    if (retrainExtendFlag)
+    {
+        meta_extend_retrain(retrainExtendFlag, lowerLimit);
+    }
+
+    return numExpired;
+}
+
+template<class Type_Key, class Type_Ts, class Type_Payload>
+inline void SWmeta<Type_Key,Type_Ts,Type_Payload>::expiry_register(SWseg<Type_Key,Type_Ts,Type_Payload> * segPtr)
+{
+    if (m_expiryQueue.size() > 2 * (size_t)m_numPairExist + 64) //Too many entries of freed SWseg (expiry not called often enough)
+    {
+        expiry_rebuild();
+    }
+
+    if (m_expiryFreeSlots.empty())
+    {
+        segPtr->m_expirySlot = m_expirySlots.size();
+        m_expirySlots.push_back(segPtr);
+    }
+    else
+    {
+        segPtr->m_expirySlot = m_expiryFreeSlots.back();
+        m_expiryFreeSlots.pop_back();
+        m_expirySlots[segPtr->m_expirySlot] = segPtr;
+    }
+    m_expiryQueue.push(make_pair(segPtr->m_maxTimeStamp, segPtr->m_expirySlot));
+}
+
+//Requeues the live SWseg with their current max timestamp and frees the slots of deleted SWseg
+template<class Type_Key, class Type_Ts, class Type_Payload>
+void SWmeta<Type_Key,Type_Ts,Type_Payload>::expiry_rebuild()
+{
+    vector<pair<Type_Ts,int>> entries;
+    entries.reserve(m_numPairExist);
+    m_expiryFreeSlots.clear();
+
+    for (int slot = 0; slot < m_expirySlots.size(); slot++)
+    {
+        if (m_expirySlots[slot])
+        {
+            entries.push_back(make_pair(m_expirySlots[slot]->m_maxTimeStamp, slot));
+        }
+        else
+        {
+            m_expiryFreeSlots.push_back(slot);
+        }
+    }
+
+    m_expiryQueue = priority_queue<pair<Type_Ts,int>, vector<pair<Type_Ts,int>>, greater<pair<Type_Ts,int>>>(greater<pair<Type_Ts,int>>(), move(entries));
+}
+
+//Deletes an SWseg, its queue entry is dropped (and the slot reused) when it reaches the top of the queue
+template<class Type_Key, class Type_Ts, class Type_Payload>
+inline void SWmeta<Type_Key,Type_Ts,Type_Payload>::release_seg(SWseg<Type_Key,Type_Ts,Type_Payload> * segPtr)
+{
+    #ifdef INCREMENTAL_META_RETRAIN
+    meta_rebuild_erase(segPtr);
+    #endif
+
+    #ifdef BACKGROUND_RETRAIN
+    if (segPtr->m_retrainTask)
+    {
+        retrain_cancel(segPtr->m_retrainTask);
+    }
+    #endif
+
+    if (segPtr->m_expirySlot != -1)
+    {
+        m_expirySlots[segPtr->m_expirySlot] = nullptr;
+    }
+
+    #ifdef SEG_POOL
+    if (!segPtr->m_localKeys.get_allocator().m_pool) //Built by the background retrain thread or a parallel bulk load
+    {
+        delete segPtr;
+        return;
+    }
+    segPtr->~SWseg<Type_Key,Type_Ts,Type_Payload>();
+    m_pool.deallocate(segPtr, sizeof(SWseg<Type_Key,Type_Ts,Type_Payload>));
+    #else
+    delete segPtr;
+    #endif
+}
+
+template<class Type_Key, class Type_Ts, class Type_Payload>
+template<class... Args>
+inline SWseg<Type_Key,Type_Ts,Type_Payload> * SWmeta<Type_Key,Type_Ts,Type_Payload>::new_seg(Args &&... args)
+{
+    #ifdef SEG_POOL
+    return new (m_pool.allocate(sizeof(SWseg<Type_Key,Type_Ts,Type_Payload>))) SWseg<Type_Key,Type_Ts,Type_Payload>(forward<Args>(args)..., max_buffer_size(), &m_pool);
+    #else
+    return new SWseg<Type_Key,Type_Ts,Type_Payload>(forward<Args>(args)..., max_buffer_size());
+    #endif
+}
+
+#ifdef BACKGROUND_RETRAIN
+/*
+Background Retrain
+*/
+
+//Copies the live tuples of the SWseg in the range and hands them to the background thread.
+//The SWseg keep serving (and log their inserts) until the retrained SWseg are published. Their retrain bits stay set
+//until then (update_seg_swap clears them), so a cancelled retrain is requested again by the next flag.
+template<class Type_Key, class Type_Ts, class Type_Payload>
+void SWmeta<Type_Key,Type_Ts,Type_Payload>::retrain_request(pair<int,int> retrainSegmentIndex, Type_Ts & lowerLimit)
+{
+    for (int i = retrainSegmentIndex.first; i < retrainSegmentIndex.second+1; i++)
+    {
+        if (bitmap_exists(i) && m_ptr[i]->m_retrainTask) //Requested again once the pending retrain is published
+        {
+            return;
+        }
+    }
+
+    SWretrainTask<Type_Key,Type_Ts,Type_Payload> * task = new SWretrainTask<Type_Key,Type_Ts,Type_Payload>();
+    task->splitError = splitError;
+    task->numBufferInsert = 0;
+
+    for (int i = retrainSegmentIndex.first; i < retrainSegmentIndex.second+1; i++)
+    {
+        if (bitmap_exists(i))
+        {
+            m_ptr[i]->merge_data(task->data, task->payloads, lowerLimit);
+            task->numBufferInsert += m_ptr[i]->m_numBufferInsert;
+            task->oldSegs.push_back(m_ptr[i]);
+        }
+    }
+    task->lowerLimit = lowerLimit;
+
+    if (task->data.empty()) //Everything expired, left to lazy deletion
+    {
+        delete task;
+        return;
+    }
+
+    #ifdef TUNE
+    segLengthRetrain += task->data.size();
+    #endif
+
+    for (auto & it : task->oldSegs)
+    {
+        it->m_retrainTask = task;
+    }
+
+    if (!m_retrainThread.joinable())
+    {
+        m_retrainThread = thread(&SWmeta<Type_Key,Type_Ts,Type_Payload>::retrain_worker, this);
+    }
+
+    {
+        lock_guard<mutex> lock(m_retrainMutex);
+        m_retrainRequests.push_back(task);
+    }
+    m_retrainCv.notify_one();
+    m_retrainNumPending++;
+}
+
+//Background thread loop, only reads the data of its request and SWparams
+template<class Type_Key, class Type_Ts, class Type_Payload>
+void SWmeta<Type_Key,Type_Ts,Type_Payload>::retrain_worker()
+{
+    while (true)
+    {
+        SWretrainTask<Type_Key,Type_Ts,Type_Payload> * task;
+        {
+            unique_lock<mutex> lock(m_retrainMutex);
+            m_retrainCv.wait(lock, [this] { return m_retrainStop || !m_retrainRequests.empty(); });
+            if (m_retrainStop)
+            {
+                return;
+            }
+            task = m_retrainRequests.front();
+            m_retrainRequests.pop_front();
+        }
+
+        build_seg(task->data, task->payloads, task->splitError, task->numBufferInsert, false, task->newSegs);
+        vector<pair<Type_Key,Type_Ts>>().swap(task->data);
+        SWpayloadColumn<Type_Payload>().swap(task->payloads);
+
+        {
+            lock_guard<mutex> lock(m_retrainMutex);
+            m_retrainDone.push_back(task);
+            m_retrainNumDone.store(m_retrainDone.size(), memory_order_relaxed);
+        }
+        m_retrainDoneCv.notify_all();
+    }
+}
+
+//Swaps finished retrains into SWmeta, then replays the inserts the replaced SWseg received after their copy
+template<class Type_Key, class Type_Ts, class Type_Payload>
+void SWmeta<Type_Key,Type_Ts,Type_Payload>::retrain_publish()
+{
+    if (m_retrainPublishing)
+    {
+        return;
+    }
+    m_retrainPublishing = true;
+
+    vector<SWretrainTask<Type_Key,Type_Ts,Type_Payload>*> done;
+    {
+        lock_guard<mutex> lock(m_retrainMutex);
+        done.swap(m_retrainDone);
+        m_retrainNumDone.store(0, memory_order_relaxed);
+    }
+
+    for (auto & task : done)
+    {
+        m_retrainNumPending--;
+
+        //The replaced SWseg may have moved in SWmeta, but are still adjacent
+        pair<int,int> retrainSegmentIndex = make_pair(numeric_limits<int>::max(), -1);
+        if (!task->cancelled)
+        {
+            for (auto & it : task->oldSegs)
+            {
+                retrainSegmentIndex.first = min(retrainSegmentIndex.first, it->m_parentIndex);
+                retrainSegmentIndex.second = max(retrainSegmentIndex.second, it->m_parentIndex);
+            }
+
+            int numSegs = 0;
+            for (int i = retrainSegmentIndex.first; i < retrainSegmentIndex.second+1; i++)
+            {
+                numSegs += bitmap_exists(i);
+            }
+
+            bool moved = false;
+            for (auto & it : task->oldSegs)
+            {
+                moved |= (m_ptr[it->m_parentIndex] != it);
+            }
+
+            if (moved || numSegs != (int)task->oldSegs.size())
+            {
+                retrain_cancel(task);
             }
-            else //Replace SWseg
+        }
+
+        if (task->cancelled)
+        {
+            for (auto & it : task->newSegs)
             {
-                it.second /= 10;
+                delete it.second;
+            }
+            delete task;
+            continue;
+        }
 
-                pair<Type_Key, SWseg<Type_Key,Type_Ts>*> tempPair = make_pair(it.first,m_ptr[it.second]);
-                bool tempBitmap = (bitmap_exists(m_retrainBitmap,it.second)) ? true : false;
+        for (auto & it : task->oldSegs)
+        {
+            it->m_retrainTask = nullptr;
+        }
 
-                m_ptr[it.second] = nullptr;
-                bitmap_erase_bit(it.second);
-                bitmap_erase_bit(m_retrainBitmap,it.second);
-                m_numPairExist--;
+        #ifdef TUNE
+        for (auto & it : task->newSegs)
+        {
+            it.second->m_tuneStage = tuneStage;
+        }
+        #endif
 
-                if (it.second) // if it.second == 0 -> first index no need to replace previous keys
-                {
-                    Type_Key previousKey = m_keys[it.second-1];
-                    m_keys[it.second] = previousKey;
-                    it.second++;
+        int retrainExtendFlag = 0;
+        update_seg_swap(retrainSegmentIndex, task->newSegs, retrainExtendFlag);
 
-                    while (!bitmap_exists(it.second) && it.second < m_keys.size())
-                    {
-                        m_keys[it.second] = previousKey;
-                        it.second++;
-                    }
-                }
-                
-                int retrainExtendFlag = 0;
-                meta_insertion(tempPair,retrainExtendFlag,tempBitmap);
+        if (retrainExtendFlag)
+        {
+            meta_extend_retrain(retrainExtendFlag, task->lowerLimit);
+        }
 
-                #if defined(TUNE_TIME) || defined(TIME_BREAKDOWN)
-                timer = 0;
-                startTimer(&timer);
-                #endif
+        for (int i = 0; i < task->delta.size(); i++)
+        {
+            insert(task->delta[i], task->deltaPayloads[i]);
+        }
 
-                if (retrainExtendFlag)
-                {               
-                    #if defined DEBUG 
-                    cout << "[Debug Info:] Class {SWmeta} :: Member Function {retrain()}" << endl;
-                    cout << endl;
-                    #elif defined DEBUG_KEY
-                    if(DEBUG_KEY == arrivalTuple.first)
-                    {
-                        cout << "[Debug Info:] Class {SWmeta} :: Member Function {retrain()}" << endl;
-                        cout << endl;
-                    }
-                    #endif
+        delete task;
+    }
 
-                    meta_extend_retrain(retrainExtendFlag, lowerLimit);
+    m_retrainPublishing = false;
+}
 
-                }
+//An SWseg of the retrain is freed, the retrained SWseg are discarded when it finishes
+template<class Type_Key, class Type_Ts, class Type_Payload>
+void SWmeta<Type_Key,Type_Ts,Type_Payload>::retrain_cancel(SWretrainTask<Type_Key,Type_Ts,Type_Payload> * task)
+{
+    task->cancelled = true;
+    for (auto & it : task->oldSegs)
+    {
+        it->m_retrainTask = nullptr;
+    }
+    vector<pair<Type_Key,Type_Ts>>().swap(task->delta);
+    SWpayloadColumn<Type_Payload>().swap(task->deltaPayloads);
+}
 
-                #if defined(TUNE_TIME) || defined(TIME_BREAKDOWN)
-                stopTimer(&timer);
-                retrainCycle += timer;
-                #endif
-            }
-        }
-        else
+template<class Type_Key, class Type_Ts, class Type_Payload>
+void SWmeta<Type_Key,Type_Ts,Type_Payload>::wait_retrain()
+{
+    while (m_retrainNumPending)
+    {
         {
-            delete m_ptr[it.second];
-            m_ptr[it.second] = nullptr;
-            bitmap_erase_bit(it.second);
-            bitmap_erase_bit(m_retrainBitmap,it.second);
-            m_numPairExist--;
-            
-            if (it.second) // if it.second == 0 -> first index no need to replace previous keys
-            {
-                Type_Key previousKey = m_keys[it.second-1];
-                m_keys[it.second] = previousKey;
-                it.second++;
-
-                while (!bitmap_exists(it.second) && it.second < m_keys.size())
-                {
-                    m_keys[it.second] = previousKey;
-                    it.second++;
-                }
-            }
+            unique_lock<mutex> lock(m_retrainMutex);
+            m_retrainDoneCv.wait(lock, [this] { return !m_retrainDone.empty(); });
         }
+        retrain_publish();
     }
+}
 
-    #if defined DEBUG 
-    cout << "[Debug Info:] Class {SWmeta} :: Member Function {insert()} End" << endl;
-    cout << endl;
-    #elif defined DEBUG_KEY
-    if(DEBUG_KEY == arrivalTuple.first)
+//Joins the background thread and discards the unpublished retrains
+template<class Type_Key, class Type_Ts, class Type_Payload>
+void SWmeta<Type_Key,Type_Ts,Type_Payload>::retrain_stop()
+{
     {
-        cout << "[Debug Info:] Class {SWmeta} :: Member Function {insert()} End" << endl;
-        cout << endl;
+        lock_guard<mutex> lock(m_retrainMutex);
+        m_retrainStop = true;
     }
-    #endif
-}
+    m_retrainCv.notify_all();
+
+    if (m_retrainThread.joinable())
+    {
+        m_retrainThread.join();
+    }
+
+    m_retrainDone.insert(m_retrainDone.end(), m_retrainRequests.begin(), m_retrainRequests.end());
+    m_retrainRequests.clear();
+
+    for (auto & task : m_retrainDone)
+    {
+        if (!task->cancelled)
+        {
+            retrain_cancel(task);
+        }
 
+        for (auto & it : task->newSegs)
+        {
+            delete it.second;
+        }
+        delete task;
+    }
+    m_retrainDone.clear();
+    m_retrainNumPending = 0;
+}
+#endif
 
 /*
 Node Functions
 */
-template<class Type_Key, class Type_Ts>
-void SWmeta<Type_Key,Type_Ts>::meta_insertion(pair<Type_Key, SWseg<Type_Key,Type_Ts>*> & insertKeyPtr, int & retrainExtendFlag, bool retrainSetBit)
+template<class Type_Key, class Type_Ts, class Type_Payload>
+void SWmeta<Type_Key,Type_Ts,Type_Payload>::meta_insertion(pair<Type_Key, SWseg<Type_Key,Type_Ts,Type_Payload>*> & insertKeyPtr, int & retrainExtendFlag, bool retrainSetBit)
 {
+    if (insertKeyPtr.second->m_expirySlot == -1) //New SWseg (replaced SWseg are already queued)
+    {
+        expiry_register(insertKeyPtr.second);
+    }
+
+    #ifdef INCREMENTAL_META_RETRAIN
+    meta_rebuild_insert(insertKeyPtr);
+    #endif
+
     #if defined(TUNE_TIME) || defined(TIME_BREAKDOWN)
     #ifdef TUNE_TIME
     rootNoInsert++;
@@ -1391,7 +2703,7 @@ void SWmeta<Type_Key,Type_Ts>::meta_insertion(pair<Type_Key, SWseg<Type_Key,Type
 
         m_startKey = m_keys.front();
 
-        if (m_keys.size() == MAX_BUFFER_SIZE)
+        if (m_keys.size() == max_buffer_size())
         {
             retrainExtendFlag = 2;
         }
@@ -1411,8 +2723,8 @@ void SWmeta<Type_Key,Type_Ts>::meta_insertion(pair<Type_Key, SWseg<Type_Key,Type
     #endif
 }
 
-template<class Type_Key, class Type_Ts>
-void SWmeta<Type_Key,Type_Ts>::meta_insertion_model(int & insertionPos, pair<Type_Key, SWseg<Type_Key,Type_Ts>*> & insertKeyPtr, bool & gapAddError, int & retrainExtendFlag, bool & retrainSetBit)
+template<class Type_Key, class Type_Ts, class Type_Payload>
+void SWmeta<Type_Key,Type_Ts,Type_Payload>::meta_insertion_model(int & insertionPos, pair<Type_Key, SWseg<Type_Key,Type_Ts,Type_Payload>*> & insertKeyPtr, bool & gapAddError, int & retrainExtendFlag, bool & retrainSetBit)
 {
 
     //If insertion position is not a gap
@@ -1446,7 +2758,7 @@ void SWmeta<Type_Key,Type_Ts>::meta_insertion_model(int & insertionPos, pair<Typ
                     }
                 }
 
-                vector<SWseg<Type_Key,Type_Ts>*> tempPtr(m_ptr.begin()+insertionPos,m_ptr.begin()+gapPos);
+                vector<SWseg<Type_Key,Type_Ts,Type_Payload>*> tempPtr(m_ptr.begin()+insertionPos,m_ptr.begin()+gapPos);
                 move(tempPtr.begin(),tempPtr.end(),m_ptr.begin()+insertionPos+1);
                 m_ptr[insertionPos] = insertKeyPtr.second;
                 // m_ptr[insertionPos]->increment_parent_index_until_bound(gapPos);
@@ -1485,7 +2797,7 @@ void SWmeta<Type_Key,Type_Ts>::meta_insertion_model(int & insertionPos, pair<Typ
                     }
                 }
 
-                vector<SWseg<Type_Key,Type_Ts>*> tempPtr(m_ptr.begin()+gapPos+1,m_ptr.begin()+insertionPos+1);
+                vector<SWseg<Type_Key,Type_Ts,Type_Payload>*> tempPtr(m_ptr.begin()+gapPos+1,m_ptr.begin()+insertionPos+1);
                 move(tempPtr.begin(),tempPtr.end(),m_ptr.begin()+gapPos);
                 m_ptr[insertionPos] = insertKeyPtr.second;
                 // m_ptr[insertionPos]->decrement_parent_index_until_bound(gapPos);
@@ -1585,8 +2897,8 @@ void SWmeta<Type_Key,Type_Ts>::meta_insertion_model(int & insertionPos, pair<Typ
     }
 }
 
-template<class Type_Key, class Type_Ts>
-void SWmeta<Type_Key,Type_Ts>::meta_insertion_end(pair<Type_Key, SWseg<Type_Key,Type_Ts>*> & insertKeyPtr, int & retrainExtendFlag, bool & retrainSetBit)
+template<class Type_Key, class Type_Ts, class Type_Payload>
+void SWmeta<Type_Key,Type_Ts,Type_Payload>::meta_insertion_end(pair<Type_Key, SWseg<Type_Key,Type_Ts,Type_Payload>*> & insertKeyPtr, int & retrainExtendFlag, bool & retrainSetBit)
 {
     if (bitmap_exists(m_keys.size()-1))
     {
@@ -1657,8 +2969,8 @@ void SWmeta<Type_Key,Type_Ts>::meta_insertion_end(pair<Type_Key, SWseg<Type_Key,
 
 }
 
-template<class Type_Key, class Type_Ts>
-void SWmeta<Type_Key,Type_Ts>::meta_insertion_append(int & insertionPos, pair<Type_Key, SWseg<Type_Key,Type_Ts>*> & insertKeyPtr, int & retrainExtendFlag, bool & retrainSetBit)
+template<class Type_Key, class Type_Ts, class Type_Payload>
+void SWmeta<Type_Key,Type_Ts,Type_Payload>::meta_insertion_append(int & insertionPos, pair<Type_Key, SWseg<Type_Key,Type_Ts,Type_Payload>*> & insertKeyPtr, int & retrainExtendFlag, bool & retrainSetBit)
 {
 
     Type_Key lastKey = m_keys.back();
@@ -1696,9 +3008,16 @@ void SWmeta<Type_Key,Type_Ts>::meta_insertion_append(int & insertionPos, pair<Ty
 }
 
 
-template<class Type_Key, class Type_Ts>
-void SWmeta<Type_Key,Type_Ts>::meta_extend_retrain(int & retrainExtendFlag, Type_Ts & lowerLimit)
+template<class Type_Key, class Type_Ts, class Type_Payload>
+void SWmeta<Type_Key,Type_Ts,Type_Payload>::meta_extend_retrain(int & retrainExtendFlag, Type_Ts & lowerLimit)
 {
+    #ifdef INCREMENTAL_META_RETRAIN
+    if (meta_rebuild_start(retrainExtendFlag, lowerLimit))
+    {
+        return;
+    }
+    #endif
+
     #ifdef TUNE_TIME
     rootNoRetrain++;
     int tempSize = m_keys.size();
@@ -1708,7 +3027,7 @@ void SWmeta<Type_Key,Type_Ts>::meta_extend_retrain(int & retrainExtendFlag, Type
     
     retrainExtendFlag = ((double)m_numPairExist/(m_keys.size()*1.05) < 0.5) ? 2 : retrainExtendFlag;
     vector<Type_Key> tempKey;
-    vector<SWseg<Type_Key,Type_Ts>*> tempPtr;
+    vector<SWseg<Type_Key,Type_Ts,Type_Payload>*> tempPtr;
     vector<uint64_t> tempBitmap;
     vector<uint64_t> tempRetrainBitmap;
     int firstIndex;
@@ -1831,7 +3150,7 @@ void SWmeta<Type_Key,Type_Ts>::meta_extend_retrain(int & retrainExtendFlag, Type
                         m_ptr[currentIndex]->m_rightSibling->m_leftSibling = m_ptr[currentIndex]->m_leftSibling;
                     }
                     
-                    delete m_ptr[currentIndex];
+                    release_seg(m_ptr[currentIndex]);
                     m_ptr[currentIndex] = nullptr;
                     currentIndex++;
                 }
@@ -1851,40 +3170,360 @@ void SWmeta<Type_Key,Type_Ts>::meta_extend_retrain(int & retrainExtendFlag, Type
         m_rightSearchBound = 0;
         m_leftSearchBound = 0;
 
-        int bitmapSize = ceil(MAX_BUFFER_SIZE/64.);
-        vector<uint64_t> temp(bitmapSize,0);
-        tempBitmap = temp;
-        tempRetrainBitmap = temp;
+        int bitmapSize = ceil(max_buffer_size()/64.);
+        vector<uint64_t> temp(bitmapSize,0);
+        tempBitmap = temp;
+        tempRetrainBitmap = temp;
+
+        m_numPairExist = 1;
+        bitmap_set_bit(tempBitmap,0);
+
+        if (bitmap_exists(m_retrainBitmap,firstIndex))
+        {
+            bitmap_set_bit(tempRetrainBitmap,0);
+        }
+        
+        m_ptr[firstIndex]->m_parentIndex = 0;
+        tempKey.push_back(m_keys[firstIndex]);
+        tempPtr.push_back(m_ptr[firstIndex]);
+        // m_maxSearchError = 0;
+    }
+
+    m_keys = tempKey;
+    m_ptr = tempPtr;
+    m_bitmap = tempBitmap;
+    m_retrainBitmap = tempRetrainBitmap;
+    bitmap_summary_rebuild();
+
+    #ifdef TUNE_TIME
+    stopTimer(&temp);
+    rootRetrainCycle += temp;
+    rootLengthRetrain += tempSize;
+    rootRetrainCyclePerLength += (double)temp/tempSize;
+    #endif
+}
+
+/*
+Incremental SWmeta Rebuild
+*/
+#ifdef INCREMENTAL_META_RETRAIN
+//Starts building the new SWmeta arrays in the background, returns false if the rebuild should run at once (small or single segment SWmeta)
+template<class Type_Key, class Type_Ts, class Type_Payload>
+bool SWmeta<Type_Key,Type_Ts,Type_Payload>::meta_rebuild_start(int & retrainExtendFlag, Type_Ts & lowerLimit)
+{
+    if (m_rebuildStage > 0) //Already rebuilding, the new arrays replace the current ones
+    {
+        return true;
+    }
+
+    if (m_rebuildStage == -1 || m_slope == -1 || m_numPairExist <= META_REBUILD_STEP)
+    {
+        m_rebuildStage = 0;
+        return false;
+    }
+
+    #ifdef TUNE_TIME
+    rootNoRetrain++;
+    #endif
+
+    retrainExtendFlag = ((double)m_numPairExist/(m_keys.size()*1.05) < 0.5) ? 2 : retrainExtendFlag;
+
+    m_rebuildCursor = 0;
+    m_rebuildCnt = 0;
+    m_rebuildNumPairExist = 0;
+    m_rebuildRightSearchBound = 0;
+    m_rebuildVisited = false;
+    m_rebuildRelocate = false;
+    m_rebuildKeys.clear();
+    m_rebuildPtr.clear();
+    m_rebuildBitmap.clear();
+    m_rebuildPending.clear();
+
+    if (retrainExtendFlag == 1) //Extend
+    {
+        m_rebuildSlope = m_slope * 1.05;
+        m_rebuildStartKey = m_startKey;
+        m_rebuildKeys.reserve(m_keys.size()*1.05);
+        m_rebuildPtr.reserve(m_ptr.size()*1.05);
+        m_rebuildMaxKey = m_keys.back();
+        m_rebuildStage = 2;
+    }
+    else //Retrain
+    {
+        fill(m_rebuildSum, m_rebuildSum + 4, 0);
+        m_rebuildStage = 1;
+    }
+
+    meta_rebuild_step(lowerLimit, META_REBUILD_STEP);
+    return true;
+}
+
+//Visits up to maxSlots slots of m_keys: stage 1 fits the new model, stage 2 places the SWseg into the new arrays.
+//Stage 2 resumes after the key of the last SWseg it visited, so shifts of the current arrays do not matter.
+template<class Type_Key, class Type_Ts, class Type_Payload>
+void SWmeta<Type_Key,Type_Ts,Type_Payload>::meta_rebuild_step(Type_Ts & lowerLimit, int maxSlots)
+{
+    if (m_rebuildStage == 1)
+    {
+        while (maxSlots > 0 && m_rebuildCursor < m_keys.size())
+        {
+            int i = m_rebuildCursor++;
+            maxSlots--;
+
+            if (bitmap_exists(i) && m_ptr[i]->m_maxTimeStamp >= lowerLimit)
+            {
+                if (!m_rebuildCnt)
+                {
+                    m_rebuildStartKey = m_keys[i];
+                }
+                m_rebuildSum[0] += (double)m_keys[i];
+                m_rebuildSum[1] += m_rebuildCnt;
+                m_rebuildSum[2] += (double)m_keys[i] * m_rebuildCnt;
+                m_rebuildSum[3] += (double)pow(m_keys[i],2);
+                m_rebuildCnt++;
+            }
+        }
+
+        if (m_rebuildCursor < m_keys.size())
+        {
+            return;
+        }
+
+        if (m_rebuildCnt < 2) //Single segment SWmeta, rebuild at once
+        {
+            m_rebuildStage = -1;
+            int retrainExtendFlag = 2;
+            meta_extend_retrain(retrainExtendFlag, lowerLimit);
+            return;
+        }
+
+        double cnt = m_rebuildCnt;
+        m_rebuildSlope = (m_rebuildSum[2] - m_rebuildSum[0] * (m_rebuildSum[1]/cnt))/(m_rebuildSum[3] - m_rebuildSum[0]*(m_rebuildSum[0]/cnt)) * 1.05;
+        m_rebuildKeys.reserve(cnt*1.05);
+        m_rebuildPtr.reserve(cnt*1.05);
+        m_rebuildCursor = 0;
+        m_rebuildMaxKey = m_keys.back();
+        m_rebuildStage = 2;
+    }
+
+    if (m_rebuildStage != 2)
+    {
+        return;
+    }
+
+    //Slots only move on insertion, resume after the last visited key
+    if (m_rebuildRelocate)
+    {
+        m_rebuildCursor = m_rebuildVisited ? upper_bound(m_keys.begin(), m_keys.end(), m_rebuildLastKey) - m_keys.begin() : 0;
+        m_rebuildRelocate = false;
+    }
+
+    while (maxSlots > 0 && m_rebuildCursor < m_keys.size())
+    {
+        int i = m_rebuildCursor++;
+        maxSlots--;
+
+        if (!bitmap_exists(i))
+        {
+            continue;
+        }
+
+        SWseg<Type_Key,Type_Ts,Type_Payload> * segPtr = m_ptr[i];
+        m_rebuildVisited = true;
+        m_rebuildLastKey = m_keys[i];
+
+        if (segPtr->m_maxTimeStamp < lowerLimit && (segPtr->m_leftSibling || segPtr->m_rightSibling)) //Segment Expired update neighbours
+        {
+            if (segPtr->m_leftSibling)
+            {
+                segPtr->m_leftSibling->m_rightSibling = segPtr->m_rightSibling;
+            }
+
+            if (segPtr->m_rightSibling)
+            {
+                segPtr->m_rightSibling->m_leftSibling = segPtr->m_leftSibling;
+            }
+
+            update_seg_delete(i);
+            continue;
+        }
+
+        if (m_keys[i] > m_rebuildMaxKey)
+        {
+            m_rebuildPending.push_back(make_pair(m_keys[i], segPtr));
+            continue;
+        }
+
+        int predictedPos = static_cast<int>(floor(m_rebuildSlope * ((double)m_keys[i] - (double)m_rebuildStartKey)));
+
+        while (predictedPos > (int)m_rebuildKeys.size()) //Gaps
+        {
+            m_rebuildKeys.push_back((m_rebuildKeys.size() == 0) ? numeric_limits<Type_Key>::min() : m_rebuildKeys.back());
+            m_rebuildPtr.push_back(nullptr);
+        }
+
+        int insertionPos = m_rebuildKeys.size();
+
+        while (static_cast<int>(insertionPos >> 6) >= m_rebuildBitmap.size())
+        {
+            m_rebuildBitmap.push_back(0);
+        }
+
+        m_rebuildKeys.push_back(m_keys[i]);
+        m_rebuildPtr.push_back(segPtr);
+        bitmap_set_bit(m_rebuildBitmap, insertionPos);
+        segPtr->m_rebuildIndex = insertionPos;
+
+        m_rebuildRightSearchBound = (insertionPos - predictedPos) > m_rebuildRightSearchBound 
+                                    ? (insertionPos - predictedPos) : m_rebuildRightSearchBound;
+        m_rebuildNumPairExist++;
+    }
+
+    if (m_rebuildCursor >= m_keys.size())
+    {
+        meta_rebuild_swap(lowerLimit);
+    }
+}
+
+//Replaces the current arrays with the new ones, then inserts the SWseg that arrived behind the cursor
+template<class Type_Key, class Type_Ts, class Type_Payload>
+void SWmeta<Type_Key,Type_Ts,Type_Payload>::meta_rebuild_swap(Type_Ts & lowerLimit)
+{
+    if (!m_rebuildNumPairExist) //Every placed SWseg was removed, rebuild at once
+    {
+        m_rebuildStage = -1;
+        int retrainExtendFlag = 2;
+        meta_extend_retrain(retrainExtendFlag, lowerLimit);
+        return;
+    }
+
+    //Retrain bits move with their SWseg
+    vector<uint64_t> retrainBitmap(m_rebuildBitmap.size(), 0);
+    for (int word = 0; word < m_retrainBitmap.size(); word++)
+    {
+        uint64_t bits = m_retrainBitmap[word];
+        while (bits)
+        {
+            int i = (word << 6) + _tzcnt_u64(bits);
+            bits &= bits - 1;
+
+            if (i < m_keys.size() && bitmap_exists(i) && m_ptr[i]->m_rebuildIndex != -1)
+            {
+                bitmap_set_bit(retrainBitmap, m_ptr[i]->m_rebuildIndex);
+            }
+        }
+    }
+
+    vector<bool> pendingRetrain;
+    pendingRetrain.reserve(m_rebuildPending.size());
+    for (auto & it : m_rebuildPending)
+    {
+        pendingRetrain.push_back(bitmap_exists(m_retrainBitmap, it.second->m_parentIndex));
+    }
+
+    for (int i = 0; i < m_rebuildPtr.size(); i++)
+    {
+        if (m_rebuildPtr[i])
+        {
+            m_rebuildPtr[i]->m_parentIndex = i;
+            m_rebuildPtr[i]->m_rebuildIndex = -1;
+        }
+    }
+
+    m_maxSearchError = min(8192,(int)ceil(0.6*m_keys.size()));
+
+    m_keys.swap(m_rebuildKeys);
+    m_ptr.swap(m_rebuildPtr);
+    m_bitmap.swap(m_rebuildBitmap);
+    bitmap_summary_rebuild();
+    m_retrainBitmap.swap(retrainBitmap);
+    m_slope = m_rebuildSlope;
+    m_startKey = m_rebuildStartKey;
+    m_numPairExist = m_rebuildNumPairExist;
+    m_rightSearchBound = m_rebuildRightSearchBound + 1;
+    m_leftSearchBound = 0;
+
+    vector<Type_Key>().swap(m_rebuildKeys);
+    vector<SWseg<Type_Key,Type_Ts,Type_Payload>*>().swap(m_rebuildPtr);
+    vector<uint64_t>().swap(m_rebuildBitmap);
+    m_rebuildStage = 0;
+
+    vector<pair<Type_Key, SWseg<Type_Key,Type_Ts,Type_Payload>*>> pending;
+    pending.swap(m_rebuildPending);
+
+    int retrainExtendFlag = 0;
+    for (int i = 0; i < pending.size(); i++)
+    {
+        meta_insertion(pending[i], retrainExtendFlag, pendingRetrain[i]);
+    }
+
+    if (retrainExtendFlag)
+    {
+        meta_extend_retrain(retrainExtendFlag, lowerLimit);
+    }
+}
+
+//Keeps the new arrays in sync when an SWseg leaves the current ones
+template<class Type_Key, class Type_Ts, class Type_Payload>
+void SWmeta<Type_Key,Type_Ts,Type_Payload>::meta_rebuild_erase(SWseg<Type_Key,Type_Ts,Type_Payload> * segPtr)
+{
+    if (m_rebuildStage != 2)
+    {
+        return;
+    }
+
+    int index = segPtr->m_rebuildIndex;
+    if (index == -1) //Not placed, may be waiting in m_rebuildPending
+    {
+        for (auto it = m_rebuildPending.begin(); it != m_rebuildPending.end(); it++)
+        {
+            if (it->second == segPtr)
+            {
+                m_rebuildPending.erase(it);
+                break;
+            }
+        }
+        return;
+    }
+
+    segPtr->m_rebuildIndex = -1;
+    m_rebuildPtr[index] = nullptr;
+    bitmap_erase_bit(m_rebuildBitmap, index);
+    m_rebuildNumPairExist--;
 
-        m_numPairExist = 1;
-        bitmap_set_bit(tempBitmap,0);
+    if (index) // if index == 0 -> first index no need to replace previous keys
+    {
+        Type_Key previousKey = m_rebuildKeys[index-1];
+        m_rebuildKeys[index] = previousKey;
+        index++;
 
-        if (bitmap_exists(m_retrainBitmap,firstIndex))
+        while (index < m_rebuildKeys.size() && !bitmap_exists(m_rebuildBitmap, index))
         {
-            bitmap_set_bit(tempRetrainBitmap,0);
+            m_rebuildKeys[index] = previousKey;
+            index++;
         }
-        
-        m_ptr[firstIndex]->m_parentIndex = 0;
-        tempKey.push_back(m_keys[firstIndex]);
-        tempPtr.push_back(m_ptr[firstIndex]);
-        // m_maxSearchError = 0;
     }
+}
 
-    m_keys = tempKey;
-    m_ptr = tempPtr;
-    m_bitmap = tempBitmap;
-    m_retrainBitmap = tempRetrainBitmap;
+//SWseg inserted behind the cursor of stage 2 are inserted into the new arrays after the swap
+template<class Type_Key, class Type_Ts, class Type_Payload>
+inline void SWmeta<Type_Key,Type_Ts,Type_Payload>::meta_rebuild_insert(pair<Type_Key, SWseg<Type_Key,Type_Ts,Type_Payload>*> & insertKeyPtr)
+{
+    if (m_rebuildStage != 2)
+    {
+        return;
+    }
 
-    #ifdef TUNE_TIME
-    stopTimer(&temp);
-    rootRetrainCycle += temp;
-    rootLengthRetrain += tempSize;
-    rootRetrainCyclePerLength += (double)temp/tempSize;
-    #endif
+    if (m_rebuildVisited && insertKeyPtr.first <= m_rebuildLastKey)
+    {
+        m_rebuildPending.push_back(insertKeyPtr);
+    }
+    m_rebuildRelocate = true;
 }
+#endif
 
-template<class Type_Key, class Type_Ts>
-void SWmeta<Type_Key,Type_Ts>::predict_search(Type_Key & targetKey, int & foundPos)
+template<class Type_Key, class Type_Ts, class Type_Payload>
+void SWmeta<Type_Key,Type_Ts,Type_Payload>::predict_search(Type_Key & targetKey, int & foundPos)
 {
     //Note: Will return position that is a gap 
 
@@ -1896,35 +3535,42 @@ void SWmeta<Type_Key,Type_Ts>::predict_search(Type_Key & targetKey, int & foundP
     {
         int predictPos, predictPosMin, predictPosMax;
         find_predict_pos_bound(targetKey, predictPos, predictPosMin, predictPosMax);
+        predict_search_bound(targetKey, predictPos, predictPosMin, predictPosMax, foundPos);
+    }
+}
 
-        if (predictPosMin < predictPosMax)
-        {
-            predictPos = predictPos < predictPosMin ? predictPosMin : predictPos;
-            predictPos = predictPos > predictPosMax ? predictPosMax : predictPos;
-            foundPos = predictPos;
+template<class Type_Key, class Type_Ts, class Type_Payload>
+inline void SWmeta<Type_Key,Type_Ts,Type_Payload>::predict_search_bound(Type_Key & targetKey, int predictPos, int predictPosMin, int predictPosMax, int & foundPos)
+{
+    //Note: targetKey must not be larger than the last key
 
-            if (targetKey <  m_keys[predictPos]) // Left of predictedPos
-            {
-                exponential_search_left(targetKey, foundPos, predictPos-predictPosMin);
-            }
-            else if (targetKey > m_keys[predictPos]) //Right of predictedPos
-            {
-                exponential_search_right(targetKey, foundPos, predictPosMax-predictPos);
-            }
+    if (predictPosMin < predictPosMax)
+    {
+        predictPos = predictPos < predictPosMin ? predictPosMin : predictPos;
+        predictPos = predictPos > predictPosMax ? predictPosMax : predictPos;
+        foundPos = predictPos;
+
+        if (targetKey <  m_keys[predictPos]) // Left of predictedPos
+        {
+            exponential_search_left(targetKey, foundPos, predictPos-predictPosMin);
         }
-        else if (predictPosMin == predictPosMax)
-        {     
-            foundPos = predictPos;
-            
-            if (targetKey < m_keys[predictPos])
-            {
-                foundPos--;
-            }
+        else if (targetKey > m_keys[predictPos]) //Right of predictedPos
+        {
+            exponential_search_right(targetKey, foundPos, predictPosMax-predictPos);
         }
-        else
+    }
+    else if (predictPosMin == predictPosMax)
+    {     
+        foundPos = predictPos;
+        
+        if (targetKey < m_keys[predictPos])
         {
-            foundPos = m_keys.size()-1;
-        }        
+            foundPos--;
+        }
+    }
+    else
+    {
+        foundPos = m_keys.size()-1;
     }
 }
 
@@ -1932,8 +3578,8 @@ void SWmeta<Type_Key,Type_Ts>::predict_search(Type_Key & targetKey, int & foundP
 Util Functions
 */
 
-template<class Type_Key, class Type_Ts>
-inline void SWmeta<Type_Key,Type_Ts>::find_predict_pos_bound(Type_Key & targetKey, int & predictPos, int & predictPosMin, int & predictPosMax)
+template<class Type_Key, class Type_Ts, class Type_Payload>
+inline void SWmeta<Type_Key,Type_Ts,Type_Payload>::find_predict_pos_bound(Type_Key & targetKey, int & predictPos, int & predictPosMin, int & predictPosMax)
 {
     #ifdef TUNE_TIME
     uint64_t temp = 0;
@@ -1941,11 +3587,7 @@ inline void SWmeta<Type_Key,Type_Ts>::find_predict_pos_bound(Type_Key & targetKe
     #endif
 
     predictPos = static_cast<int>(floor(m_slope * ((double)targetKey - (double)m_startKey)));
-    predictPosMin = predictPos - m_leftSearchBound;
-    predictPosMin = predictPosMin < 0 ? 0 : predictPosMin;
-
-    predictPosMax = (m_rightSearchBound == 0) ? predictPos + 1 : predictPos + m_rightSearchBound;
-    predictPosMax = predictPosMax > m_keys.size()-1 ? m_keys.size()-1: predictPosMax;
+    predict_pos_bound(predictPos, predictPosMin, predictPosMax);
 
     #ifdef TUNE_TIME
     stopTimer(&temp);
@@ -1954,8 +3596,42 @@ inline void SWmeta<Type_Key,Type_Ts>::find_predict_pos_bound(Type_Key & targetKe
     #endif
 }
 
-template<class Type_Key, class Type_Ts>
-inline void SWmeta<Type_Key,Type_Ts>::exponential_search(Type_Key & targetKey, int & foundPos)
+//Evaluates the model for a group of keys, 4 at a time with AVX2. Matches the scalar floor() of find_predict_pos_bound.
+template<class Type_Key, class Type_Ts, class Type_Payload>
+inline void SWmeta<Type_Key,Type_Ts,Type_Payload>::find_predict_pos_batch(Type_Key * targetKeys, int groupSize, int * predictPos)
+{
+    int i = 0;
+
+    #ifdef __AVX2__
+    __m256d slope = _mm256_set1_pd(m_slope);
+    __m256d startKey = _mm256_set1_pd((double)m_startKey);
+
+    for (; i + 4 <= groupSize; i += 4)
+    {
+        __m256d keys = _mm256_set_pd((double)targetKeys[i+3], (double)targetKeys[i+2], (double)targetKeys[i+1], (double)targetKeys[i]);
+        __m256d pos = _mm256_floor_pd(_mm256_mul_pd(slope, _mm256_sub_pd(keys, startKey)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(predictPos + i), _mm256_cvttpd_epi32(pos));
+    }
+    #endif
+
+    for (; i < groupSize; i++)
+    {
+        predictPos[i] = static_cast<int>(floor(m_slope * ((double)targetKeys[i] - (double)m_startKey)));
+    }
+}
+
+template<class Type_Key, class Type_Ts, class Type_Payload>
+inline void SWmeta<Type_Key,Type_Ts,Type_Payload>::predict_pos_bound(int predictPos, int & predictPosMin, int & predictPosMax)
+{
+    predictPosMin = predictPos - m_leftSearchBound;
+    predictPosMin = predictPosMin < 0 ? 0 : predictPosMin;
+
+    predictPosMax = (m_rightSearchBound == 0) ? predictPos + 1 : predictPos + m_rightSearchBound;
+    predictPosMax = predictPosMax > m_keys.size()-1 ? m_keys.size()-1: predictPosMax;
+}
+
+template<class Type_Key, class Type_Ts, class Type_Payload>
+inline void SWmeta<Type_Key,Type_Ts,Type_Payload>::exponential_search(Type_Key & targetKey, int & foundPos)
 {
     #ifdef TUNE_TIME
     uint64_t temp = 0;
@@ -2001,8 +3677,8 @@ inline void SWmeta<Type_Key,Type_Ts>::exponential_search(Type_Key & targetKey, i
     #endif
 }
 
-template<class Type_Key, class Type_Ts>
-inline void SWmeta<Type_Key,Type_Ts>::exponential_search_insert(Type_Key & targetKey, int & foundPos)
+template<class Type_Key, class Type_Ts, class Type_Payload>
+inline void SWmeta<Type_Key,Type_Ts,Type_Payload>::exponential_search_insert(Type_Key & targetKey, int & foundPos)
 {
     #ifdef TUNE_TIME
     uint64_t temp = 0;
@@ -2049,8 +3725,8 @@ inline void SWmeta<Type_Key,Type_Ts>::exponential_search_insert(Type_Key & targe
 }
 
 
-template<class Type_Key, class Type_Ts>
-inline void SWmeta<Type_Key,Type_Ts>::exponential_search_right(Type_Key & targetKey, int & foundPos, int maxSearchBound)
+template<class Type_Key, class Type_Ts, class Type_Payload>
+inline void SWmeta<Type_Key,Type_Ts,Type_Payload>::exponential_search_right(Type_Key & targetKey, int & foundPos, int maxSearchBound)
 {
     #ifdef TUNE
     int predictPos = foundPos;
@@ -2101,8 +3777,8 @@ inline void SWmeta<Type_Key,Type_Ts>::exponential_search_right(Type_Key & target
     #endif
 }
 
-template<class Type_Key, class Type_Ts>
-inline void SWmeta<Type_Key,Type_Ts>::exponential_search_right_insert(Type_Key & targetKey, int & foundPos, int maxSearchBound)
+template<class Type_Key, class Type_Ts, class Type_Payload>
+inline void SWmeta<Type_Key,Type_Ts,Type_Payload>::exponential_search_right_insert(Type_Key & targetKey, int & foundPos, int maxSearchBound)
 {
     #ifdef TUNE
     int predictPos = foundPos;
@@ -2154,8 +3830,8 @@ inline void SWmeta<Type_Key,Type_Ts>::exponential_search_right_insert(Type_Key &
 }
 
 
-template<class Type_Key, class Type_Ts>
-inline void SWmeta<Type_Key,Type_Ts>::exponential_search_left(Type_Key & targetKey, int & foundPos, int maxSearchBound)
+template<class Type_Key, class Type_Ts, class Type_Payload>
+inline void SWmeta<Type_Key,Type_Ts,Type_Payload>::exponential_search_left(Type_Key & targetKey, int & foundPos, int maxSearchBound)
 {
     #ifdef TUNE
     int predictPos = foundPos;
@@ -2206,8 +3882,8 @@ inline void SWmeta<Type_Key,Type_Ts>::exponential_search_left(Type_Key & targetK
     #endif
 }
 
-template<class Type_Key, class Type_Ts>
-inline void SWmeta<Type_Key,Type_Ts>::exponential_search_left_insert(Type_Key & targetKey, int & foundPos, int maxSearchBound)
+template<class Type_Key, class Type_Ts, class Type_Payload>
+inline void SWmeta<Type_Key,Type_Ts,Type_Payload>::exponential_search_left_insert(Type_Key & targetKey, int & foundPos, int maxSearchBound)
 {
     #ifdef TUNE
     int predictPos = foundPos;
@@ -2258,32 +3934,101 @@ inline void SWmeta<Type_Key,Type_Ts>::exponential_search_left_insert(Type_Key &
     #endif
 }
 
-template<class Type_Key, class Type_Ts>
-size_t SWmeta<Type_Key,Type_Ts>::get_meta_size()
+template<class Type_Key, class Type_Ts, class Type_Payload>
+size_t SWmeta<Type_Key,Type_Ts,Type_Payload>::get_meta_size()
 {
     return m_keys.size();
 }
 
-template<class Type_Key, class Type_Ts>
-size_t SWmeta<Type_Key,Type_Ts>::get_no_seg()
+template<class Type_Key, class Type_Ts, class Type_Payload>
+size_t SWmeta<Type_Key,Type_Ts,Type_Payload>::get_no_seg()
 {
     return m_numPairExist;
 }
 
-template<class Type_Key, class Type_Ts>
-int SWmeta<Type_Key,Type_Ts>::get_split_error()
+template<class Type_Key, class Type_Ts, class Type_Payload>
+int SWmeta<Type_Key,Type_Ts,Type_Payload>::get_split_error()
 {
     return splitError;
 }
 
-template<class Type_Key, class Type_Ts>
-void SWmeta<Type_Key,Type_Ts>::set_split_error(int error)
+template<class Type_Key, class Type_Ts, class Type_Payload>
+void SWmeta<Type_Key,Type_Ts,Type_Payload>::set_split_error(int error)
 {
     splitError = error;
 }
 
-template<class Type_Key, class Type_Ts>
-void  SWmeta<Type_Key,Type_Ts>::print()
+template<class Type_Key, class Type_Ts, class Type_Payload>
+uint64_t SWmeta<Type_Key,Type_Ts,Type_Payload>::get_auto_tune_size()
+{
+    #ifdef STATIC_PARAMS
+    return AUTO_TUNE_SIZE;
+    #else
+    return m_params.autoTuneSize;
+    #endif
+}
+
+/*
+Per-Instance Parameters
+*/
+template<class Type_Key, class Type_Ts, class Type_Payload>
+inline uint64_t SWmeta<Type_Key,Type_Ts,Type_Payload>::time_window() const
+{
+    #ifdef STATIC_PARAMS
+    return TIME_WINDOW;
+    #else
+    return m_params.timeWindow;
+    #endif
+}
+
+template<class Type_Key, class Type_Ts, class Type_Payload>
+inline int SWmeta<Type_Key,Type_Ts,Type_Payload>::max_buffer_size() const
+{
+    #ifdef STATIC_PARAMS
+    return MAX_BUFFER_SIZE;
+    #else
+    return m_params.maxBufferSize;
+    #endif
+}
+
+template<class Type_Key, class Type_Ts, class Type_Payload>
+inline int SWmeta<Type_Key,Type_Ts,Type_Payload>::initial_error() const
+{
+    #ifdef STATIC_PARAMS
+    return INITIAL_ERROR;
+    #else
+    return m_params.initialError;
+    #endif
+}
+
+template<class Type_Key, class Type_Ts, class Type_Payload>
+inline SWsplit SWmeta<Type_Key,Type_Ts,Type_Payload>::bulk_load_split() const
+{
+    #ifdef STATIC_PARAMS
+    return BULKLOAD_SPLIT;
+    #else
+    return m_params.bulkLoadSplit;
+    #endif
+}
+
+template<class Type_Key, class Type_Ts, class Type_Payload>
+inline SWsplit SWmeta<Type_Key,Type_Ts,Type_Payload>::retrain_split() const
+{
+    #ifdef STATIC_PARAMS
+    return RETRAIN_SPLIT;
+    #else
+    return m_params.retrainSplit;
+    #endif
+}
+
+template<class Type_Key, class Type_Ts, class Type_Payload>
+inline Type_Ts SWmeta<Type_Key,Type_Ts,Type_Payload>::calculate_lower_limit(Type_Ts timestamp) const
+{
+    return ((double)timestamp - time_window() < numeric_limits<Type_Ts>::min()) ? numeric_limits<Type_Ts>::min(): timestamp - time_window();
+}
+
+template<class Type_Key, class Type_Ts, class Type_Payload>
+void  SWmeta<Type_Key,Type_Ts,Type_Payload>::print()
 {
     cout << "start key:" << m_startKey << ", slope:" << m_slope << endl;
     if (bitmap_exists(0))
@@ -2310,8 +4055,8 @@ void  SWmeta<Type_Key,Type_Ts>::print()
     cout << endl;
 }
 
-template<class Type_Key, class Type_Ts>
-void  SWmeta<Type_Key,Type_Ts>::print_all()
+template<class Type_Key, class Type_Ts, class Type_Payload>
+void  SWmeta<Type_Key,Type_Ts,Type_Payload>::print_all()
 {
     for (int i = 0; i < m_keys.size(); i++)
     {
@@ -2332,8 +4077,8 @@ void  SWmeta<Type_Key,Type_Ts>::print_all()
     cout << endl;
 }
 
-template <class Type_Key, class Type_Ts>
-inline uint64_t SWmeta<Type_Key,Type_Ts>::get_total_size_in_bytes()
+template <class Type_Key, class Type_Ts, class Type_Payload>
+inline uint64_t SWmeta<Type_Key,Type_Ts,Type_Payload>::get_total_size_in_bytes()
 {
     uint64_t leafSize = 0;
     for (int i = 0; i < m_keys.size(); i++)
@@ -2344,14 +4089,48 @@ inline uint64_t SWmeta<Type_Key,Type_Ts>::get_total_size_in_bytes()
         }
     }
 
-    return sizeof(int)*5 + sizeof(double) + sizeof(Type_Key) + sizeof(vector<uint64_t>)*2 + sizeof(uint64_t)*(m_bitmap.size()*2) +
-    sizeof(vector<Type_Key>) + sizeof(Type_Key) * m_keys.size() + sizeof(vector<SWseg<Type_Key,Type_Ts>*>) + sizeof(SWseg<Type_Key,Type_Ts>*) * m_keys.size() + leafSize;
+    uint64_t paramSize = 0;
+    #ifndef STATIC_PARAMS
+    paramSize = sizeof(SWparams);
+    #endif
+
+    uint64_t expirySize = sizeof(m_expiryQueue) + sizeof(pair<Type_Ts,int>) * m_expiryQueue.size() + 
+    sizeof(vector<SWseg<Type_Key,Type_Ts,Type_Payload>*>) + sizeof(SWseg<Type_Key,Type_Ts,Type_Payload>*) * m_expirySlots.size() + sizeof(vector<int>) + sizeof(int) * m_expiryFreeSlots.size();
+
+    uint64_t rebuildSize = 0;
+    #ifdef INCREMENTAL_META_RETRAIN
+    rebuildSize = sizeof(int)*5 + sizeof(bool)*2 + sizeof(double)*5 + sizeof(Type_Key)*3 + 
+    sizeof(vector<Type_Key>) + sizeof(Type_Key) * m_rebuildKeys.capacity() + sizeof(vector<SWseg<Type_Key,Type_Ts,Type_Payload>*>) + sizeof(SWseg<Type_Key,Type_Ts,Type_Payload>*) * m_rebuildPtr.capacity() + 
+    sizeof(vector<uint64_t>) + sizeof(uint64_t) * m_rebuildBitmap.capacity() + sizeof(m_rebuildPending) + sizeof(pair<Type_Key, SWseg<Type_Key,Type_Ts,Type_Payload>*>) * m_rebuildPending.capacity();
+    #endif
+
+    uint64_t segModelSize = 0;
+    #ifdef INLINE_SEG_MODEL
+    segModelSize = sizeof(vector<SWsegModel<Type_Key>>) + sizeof(SWsegModel<Type_Key>) * m_segModel.capacity();
+    #endif
+
+    return sizeof(int)*5 + sizeof(double) + sizeof(Type_Key) + sizeof(vector<uint64_t>)*4 + sizeof(uint64_t)*(m_bitmap.size()*2 + m_bitmapSummary.size()*2) +
+    sizeof(vector<Type_Key>) + sizeof(Type_Key) * m_keys.size() + sizeof(vector<SWseg<Type_Key,Type_Ts,Type_Payload>*>) + sizeof(SWseg<Type_Key,Type_Ts,Type_Payload>*) * m_keys.size() + leafSize + paramSize + expirySize + rebuildSize + segModelSize;
+}
+
+//Same size as above; poolStats is filled with the SWpool statistics (all zero without SEG_POOL).
+//poolStats.reservedBytes + poolStats.largeBytes is what the segments hold from the system, including free blocks and size class rounding.
+template <class Type_Key, class Type_Ts, class Type_Payload>
+uint64_t SWmeta<Type_Key,Type_Ts,Type_Payload>::get_total_size_in_bytes(SWpoolStats & poolStats)
+{
+    #ifdef SEG_POOL
+    poolStats = m_pool.get_stats();
+    #else
+    poolStats = SWpoolStats();
+    #endif
+
+    return get_total_size_in_bytes();
 }
 
-template <class Type_Key, class Type_Ts>
-inline uint64_t SWmeta<Type_Key,Type_Ts>::get_no_keys(Type_Ts Timestamp)
+template <class Type_Key, class Type_Ts, class Type_Payload>
+inline uint64_t SWmeta<Type_Key,Type_Ts,Type_Payload>::get_no_keys(Type_Ts Timestamp)
 {
-    Type_Ts lowerLimit =  ((double)Timestamp - TIME_WINDOW < numeric_limits<Type_Ts>::min()) ? numeric_limits<Type_Ts>::min(): Timestamp - TIME_WINDOW;
+    Type_Ts lowerLimit = calculate_lower_limit(Timestamp);
 
     uint64_t cnt = 0;
     for (int i = 0; i < m_keys.size(); i++)
@@ -2365,8 +4144,8 @@ inline uint64_t SWmeta<Type_Key,Type_Ts>::get_no_keys(Type_Ts Timestamp)
     return cnt;
 }
 
-template<class Type_Key, class Type_Ts>
-void SWmeta<Type_Key,Type_Ts>::print_stats()
+template<class Type_Key, class Type_Ts, class Type_Payload>
+void SWmeta<Type_Key,Type_Ts,Type_Payload>::print_stats()
 {   
     #ifdef PRINT && TUNE
     printf("##### ROOT STATS ##### \n");
@@ -2389,7 +4168,7 @@ void SWmeta<Type_Key,Type_Ts>::print_stats()
         if (bitmap_exists(i))
         {
             avgOccupancy += m_ptr[i]->m_numPairExist / (m_ptr[i]->m_numPair+0.0001);
-            avgBufferSize += m_ptr[i]->m_buffer.size();
+            avgBufferSize += m_ptr[i]->m_bufferKeys.size();
             avgRightErrorBound += m_ptr[i]->m_rightSearchBound;
             avgLeftErrorBound += m_ptr[i]->m_leftSearchBound;
         }
@@ -2403,33 +4182,34 @@ void SWmeta<Type_Key,Type_Ts>::print_stats()
     return;
 }
 
-template<class Type_Key, class Type_Ts>
-inline bool SWmeta<Type_Key,Type_Ts>::bitmap_exists(int index) const
+template<class Type_Key, class Type_Ts, class Type_Payload>
+inline bool SWmeta<Type_Key,Type_Ts,Type_Payload>::bitmap_exists(int index) const
 {
     int bitmapPos = index >> 6;
     int bitPos = index - (bitmapPos << 6);
     return static_cast<bool>(m_bitmap[bitmapPos] & (1ULL << bitPos));
 }
 
-template<class Type_Key, class Type_Ts>
-inline bool SWmeta<Type_Key,Type_Ts>::bitmap_exists(vector<uint64_t> & bitmap, int index) const
+template<class Type_Key, class Type_Ts, class Type_Payload>
+inline bool SWmeta<Type_Key,Type_Ts,Type_Payload>::bitmap_exists(vector<uint64_t> & bitmap, int index) const
 {
     int bitmapPos = index >> 6;
     int bitPos = index - (bitmapPos << 6);
     return static_cast<bool>(bitmap[bitmapPos] & (1ULL << bitPos));
 }
 
-template<class Type_Key, class Type_Ts>
-inline void SWmeta<Type_Key,Type_Ts>::bitmap_set_bit(int index)
+template<class Type_Key, class Type_Ts, class Type_Payload>
+inline void SWmeta<Type_Key,Type_Ts,Type_Payload>::bitmap_set_bit(int index)
 {
     int bitmapPos = index >> 6;
     int bitPos = index - (bitmapPos << 6);
 
     m_bitmap[bitmapPos] |= (1ULL << bitPos); 
+    bitmap_summary_update(bitmapPos);
 }
 
-template<class Type_Key, class Type_Ts>
-inline void SWmeta<Type_Key,Type_Ts>::bitmap_set_bit(vector<uint64_t> & bitmap, int index)
+template<class Type_Key, class Type_Ts, class Type_Payload>
+inline void SWmeta<Type_Key,Type_Ts,Type_Payload>::bitmap_set_bit(vector<uint64_t> & bitmap, int index)
 {
     int bitmapPos = index >> 6;
     int bitPos = index - (bitmapPos << 6);
@@ -2437,16 +4217,17 @@ inline void SWmeta<Type_Key,Type_Ts>::bitmap_set_bit(vector<uint64_t> & bitmap,
     bitmap[bitmapPos] |= (1ULL << bitPos); 
 }
 
-template<class Type_Key, class Type_Ts>
-inline void SWmeta<Type_Key,Type_Ts>::bitmap_erase_bit(int index)
+template<class Type_Key, class Type_Ts, class Type_Payload>
+inline void SWmeta<Type_Key,Type_Ts,Type_Payload>::bitmap_erase_bit(int index)
 {
     int bitmapPos = index >> 6;
     int bitPos = index - (bitmapPos << 6);
     m_bitmap[bitmapPos] &= ~(1ULL << bitPos);
+    bitmap_summary_update(bitmapPos);
 }
 
-template<class Type_Key, class Type_Ts>
-inline void SWmeta<Type_Key,Type_Ts>::bitmap_erase_bit(vector<uint64_t> & bitmap, int index)
+template<class Type_Key, class Type_Ts, class Type_Payload>
+inline void SWmeta<Type_Key,Type_Ts,Type_Payload>::bitmap_erase_bit(vector<uint64_t> & bitmap, int index)
 {
     int bitmapPos = index >> 6;
     int bitPos = index - (bitmapPos << 6);
@@ -2454,8 +4235,8 @@ inline void SWmeta<Type_Key,Type_Ts>::bitmap_erase_bit(vector<uint64_t> & bitmap
 }
 
 
-template<class Type_Key, class Type_Ts>
-inline int SWmeta<Type_Key,Type_Ts>::bitmap_closest_right_nongap(int index)
+template<class Type_Key, class Type_Ts, class Type_Payload>
+inline int SWmeta<Type_Key,Type_Ts,Type_Payload>::bitmap_closest_right_nongap(int index)
 {
     int bitmapPos = index >> 6;
     int bitPos = index - (bitmapPos << 6);
@@ -2463,10 +4244,10 @@ inline int SWmeta<Type_Key,Type_Ts>::bitmap_closest_right_nongap(int index)
     uint64_t currentBitmap = m_bitmap[bitmapPos];
     currentBitmap &= ~((1ULL << (bitPos)) - 1); //Erase all bits before the index (set them to 0)
 
-    while(currentBitmap == 0) 
+    if (currentBitmap == 0) 
     //If current set of bitmap is empty (find next bitmap that is not empty)
     {
-        bitmapPos++;
+        bitmapPos = bitmap_summary_next(m_bitmapSummary, 0, bitmapPos + 1);
         if (bitmapPos >= m_bitmap.size())
         {
             return m_keys.size(); //Out of bounds
@@ -2477,8 +4258,8 @@ inline int SWmeta<Type_Key,Type_Ts>::bitmap_closest_right_nongap(int index)
     return bit_get_index(bitmapPos,bit_extract_rightmost_bit(currentBitmap));
 }
 
-template<class Type_Key, class Type_Ts>
-inline int SWmeta<Type_Key,Type_Ts>::bitmap_closest_left_nongap(int index)
+template<class Type_Key, class Type_Ts, class Type_Payload>
+inline int SWmeta<Type_Key,Type_Ts,Type_Payload>::bitmap_closest_left_nongap(int index)
 {
     int bitmapPos = index >> 6;
     int bitPos = index - (bitmapPos << 6);
@@ -2486,10 +4267,10 @@ inline int SWmeta<Type_Key,Type_Ts>::bitmap_closest_left_nongap(int index)
     uint64_t currentBitmap = m_bitmap[bitmapPos];
     currentBitmap &= ((1ULL << (bitPos)) - 1); //Erase all bits after the index (set them to 0)
 
-    while(currentBitmap == 0) 
+    if (currentBitmap == 0) 
     //If current set of bitmap is empty (find previous bitmap that is not empty)
     {
-        bitmapPos--;
+        bitmapPos = bitmap_summary_prev(m_bitmapSummary, 0, bitmapPos - 1);
         if (bitmapPos < 0 )
         {
             return -1; //Out of bounds
@@ -2501,8 +4282,8 @@ inline int SWmeta<Type_Key,Type_Ts>::bitmap_closest_left_nongap(int index)
     return (bitmapPos << 6) + (63-static_cast<int>(_lzcnt_u64(currentBitmap)));
 }
 
-template<class Type_Key, class Type_Ts>
-inline int SWmeta<Type_Key,Type_Ts>::bitmap_closest_gap(int index)
+template<class Type_Key, class Type_Ts, class Type_Payload>
+inline int SWmeta<Type_Key,Type_Ts,Type_Payload>::bitmap_closest_gap(int index)
 {
     int bitmapPos = index >> 6;
     int bitPos = index - (bitmapPos << 6);
@@ -2512,8 +4293,7 @@ inline int SWmeta<Type_Key,Type_Ts>::bitmap_closest_gap(int index)
        (bitmapPos == m_bitmap.size()-1 && _mm_popcnt_u64(m_bitmap[bitmapPos]) == (m_keys.size()-((m_bitmap.size()-1)<<6))) //last block full
        )
     {
-        int maxLeftBlockDist = bitmapPos;
-        int maxRightBlockDist =  ((m_keys.size()-1) >> 6) - bitmapPos;
+        int rightBound = ((m_keys.size()-1) >> 6);
 
         if (m_bitmap.size() == 1)
         {
@@ -2525,100 +4305,31 @@ inline int SWmeta<Type_Key,Type_Ts>::bitmap_closest_gap(int index)
             return m_numPairExist;
         }
 
-        int blockDist = 1;
-        int maxBothBlockDist = min<int>(maxLeftBlockDist,maxRightBlockDist);
-        
-        while (blockDist <= maxBothBlockDist)
-        {
-            uint64_t rightBitmap = m_bitmap[bitmapPos + blockDist];
-            uint64_t leftBitmap = m_bitmap[bitmapPos - blockDist];
+        //Closest blocks with a gap on each side
+        int leftBitmapPos = bitmap_summary_prev(m_bitmapFullSummary, numeric_limits<uint64_t>::max(), bitmapPos - 1);
+        int rightBitmapPos = (bitmapPos < rightBound) ? bitmap_summary_next(m_bitmapFullSummary, numeric_limits<uint64_t>::max(), bitmapPos + 1) : rightBound + 1;
 
-            //Both blocks have gaps (find closest)
-            if (leftBitmap != numeric_limits<uint64_t>::max() && rightBitmap != numeric_limits<uint64_t>::max())
-            {
-                int rightGap = ((bitmapPos + blockDist) << 6) + static_cast<int>(_tzcnt_u64(~rightBitmap));
-                int leftGap = ((bitmapPos - blockDist + 1) << 6) - static_cast<int>(_lzcnt_u64(~leftBitmap)) - 1;
+        if (leftBitmapPos >= 0 && rightBitmapPos <= rightBound)
+        {
+            int rightGap = (rightBitmapPos << 6) + static_cast<int>(_tzcnt_u64(~m_bitmap[rightBitmapPos]));
+            int leftGap = ((leftBitmapPos + 1) << 6) - static_cast<int>(_lzcnt_u64(~m_bitmap[leftBitmapPos])) - 1;
 
-                if (rightGap - index < index - leftGap)
-                {
-                    return rightGap; //Can also be last position (need to check outside to append)
-                }
-                else
-                {
-                    return leftGap;
-                }
-            }
-            //Gap in right block only (Also need to check leftblock-1 if bitPos < 32)
-            else if (rightBitmap != numeric_limits<uint64_t>::max())
+            if (rightGap - index < index - leftGap)
             {
-                int rightGap = ((bitmapPos + blockDist) << 6) + static_cast<int>(_tzcnt_u64(~rightBitmap));
-
-                if (bitPos < 32 && bitmapPos - blockDist > 0 &&
-                    m_bitmap[bitmapPos - blockDist - 1] != numeric_limits<uint64_t>::max())
-                {
-                    int leftGap = ((bitmapPos - blockDist) << 6) - static_cast<int>(_lzcnt_u64(~m_bitmap[bitmapPos - blockDist - 1])) - 1;
-
-                    if (rightGap - index < index - leftGap)
-                    {
-                        return rightGap; //Can also be last position (need to check outside to append)
-                    }
-                    else
-                    {
-                        return leftGap;
-                    }
-                }
-                else
-                {
-                    return rightGap;
-                }
+                return rightGap; //Can also be last position (need to check outside to append)
             }
-            //Gap in left block only (Also need to check rightblock+1 if bitPos > 32)
-            else if (leftBitmap != numeric_limits<uint64_t>::max())
+            else
             {
-                int leftGap = ((bitmapPos - blockDist + 1) << 6) - static_cast<int>(_lzcnt_u64(~leftBitmap)) - 1;
-
-                if (bitPos > 32 && bitmapPos + blockDist + 1 < m_bitmap.size() && 
-                    m_bitmap[bitmapPos + blockDist + 1] != numeric_limits<uint64_t>::max())
-                {
-                    int rightGap = ((bitmapPos + blockDist+1) << 6) + static_cast<int>(_tzcnt_u64(~m_bitmap[bitmapPos + blockDist + 1]));
-
-                    if (rightGap - index < index - leftGap)
-                    {
-                        return rightGap; //Can also be last position (need to check outside to append)
-                    }
-                    else
-                    {
-                        return leftGap;
-                    } 
-                }
-                else
-                {
-                    return leftGap;
-                }
+                return leftGap;
             }
-            blockDist++;
         }
-
-        if (maxLeftBlockDist > maxRightBlockDist)
+        else if (rightBitmapPos <= rightBound)
         {
-            for (int i = bitmapPos - blockDist; i >= 0; i--)
-            {
-                if (m_bitmap[i] != numeric_limits<uint64_t>::max())
-                {
-                    return ((i + 1) << 6) - static_cast<int>(_lzcnt_u64(~m_bitmap[i])) - 1;
-                }
-            }
+            return (rightBitmapPos << 6) + static_cast<int>(_tzcnt_u64(~m_bitmap[rightBitmapPos]));
         }
-        else
+        else if (leftBitmapPos >= 0)
         {
-            int rightBound = ((m_keys.size()-1) >> 6);
-            for (int i = bitmapPos + blockDist; i <= rightBound; i++)
-            {
-                if (m_bitmap[i] != numeric_limits<uint64_t>::max())
-                {
-                    return (i << 6) + static_cast<int>(_tzcnt_u64(~m_bitmap[i]));
-                }
-            }
+            return ((leftBitmapPos + 1) << 6) - static_cast<int>(_lzcnt_u64(~m_bitmap[leftBitmapPos])) - 1;
         }
         return -1; //Something went wrong (No Gap)
 
@@ -2662,8 +4373,8 @@ inline int SWmeta<Type_Key,Type_Ts>::bitmap_closest_gap(int index)
 }
 
 
-template<class Type_Key, class Type_Ts>
-inline pair<int,int> SWmeta<Type_Key,Type_Ts>::bitmap_retrain_range(int index)
+template<class Type_Key, class Type_Ts, class Type_Payload>
+inline pair<int,int> SWmeta<Type_Key,Type_Ts,Type_Payload>::bitmap_retrain_range(int index)
 //Returns [leftExistIndex,rightExistIndex]. 
 //If leftExistIndex == rightExistIndex: retrain alone
 //Else: retrain with neighbours 
@@ -2762,13 +4473,22 @@ inline pair<int,int> SWmeta<Type_Key,Type_Ts>::bitmap_retrain_range(int index)
     return make_pair(rightIndex,leftIndex);
 }
 
-template<class Type_Key, class Type_Ts>
-inline void SWmeta<Type_Key,Type_Ts>::bitmap_move_bit_back(int startingIndex, int endingIndex) 
+template<class Type_Key, class Type_Ts, class Type_Payload>
+inline void SWmeta<Type_Key,Type_Ts,Type_Payload>::bitmap_move_bit_back(int startingIndex, int endingIndex) 
+//Inclusive: [startingIndex,endingIndex] and startingIndex < endingIndex
+{
+    bitmap_move_bit_back(m_bitmap, startingIndex, endingIndex);
+    bitmap_summary_update(startingIndex >> 6, endingIndex >> 6);
+}
+
+template<class Type_Key, class Type_Ts, class Type_Payload>
+inline void SWmeta<Type_Key,Type_Ts,Type_Payload>::bitmap_move_bit_back(vector<uint64_t> & bitmap, int startingIndex, int endingIndex) 
 //Inclusive: [startingIndex,endingIndex] and startingIndex < endingIndex
+//Bit i moves to i+1 for i in [startingIndex,endingIndex), bit startingIndex is unchanged
 {
-    if (static_cast<int>(endingIndex >> 6) == m_bitmap.size())
+    if (static_cast<int>(endingIndex >> 6) == bitmap.size())
     {
-        m_bitmap.push_back(0); //When end exceeds last pos (end == m_keys.size())
+        bitmap.push_back(0); //When end exceeds last pos (end == m_keys.size())
     }
 
     int bitmapPos = startingIndex >> 6;
@@ -2777,151 +4497,131 @@ inline void SWmeta<Type_Key,Type_Ts>::bitmap_move_bit_back(int startingIndex, in
     int bitmapPosEnd = endingIndex >> 6;
     int bitPosEnd = endingIndex - (bitmapPosEnd << 6);
 
-    bool previousBitValue = static_cast<bool>(m_bitmap[bitmapPos] & (1ULL << bitPos));
-
-    while (!(bitmapPos == bitmapPosEnd && bitPos == bitPosEnd))
+    //Shift one word at a time from the end, the lower word is still unshifted when its top bit is carried
+    for (int i = bitmapPosEnd; i >= bitmapPos; i--)
     {
-        if (bitPos == 63)
-        {
-            bitPos = 0;
-            bitmapPos++;
-        }
-        else
-        {
-            bitPos++;
-        }
-
-        bool temp = static_cast<bool>(m_bitmap[bitmapPos] & (1ULL << bitPos));
-        if (previousBitValue)
-        {
-            m_bitmap[bitmapPos] |= (1ULL << bitPos);
-        }
-        else
-        {
-            m_bitmap[bitmapPos] &= ~(1ULL << bitPos);
-        }
-        previousBitValue = temp;
+        uint64_t shifted = (bitmap[i] << 1) | ((i > bitmapPos) ? (bitmap[i-1] >> 63) : 0);
+        uint64_t mask = bit_range_mask((i == bitmapPos) ? bitPos + 1 : 0, (i == bitmapPosEnd) ? bitPosEnd : 63);
+        bitmap[i] = (bitmap[i] & ~mask) | (shifted & mask);
     }
     return;
 }
 
-template<class Type_Key, class Type_Ts>
-inline void SWmeta<Type_Key,Type_Ts>::bitmap_move_bit_back(vector<uint64_t> & bitmap, int startingIndex, int endingIndex) 
-//Inclusive: [startingIndex,endingIndex] and startingIndex < endingIndex
+template<class Type_Key, class Type_Ts, class Type_Payload>
+inline void SWmeta<Type_Key,Type_Ts,Type_Payload>::bitmap_move_bit_front(int startingIndex, int endingIndex) 
+//Inclusive: [startingIndex,endingIndex] and startingIndex > endingIndex
 {
-    if (static_cast<int>(endingIndex >> 6) == bitmap.size())
-    {
-        bitmap.push_back(0); //When end exceeds last pos (end == m_keys.size())
-    }
+    bitmap_move_bit_front(m_bitmap, startingIndex, endingIndex);
+    bitmap_summary_update(endingIndex >> 6, startingIndex >> 6);
+}
 
+template<class Type_Key, class Type_Ts, class Type_Payload>
+inline void SWmeta<Type_Key,Type_Ts,Type_Payload>::bitmap_move_bit_front(vector<uint64_t> & bitmap, int startingIndex, int endingIndex) 
+//Inclusive: [startingIndex,endingIndex] and startingIndex > endingIndex
+//Bit i moves to i-1 for i in (endingIndex,startingIndex], bit startingIndex is unchanged
+{
     int bitmapPos = startingIndex >> 6;
     int bitPos = startingIndex - (bitmapPos << 6);
 
     int bitmapPosEnd = endingIndex >> 6;
     int bitPosEnd = endingIndex - (bitmapPosEnd << 6);
 
-    bool previousBitValue = static_cast<bool>(bitmap[bitmapPos] & (1ULL << bitPos));
-
-    while (!(bitmapPos == bitmapPosEnd && bitPos == bitPosEnd))
+    //Shift one word at a time from the end, the higher word is still unshifted when its bottom bit is carried
+    for (int i = bitmapPosEnd; i <= bitmapPos; i++)
     {
-        if (bitPos == 63)
-        {
-            bitPos = 0;
-            bitmapPos++;
-        }
-        else
-        {
-            bitPos++;
-        }
-
-        bool temp = static_cast<bool>(bitmap[bitmapPos] & (1ULL << bitPos));
-        if (previousBitValue)
-        {
-            bitmap[bitmapPos] |= (1ULL << bitPos);
-        }
-        else
-        {
-            bitmap[bitmapPos] &= ~(1ULL << bitPos);
-        }
-        previousBitValue = temp;
+        uint64_t shifted = (bitmap[i] >> 1) | ((i < bitmapPos) ? (bitmap[i+1] << 63) : 0);
+        uint64_t mask = bit_range_mask((i == bitmapPosEnd) ? bitPosEnd : 0, (i == bitmapPos) ? bitPos - 1 : 63);
+        bitmap[i] = (bitmap[i] & ~mask) | (shifted & mask);
     }
     return;
 }
 
-template<class Type_Key, class Type_Ts>
-inline void SWmeta<Type_Key,Type_Ts>::bitmap_move_bit_front(int startingIndex, int endingIndex) 
-//Inclusive: [startingIndex,endingIndex] and startingIndex > endingIndex
+template<class Type_Key, class Type_Ts, class Type_Payload>
+inline void SWmeta<Type_Key,Type_Ts,Type_Payload>::bitmap_summary_update(int bitmapPos)
 {
-    int bitmapPos = startingIndex >> 6;
-    int bitPos = startingIndex - (bitmapPos << 6);
+    int summaryPos = bitmapPos >> 6;
+    if (summaryPos >= m_bitmapSummary.size())
+    {
+        m_bitmapSummary.resize(summaryPos + 1, 0);
+        m_bitmapFullSummary.resize(summaryPos + 1, 0);
+    }
 
-    int bitmapPosEnd = endingIndex >> 6;
-    int bitPosEnd = endingIndex - (bitmapPosEnd << 6);
+    uint64_t bit = 1ULL << (bitmapPos & 63);
+    uint64_t word = m_bitmap[bitmapPos];
+    m_bitmapSummary[summaryPos] = (word != 0) ? (m_bitmapSummary[summaryPos] | bit) : (m_bitmapSummary[summaryPos] & ~bit);
+    m_bitmapFullSummary[summaryPos] = (word == numeric_limits<uint64_t>::max()) ? (m_bitmapFullSummary[summaryPos] | bit) : (m_bitmapFullSummary[summaryPos] & ~bit);
+}
 
-    bool previousBitValue = static_cast<bool>(m_bitmap[bitmapPos] & (1ULL << bitPos));
+template<class Type_Key, class Type_Ts, class Type_Payload>
+inline void SWmeta<Type_Key,Type_Ts,Type_Payload>::bitmap_summary_update(int startBitmapPos, int endBitmapPos)
+{
+    for (int i = startBitmapPos; i <= endBitmapPos; i++)
+    {
+        bitmap_summary_update(i);
+    }
+}
 
-    while (!(bitmapPos == bitmapPosEnd && bitPos == bitPosEnd))
+template<class Type_Key, class Type_Ts, class Type_Payload>
+void SWmeta<Type_Key,Type_Ts,Type_Payload>::bitmap_summary_rebuild()
+{
+    m_bitmapSummary.assign((m_bitmap.size() + 63) >> 6, 0);
+    m_bitmapFullSummary.assign((m_bitmap.size() + 63) >> 6, 0);
+    bitmap_summary_update(0, static_cast<int>(m_bitmap.size()) - 1);
+}
+
+template<class Type_Key, class Type_Ts, class Type_Payload>
+inline int SWmeta<Type_Key,Type_Ts,Type_Payload>::bitmap_summary_next(const vector<uint64_t> & summary, uint64_t flip, int bitmapPos) const
+//First word at or after bitmapPos with its summary bit (xor flip) set, m_bitmap.size() if none
+{
+    if (bitmapPos >= m_bitmap.size())
     {
-        if (bitPos == 0)
-        {
-            bitPos = 63;
-            bitmapPos--;
-        }
-        else
-        {
-            bitPos--;
-        }
+        return m_bitmap.size();
+    }
 
-        bool temp = static_cast<bool>(m_bitmap[bitmapPos] & (1ULL << bitPos));
-        if (previousBitValue)
-        {
-            m_bitmap[bitmapPos] |= (1ULL << bitPos);
-        }
-        else
+    int summaryPos = bitmapPos >> 6;
+    int summaryEnd = (m_bitmap.size() + 63) >> 6;
+
+    uint64_t currentSummary = ((summaryPos < summary.size()) ? summary[summaryPos] : 0) ^ flip;
+    currentSummary &= ~((1ULL << (bitmapPos & 63)) - 1);
+
+    while (currentSummary == 0)
+    {
+        summaryPos++;
+        if (summaryPos >= summaryEnd)
         {
-            m_bitmap[bitmapPos] &= ~(1ULL << bitPos);
+            return m_bitmap.size();
         }
-        previousBitValue = temp;
+        currentSummary = ((summaryPos < summary.size()) ? summary[summaryPos] : 0) ^ flip;
     }
-    return;
+
+    return min<int>((summaryPos << 6) + static_cast<int>(_tzcnt_u64(currentSummary)), m_bitmap.size());
 }
 
-template<class Type_Key, class Type_Ts>
-inline void SWmeta<Type_Key,Type_Ts>::bitmap_move_bit_front(vector<uint64_t> & bitmap, int startingIndex, int endingIndex) 
-//Inclusive: [startingIndex,endingIndex] and startingIndex > endingIndex
+template<class Type_Key, class Type_Ts, class Type_Payload>
+inline int SWmeta<Type_Key,Type_Ts,Type_Payload>::bitmap_summary_prev(const vector<uint64_t> & summary, uint64_t flip, int bitmapPos) const
+//Last word at or before bitmapPos with its summary bit (xor flip) set, -1 if none
 {
-    int bitmapPos = startingIndex >> 6;
-    int bitPos = startingIndex - (bitmapPos << 6);
+    if (bitmapPos < 0)
+    {
+        return -1;
+    }
 
-    int bitmapPosEnd = endingIndex >> 6;
-    int bitPosEnd = endingIndex - (bitmapPosEnd << 6);
+    int summaryPos = bitmapPos >> 6;
 
-    bool previousBitValue = static_cast<bool>(bitmap[bitmapPos] & (1ULL << bitPos));
+    uint64_t currentSummary = ((summaryPos < summary.size()) ? summary[summaryPos] : 0) ^ flip;
+    currentSummary &= bit_range_mask(0, bitmapPos & 63);
 
-    while (!(bitmapPos == bitmapPosEnd && bitPos == bitPosEnd))
+    while (currentSummary == 0)
     {
-        if (bitPos == 0)
-        {
-            bitPos = 63;
-            bitmapPos--;
-        }
-        else
+        summaryPos--;
+        if (summaryPos < 0)
         {
-            bitPos--;
+            return -1;
         }
-
-        bool temp = static_cast<bool>(bitmap[bitmapPos] & (1ULL << bitPos));
-        if (previousBitValue)
-        {
-            bitmap[bitmapPos] |= (1ULL << bitPos);
-        }
-        else
-        {
-            bitmap[bitmapPos] &= ~(1ULL << bitPos);
-        }
-        previousBitValue = temp;
+        currentSummary = ((summaryPos < summary.size()) ? summary[summaryPos] : 0) ^ flip;
     }
-    return;
+
+    return (summaryPos << 6) + (63 - static_cast<int>(_lzcnt_u64(currentSummary)));
 }
 
 }
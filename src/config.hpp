@@ -1,8 +1,28 @@
 #pragma once
 #include "../parameters.hpp"
 #define MAX_BUFFER_SIZE 256
+#define BUFFER_INITIAL_SIZE 8 //Buffer capacity of an SWseg without an observed insert rate, allocated on the first buffered insert
 #define INITIAL_ERROR 256
+#define BULKLOAD_SPLIT SPLIT_DERIVATIVE //SWsplit used by bulk_load (helper.hpp)
+#define RETRAIN_SPLIT SPLIT_SHRINKING_CONE //SWsplit used by retrain_seg, must be error bounded
+// #define TWO_PIECE_SEG //Pair neighbouring small splits into one SWseg with a two-piece linear model (helper.hpp)
+#define TWO_PIECE_MAX_SIZE 1024 //Max tuples of a two-piece SWseg
+// #define COMPRESSED_SEG //Store SWseg keys and timestamps as 16/32-bit offsets from a per-SWseg base (SWpacked.hpp)
+#define BULKLOAD_PARALLEL_SIZE 65536 //Bulk loads of fewer tuples stay on one thread (more use omp_get_max_threads())
+#define SEARCH_LINEAR_MAX 256 //SWseg with m_leftSearchBound + m_rightSearchBound up to this count the smaller keys with SIMD (linear_search_lower_bound)
+#define SEARCH_BINARY_MAX 512 //SWseg with a search bound up to this use the branchless binary search, larger ones exponential search
 #define FANOUT_BP 256
 #define AUTO_TUNE_RATE 0.1
 #define AUTO_TUNE_SIZE AUTO_TUNE_RATE * TIME_WINDOW
-#define TUNE
\ No newline at end of file
+#define BATCH_GROUP_SIZE 16 //Keys interleaved per group in lookup_batch/range_search_batch
+#define BATCH_MAX_WALK 16 //Max SWseg walked forward in insert_batch before falling back to model search
+#define EXPIRY_STEP_SIZE 2 //Expiry queue entries processed per insert with EAGER_EXPIRY
+// #define EAGER_EXPIRY //Reclaim expired SWseg during insert instead of only when scans/inserts reach them
+#define META_REBUILD_STEP 64 //SWmeta slots rebuilt per insert with INCREMENTAL_META_RETRAIN
+// #define INCREMENTAL_META_RETRAIN //Rebuild SWmeta over several inserts instead of inside the insert that triggers it
+// #define BACKGROUND_RETRAIN //Retrain SWseg on a helper thread, inserts only publish the finished SWseg
+// #define INLINE_SEG_MODEL //Copy each SWseg's model into its SWmeta slot, m_localKeys is prefetched before the SWseg is read
+#define SEG_POOL //Allocate SWseg and their arrays from a per-index pool (SWpool.hpp)
+#define POOL_CHUNK_LOG 20 //SWpool chunk size (log2 bytes)
+#define TUNE
+// #define STATIC_PARAMS //Use the macros above instead of the per-instance SWparams
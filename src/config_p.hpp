@@ -5,4 +5,10 @@
 #define INITIAL_ERROR 64
 #define AUTO_TUNE_RATE 0.1
 #define AUTO_TUNE_SIZE AUTO_TUNE_RATE * TIME_WINDOW
-enum class task_status { FINISH = -6, ROUND_END = -5, SEARCH = -4, INSERT = -3, DELETE = -2, RETRAIN = -1};
\ No newline at end of file
+#define BULKLOAD_PARALLEL_SIZE 65536 //Bulk loads of fewer tuples stay on one thread (more use one thread per partition)
+// #define STATIC_PARAMS //Use the macros above instead of the per-instance SWparams
+#define ROUTER_BATCH_SIZE 64 //Tasks SWrouter collects per partition before enqueuing them
+#define ROUTER_MAX_PENDING 65536 //Tasks a partition may fall behind the SWrouter dispatcher before it waits
+#define REBALANCE_THRESHOLD 2.0 //Load of a partition (times the mean) above which SWrouter::rebalance moves its boundary
+#define REBALANCE_SAMPLES 64 //Recent keys of each partition from which SWrouter::rebalance picks the new boundary
+enum class task_status : int8_t { REBALANCE = -8, WATERMARK = -7, FINISH = -6, ROUND_END = -5, SEARCH = -4, INSERT = -3, DELETE = -2, RETRAIN = -1};
\ No newline at end of file
@@ -6,6 +6,7 @@
 #include <algorithm>
 #include <iterator>
 #include <vector>
+#include <queue>
 #include <array>
 #include <cmath>
 #include <stdexcept>
@@ -14,8 +15,17 @@
 #include <x86intrin.h>
 #include <bitset>
 #include <stdint.h>
+#include <tuple>
+#include <type_traits>
+#include <memory>
+
+#ifdef _OPENMP
+#include <omp.h>
+#include <parallel/algorithm>
+#endif
 
 #include "config.hpp"
+#include "../lib/piecewise_linear_model.hpp"
 
 using namespace std;
 
@@ -136,11 +146,250 @@ uint64_t print_segLengthExponentialSearchAll = 0;
 #include "../utils/debug.hpp"
 #endif
 
+/*
+Segmentation Algorithms
+*/
+//How data is split into SWseg. SPLIT_DERIVATIVE and SPLIT_EQUAL cut a fixed number of SWseg and can only be used for bulk load,
+//the others keep every SWseg within the split error and can be used for both bulk load and retrain.
+enum SWsplit
+{
+    SPLIT_DERIVATIVE,       //calculate_split_derivative
+    SPLIT_EQUAL,            //calculate_split_equal
+    SPLIT_SHRINKING_CONE,   //calculate_split_index_one_pass
+    SPLIT_LEAST_SQUARE,     //calculate_split_index_one_pass_least_sqaure
+    SPLIT_OPTIMAL_PLA       //calculate_split_index_optimal_pla
+};
+
+/*
+Per-Instance Parameters
+*/
+//Window length, buffer size, error and split algorithms of one SWmeta instance (defaults are the compile-time macros).
+//autoTuneSize = 0 derives it from the window (AUTO_TUNE_RATE * timeWindow).
+//With STATIC_PARAMS defined, the macros are used directly and these values are ignored.
+struct SWparams
+{
+    uint64_t timeWindow;
+    int maxBufferSize;
+    int initialError;
+    uint64_t autoTuneSize;
+    SWsplit bulkLoadSplit;
+    SWsplit retrainSplit;
+
+    SWparams(uint64_t timeWindow = TIME_WINDOW, int maxBufferSize = MAX_BUFFER_SIZE, 
+            int initialError = INITIAL_ERROR, uint64_t autoTuneSize = 0,
+            SWsplit bulkLoadSplit = BULKLOAD_SPLIT, SWsplit retrainSplit = RETRAIN_SPLIT)
+    :timeWindow(timeWindow), maxBufferSize(maxBufferSize), initialError(initialError), 
+    autoTuneSize((autoTuneSize == 0) ? (uint64_t)(AUTO_TUNE_RATE * timeWindow) : autoTuneSize),
+    bulkLoadSplit(bulkLoadSplit), retrainSplit(retrainSplit)
+    {
+        if (timeWindow == 0 || maxBufferSize < 2 || initialError < 1)
+        {
+            throw invalid_argument("SWparams: timeWindow must be > 0, maxBufferSize > 1 and initialError > 0");
+        }
+
+        if (bulkLoadSplit < SPLIT_DERIVATIVE || bulkLoadSplit > SPLIT_OPTIMAL_PLA || 
+            retrainSplit < SPLIT_SHRINKING_CONE || retrainSplit > SPLIT_OPTIMAL_PLA)
+        {
+            throw invalid_argument("SWparams: unknown bulkLoadSplit, or retrainSplit is not error bounded (SPLIT_SHRINKING_CONE, SPLIT_LEAST_SQUARE, SPLIT_OPTIMAL_PLA)");
+        }
+    }
+};
+
+//Result of an aggregate range query (COUNT, SUM, MIN, MAX over the matching keys), filled without materializing the tuples.
+//min/max are only meaningful when count > 0. sum is exact for integer keys (128 bits hold 2^64 64-bit keys).
+template<class Type_Key>
+struct SWaggregate
+{
+    typedef typename conditional<is_floating_point<Type_Key>::value, double,
+                typename conditional<is_signed<Type_Key>::value, __int128, unsigned __int128>::type>::type Type_Sum;
+
+    uint64_t count = 0;
+    Type_Sum sum = 0;
+    Type_Key min = numeric_limits<Type_Key>::max();
+    Type_Key max = numeric_limits<Type_Key>::lowest();
+
+    inline void add(Type_Key key)
+    {
+        count++;
+        sum += (Type_Sum)key;
+        min = (key < min) ? key : min;
+        max = (key > max) ? key : max;
+    }
+
+    inline void merge(const SWaggregate<Type_Key> & other)
+    {
+        count += other.count;
+        sum += other.sum;
+        min = (other.min < min) ? other.min : min;
+        max = (other.max > max) ? other.max : max;
+    }
+};
+
+//Range scan outputs: materialized tuples or an aggregate
+template<class Type_Key, class Type_Ts>
+inline void append_result(vector<pair<Type_Key,Type_Ts>> & rangeSearchResult, const pair<Type_Key,Type_Ts> * matches, int numMatch)
+{
+    rangeSearchResult.insert(rangeSearchResult.end(), matches, matches + numMatch);
+}
+
+template<class Type_Key, class Type_Ts>
+inline void append_result(SWaggregate<Type_Key> & aggregate, const pair<Type_Key,Type_Ts> * matches, int numMatch)
+{
+    for (int i = 0; i < numMatch; i++)
+    {
+        aggregate.add(matches[i].first);
+    }
+}
+
+template<class Type_Key, class Type_Ts>
+inline void append_result(vector<pair<Type_Key,Type_Ts>> & rangeSearchResult, Type_Key key, Type_Ts timeStamp)
+{
+    rangeSearchResult.push_back(make_pair(key,timeStamp));
+}
+
+template<class Type_Key, class Type_Ts>
+inline void append_result(SWaggregate<Type_Key> & aggregate, Type_Key key, Type_Ts timeStamp)
+{
+    aggregate.add(key);
+}
+
+/*
+Parallel Bulk Load
+*/
+//Threads used to bulk load size tuples (omp_get_max_threads(), 1 below BULKLOAD_PARALLEL_SIZE or without OpenMP)
+inline int bulk_load_threads(size_t size)
+{
+    #ifdef _OPENMP
+    return (size < BULKLOAD_PARALLEL_SIZE) ? 1 : omp_get_max_threads();
+    #else
+    return 1;
+    #endif
+}
+
+template<class Iterator, class Compare>
+inline void parallel_sort(Iterator first, Iterator last, Compare comp, int numThreads)
+{
+    #ifdef _OPENMP
+    if (numThreads > 1)
+    {
+        __gnu_parallel::sort(first, last, comp, __gnu_parallel::parallel_tag(numThreads));
+        return;
+    }
+    #endif
+    sort(first, last, comp);
+}
+
+/*
+In-Segment Search
+*/
+//Search around an SWseg's predicted position, picked per SWseg from its search bound (SWseg::search_policy)
+enum SWsearch
+{
+    SEARCH_LINEAR,          //linear_search_lower_bound, search bound <= SEARCH_LINEAR_MAX
+    SEARCH_BINARY,          //binary_search_lower_bound, search bound <= SEARCH_BINARY_MAX
+    SEARCH_EXPONENTIAL      //SWseg::exponential_search_model_left/right
+};
+
+//First index in [first, last) with keys[index] >= targetKey (last if none) of sorted keys.
+//Counts the smaller keys without branches, with AVX-512 or AVX2 for unsigned 64-bit keys and 32/16-bit codes (SWpackedArray).
+template<class Type_Key>
+inline int linear_search_lower_bound(const Type_Key * keys, int first, int last, const Type_Key & targetKey)
+{
+    int pos = first;
+    int numLess = 0;
+
+    #if defined(__AVX512F__) || defined(__AVX2__)
+    if constexpr (is_unsigned<Type_Key>::value && sizeof(Type_Key) == 8)
+    {
+        #if defined(__AVX512F__)
+        const __m512i target = _mm512_set1_epi64(static_cast<long long>(targetKey));
+        for (; pos + 8 <= last; pos += 8)
+        {
+            numLess += __builtin_popcount(_mm512_cmplt_epu64_mask(_mm512_loadu_si512(keys + pos), target));
+        }
+        #else
+        const __m256i signFlip = _mm256_set1_epi64x(static_cast<long long>(1ULL << 63));
+        const __m256i target = _mm256_xor_si256(_mm256_set1_epi64x(static_cast<long long>(targetKey)), signFlip);
+        for (; pos + 4 <= last; pos += 4)
+        {
+            __m256i key = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + pos)), signFlip);
+            numLess += __builtin_popcount(_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(target, key))));
+        }
+        #endif
+    }
+    else if constexpr (is_unsigned<Type_Key>::value && sizeof(Type_Key) == 4)
+    {
+        #if defined(__AVX512F__)
+        const __m512i target = _mm512_set1_epi32(static_cast<int>(targetKey));
+        for (; pos + 16 <= last; pos += 16)
+        {
+            numLess += __builtin_popcount(_mm512_cmplt_epu32_mask(_mm512_loadu_si512(keys + pos), target));
+        }
+        #else
+        const __m256i signFlip = _mm256_set1_epi32(static_cast<int>(1U << 31));
+        const __m256i target = _mm256_xor_si256(_mm256_set1_epi32(static_cast<int>(targetKey)), signFlip);
+        for (; pos + 8 <= last; pos += 8)
+        {
+            __m256i key = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + pos)), signFlip);
+            numLess += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(target, key))));
+        }
+        #endif
+    }
+    else if constexpr (is_unsigned<Type_Key>::value && sizeof(Type_Key) == 2)
+    {
+        #if defined(__AVX512BW__)
+        const __m512i target = _mm512_set1_epi16(static_cast<short>(targetKey));
+        for (; pos + 32 <= last; pos += 32)
+        {
+            numLess += __builtin_popcount(_mm512_cmplt_epu16_mask(_mm512_loadu_si512(keys + pos), target));
+        }
+        #else
+        const __m256i signFlip = _mm256_set1_epi16(static_cast<short>(1U << 15));
+        const __m256i target = _mm256_xor_si256(_mm256_set1_epi16(static_cast<short>(targetKey)), signFlip);
+        for (; pos + 16 <= last; pos += 16)
+        {
+            __m256i key = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + pos)), signFlip);
+            numLess += __builtin_popcount(_mm256_movemask_epi8(_mm256_cmpgt_epi16(target, key))) >> 1;
+        }
+        #endif
+    }
+    #endif
+
+    for (; pos < last; pos++)
+    {
+        numLess += keys[pos] < targetKey;
+    }
+
+    return first + numLess;
+}
+
+//First index in [first, last) with keys[index] >= targetKey (last if none) of sorted keys.
+//The halving step has no branch (conditional move).
+template<class Type_Key>
+inline int binary_search_lower_bound(const Type_Key * keys, int first, int last, const Type_Key & targetKey)
+{
+    if (first >= last)
+    {
+        return first;
+    }
+
+    const Type_Key * base = keys + first;
+    int length = last - first;
+    while (length > 1)
+    {
+        int half = length >> 1;
+        base = (base[half] < targetKey) ? base + half : base;
+        length -= half;
+    }
+
+    return (base - keys) + (*base < targetKey);
+}
+
 /*
 Function Headers
 */
 template<class Type_Key, class Type_Ts>
-void calculate_split_derivative(int noSeg, vector<pair<Type_Key,Type_Ts>> & data, vector<tuple<int,int,double>> & splitIndexSlopeVector);
+void calculate_split_derivative(int noSeg, vector<pair<Type_Key,Type_Ts>> & data, vector<tuple<int,int,double>> & splitIndexSlopeVector, int numThreads = 1);
 
 template<class Type_Key, class Type_Ts>
 void calculate_split_equal(int noSeg, vector<pair<Type_Key,Type_Ts>> & data, vector<tuple<int,int,double>> & splitIndexSlopeVector);
@@ -158,7 +407,33 @@ template<class Type_Key, class Type_Ts>
 void calculate_split_index_one_pass(vector<Type_Key> & data, vector<tuple<int,int,double>> &splitIndexSlopeVector, int & splitError);
 
 template<class Type_Key, class Type_Ts>
-void calculate_split_derivative(int noSeg, vector<pair<Type_Key,Type_Ts>> & data, vector<tuple<int,int,double>> & splitIndexSlopeVector)
+void calculate_split_index_one_pass(vector<pair<Type_Key,Type_Ts>> & data, int startIndex, int endIndex, vector<tuple<int,int,double>> &splitIndexSlopeVector, int & splitError);
+
+template<class Type_Key, class Type_Ts>
+void calculate_split_index_one_pass_least_sqaure(vector<pair<Type_Key,Type_Ts>> & data, int startIndex, int endIndex, vector<tuple<int,int,double>> &splitIndexSlopeVector, int & splitError);
+
+template<class Type_Key, class Type_Ts>
+void calculate_split_index_optimal_pla(vector<pair<Type_Key,Type_Ts>> & data, vector<tuple<int,int,double>> &splitIndexSlopeVector, int splitError);
+
+template<class Type_Key, class Type_Ts>
+void calculate_split_index_optimal_pla(vector<pair<Type_Key,Type_Ts>> & data, int startIndex, int endIndex, vector<tuple<int,int,double>> &splitIndexSlopeVector, int splitError);
+
+template<class Type_Key, class Type_Ts>
+void calculate_split(SWsplit method, int noSeg, int splitError, vector<pair<Type_Key,Type_Ts>> & data, vector<tuple<int,int,double>> &splitIndexSlopeVector);
+
+template<class Type_Key, class Type_Ts>
+void calculate_split_range(SWsplit method, int splitError, vector<pair<Type_Key,Type_Ts>> & data, int startIndex, int endIndex, vector<tuple<int,int,double>> &splitIndexSlopeVector);
+
+template<class Type_Key, class Type_Ts>
+void calculate_split_parallel(SWsplit method, int noSeg, int splitError, int numThreads, vector<pair<Type_Key,Type_Ts>> & data, vector<tuple<int,int,double>> &splitIndexSlopeVector);
+
+#ifdef TWO_PIECE_SEG
+template<class Type_Key, class Type_Ts>
+void pair_split_two_piece(vector<pair<Type_Key,Type_Ts>> & data, vector<tuple<int,int,double>> &splitIndexSlopeVector, vector<pair<int,double>> & breakIndexSlopeVector);
+#endif
+
+template<class Type_Key, class Type_Ts>
+void calculate_split_derivative(int noSeg, vector<pair<Type_Key,Type_Ts>> & data, vector<tuple<int,int,double>> & splitIndexSlopeVector, int numThreads)
 {
     #ifdef DEBUG
     cout << "[Debug Info:] Util Function {calculate_split_index_vect(noSeg, data, slplitIndexVector)} Begin" << endl;
@@ -169,14 +444,16 @@ void calculate_split_derivative(int noSeg, vector<pair<Type_Key,Type_Ts>> & data
     vector<double> secondDerivative(data.size());
     secondDerivative[0] = 0;
     secondDerivative.back() = 0;
+    #pragma omp parallel for num_threads(numThreads)
     for (int i = 2; i < data.size(); i++)
     {
         secondDerivative[i-1] =  abs((double)(data[i].first-data[i-1].first) - (data[i-1].first-data[i-2].first));      
     }
 
+    //Ties are ordered by index so the split does not depend on the number of threads
     vector<int> indexVec(data.size());
     iota(indexVec.begin(),indexVec.end(),0);
-    sort(indexVec.begin(),indexVec.end(), [&](double i,double j){return secondDerivative[i] > secondDerivative[j];} );
+    parallel_sort(indexVec.begin(),indexVec.end(), [&](int i,int j){return secondDerivative[i] > secondDerivative[j] || (secondDerivative[i] == secondDerivative[j] && i < j);}, numThreads);
 
     int slpitTimes = 0;
     vector<bool> splitIndexVector(data.size());
@@ -193,7 +470,8 @@ void calculate_split_derivative(int noSeg, vector<pair<Type_Key,Type_Ts>> & data
 
         if( secondDerivative[indexVec[i]] > 0)
         {
-            if (secondDerivative[indexVec[i+1]] < secondDerivative[indexVec[i-1]])
+            //Neighbours in the sorted order, only when both exist
+            if (i > 0 && i+1 < indexVec.size() && secondDerivative[indexVec[i+1]] < secondDerivative[indexVec[i-1]])
             {
                 splitIndexVector[indexVec[i-1]] = true;
             }
@@ -231,7 +509,7 @@ void calculate_split_derivative(int noSeg, vector<pair<Type_Key,Type_Ts>> & data
         
         if(splitIndexVector[i])
         {
-            splitIndexSlopeVector.push_back(make_tuple(startSplitIndex,i,(sumKeyIndex - sumKey *(sumIndex/cnt))/(sumKeySquared - sumKey*(sumKey/cnt))));
+            splitIndexSlopeVector.push_back(make_tuple(startSplitIndex,i,(cnt > 1) ? (sumKeyIndex - sumKey *(sumIndex/cnt))/(sumKeySquared - sumKey*(sumKey/cnt)) : 0));
 
             sumKey = 0;
             sumIndex = 0;
@@ -265,26 +543,18 @@ void calculate_split_equal(int noSeg, vector<pair<Type_Key,Type_Ts>> & data, vec
     cout << endl;
     #endif
 
-    int segSize = data.size()/(noSeg);
+    //Only the last index of each SWseg is marked, marking the first too made single point SWseg with a NaN slope
+    int segSize = max(1, (int)data.size()/noSeg);
     vector<bool> splitIndexVector(data.size());
     
     int startIndex = 0;
-    for (int i = 0; i < noSeg-1; i++)
+    for (int i = 0; i < noSeg-1 && startIndex+segSize-1 < data.size(); i++)
     {
-        splitIndexVector[startIndex] = true;
         splitIndexVector[startIndex+segSize-1] = true;
         startIndex = startIndex+segSize;
     }
 
-    if (startIndex >= data.size()-1)
-    {
-        splitIndexVector.back() = true;
-    }
-    else
-    {
-        splitIndexVector[startIndex] = true;
-        splitIndexVector.back() = true;
-    }
+    splitIndexVector.back() = true;
 
     int startSplitIndex = 0, cnt = 0;
     double sumKey = 0,sumIndex = 0, sumKeyIndex = 0, sumKeySquared = 0;
@@ -298,7 +568,7 @@ void calculate_split_equal(int noSeg, vector<pair<Type_Key,Type_Ts>> & data, vec
         
         if(splitIndexVector[i])
         {
-            splitIndexSlopeVector.push_back(make_tuple(startSplitIndex,i,(sumKeyIndex - sumKey *(sumIndex/cnt))/(sumKeySquared - sumKey*(sumKey/cnt))));
+            splitIndexSlopeVector.push_back(make_tuple(startSplitIndex,i,(cnt > 1) ? (sumKeyIndex - sumKey *(sumIndex/cnt))/(sumKeySquared - sumKey*(sumKey/cnt)) : 0));
 
             sumKey = 0;
             sumIndex = 0;
@@ -391,10 +661,17 @@ void calculate_split_index_one_pass(vector<pair<Type_Key,Type_Ts>> & data, vecto
 
 template<class Type_Key, class Type_Ts>
 void calculate_split_index_one_pass(vector<pair<Type_Key,Type_Ts>> & data, vector<tuple<int,int,double>> &splitIndexSlopeVector, int & splitError)
+{
+    calculate_split_index_one_pass(data, 0, (int)data.size()-1, splitIndexSlopeVector, splitError);
+}
+
+//Splits data[startIndex..endIndex], the indexes in splitIndexSlopeVector are indexes of data
+template<class Type_Key, class Type_Ts>
+void calculate_split_index_one_pass(vector<pair<Type_Key,Type_Ts>> & data, int startIndex, int endIndex, vector<tuple<int,int,double>> &splitIndexSlopeVector, int & splitError)
 {
     #ifdef DEBUG
     cout << "[Debug Info:] Util Function {calculate_split_index_one_pass(data, slplitIndexSlope, splitError)} Start" << endl;
-    cout << "[Debug Info:] size of DualData = " << data.size() << endl;
+    cout << "[Debug Info:] size of DualData = " << endIndex - startIndex + 1 << endl;
     cout << endl;
     #endif
 
@@ -402,13 +679,13 @@ void calculate_split_index_one_pass(vector<pair<Type_Key,Type_Ts>> & data, vecto
     double slopeHigh = numeric_limits<double>::max();
     double slope = 1;
 
-    double keyStart = data.front().first;
+    double keyStart = data[startIndex].first;
     
     int index = 1;
-    int splitIndexStart = 0; 
-    int splitIndexEnd = 1;
+    int splitIndexStart = startIndex; 
+    int splitIndexEnd = startIndex + 1;
 
-    for (auto it = data.begin()+1; it != data.end(); it++)
+    for (auto it = data.begin()+startIndex+1; it != data.begin()+endIndex+1; it++)
     {
         double denominator = it->first - keyStart;
 
@@ -457,10 +734,16 @@ void calculate_split_index_one_pass(vector<pair<Type_Key,Type_Ts>> & data, vecto
 
 template<class Type_Key, class Type_Ts>
 void calculate_split_index_one_pass_least_sqaure(vector<pair<Type_Key,Type_Ts>> & data, vector<tuple<int,int,double>> &splitIndexSlopeVector, int & splitError)
+{
+    calculate_split_index_one_pass_least_sqaure(data, 0, (int)data.size()-1, splitIndexSlopeVector, splitError);
+}
+
+template<class Type_Key, class Type_Ts>
+void calculate_split_index_one_pass_least_sqaure(vector<pair<Type_Key,Type_Ts>> & data, int startIndex, int endIndex, vector<tuple<int,int,double>> &splitIndexSlopeVector, int & splitError)
 {
     #ifdef DEBUG
     cout << "[Debug Info:] Util Function {calculate_split_index_one_pass_least_sqaure(data, slplitIndexSlope, splitError)} Start" << endl;
-    cout << "[Debug Info:] size of DualData = " << data.size() << endl;
+    cout << "[Debug Info:] size of DualData = " << endIndex - startIndex + 1 << endl;
     cout << endl;
     #endif
 
@@ -468,14 +751,14 @@ void calculate_split_index_one_pass_least_sqaure(vector<pair<Type_Key,Type_Ts>>
     double slopeHigh = numeric_limits<double>::max();
     double slope = 1;
 
-    double keyStart = data.front().first;
+    double keyStart = data[startIndex].first;
     
     int index = 1;
-    int splitIndexStart = 0; 
-    int splitIndexEnd = 1;
+    int splitIndexStart = startIndex; 
+    int splitIndexEnd = startIndex + 1;
 
     double sumKey = (double)keyStart,sumIndex = 1, sumKeyIndex = 0, sumKeySquared = (double)pow(keyStart,2);
-    for (auto it = data.begin()+1; it != data.end(); it++)
+    for (auto it = data.begin()+startIndex+1; it != data.begin()+endIndex+1; it++)
     {
         double denominator = it->first - keyStart;
 
@@ -597,6 +880,205 @@ void calculate_split_index_one_pass(vector<Type_Key> & data, vector<tuple<int,in
     #endif
 }
 
+//Optimal streaming PLA from PGM-index (lib/piecewise_linear_model.hpp): the fewest SWseg such that a line through each keeps
+//every position within splitError. Points are (key, position - start of SWseg), equal keys stay in the same SWseg.
+//The model keeps its hull buffers between calls, so a thread only allocates them again when splitError changes.
+template<class Type_Key, class Type_Ts>
+void calculate_split_index_optimal_pla(vector<pair<Type_Key,Type_Ts>> & data, vector<tuple<int,int,double>> &splitIndexSlopeVector, int splitError)
+{
+    calculate_split_index_optimal_pla(data, 0, (int)data.size()-1, splitIndexSlopeVector, splitError);
+}
+
+template<class Type_Key, class Type_Ts>
+void calculate_split_index_optimal_pla(vector<pair<Type_Key,Type_Ts>> & data, int startIndex, int endIndex, vector<tuple<int,int,double>> &splitIndexSlopeVector, int splitError)
+{
+    #ifdef DEBUG
+    cout << "[Debug Info:] Util Function {calculate_split_index_optimal_pla(data, slplitIndexSlope, splitError)} Start" << endl;
+    cout << "[Debug Info:] size of DualData = " << endIndex - startIndex + 1 << endl;
+    cout << endl;
+    #endif
+
+    typedef pgm::internal::OptimalPiecewiseLinearModel<Type_Key,int> Type_Model;
+    static thread_local unique_ptr<Type_Model> model;
+    static thread_local int modelError = -1;
+
+    if (!model || modelError != splitError)
+    {
+        model.reset(new Type_Model(splitError));
+        modelError = splitError;
+    }
+
+    model->reset();
+    model->add_point(data[startIndex].first, 0);
+
+    int splitIndexStart = startIndex;
+
+    for (int i = startIndex + 1; i <= endIndex; i++)
+    {
+        if (data[i].first == data[i-1].first)
+        {
+            continue;
+        }
+
+        if (!model->add_point(data[i].first, i - splitIndexStart))
+        {
+            splitIndexSlopeVector.push_back(make_tuple(splitIndexStart, i-1, 
+                (double)model->get_segment().get_floating_point_segment(data[splitIndexStart].first).first));
+
+            splitIndexStart = i;
+            model->add_point(data[i].first, 0);
+        }
+    }
+
+    splitIndexSlopeVector.push_back(make_tuple(splitIndexStart, endIndex, 
+        (double)model->get_segment().get_floating_point_segment(data[splitIndexStart].first).first));
+
+    #ifdef DEBUG
+    cout << "[Debug Info:] Util Function {calculate_split_index_optimal_pla(data, slplitIndexSlope, splitError)} End" << endl;
+    cout << "Optimal PLA Split:" << endl;
+    for (auto &it: splitIndexSlopeVector)
+    {
+        cout << "start = " << get<0>(it) << ", end = " << get<1>(it) << ", slope = " << get<2>(it) << endl;
+    }
+    cout <<endl;
+    #endif
+}
+
+//noSeg is only used by SPLIT_DERIVATIVE and SPLIT_EQUAL, splitError by the others
+template<class Type_Key, class Type_Ts>
+void calculate_split(SWsplit method, int noSeg, int splitError, vector<pair<Type_Key,Type_Ts>> & data, vector<tuple<int,int,double>> &splitIndexSlopeVector)
+{
+    switch (method)
+    {
+    case SPLIT_DERIVATIVE:
+        calculate_split_derivative(noSeg, data, splitIndexSlopeVector);
+        break;
+    case SPLIT_EQUAL:
+        calculate_split_equal(noSeg, data, splitIndexSlopeVector);
+        break;
+    default:
+        calculate_split_range(method, splitError, data, 0, (int)data.size()-1, splitIndexSlopeVector);
+    }
+}
+
+//Error bounded splits of data[startIndex..endIndex]
+template<class Type_Key, class Type_Ts>
+void calculate_split_range(SWsplit method, int splitError, vector<pair<Type_Key,Type_Ts>> & data, int startIndex, int endIndex, vector<tuple<int,int,double>> &splitIndexSlopeVector)
+{
+    switch (method)
+    {
+    case SPLIT_SHRINKING_CONE:
+        calculate_split_index_one_pass(data, startIndex, endIndex, splitIndexSlopeVector, splitError);
+        break;
+    case SPLIT_LEAST_SQUARE:
+        calculate_split_index_one_pass_least_sqaure(data, startIndex, endIndex, splitIndexSlopeVector, splitError);
+        break;
+    case SPLIT_OPTIMAL_PLA:
+        calculate_split_index_optimal_pla(data, startIndex, endIndex, splitIndexSlopeVector, splitError);
+        break;
+    default:
+        throw invalid_argument("calculate_split_range: unknown or not error bounded split algorithm");
+    }
+}
+
+//Error bounded splits run on numThreads chunks of data (chunk boundaries never separate equal keys).
+//Where two chunks meet, the last SWseg of one and the first of the next are split again and replaced if they fit in one SWseg.
+//SPLIT_DERIVATIVE and SPLIT_EQUAL pick a fixed number of SWseg over the whole data and are not chunked.
+template<class Type_Key, class Type_Ts>
+void calculate_split_parallel(SWsplit method, int noSeg, int splitError, int numThreads, vector<pair<Type_Key,Type_Ts>> & data, vector<tuple<int,int,double>> &splitIndexSlopeVector)
+{
+    if (method == SPLIT_DERIVATIVE)
+    {
+        calculate_split_derivative(noSeg, data, splitIndexSlopeVector, numThreads);
+        return;
+    }
+
+    if (numThreads <= 1 || method == SPLIT_EQUAL)
+    {
+        calculate_split(method, noSeg, splitError, data, splitIndexSlopeVector);
+        return;
+    }
+
+    vector<int> chunkStart(numThreads+1, (int)data.size());
+    chunkStart[0] = 0;
+    for (int i = 1; i < numThreads; i++)
+    {
+        int index = max(chunkStart[i-1], (int)(data.size() * i / numThreads));
+        while (index > 0 && index < data.size() && data[index].first == data[index-1].first)
+        {
+            index++;
+        }
+        chunkStart[i] = index;
+    }
+
+    vector<vector<tuple<int,int,double>>> chunkSplit(numThreads);
+
+    #pragma omp parallel for num_threads(numThreads) schedule(static,1)
+    for (int i = 0; i < numThreads; i++)
+    {
+        if (chunkStart[i] < chunkStart[i+1])
+        {
+            calculate_split_range(method, splitError, data, chunkStart[i], chunkStart[i+1]-1, chunkSplit[i]);
+        }
+    }
+
+    vector<tuple<int,int,double>> stitch;
+    for (auto & chunk : chunkSplit)
+    {
+        for (auto it = chunk.begin(); it != chunk.end(); it++)
+        {
+            if (it == chunk.begin() && !splitIndexSlopeVector.empty())
+            {
+                stitch.clear();
+                calculate_split_range(method, splitError, data, get<0>(splitIndexSlopeVector.back()), get<1>(*it), stitch);
+                if (stitch.size() == 1)
+                {
+                    splitIndexSlopeVector.back() = stitch[0];
+                    continue;
+                }
+            }
+            splitIndexSlopeVector.push_back(*it);
+        }
+    }
+}
+
+#ifdef TWO_PIECE_SEG
+//Merges neighbouring splits into one two-piece SWseg when both have two or more tuples, they hold at most TWO_PIECE_MAX_SIZE
+//tuples together and the second does not start with a duplicate of the first one's last key. Each piece keeps its own slope
+//and search error, so pairing only trades SWmeta slots (and SWseg) for a branch in the SWseg model.
+//breakIndexSlopeVector gets (start index, slope) of the second piece per split, (-1, 0) for a single piece.
+template<class Type_Key, class Type_Ts>
+void pair_split_two_piece(vector<pair<Type_Key,Type_Ts>> & data, vector<tuple<int,int,double>> &splitIndexSlopeVector, vector<pair<int,double>> & breakIndexSlopeVector)
+{
+    vector<tuple<int,int,double>> pairedVector;
+    pairedVector.reserve(splitIndexSlopeVector.size());
+    breakIndexSlopeVector.clear();
+    breakIndexSlopeVector.reserve(splitIndexSlopeVector.size());
+
+    for (int i = 0; i < splitIndexSlopeVector.size(); i++)
+    {
+        auto & first = splitIndexSlopeVector[i];
+        if (i+1 < splitIndexSlopeVector.size())
+        {
+            auto & second = splitIndexSlopeVector[i+1];
+            if (get<0>(first) < get<1>(first) && get<0>(second) < get<1>(second) 
+                && get<1>(second) - get<0>(first) + 1 <= TWO_PIECE_MAX_SIZE
+                && data[get<0>(second)].first != data[get<1>(first)].first)
+            {
+                pairedVector.push_back(make_tuple(get<0>(first), get<1>(second), get<2>(first)));
+                breakIndexSlopeVector.push_back(make_pair(get<0>(second), get<2>(second)));
+                i++;
+                continue;
+            }
+        }
+        pairedVector.push_back(first);
+        breakIndexSlopeVector.push_back(make_pair(-1, 0.0));
+    }
+
+    splitIndexSlopeVector.swap(pairedVector);
+}
+#endif
+
 
 
 /*
@@ -628,5 +1110,14 @@ inline int bit_get_index(int bitmapPos, uint64_t value) {
   return (bitmapPos << 6) + bit_count_ones(value - 1);
 }
 
+//range_mask(2,4) = 000011100, empty if lowBit > highBit
+inline uint64_t bit_range_mask(int lowBit, int highBit) {
+  if (lowBit > highBit) {
+    return 0;
+  }
+  uint64_t high = (highBit == 63) ? numeric_limits<uint64_t>::max() : ((1ULL << (highBit + 1)) - 1);
+  return high & ~((1ULL << lowBit) - 1);
+}
+
 }
 #endif
\ No newline at end of file
@@ -10,6 +10,8 @@
 #include<cassert>
 #include<cmath>
 #include<tuple>
+#include<memory>
+#include<type_traits>
 
 #include <x86intrin.h>
 #include <bitset>
@@ -20,6 +22,11 @@
 #include <condition_variable>
 #include "../lib/multithread_queues/concurrent_queue.h"
 
+#ifdef _OPENMP
+#include <omp.h>
+#include <parallel/algorithm>
+#endif
+
 #include "config_p.hpp"
 #include "../utils/print_util.hpp"
 
@@ -58,11 +65,129 @@ Helper decalrations
 
 enum class seg_update_type {NONE = 0, RETRAIN = 1, REPLACE = 2, DELETE = 3};
 
+//Window length, buffer size and error of one SWmeta instance (defaults are the compile-time macros).
+//autoTuneSize = 0 derives it from the window (AUTO_TUNE_RATE * timeWindow).
+//With STATIC_PARAMS defined, the macros are used directly and these values are ignored.
+struct SWparams
+{
+    uint64_t timeWindow;
+    int maxBufferSize;
+    int initialError;
+    uint64_t autoTuneSize;
+
+    SWparams(uint64_t timeWindow = TIME_WINDOW, int maxBufferSize = MAX_BUFFER_SIZE, 
+            int initialError = INITIAL_ERROR, uint64_t autoTuneSize = 0)
+    :timeWindow(timeWindow), maxBufferSize(maxBufferSize), initialError(initialError), 
+    autoTuneSize((autoTuneSize == 0) ? (uint64_t)(AUTO_TUNE_RATE * timeWindow) : autoTuneSize)
+    {
+        if (timeWindow == 0 || maxBufferSize < 2 || initialError < 1)
+        {
+            throw invalid_argument("SWparams: timeWindow must be > 0, maxBufferSize > 1 and initialError > 0");
+        }
+    }
+};
+
+//Result of an aggregate range query (COUNT, SUM, MIN, MAX over the matching keys), filled without materializing the tuples.
+//min/max are only meaningful when count > 0. sum is exact for integer keys (128 bits hold 2^64 64-bit keys).
+template<class Type_Key>
+struct SWaggregate
+{
+    typedef typename conditional<is_floating_point<Type_Key>::value, double,
+                typename conditional<is_signed<Type_Key>::value, __int128, unsigned __int128>::type>::type Type_Sum;
+
+    uint64_t count = 0;
+    Type_Sum sum = 0;
+    Type_Key min = numeric_limits<Type_Key>::max();
+    Type_Key max = numeric_limits<Type_Key>::lowest();
+
+    inline void add(Type_Key key)
+    {
+        count++;
+        sum += (Type_Sum)key;
+        min = (key < min) ? key : min;
+        max = (key > max) ? key : max;
+    }
+
+    //Combines the aggregates of disjoint ranges (e.g. the range_aggregate of each partition)
+    inline void merge(const SWaggregate<Type_Key> & other)
+    {
+        count += other.count;
+        sum += other.sum;
+        min = (other.min < min) ? other.min : min;
+        max = (other.max > max) ? other.max : max;
+    }
+};
+
+//Range scan outputs: a plain count or an aggregate
+template<class Type_Key>
+inline void append_result(int & count, Type_Key key)
+{
+    ++count;
+}
+
+template<class Type_Key>
+inline void append_result(SWaggregate<Type_Key> & aggregate, Type_Key key)
+{
+    aggregate.add(key);
+}
+
+//Task handed to the worker of a partition (SWrouter). SEARCH covers [lowerBound, upperBound] (a lookup when both are
+//equal), INSERT and DELETE only use lowerBound. Markers (WATERMARK, ROUND_END, FINISH) go to every partition and carry
+//the latest timestamp dispatched before them. Packed, 25 bytes with 64-bit keys and timestamps.
+template<class Type_Key, class Type_Ts>
+struct __attribute__((packed)) SWtask
+{
+    Type_Key lowerBound;
+    Type_Key upperBound;
+    Type_Ts timestamp;
+    task_status status;
+};
+
+//Counter written by one thread and read by others, alone on its cache line
+struct alignas(CACHELINE_SIZE) SWcounter
+{
+    atomic<uint64_t> value{0};
+};
+
+//Lock of one partition (SWmeta::lock_thread / unlock_thread), padded so neighbouring partitions do not share a cache line
+struct alignas(CACHELINE_SIZE) SWlock
+{
+    mutex lock;
+    condition_variable cv;
+    bool occupied = false;
+};
+
+/*
+Parallel Bulk Load
+*/
+//Threads used to bulk load size tuples (numThreads, 1 below BULKLOAD_PARALLEL_SIZE or without OpenMP)
+inline int bulk_load_threads(size_t size, int numThreads)
+{
+    #ifdef _OPENMP
+    return (size < BULKLOAD_PARALLEL_SIZE) ? 1 : numThreads;
+    #else
+    return 1;
+    #endif
+}
+
+template<class Iterator, class Compare>
+inline void parallel_sort(Iterator first, Iterator last, Compare comp, int numThreads)
+{
+    #ifdef _OPENMP
+    if (numThreads > 1)
+    {
+        __gnu_parallel::sort(first, last, comp, __gnu_parallel::parallel_tag(numThreads));
+        return;
+    }
+    #endif
+    sort(first, last, comp);
+}
+
 /*
 Function Headers
 */
 template<class Type_Key, class Type_Ts>
-void calculate_split_derivative(int noSeg, const vector<pair<Type_Key,Type_Ts>> & data, vector<tuple<int,int,double>> & splitIndexSlopeVector);
+void calculate_split_derivative(int noSeg, const vector<pair<Type_Key,Type_Ts>> & data, vector<tuple<int,int,double>> & splitIndexSlopeVector, int numThreads = 1);
 
 template<class Type_Key, class Type_Ts>
 void calculate_split_index_one_pass(const vector<pair<Type_Key,Type_Ts>> & data, vector<tuple<int,int,double>> &splitIndexSlopeVector, int splitError);
@@ -75,7 +200,7 @@ void calculate_split_index_one_pass_least_sqaure(const vector<pair<Type_Key,Type
 Functions
 */
 template<class Type_Key, class Type_Ts>
-void calculate_split_derivative(int noSeg, const vector<pair<Type_Key,Type_Ts>> & data, vector<tuple<int,int,double>> & splitIndexSlopeVector)
+void calculate_split_derivative(int noSeg, const vector<pair<Type_Key,Type_Ts>> & data, vector<tuple<int,int,double>> & splitIndexSlopeVector, int numThreads)
 {
     #ifdef DEBUG
     DEBUG_ENTER_FUNCTION("Util","calculate_split_derivative");
@@ -84,14 +209,16 @@ void calculate_split_derivative(int noSeg, const vector<pair<Type_Key,Type_Ts>>
     vector<double> secondDerivative(data.size());
     secondDerivative[0] = 0;
     secondDerivative.back() = 0;
+    #pragma omp parallel for num_threads(numThreads)
     for (int i = 2; i < data.size(); i++)
     {
         secondDerivative[i-1] =  abs((double)(data[i].first-data[i-1].first) - (data[i-1].first-data[i-2].first));      
     }
 
+    //Ties are ordered by index so the split does not depend on the number of threads
     vector<int> indexVec(data.size());
     iota(indexVec.begin(),indexVec.end(),0);
-    sort(indexVec.begin(),indexVec.end(), [&](double i,double j){return secondDerivative[i] > secondDerivative[j];} );
+    parallel_sort(indexVec.begin(),indexVec.end(), [&](int i,int j){return secondDerivative[i] > secondDerivative[j] || (secondDerivative[i] == secondDerivative[j] && i < j);}, numThreads);
 
     int slpitTimes = 0;
     vector<bool> splitIndexVector(data.size());
@@ -108,7 +235,8 @@ void calculate_split_derivative(int noSeg, const vector<pair<Type_Key,Type_Ts>>
 
         if( secondDerivative[indexVec[i]] > 0)
         {
-            if (secondDerivative[indexVec[i+1]] < secondDerivative[indexVec[i-1]])
+            //Neighbours in the sorted order, only when both exist
+            if (i > 0 && i+1 < indexVec.size() && secondDerivative[indexVec[i+1]] < secondDerivative[indexVec[i-1]])
             {
                 splitIndexVector[indexVec[i-1]] = true;
             }
@@ -138,7 +266,8 @@ void calculate_split_derivative(int noSeg, const vector<pair<Type_Key,Type_Ts>>
     double sumKey = 0,sumIndex = 0, sumKeyIndex = 0, sumKeySquared = 0;
     for (int i = 0; i < data.size(); i++)
     {
-        double nomalizedKey = (double)data[i].first - (double)data[0].first;
+        //Normalized by the first key of the split, large keys would cancel out in the denominator
+        double nomalizedKey = (double)data[i].first - (double)data[startSplitIndex].first;
         sumKey += nomalizedKey;
         sumIndex += cnt;
         sumKeyIndex += nomalizedKey * cnt;
@@ -147,7 +276,8 @@ void calculate_split_derivative(int noSeg, const vector<pair<Type_Key,Type_Ts>>
         
         if(splitIndexVector[i])
         {
-            splitIndexSlopeVector.push_back(make_tuple(startSplitIndex,i,(sumKeyIndex - sumKey *(sumIndex/cnt))/(sumKeySquared - sumKey*(sumKey/cnt))));
+            double denominator = sumKeySquared - sumKey*(sumKey/cnt);
+            splitIndexSlopeVector.push_back(make_tuple(startSplitIndex,i,(cnt > 1 && denominator > 0) ? (sumKeyIndex - sumKey *(sumIndex/cnt))/denominator : 0));
 
             sumKey = 0;
             sumIndex = 0;
@@ -263,7 +393,10 @@ void calculate_split_index_one_pass_least_sqaure(const vector<pair<Type_Key,Type
             sumIndex += index;
             sumKeyIndex += nomalizedKey * index;
             sumKeySquared += (double)pow(nomalizedKey,2);
-            slope = (sumKeyIndex - sumKey *(sumIndex/index))/(sumKeySquared - sumKey*(sumKey/index));
+
+            //A single fitted key has no least squares slope (0/0), use the middle of the feasible slopes
+            double fitDenominator = sumKeySquared - sumKey*(sumKey/index);
+            slope = (fitDenominator > 0) ? (sumKeyIndex - sumKey *(sumIndex/index))/fitDenominator : 0.5*(slopeHigh + slopeLow);
 
             ++index;
         }
@@ -330,5 +463,14 @@ inline int bit_get_index(int bitmapPos, uint64_t value) {
   return (bitmapPos << 6) + bit_count_ones(value - 1);
 }
 
+//range_mask(2,4) = 000011100, empty if lowBit > highBit
+inline uint64_t bit_range_mask(int lowBit, int highBit) {
+  if (lowBit > highBit) {
+    return 0;
+  }
+  uint64_t high = (highBit == 63) ? numeric_limits<uint64_t>::max() : ((1ULL << (highBit + 1)) - 1);
+  return high & ~((1ULL << lowBit) - 1);
+}
+
 }
 #endif
\ No newline at end of file
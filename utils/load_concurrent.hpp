@@ -133,6 +133,57 @@ int sosd_range_query_sequential(string filename)
     return 0;
 }
 
+//Half of the tuples (drawn at random) are hot and the others arrive at random times. The hot ones arrive band by band
+//of an eighth of the keys each, so half of the inserts fall in a key range that steps across the key space
+template<typename Type_Key, typename Type_Ts>
+int sosd_range_query_hotspot(string filename)
+{
+    vector<Type_Key> data_binary;
+    sosd_load_binary<Type_Key>(filename, data_binary);
+
+	sort(data_binary.begin(), data_binary.end());
+	data_binary.erase( unique( data_binary.begin(), data_binary.end() ), data_binary.end() );
+
+    std::mt19937 gen(SEED);
+    std::uniform_int_distribution<Type_Ts> distr(1, MAX_TIMESTAMP);
+
+    vector<bool> hot(TEST_LEN);
+    vector<Type_Ts> hotTimestamps;
+    for (int i = 0; i < TEST_LEN; i++)
+    {
+        hot[i] = gen() % 2;
+        if (hot[i])
+        {
+            hotTimestamps.push_back(distr(gen));
+        }
+    }
+    sort(hotTimestamps.begin(),hotTimestamps.end());
+    //Bands of consecutive hot keys, in random order within a band
+    size_t bandSize = hotTimestamps.size() / 8 + 1;
+    for (size_t i = 0; i < hotTimestamps.size(); i += bandSize)
+    {
+        shuffle(hotTimestamps.begin() + i, hotTimestamps.begin() + min(i + bandSize, hotTimestamps.size()), gen);
+    }
+
+    benchmark_data.reserve(TEST_LEN);
+    auto hotIt = hotTimestamps.begin();
+    for (int i = 0; i < TEST_LEN; i++)
+    {
+        Type_Ts timestamp = hot[i] ? *(hotIt++) : distr(gen);
+        if (i + MATCH_RATE > TEST_LEN)
+        {
+            benchmark_data.push_back(make_tuple(data_binary[i],timestamp,data_binary[TEST_LEN-1]));
+        }
+        else
+        {
+            benchmark_data.push_back(make_tuple(data_binary[i],timestamp,data_binary[i + MATCH_RATE -1]));
+        }
+    }
+    sort(benchmark_data.begin(),benchmark_data.end(),sort_based_on_second_tuple);
+
+    return 0;
+}
+
 template<typename Type_Key, typename Type_Ts>
 int sosd_range_query_skewed(string filename, int no_std)
 {